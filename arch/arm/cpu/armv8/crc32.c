@@ -0,0 +1,22 @@
+/*
+ * CRC32 using the ARMv8 CRC32 instructions
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <errno.h>
+#include <asm/system.h>
+#include <u-boot/crc.h>
+
+u32 crc32_armv8(u32 crc, const u8 *buf, unsigned int len);
+
+int crc32_no_comp_arch(uint32_t *crc, const unsigned char *buf, uint len)
+{
+	if (!has_isar0_feature(ID_AA64ISAR0_CRC32_SHIFT))
+		return -ENOSYS;
+
+	*crc = crc32_armv8(*crc, buf, len);
+
+	return 0;
+}
@@ -0,0 +1,33 @@
+/*
+ * SHA-1 using the ARMv8 Crypto Extensions
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <errno.h>
+#include <asm/system.h>
+#include <u-boot/sha1.h>
+
+void sha1_ce_transform(u32 state[5], const u8 *data, unsigned int blocks);
+
+int sha1_process_arch(sha1_context *ctx, const unsigned char *data,
+		      unsigned int blocks)
+{
+	u32 state[5];
+	int i;
+
+	if (!has_isar0_feature(ID_AA64ISAR0_SHA1_SHIFT))
+		return -ENOSYS;
+	if (!blocks)
+		return 0;
+
+	/* The context holds the state as unsigned longs */
+	for (i = 0; i < 5; i++)
+		state[i] = ctx->state[i];
+	sha1_ce_transform(state, data, blocks);
+	for (i = 0; i < 5; i++)
+		ctx->state[i] = state[i];
+
+	return 0;
+}
@@ -0,0 +1,23 @@
+/*
+ * SHA-256 using the ARMv8 Crypto Extensions
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <errno.h>
+#include <asm/system.h>
+#include <u-boot/sha256.h>
+
+void sha256_ce_transform(u32 state[8], const u8 *data, unsigned int blocks);
+
+int sha256_process_arch(sha256_context *ctx, const uint8_t *data,
+			unsigned int blocks)
+{
+	if (!has_isar0_feature(ID_AA64ISAR0_SHA2_SHIFT))
+		return -ENOSYS;
+	if (blocks)
+		sha256_ce_transform(ctx->state, data, blocks);
+
+	return 0;
+}
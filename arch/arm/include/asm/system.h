@@ -14,6 +14,13 @@
 #define CR_WXN		(1 << 19)	/* Write Permision Imply XN	*/
 #define CR_EE		(1 << 25)	/* Exception (Big) Endian	*/
 
+/*
+ * ID_AA64ISAR0_EL1 fields of the optional instructions
+ */
+#define ID_AA64ISAR0_SHA1_SHIFT		8
+#define ID_AA64ISAR0_SHA2_SHIFT		12
+#define ID_AA64ISAR0_CRC32_SHIFT	16
+
 #define PGTABLE_SIZE	(0x10000)
 /* 2MB granularity */
 #define MMU_SECTION_SHIFT	21
@@ -57,6 +64,16 @@ static inline unsigned int get_sctlr(void)
 	return val;
 }
 
+/* Check whether the CPU implements an ID_AA64ISAR0_EL1 feature */
+static inline int has_isar0_feature(int shift)
+{
+	unsigned long isar0;
+
+	asm volatile("mrs %0, id_aa64isar0_el1" : "=r" (isar0));
+
+	return (isar0 >> shift) & 0xf;
+}
+
 static inline void set_sctlr(unsigned int val)
 {
 	unsigned int el;
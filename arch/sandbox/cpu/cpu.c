@@ -5,6 +5,7 @@
 #define DEBUG
 #include <common.h>
 #include <dm/root.h>
+#include <lz4_frame.h>
 #include <os.h>
 #include <asm/io.h>
 #include <asm/state.h>
@@ -97,6 +98,16 @@ void flush_dcache_range(unsigned long start, unsigned long stop)
 {
 }
 
+#ifdef CONFIG_LZ4_PARALLEL
+/* Decode LZ4 blocks in host threads, as a board would on secondary cores */
+int ulz4_run_workers(void (*func)(void *arg, int worker), void *arg, int nr)
+{
+	state_get_current()->lz4_worker_runs++;
+
+	return os_run_threads(func, arg, nr);
+}
+#endif
+
 int sandbox_read_fdt_from_file(void)
 {
 	struct sandbox_state *state = state_get_current();
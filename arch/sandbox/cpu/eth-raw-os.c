@@ -13,6 +13,7 @@
 #include <net/if.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
+#include <netinet/tcp.h>
 #include <netinet/udp.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -26,6 +27,11 @@
 #include <linux/if_ether.h>
 #include <linux/if_packet.h>
 
+/* Largest IP packet passed to U-Boot, as on Ethernet */
+#define LOCAL_MTU		1500
+/* Room for the largest IP packet, which TCP on 'lo' may use */
+#define LOCAL_TCP_BUF_SIZE	65536
+
 static int _raw_packet_start(const char *ifname, unsigned char *ethmac,
 			    struct eth_sandbox_raw_priv *priv)
 {
@@ -112,7 +118,7 @@ static int _local_inet_start(struct eth_sandbox_raw_priv *priv)
 	 * Open socket
 	 *  Since we specify UDP here, any incoming ICMP packets will
 	 *  not be received, so things like ping will not work on this
-	 *  localhost interface.
+	 *  localhost interface. TCP is received on a second socket.
 	 */
 	priv->sd = socket(AF_INET, SOCK_RAW, IPPROTO_UDP);
 	if (priv->sd < 0) {
@@ -135,9 +141,113 @@ static int _local_inet_start(struct eth_sandbox_raw_priv *priv)
 	}
 	priv->local_bind_sd = -1;
 	priv->local_bind_udp_port = 0;
+
+	/*
+	 * A raw socket only receives its own protocol, so open another one
+	 * for TCP (e.g. wget). Sending needs no second socket, since the
+	 * headers are included and say which protocol it is.
+	 */
+	priv->local_tcp_buf = malloc(LOCAL_TCP_BUF_SIZE);
+	if (priv->local_tcp_buf == NULL)
+		return -ENOMEM;
+	priv->local_tcp_len = 0;
+	priv->local_tcp_sd = socket(AF_INET, SOCK_RAW, IPPROTO_TCP);
+	if (priv->local_tcp_sd < 0) {
+		printf("Failed to open TCP socket: %d %s\n", errno,
+		       strerror(errno));
+		return -errno;
+	}
+	flags = fcntl(priv->local_tcp_sd, F_GETFL, 0);
+	fcntl(priv->local_tcp_sd, F_SETFL, flags | O_NONBLOCK);
+
 	return 0;
 }
 
+/* Add up the 16-bit big-endian words of an Internet checksum */
+static unsigned int _csum_add(unsigned int sum, const void *data, int len)
+{
+	const unsigned char *p = data;
+	int i;
+
+	for (i = 0; i + 1 < len; i += 2)
+		sum += (p[i] << 8) | p[i + 1];
+	if (len & 1)
+		sum += p[len - 1] << 8;
+
+	return sum;
+}
+
+static unsigned short _csum_fold(unsigned int sum)
+{
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+
+	return htons(~sum & 0xffff);
+}
+
+/*
+ * Hand the next piece of the TCP packet in local_tcp_buf to U-Boot
+ *
+ * Linux does not split TCP on the localhost interface into segments of the
+ * size that U-Boot asked for, so a packet may carry up to 64KiB. Split it
+ * as a network card would have done. Linux also leaves the checksum for
+ * hardware which does not exist to fill in, so it arrives only partly
+ * computed. Nothing can corrupt the packet on the way, so fill it in.
+ */
+static int _local_tcp_next(unsigned char *packet,
+			   struct eth_sandbox_raw_priv *priv)
+{
+	struct iphdr *iph = (struct iphdr *)priv->local_tcp_buf;
+	struct tcphdr *tcph;
+	int ihl = iph->ihl * 4;
+	int hdr_len, data_len, len;
+	int last;
+
+	tcph = (struct tcphdr *)(priv->local_tcp_buf + ihl);
+	if (ihl < (int)sizeof(*iph) ||
+	    priv->local_tcp_len < ihl + (int)sizeof(*tcph)) {
+		priv->local_tcp_len = 0;
+		return 0;
+	}
+	hdr_len = ihl + tcph->doff * 4;
+	data_len = priv->local_tcp_len - hdr_len;
+	if (hdr_len > LOCAL_MTU || data_len < 0) {
+		priv->local_tcp_len = 0;
+		return 0;
+	}
+
+	len = data_len - priv->local_tcp_done;
+	if (len > LOCAL_MTU - hdr_len)
+		len = LOCAL_MTU - hdr_len;
+	last = priv->local_tcp_done + len == data_len;
+
+	memcpy(packet, priv->local_tcp_buf, hdr_len);
+	memcpy(packet + hdr_len,
+	       priv->local_tcp_buf + hdr_len + priv->local_tcp_done, len);
+	iph = (struct iphdr *)packet;
+	tcph = (struct tcphdr *)(packet + ihl);
+
+	iph->tot_len = htons(hdr_len + len);
+	iph->check = 0;
+	iph->check = _csum_fold(_csum_add(0, iph, ihl));
+
+	tcph->seq = htonl(ntohl(tcph->seq) + priv->local_tcp_done);
+	if (!last) {
+		tcph->fin = 0;
+		tcph->psh = 0;
+	}
+	tcph->check = 0;
+	tcph->check = _csum_fold(
+		_csum_add(IPPROTO_TCP + hdr_len - ihl + len, &iph->saddr, 8) +
+		_csum_add(0, tcph, hdr_len - ihl + len));
+
+	priv->local_tcp_done += len;
+	if (last)
+		priv->local_tcp_len = 0;
+
+	return hdr_len + len;
+}
+
 int sandbox_eth_raw_os_start(const char *ifname, unsigned char *ethmac,
 			    struct eth_sandbox_raw_priv *priv)
 {
@@ -151,6 +261,7 @@ int sandbox_eth_raw_os_send(void *packet, int length,
 			    struct eth_sandbox_raw_priv *priv)
 {
 	int retval;
+	struct iphdr *iph = packet;
 	struct udphdr *udph = packet + sizeof(struct iphdr);
 
 	if (!priv->sd || !priv->device)
@@ -169,9 +280,9 @@ int sandbox_eth_raw_os_send(void *packet, int length,
 	 * stack from sending that ICMP message claiming that the port has no
 	 * bound socket.
 	 */
-	if (priv->local && (priv->local_bind_sd == -1 ||
-			    priv->local_bind_udp_port != udph->source)) {
-		struct iphdr *iph = packet;
+	if (priv->local && iph->protocol == IPPROTO_UDP &&
+	    (priv->local_bind_sd == -1 ||
+	     priv->local_bind_udp_port != udph->source)) {
 		struct sockaddr_in addr;
 
 		if (priv->local_bind_sd != -1)
@@ -200,6 +311,14 @@ int sandbox_eth_raw_os_send(void *packet, int length,
 			       strerror(errno));
 	}
 
+	/*
+	 * There is no such trick for TCP. The host answers the server's
+	 * SYN-ACK with a reset whether or not a socket is bound to, or
+	 * listening on, our port, since only a connected socket would match
+	 * it. So TCP on the localhost interface needs the host to drop those
+	 * resets; see doc/README.sandbox.
+	 */
+
 	retval = sendto(priv->sd, packet, length, 0,
 			(struct sockaddr *)priv->device,
 			sizeof(struct sockaddr_ll));
@@ -212,17 +331,34 @@ int sandbox_eth_raw_os_send(void *packet, int length,
 }
 
 int sandbox_eth_raw_os_recv(void *packet, int *length,
-			    const struct eth_sandbox_raw_priv *priv)
+			    struct eth_sandbox_raw_priv *priv)
 {
 	int retval;
 	int saddr_size;
 
 	if (!priv->sd || !priv->device)
 		return -EINVAL;
+	/* Finish handing over a large TCP packet first */
+	if (priv->local && priv->local_tcp_len) {
+		*length = _local_tcp_next(packet, priv);
+		return 0;
+	}
 	saddr_size = sizeof(struct sockaddr);
 	retval = recvfrom(priv->sd, packet, 1536, 0,
 			  (struct sockaddr *)priv->device,
 			  (socklen_t *)&saddr_size);
+	if (retval < 0 && errno == EAGAIN && priv->local) {
+		saddr_size = sizeof(struct sockaddr);
+		retval = recvfrom(priv->local_tcp_sd, priv->local_tcp_buf,
+				  LOCAL_TCP_BUF_SIZE, 0,
+				  (struct sockaddr *)priv->device,
+				  (socklen_t *)&saddr_size);
+		if (retval > 0) {
+			priv->local_tcp_len = retval;
+			priv->local_tcp_done = 0;
+			retval = _local_tcp_next(packet, priv);
+		}
+	}
 	*length = 0;
 	if (retval >= 0) {
 		*length = retval;
@@ -245,5 +381,11 @@ void sandbox_eth_raw_os_stop(struct eth_sandbox_raw_priv *priv)
 			close(priv->local_bind_sd);
 		priv->local_bind_sd = -1;
 		priv->local_bind_udp_port = 0;
+		if (priv->local_tcp_sd != -1)
+			close(priv->local_tcp_sd);
+		priv->local_tcp_sd = -1;
+		free(priv->local_tcp_buf);
+		priv->local_tcp_buf = NULL;
+		priv->local_tcp_len = 0;
 	}
 }
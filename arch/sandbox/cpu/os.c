@@ -7,6 +7,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -206,6 +207,50 @@ uint64_t __attribute__((no_instrument_function)) os_get_nsec(void)
 #endif
 }
 
+struct os_thread {
+	pthread_t thread;
+	void (*func)(void *arg, int num);
+	void *arg;
+	int num;
+};
+
+static void *os_thread_start(void *ptr)
+{
+	struct os_thread *thread = ptr;
+
+	thread->func(thread->arg, thread->num);
+
+	return NULL;
+}
+
+int os_run_threads(void (*func)(void *arg, int num), void *arg, int nr)
+{
+	struct os_thread *thread;
+	int started, i;
+
+	thread = calloc(nr, sizeof(*thread));
+	if (!thread)
+		return -ENOMEM;
+	for (started = 1; started < nr; started++) {
+		thread[started].func = func;
+		thread[started].arg = arg;
+		thread[started].num = started;
+		if (pthread_create(&thread[started].thread, NULL,
+				   os_thread_start, &thread[started]))
+			break;
+	}
+
+	/* Do the first one here, and any which could not be started */
+	func(arg, 0);
+	for (i = started; i < nr; i++)
+		func(arg, i);
+	for (i = 1; i < started; i++)
+		pthread_join(thread[i].thread, NULL);
+	free(thread);
+
+	return 0;
+}
+
 static char *short_opts;
 static struct option *long_opts;
 
@@ -20,6 +20,12 @@
  *		 a message to the server claiming the port is
  *		 unreachable
  * local_bind_udp_port: The UDP port number that we bound to
+ * local_tcp_sd: socket descriptor receiving TCP on the local interface,
+ *		 as the main one only receives UDP
+ * local_tcp_buf: last TCP packet received on the local interface, which is
+ *		  passed on in pieces of at most 1500 bytes
+ * local_tcp_len: length of the packet in local_tcp_buf, 0 once passed on
+ * local_tcp_done: number of its data bytes already passed on
  */
 struct eth_sandbox_raw_priv {
 	int sd;
@@ -27,6 +33,10 @@ struct eth_sandbox_raw_priv {
 	int local;
 	int local_bind_sd;
 	unsigned short local_bind_udp_port;
+	int local_tcp_sd;
+	unsigned char *local_tcp_buf;
+	int local_tcp_len;
+	int local_tcp_done;
 };
 
 int sandbox_eth_raw_os_start(const char *ifname, unsigned char *ethmac,
@@ -34,7 +44,7 @@ int sandbox_eth_raw_os_start(const char *ifname, unsigned char *ethmac,
 int sandbox_eth_raw_os_send(void *packet, int length,
 			    struct eth_sandbox_raw_priv *priv);
 int sandbox_eth_raw_os_recv(void *packet, int *length,
-			    const struct eth_sandbox_raw_priv *priv);
+			    struct eth_sandbox_raw_priv *priv);
 void sandbox_eth_raw_os_stop(struct eth_sandbox_raw_priv *priv);
 
 #endif /* __ETH_RAW_OS_H */
@@ -263,6 +263,14 @@ static bool has_mtrr(void)
 	return cpuid_edx(0x00000001) & (1 << 12) ? true : false;
 }
 
+/* Check for FXSAVE/FXRSTOR and SSE */
+static bool has_sse(void)
+{
+	u32 mask = (1 << 24) | (1 << 25);
+
+	return (cpuid_edx(0x00000001) & mask) == mask;
+}
+
 static int build_vendor_name(char *vendor_name)
 {
 	struct cpuid_result result;
@@ -346,6 +354,11 @@ int x86_cpu_init_f(void)
 		"orl  %1, %%eax\n" \
 		"movl %%eax, %%cr0\n" \
 		: : "i" (em_rst), "i" (mp_ne_set) : "eax");
+
+		/* allow SSE instructions, which e.g. crc32 uses */
+		if (has_cpuid() && has_sse())
+			write_cr4(read_cr4() | X86_CR4_OSFXSR |
+				  X86_CR4_OSXMMEXCPT);
 	}
 
 	/* identify CPU via cpuid and store the decoded info into gd->arch */
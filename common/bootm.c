@@ -9,6 +9,7 @@
 #include <common.h>
 #include <bootstage.h>
 #include <bzlib.h>
+#include <decomp_stream.h>
 #include <errno.h>
 #include <fdt_support.h>
 #include <lmb.h>
@@ -19,6 +20,7 @@
 #include <lzma/LzmaTypes.h>
 #include <lzma/LzmaDec.h>
 #include <lzma/LzmaTools.h>
+#include <u-boot/zstd.h>
 #if defined(CONFIG_CMD_USB)
 #include <usb.h>
 #endif
@@ -325,6 +327,45 @@ static int handle_decomp_error(int comp_type, size_t uncomp_size,
 	return BOOTM_ERR_RESET;
 }
 
+#if defined(CONFIG_DECOMP_STREAM) && !defined(USE_HOSTCC)
+/**
+ * bootm_decomp_stream() - Decompress an image with the streaming decompressor
+ *
+ * The image is already in memory so it is passed in a single piece, which
+ * the decompressor uses where it is.
+ *
+ * @comp:	Compression type
+ * @load_buf:	Where to put the output
+ * @unc_len:	Space available at @load_buf
+ * @image_buf:	Compressed image
+ * @image_len:	Size of the compressed image; returns the number of bytes
+ *		written, or @unc_len if the output did not fit
+ * @return 0 if OK, -EPROTONOSUPPORT if @comp is not supported (or is better
+ *	handled in one go), other -ve error on failure
+ */
+static int bootm_decomp_stream(int comp, void *load_buf, uint unc_len,
+			       void *image_buf, ulong *image_len)
+{
+	struct decomp_stream *ds;
+	int ret;
+
+#ifdef CONFIG_LZ4_PARALLEL
+	/* ulz4fn() can decode the blocks of a whole frame on several CPUs */
+	if (comp == IH_COMP_LZ4)
+		return -EPROTONOSUPPORT;
+#endif
+	ret = decomp_stream_init(&ds, comp, load_buf, unc_len);
+	if (ret)
+		return ret;
+	decomp_stream_feed(ds, image_buf, *image_len);
+	ret = decomp_stream_finish(ds, image_len);
+	if (ret == -ENOSPC)
+		*image_len = unc_len;
+
+	return ret;
+}
+#endif
+
 int bootm_decomp_image(int comp, ulong load, ulong image_start, int type,
 		       void *load_buf, void *image_buf, ulong image_len,
 		       uint unc_len, ulong *load_end)
@@ -339,6 +380,13 @@ int bootm_decomp_image(int comp, ulong load, ulong image_start, int type,
 	 * this, image_len will be set to the number of uncompressed bytes
 	 * loaded, ret will be non-zero on error.
 	 */
+#if defined(CONFIG_DECOMP_STREAM) && !defined(USE_HOSTCC)
+	ret = bootm_decomp_stream(comp, load_buf, unc_len, image_buf,
+				  &image_len);
+	if (ret != -EPROTONOSUPPORT)
+		goto done;
+	ret = 0;
+#endif
 	switch (comp) {
 	case IH_COMP_NONE:
 		if (load == image_start)
@@ -398,11 +446,23 @@ int bootm_decomp_image(int comp, ulong load, ulong image_start, int type,
 		break;
 	}
 #endif /* CONFIG_LZ4 */
+#ifdef CONFIG_ZSTD
+	case IH_COMP_ZSTD: {
+		size_t size = unc_len;
+
+		ret = zstd_decompress(image_buf, image_len, load_buf, &size);
+		image_len = ret == -ENOSPC ? unc_len : size;
+		break;
+	}
+#endif /* CONFIG_ZSTD */
 	default:
 		printf("Unimplemented compression type %d\n", comp);
 		return BOOTM_ERR_UNIMPLEMENTED;
 	}
 
+#if defined(CONFIG_DECOMP_STREAM) && !defined(USE_HOSTCC)
+done:
+#endif
 	if (ret)
 		return handle_decomp_error(comp, image_len, unc_len, ret);
 	*load_end = load + image_len;
@@ -0,0 +1,126 @@
+/*
+ * Control and statistics of the block device cache
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <blkcache.h>
+#include <command.h>
+#include <part.h>
+
+static const char *const if_type_names[IF_TYPE_MAX] = {
+	[IF_TYPE_UNKNOWN]	= "unknown",
+	[IF_TYPE_IDE]		= "ide",
+	[IF_TYPE_SCSI]		= "scsi",
+	[IF_TYPE_ATAPI]		= "atapi",
+	[IF_TYPE_USB]		= "usb",
+	[IF_TYPE_DOC]		= "doc",
+	[IF_TYPE_MMC]		= "mmc",
+	[IF_TYPE_SD]		= "sd",
+	[IF_TYPE_SATA]		= "sata",
+	[IF_TYPE_HOST]		= "host",
+};
+
+static int do_blkcache_show(cmd_tbl_t *cmdtp, int flag, int argc,
+			    char * const argv[])
+{
+	struct blkcache_dev_stats ds;
+	struct blkcache_stats stats;
+	const char *name;
+	int i;
+
+	blkcache_get_stats(&stats);
+	printf("reads of up to %u blocks, %u of %u entries used\n",
+	       stats.max_blocks, stats.entries, stats.max_entries);
+	printf("hits %lu, misses %lu\n", stats.hits, stats.misses);
+
+	for (i = 0; !blkcache_get_dev_stats(i, &ds); i++) {
+		if (i == 0)
+			puts("\ndevice     entries       hits     misses     writes\n");
+		name = ds.if_type >= 0 && ds.if_type < IF_TYPE_MAX ?
+			if_type_names[ds.if_type] : NULL;
+		printf("%-6s %-3d %7u %10lu %10lu %10lu\n",
+		       name ? name : "?", ds.dev, ds.entries, ds.hits,
+		       ds.misses, ds.writes);
+	}
+
+	return CMD_RET_SUCCESS;
+}
+
+static int do_blkcache_flush(cmd_tbl_t *cmdtp, int flag, int argc,
+			     char * const argv[])
+{
+	blkcache_invalidate_all();
+
+	return CMD_RET_SUCCESS;
+}
+
+static int do_blkcache_reset(cmd_tbl_t *cmdtp, int flag, int argc,
+			     char * const argv[])
+{
+	blkcache_reset_stats();
+
+	return CMD_RET_SUCCESS;
+}
+
+static int do_blkcache_configure(cmd_tbl_t *cmdtp, int flag, int argc,
+				 char * const argv[])
+{
+	unsigned max_blocks, max_entries;
+
+	if (argc != 3)
+		return CMD_RET_USAGE;
+
+	max_blocks = simple_strtoul(argv[1], NULL, 0);
+	max_entries = simple_strtoul(argv[2], NULL, 0);
+	blkcache_configure(max_blocks, max_entries);
+	printf("changed to reads of up to %u blocks, %u entries\n",
+	       max_blocks, max_entries);
+
+	return CMD_RET_SUCCESS;
+}
+
+static cmd_tbl_t cmd_blkcache_sub[] = {
+	U_BOOT_CMD_MKENT(show, 1, 1, do_blkcache_show, "", ""),
+	U_BOOT_CMD_MKENT(flush, 1, 0, do_blkcache_flush, "", ""),
+	U_BOOT_CMD_MKENT(reset, 1, 0, do_blkcache_reset, "", ""),
+	U_BOOT_CMD_MKENT(configure, 3, 0, do_blkcache_configure, "", ""),
+};
+
+static int do_blkcache(cmd_tbl_t *cmdtp, int flag, int argc,
+		       char * const argv[])
+{
+	cmd_tbl_t *cp;
+
+	if (argc < 2)
+		return CMD_RET_USAGE;
+
+	cp = find_cmd_tbl(argv[1], cmd_blkcache_sub,
+			  ARRAY_SIZE(cmd_blkcache_sub));
+
+	/* Drop the blkcache command */
+	argc--;
+	argv++;
+
+	if (cp == NULL || argc > cp->maxargs)
+		return CMD_RET_USAGE;
+	if (flag == CMD_FLAG_REPEAT && !cp->repeatable)
+		return CMD_RET_SUCCESS;
+
+	return cp->cmd(cmdtp, flag, argc, argv);
+}
+
+U_BOOT_CMD(
+	blkcache, 4, 0, do_blkcache,
+	"block device cache control and statistics",
+	"show\n"
+	"    - show the size of the cache and hits and misses per device\n"
+	"blkcache flush\n"
+	"    - drop everything held in the cache\n"
+	"blkcache reset\n"
+	"    - clear the hit, miss and write counters\n"
+	"blkcache configure <blocks> <entries>\n"
+	"    - cache reads of up to <blocks> blocks, in up to <entries>\n"
+	"      entries; 0 entries turns the cache off"
+);
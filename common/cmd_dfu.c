@@ -41,6 +41,9 @@ static int do_dfu(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 	}
 #endif
 
+#ifdef CONFIG_DFU_BACKGROUND_WRITE
+	dfu_set_background_write(true);
+#endif
 	ret = dfu_init_env_entities(interface, devstring);
 	if (ret)
 		goto done;
@@ -81,12 +84,16 @@ static int do_dfu(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 
 		WATCHDOG_RESET();
 		usb_gadget_handle_interrupts(controller_index);
+		dfu_background_write();
 	}
 exit:
 	g_dnl_unregister();
 	board_usb_cleanup(controller_index, USB_INIT_DEVICE);
 done:
 	dfu_free_entities();
+#ifdef CONFIG_DFU_BACKGROUND_WRITE
+	dfu_set_background_write(false);
+#endif
 
 	if (dfu_reset)
 		run_command("reset", 0);
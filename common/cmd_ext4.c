@@ -87,6 +87,35 @@ U_BOOT_CMD(ext4ls, 4, 1, do_ext4_ls,
 	   "<interface> <dev[:part]> [directory]\n"
 	   "    - list files from 'dev' on 'interface' in a 'directory'");
 
+static int do_ext4_cache(cmd_tbl_t *cmdtp, int flag, int argc,
+			 char *const argv[])
+{
+	const struct ext4_cache_stats *stats;
+
+	if (argc > 2)
+		return CMD_RET_USAGE;
+	if (argc == 2) {
+		if (strcmp(argv[1], "reset"))
+			return CMD_RET_USAGE;
+		ext4fs_reset_cache_stats();
+		return CMD_RET_SUCCESS;
+	}
+
+	stats = ext4fs_get_cache_stats();
+	printf("ext4 metadata cache: %d of %d blocks used\n", stats->used,
+	       stats->size);
+	printf("hits %lu, misses %lu\n", stats->hits, stats->misses);
+
+	return CMD_RET_SUCCESS;
+}
+
+U_BOOT_CMD(ext4cache, 2, 1, do_ext4_cache,
+	   "show ext4 metadata cache statistics",
+	   "\n"
+	   "    - show hits and misses of the ext4 metadata block cache\n"
+	   "ext4cache reset\n"
+	   "    - clear the hit and miss counters");
+
 U_BOOT_CMD(ext4load, 7, 0, do_ext4_load,
 	   "load binary file from a Ext4 filesystem",
 	   "<interface> [<dev[:part]> [addr [filename [bytes [pos]]]]]\n"
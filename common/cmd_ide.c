@@ -10,6 +10,7 @@
  */
 
 #include <common.h>
+#include <blkcache.h>
 #include <config.h>
 #include <watchdog.h>
 #include <command.h>
@@ -230,7 +231,9 @@ int do_ide(cmd_tbl_t *cmdtp, int flag, int argc, char *const argv[])
 			printf("\nIDE write: device %d block # %ld, count %ld ... ",
 				curr_device, blk, cnt);
 #endif
-			n = ide_write(curr_device, blk, cnt, (ulong *) addr);
+			n = ide_dev_desc[curr_device].block_write(curr_device,
+								  blk, cnt,
+								  (ulong *)addr);
 
 			printf("%ld blocks written: %s\n",
 				n, (n == cnt) ? "OK" : "ERROR");
@@ -312,6 +315,39 @@ __weak unsigned char ide_inb(int dev, int port)
 	return val;
 }
 
+/* ide_read() and ide_write() with the block cache in front of them */
+static ulong ide_bread(int device, lbaint_t blknr, lbaint_t blkcnt,
+		       void *buffer)
+{
+	ulong n;
+
+	if (blkcache_read(IF_TYPE_IDE, device, blknr, blkcnt,
+			  ide_dev_desc[device].blksz, buffer))
+		return blkcnt;
+
+	n = ide_read(device, blknr, blkcnt, buffer);
+	if (n == blkcnt)
+		blkcache_fill(IF_TYPE_IDE, device, blknr, blkcnt,
+			      ide_dev_desc[device].blksz, buffer);
+
+	return n;
+}
+
+static ulong ide_bwrite(int device, lbaint_t blknr, lbaint_t blkcnt,
+			const void *buffer)
+{
+	ulong n;
+
+	n = ide_write(device, blknr, blkcnt, buffer);
+	if (n == blkcnt)
+		blkcache_write(IF_TYPE_IDE, device, blknr, blkcnt,
+			       ide_dev_desc[device].blksz, buffer);
+	else
+		blkcache_invalidate(IF_TYPE_IDE, device);
+
+	return n;
+}
+
 void ide_init(void)
 {
 	unsigned char c;
@@ -422,8 +458,9 @@ void ide_init(void)
 		ide_dev_desc[i].log2blksz =
 			LOG2_INVALID(typeof(ide_dev_desc[i].log2blksz));
 		ide_dev_desc[i].lba = 0;
-		ide_dev_desc[i].block_read = ide_read;
-		ide_dev_desc[i].block_write = ide_write;
+		ide_dev_desc[i].block_read = ide_bread;
+		ide_dev_desc[i].block_write = ide_bwrite;
+		blkcache_invalidate(IF_TYPE_IDE, i);
 		if (!ide_bus_ok[IDE_BUS(i)])
 			continue;
 		ide_led(led, 1);	/* LED on       */
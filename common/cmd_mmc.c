@@ -8,6 +8,9 @@
 #include <common.h>
 #include <command.h>
 #include <console.h>
+#include <decomp_stream.h>
+#include <image.h>
+#include <malloc.h>
 #include <mmc.h>
 
 static int curr_device = -1;
@@ -140,6 +143,11 @@ static void print_mmcinfo(struct mmc *mmc)
 					putc('\n');
 			}
 		}
+		if (mmc->cache_size) {
+			puts("Write Cache: ");
+			print_size(((u64)mmc->cache_size) << 10,
+				   mmc->cache_on ? " ON\n" : " OFF\n");
+		}
 	}
 }
 static struct mmc *init_mmc_device(int dev, bool force_init)
@@ -358,6 +366,85 @@ static int do_mmc_read(cmd_tbl_t *cmdtp, int flag,
 
 	return (n == cnt) ? CMD_RET_SUCCESS : CMD_RET_FAILURE;
 }
+
+#ifdef CONFIG_DECOMP_STREAM
+/*
+ * Read buffer size. Each read fills it in two halves, so that one half is
+ * decompressed while the other is read.
+ */
+#define MMC_READZ_BUF_SIZE	(256 << 10)
+
+struct mmc_readz_priv {
+	struct decomp_stream *ds;
+	uint blksz;
+};
+
+static int mmc_readz_chunk(void *priv, void *buf, lbaint_t blkcnt)
+{
+	struct mmc_readz_priv *rz = priv;
+
+	return decomp_stream_feed(rz->ds, buf, blkcnt * rz->blksz);
+}
+
+static int do_mmc_readz(cmd_tbl_t *cmdtp, int flag,
+			int argc, char * const argv[])
+{
+	struct mmc_readz_priv rz;
+	struct mmc *mmc;
+	u32 blk, cnt, n, win, todo;
+	ulong size, len;
+	void *addr, *buf;
+	int ret;
+
+	if (argc != 6)
+		return CMD_RET_USAGE;
+
+	addr = (void *)simple_strtoul(argv[2], NULL, 16);
+	size = simple_strtoul(argv[3], NULL, 16);
+	blk = simple_strtoul(argv[4], NULL, 16);
+	cnt = simple_strtoul(argv[5], NULL, 16);
+
+	mmc = init_mmc_device(curr_device, false);
+	if (!mmc)
+		return CMD_RET_FAILURE;
+
+	rz.blksz = mmc->read_bl_len;
+	win = MMC_READZ_BUF_SIZE / rz.blksz;
+	buf = memalign(ARCH_DMA_MINALIGN, win * rz.blksz);
+	if (!buf)
+		return CMD_RET_FAILURE;
+	ret = decomp_stream_init(&rz.ds, genimg_get_comp_id(argv[1]), addr,
+				 size);
+	if (ret) {
+		printf("Cannot decompress '%s'\n", argv[1]);
+		free(buf);
+		return CMD_RET_FAILURE;
+	}
+
+	printf("\nMMC readz: dev # %d, block # %d, count %d ... ",
+	       curr_device, blk, cnt);
+
+	/* Stop reading once the end of the compressed data is seen */
+	for (n = 0; n < cnt && !decomp_stream_done(rz.ds); n += todo) {
+		todo = min(cnt - n, win);
+		if (mmc_bread_stream(mmc, blk + n, todo, buf, win / 2,
+				     mmc_readz_chunk, &rz) != todo)
+			break;
+	}
+	ret = decomp_stream_finish(rz.ds, &len);
+	free(buf);
+	flush_cache((ulong)addr, ALIGN(len, ARCH_DMA_MINALIGN));
+	if (ret) {
+		printf("ERROR %d after %lu bytes\n", ret, len);
+		return CMD_RET_FAILURE;
+	}
+	printf("%lu bytes: OK\n", len);
+	setenv_hex("filesize", len);
+
+	return CMD_RET_SUCCESS;
+}
+#endif
+
 static int do_mmc_write(cmd_tbl_t *cmdtp, int flag,
 			int argc, char * const argv[])
 {
@@ -795,6 +882,9 @@ static int do_mmc_setdsr(cmd_tbl_t *cmdtp, int flag,
 static cmd_tbl_t cmd_mmc[] = {
 	U_BOOT_CMD_MKENT(info, 1, 0, do_mmcinfo, "", ""),
 	U_BOOT_CMD_MKENT(read, 4, 1, do_mmc_read, "", ""),
+#ifdef CONFIG_DECOMP_STREAM
+	U_BOOT_CMD_MKENT(readz, 6, 1, do_mmc_readz, "", ""),
+#endif
 	U_BOOT_CMD_MKENT(write, 4, 0, do_mmc_write, "", ""),
 	U_BOOT_CMD_MKENT(erase, 3, 0, do_mmc_erase, "", ""),
 	U_BOOT_CMD_MKENT(rescan, 1, 1, do_mmc_rescan, "", ""),
@@ -845,6 +935,10 @@ U_BOOT_CMD(
 	"MMC sub system",
 	"info - display info of the current MMC device\n"
 	"mmc read addr blk# cnt\n"
+#ifdef CONFIG_DECOMP_STREAM
+	"mmc readz comp addr size blk# cnt\n"
+	" - read and decompress (gzip, lzma, lzo, lz4) to at most size bytes\n"
+#endif
 	"mmc write addr blk# cnt\n"
 	"mmc erase blk# cnt\n"
 	"mmc rescan\n"
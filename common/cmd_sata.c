@@ -11,6 +11,7 @@
  */
 
 #include <common.h>
+#include <blkcache.h>
 #include <command.h>
 #include <part.h>
 #include <sata.h>
@@ -18,6 +19,38 @@
 static int sata_curr_device = -1;
 block_dev_desc_t sata_dev_desc[CONFIG_SYS_SATA_MAX_DEVICE];
 
+/* sata_read() and sata_write() with the block cache in front of them */
+static ulong sata_bread(int dev, lbaint_t start, lbaint_t blkcnt, void *dst)
+{
+	ulong ret;
+
+	if (blkcache_read(IF_TYPE_SATA, dev, start, blkcnt,
+			  sata_dev_desc[dev].blksz, dst))
+		return blkcnt;
+
+	ret = sata_read(dev, start, blkcnt, dst);
+	if (ret == blkcnt)
+		blkcache_fill(IF_TYPE_SATA, dev, start, blkcnt,
+			      sata_dev_desc[dev].blksz, dst);
+
+	return ret;
+}
+
+static ulong sata_bwrite(int dev, lbaint_t start, lbaint_t blkcnt,
+			 const void *src)
+{
+	ulong ret;
+
+	ret = sata_write(dev, start, blkcnt, src);
+	if (ret == blkcnt)
+		blkcache_write(IF_TYPE_SATA, dev, start, blkcnt,
+			       sata_dev_desc[dev].blksz, src);
+	else
+		blkcache_invalidate(IF_TYPE_SATA, dev);
+
+	return ret;
+}
+
 int __sata_initialize(void)
 {
 	int rc;
@@ -32,8 +65,9 @@ int __sata_initialize(void)
 		sata_dev_desc[i].lba = 0;
 		sata_dev_desc[i].blksz = 512;
 		sata_dev_desc[i].log2blksz = LOG2(sata_dev_desc[i].blksz);
-		sata_dev_desc[i].block_read = sata_read;
-		sata_dev_desc[i].block_write = sata_write;
+		sata_dev_desc[i].block_read = sata_bread;
+		sata_dev_desc[i].block_write = sata_bwrite;
+		blkcache_invalidate(IF_TYPE_SATA, i);
 
 		rc = init_sata(i);
 		if (!rc) {
@@ -171,7 +205,7 @@ static int do_sata(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 			printf("\nSATA read: device %d block # %ld, count %ld ... ",
 				sata_curr_device, blk, cnt);
 
-			n = sata_read(sata_curr_device, blk, cnt, (u32 *)addr);
+			n = sata_bread(sata_curr_device, blk, cnt, (u32 *)addr);
 
 			/* flush cache after read */
 			flush_cache(addr, cnt * sata_dev_desc[sata_curr_device].blksz);
@@ -189,7 +223,7 @@ static int do_sata(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 			printf("\nSATA write: device %d block # %ld, count %ld ... ",
 				sata_curr_device, blk, cnt);
 
-			n = sata_write(sata_curr_device, blk, cnt, (u32 *)addr);
+			n = sata_bwrite(sata_curr_device, blk, cnt, (u32 *)addr);
 
 			printf("%ld blocks written: %s\n",
 				n, (n == cnt) ? "OK" : "ERROR");
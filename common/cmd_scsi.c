@@ -9,6 +9,7 @@
  * SCSI support.
  */
 #include <common.h>
+#include <blkcache.h>
 #include <command.h>
 #include <inttypes.h>
 #include <asm/processor.h>
@@ -103,6 +104,7 @@ void scsi_scan(int mode)
 		scsi_dev_desc[i].part_type=PART_TYPE_UNKNOWN;
 		scsi_dev_desc[i].block_read=scsi_read;
 		scsi_dev_desc[i].block_write = scsi_write;
+		blkcache_invalidate(IF_TYPE_SCSI, i);
 	}
 	scsi_max_devs=0;
 	for(i=0;i<CONFIG_SYS_SCSI_MAX_SCSI_ID;i++) {
@@ -370,7 +372,11 @@ static ulong scsi_read(int device, lbaint_t blknr, lbaint_t blkcnt,
 	uintptr_t buf_addr;
 	unsigned short smallblks = 0;
 	ccb* pccb=(ccb *)&tempccb;
+	int failed = 0;
 	device&=0xff;
+	if (blkcache_read(IF_TYPE_SCSI, device, blknr, blkcnt,
+			  scsi_dev_desc[device].blksz, buffer))
+		return blkcnt;
 	/* Setup  device
 	 */
 	pccb->target=scsi_dev_desc[device].target;
@@ -413,12 +419,16 @@ static ulong scsi_read(int device, lbaint_t blknr, lbaint_t blkcnt,
 		if (scsi_exec(pccb) != true) {
 			scsi_print_error(pccb);
 			blkcnt-=blks;
+			failed = 1;
 			break;
 		}
 		buf_addr+=pccb->datalen;
 	} while(blks!=0);
 	debug("scsi_read_ext: end startblk " LBAF
 	      ", blccnt %x buffer %" PRIXPTR "\n", start, smallblks, buf_addr);
+	if (!failed)
+		blkcache_fill(IF_TYPE_SCSI, device, blknr, blkcnt,
+			      scsi_dev_desc[device].blksz, buffer);
 	return(blkcnt);
 }
 
@@ -436,6 +446,7 @@ static ulong scsi_write(int device, lbaint_t blknr,
 	uintptr_t buf_addr;
 	unsigned short smallblks;
 	ccb* pccb = (ccb *)&tempccb;
+	int failed = 0;
 	device &= 0xff;
 	/* Setup  device
 	 */
@@ -467,12 +478,19 @@ static ulong scsi_write(int device, lbaint_t blknr,
 		if (scsi_exec(pccb) != true) {
 			scsi_print_error(pccb);
 			blkcnt -= blks;
+			failed = 1;
 			break;
 		}
 		buf_addr += pccb->datalen;
 	} while (blks != 0);
 	debug("%s: end startblk " LBAF ", blccnt %x buffer %" PRIXPTR "\n",
 	      __func__, start, smallblks, buf_addr);
+	/* After an error some of the failed blocks may have been written */
+	if (failed)
+		blkcache_invalidate(IF_TYPE_SCSI, device);
+	else
+		blkcache_write(IF_TYPE_SCSI, device, blknr, blkcnt,
+			       scsi_dev_desc[device].blksz, buffer);
 	return blkcnt;
 }
 
@@ -1506,6 +1506,7 @@ static inline void malloc_bin_reloc(void) {}
 ulong mem_malloc_start = 0;
 ulong mem_malloc_end = 0;
 ulong mem_malloc_brk = 0;
+ulong mem_malloc_brk_max = 0;
 
 void *sbrk(ptrdiff_t increment)
 {
@@ -1523,6 +1524,8 @@ void *sbrk(ptrdiff_t increment)
 		return (void *)MORECORE_FAILURE;
 
 	mem_malloc_brk = new;
+	if (new > mem_malloc_brk_max)
+		mem_malloc_brk_max = new;
 
 	return (void *)old;
 }
@@ -1532,6 +1535,7 @@ void mem_malloc_init(ulong start, ulong size)
 	mem_malloc_start = start;
 	mem_malloc_end = start + size;
 	mem_malloc_brk = start;
+	mem_malloc_brk_max = start;
 
 	debug("using memory %#lx-%#lx for malloc()\n", mem_malloc_start,
 	      mem_malloc_end);
@@ -23,8 +23,22 @@ static char *response_str;
 
 struct fb_mmc_sparse {
 	block_dev_desc_t	*dev_desc;
+	lbaint_t		blks;	/* blocks written so far */
 };
 
+/* Show how long a write took and how fast the device took the data */
+static void fb_mmc_show_speed(u64 bytes, ulong start)
+{
+	ulong ms = get_timer(start);
+
+	printf("........ took %lu ms", ms);
+	if (ms) {
+		puts(", ");
+		print_size(lldiv(bytes * 1000, ms), "/s");
+	}
+	putc('\n');
+}
+
 static int get_partition_info_efi_by_name_or_alias(block_dev_desc_t *dev_desc,
 		const char *name, disk_partition_t *info)
 {
@@ -58,19 +72,67 @@ static int fb_mmc_sparse_write(struct sparse_storage *storage,
 	block_dev_desc_t *dev_desc = sparse->dev_desc;
 	int ret;
 
-	ret = dev_desc->block_write(dev_desc->dev, offset, size, data);
+	/* fb_mmc_sparse_flush() writes back the cache once at the end */
+	ret = mmc_bwrite_cached(dev_desc->dev, offset, size, data);
 	if (!ret)
 		return -EIO;
+	sparse->blks += ret;
 
 	return ret;
 }
 
+static int fb_mmc_sparse_flush(struct fb_mmc_sparse *sparse)
+{
+	struct mmc *mmc = find_mmc_device(sparse->dev_desc->dev);
+
+	if (!mmc)
+		return -ENODEV;
+
+	return mmc_flush_cache(mmc);
+}
+
+static int fb_mmc_sparse_erase(struct sparse_storage *storage,
+			       void *priv,
+			       unsigned int offset,
+			       unsigned int size)
+{
+	struct fb_mmc_sparse *sparse = priv;
+
+	return mmc_btrim(sparse->dev_desc->dev, offset, size);
+}
+
+static void fb_mmc_sparse_init(sparse_storage_t *sparse,
+			       struct fb_mmc_sparse *sparse_priv,
+			       block_dev_desc_t *dev_desc,
+			       disk_partition_t *info, const char *name)
+{
+	struct mmc *mmc;
+
+	sparse_priv->dev_desc = dev_desc;
+	sparse_priv->blks = 0;
+
+	sparse->block_sz = info->blksz;
+	sparse->start = info->start;
+	sparse->size = info->size;
+	sparse->name = name;
+	sparse->write = fb_mmc_sparse_write;
+	sparse->erase = NULL;
+	sparse->erase_zeroes = false;
+
+	mmc = find_mmc_device(dev_desc->dev);
+	if (mmc && mmc->trim_support) {
+		sparse->erase = fb_mmc_sparse_erase;
+		sparse->erase_zeroes = mmc->erased_zero;
+	}
+}
+
 static void write_raw_image(block_dev_desc_t *dev_desc, disk_partition_t *info,
 		const char *part_name, void *buffer,
 		unsigned int download_bytes)
 {
 	lbaint_t blkcnt;
 	lbaint_t blks;
+	ulong start;
 
 	/* determine number of blocks to write */
 	blkcnt = ((download_bytes + (info->blksz - 1)) & ~(info->blksz - 1));
@@ -84,6 +146,7 @@ static void write_raw_image(block_dev_desc_t *dev_desc, disk_partition_t *info,
 
 	puts("Flashing Raw Image\n");
 
+	start = get_timer(0);
 	blks = dev_desc->block_write(dev_desc->dev, info->start, blkcnt,
 				     buffer);
 	if (blks != blkcnt) {
@@ -94,6 +157,7 @@ static void write_raw_image(block_dev_desc_t *dev_desc, disk_partition_t *info,
 
 	printf("........ wrote " LBAFU " bytes to '%s'\n", blkcnt * info->blksz,
 	       part_name);
+	fb_mmc_show_speed((u64)blkcnt * info->blksz, start);
 	fastboot_okay(response_str, "");
 }
 
@@ -141,20 +205,22 @@ void fb_mmc_flash_write(const char *cmd, unsigned int session_id,
 	if (is_sparse_image(download_buffer)) {
 		struct fb_mmc_sparse sparse_priv;
 		sparse_storage_t sparse;
+		ulong start;
 
-		sparse_priv.dev_desc = dev_desc;
-
-		sparse.block_sz = info.blksz;
-		sparse.start = info.start;
-		sparse.size = info.size;
-		sparse.name = cmd;
-		sparse.write = fb_mmc_sparse_write;
+		fb_mmc_sparse_init(&sparse, &sparse_priv, dev_desc, &info, cmd);
 
 		printf("Flashing sparse image at offset " LBAFU "\n",
 		       info.start);
 
+		start = get_timer(0);
 		store_sparse_image(&sparse, &sparse_priv, session_id,
 				   download_buffer);
+		if (fb_mmc_sparse_flush(&sparse_priv)) {
+			error("failed flushing device %d\n", dev_desc->dev);
+			fastboot_fail(response_str, "failed flushing device");
+			return;
+		}
+		fb_mmc_show_speed((u64)sparse_priv.blks * info.blksz, start);
 	} else {
 		write_raw_image(dev_desc, &info, cmd, download_buffer,
 				download_bytes);
@@ -163,6 +229,99 @@ void fb_mmc_flash_write(const char *cmd, unsigned int session_id,
 	fastboot_okay(response_str, "");
 }
 
+static struct {
+	struct fb_mmc_sparse	priv;
+	sparse_storage_t	storage;
+	struct sparse_stream	ss;
+	char			name[33];	/* partition name */
+	ulong			start;
+	bool			active;
+} fb_mmc_stream;
+
+int fb_mmc_stream_start(const char *cmd, unsigned int session_id,
+			char *response)
+{
+	block_dev_desc_t *dev_desc;
+	disk_partition_t info;
+
+	response_str = response;
+
+	/* A download which never finished */
+	if (fb_mmc_stream.active) {
+		sparse_stream_abort(&fb_mmc_stream.ss);
+		fb_mmc_sparse_flush(&fb_mmc_stream.priv);
+		fb_mmc_stream.active = false;
+	}
+
+	dev_desc = get_dev("mmc", CONFIG_FASTBOOT_FLASH_MMC_DEV);
+	if (!dev_desc || dev_desc->type == DEV_TYPE_UNKNOWN) {
+		error("invalid mmc device\n");
+		fastboot_fail(response_str, "invalid mmc device");
+		return -ENODEV;
+	}
+
+	if (strcmp(cmd, CONFIG_FASTBOOT_GPT_NAME) == 0) {
+		fastboot_fail(response_str, "cannot stream a GPT");
+		return -EINVAL;
+	} else if (get_partition_info_efi_by_name_or_alias(dev_desc, cmd,
+							   &info)) {
+		error("cannot find partition: '%s'\n", cmd);
+		fastboot_fail(response_str, "cannot find partition");
+		return -ENOENT;
+	}
+
+	strlcpy(fb_mmc_stream.name, cmd, sizeof(fb_mmc_stream.name));
+	fb_mmc_sparse_init(&fb_mmc_stream.storage, &fb_mmc_stream.priv,
+			   dev_desc, &info, fb_mmc_stream.name);
+	if (sparse_stream_start(&fb_mmc_stream.ss, &fb_mmc_stream.storage,
+				&fb_mmc_stream.priv, session_id)) {
+		fastboot_fail(response_str, "out of memory");
+		return -ENOMEM;
+	}
+
+	printf("Flashing to '%s' during download\n", cmd);
+	fb_mmc_stream.start = get_timer(0);
+	fb_mmc_stream.active = true;
+
+	return 0;
+}
+
+int fb_mmc_stream_write(void *buffer, unsigned int len)
+{
+	if (!fb_mmc_stream.active)
+		return -EINVAL;
+
+	return sparse_stream_feed(&fb_mmc_stream.ss, buffer, len);
+}
+
+void fb_mmc_stream_finish(char *response)
+{
+	int ret;
+
+	response_str = response;
+
+	if (!fb_mmc_stream.active) {
+		fastboot_fail(response_str, "no download in progress");
+		return;
+	}
+	fb_mmc_stream.active = false;
+
+	ret = sparse_stream_finish(&fb_mmc_stream.ss);
+	if (fb_mmc_sparse_flush(&fb_mmc_stream.priv))
+		ret = -EIO;
+	fb_mmc_show_speed((u64)fb_mmc_stream.priv.blks *
+			  fb_mmc_stream.storage.block_sz,
+			  fb_mmc_stream.start);
+	if (ret) {
+		error("failed writing to device %d\n",
+		      fb_mmc_stream.priv.dev_desc->dev);
+		fastboot_fail(response_str, "failed writing to device");
+		return;
+	}
+
+	fastboot_okay(response_str, "");
+}
+
 void fb_mmc_erase(const char *cmd, char *response)
 {
 	int ret;
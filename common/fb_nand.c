@@ -160,6 +160,8 @@ void fb_nand_flash_write(const char *partname, unsigned int session_id,
 		sparse.size = part->size  / sparse.block_sz;
 		sparse.name = part->name;
 		sparse.write = fb_nand_sparse_write;
+		sparse.erase = NULL;
+		sparse.erase_zeroes = false;
 
 		ret = store_sparse_image(&sparse, &sparse_priv, session_id,
 					 download_buffer);
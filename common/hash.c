@@ -16,6 +16,7 @@
 #include <malloc.h>
 #include <mapmem.h>
 #include <hw_sha.h>
+#include <watchdog.h>
 #include <asm/io.h>
 #include <asm/errno.h>
 #else
@@ -84,6 +85,15 @@ static int hash_finish_sha256(struct hash_algo *algo, void *ctx, void
 	free(ctx);
 	return 0;
 }
+
+static int hash_update_multi_sha256(struct hash_algo *algo, void *ctx[],
+				    const void *buf[],
+				    const unsigned int size[], int count)
+{
+	sha256_update_multi((sha256_context **)ctx, (const uint8_t **)buf,
+			    size, count);
+	return 0;
+}
 #endif
 
 static int hash_init_crc32(struct hash_algo *algo, void **ctxp)
@@ -104,10 +114,14 @@ static int hash_update_crc32(struct hash_algo *algo, void *ctx,
 static int hash_finish_crc32(struct hash_algo *algo, void *ctx, void *dest_buf,
 			     int size)
 {
+	uint32_t crc;
+
 	if (size < algo->digest_size)
 		return -1;
 
-	*((uint32_t *)dest_buf) = *((uint32_t *)ctx);
+	/* big-endian, as crc32_wd_buf() stores it */
+	crc = cpu_to_be32(*((uint32_t *)ctx));
+	memcpy(dest_buf, &crc, sizeof(crc));
 	free(ctx);
 	return 0;
 }
@@ -132,6 +146,9 @@ static struct hash_algo hash_algo[] = {
 		hw_sha_init,
 		hw_sha_update,
 		hw_sha_finish,
+#ifdef CONFIG_SHA_MULTI_HW_ACCEL
+		hw_sha_update_multi,
+#endif
 #endif
 	}, {
 		"sha256",
@@ -142,6 +159,9 @@ static struct hash_algo hash_algo[] = {
 		hw_sha_init,
 		hw_sha_update,
 		hw_sha_finish,
+#ifdef CONFIG_SHA_MULTI_HW_ACCEL
+		hw_sha_update_multi,
+#endif
 #endif
 	},
 #endif
@@ -165,6 +185,7 @@ static struct hash_algo hash_algo[] = {
 		hash_init_sha256,
 		hash_update_sha256,
 		hash_finish_sha256,
+		hash_update_multi_sha256,
 	},
 #endif
 	{
@@ -226,6 +247,120 @@ int hash_progressive_lookup_algo(const char *algo_name,
 	return -EPROTONOSUPPORT;
 }
 
+/* Drop the contexts which are still there after an error */
+static void hash_multi_abort(struct hash_algo *algo, void *ctx[],
+			     struct hash_job *jobs, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		if (ctx[i])
+			algo->hash_finish(algo, ctx[i], jobs[i].digest,
+					  algo->digest_size);
+}
+
+int hash_multi(struct hash_algo *algo, struct hash_job *jobs, int count,
+	       hash_progress_func progress, void *priv)
+{
+	void *ctx[HASH_MULTI_MAX], *step_ctx[HASH_MULTI_MAX];
+	const void *buf[HASH_MULTI_MAX];
+	unsigned int pos[HASH_MULTI_MAX], size[HASH_MULTI_MAX];
+	int idx[HASH_MULTI_MAX], last[HASH_MULTI_MAX];
+	ulong done = 0, total = 0;
+	int i, n, active, ret;
+
+	for (i = 0; i < count; i++)
+		total += jobs[i].size;
+
+	/* Without progressive hashing the buffers are done one by one */
+	if (!algo->hash_init) {
+		for (i = 0; i < count; i++) {
+			algo->hash_func_ws(jobs[i].data, jobs[i].size,
+					   jobs[i].digest, algo->chunk_size);
+			done += jobs[i].size;
+			if (progress)
+				progress(priv, done, total);
+		}
+		return 0;
+	}
+
+	for (; count > 0; count -= n, jobs += n) {
+		n = count < HASH_MULTI_MAX ? count : HASH_MULTI_MAX;
+		for (i = 0; i < n; i++) {
+			ret = algo->hash_init(algo, &ctx[i]);
+			if (ret) {
+				hash_multi_abort(algo, ctx, jobs, i);
+				return ret;
+			}
+			pos[i] = 0;
+		}
+
+		/* Hash up to a watchdog chunk of each buffer per step */
+		do {
+			for (active = 0, i = 0; i < n; i++) {
+				unsigned int left = jobs[i].size - pos[i];
+
+				if (!left)
+					continue;
+				idx[active] = i;
+				step_ctx[active] = ctx[i];
+				buf[active] = (const char *)jobs[i].data +
+					pos[i];
+				size[active] = left < algo->chunk_size ? left :
+					algo->chunk_size;
+				pos[i] += size[active];
+				last[active] = pos[i] == jobs[i].size;
+				done += size[active];
+				active++;
+			}
+			if (!active)
+				break;
+
+			if (algo->hash_update_multi) {
+				ret = algo->hash_update_multi(algo, step_ctx,
+							      buf, size,
+							      active);
+				if (ret) {
+					for (i = 0; i < active; i++)
+						ctx[idx[i]] = NULL;
+					hash_multi_abort(algo, ctx, jobs, n);
+					return ret;
+				}
+			} else {
+				for (i = 0; i < active; i++) {
+					ret = algo->hash_update(algo,
+								step_ctx[i],
+								buf[i], size[i],
+								last[i]);
+					if (ret) {
+						ctx[idx[i]] = NULL;
+						hash_multi_abort(algo, ctx,
+								 jobs, n);
+						return ret;
+					}
+				}
+			}
+#ifndef USE_HOSTCC
+			WATCHDOG_RESET();
+#endif
+			if (progress)
+				progress(priv, done, total);
+		} while (active);
+
+		for (i = 0; i < n; i++) {
+			ret = algo->hash_finish(algo, ctx[i], jobs[i].digest,
+						algo->digest_size);
+			ctx[i] = NULL;
+			if (ret) {
+				hash_multi_abort(algo, ctx, jobs, n);
+				return ret;
+			}
+		}
+	}
+
+	return 0;
+}
+
 #ifndef USE_HOSTCC
 int hash_parse_string(const char *algo_name, const char *str, uint8_t *result)
 {
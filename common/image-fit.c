@@ -16,6 +16,7 @@
 #else
 #include <common.h>
 #include <errno.h>
+#include <malloc.h>
 #include <mapmem.h>
 #include <asm/io.h>
 DECLARE_GLOBAL_DATA_PTR;
@@ -926,11 +927,21 @@ int calculate_hash(const void *data, int data_len, const char *algo,
 	return 0;
 }
 
+/* Hash value of a hash node computed up front by fit_all_image_verify() */
+struct fit_hash_value {
+	int noffset;
+	int value_len;
+	uint8_t value[FIT_MAX_HASH_LEN];
+};
+
 static int fit_image_check_hash(const void *fit, int noffset, const void *data,
-				size_t size, char **err_msgp)
+				size_t size,
+				const struct fit_hash_value *values, int count,
+				char **err_msgp)
 {
 	uint8_t value[FIT_MAX_HASH_LEN];
 	int value_len;
+	int i;
 	char *algo;
 	uint8_t *fit_value;
 	int fit_value_len;
@@ -958,7 +969,12 @@ static int fit_image_check_hash(const void *fit, int noffset, const void *data,
 		return -1;
 	}
 
-	if (calculate_hash(data, size, algo, value, &value_len)) {
+	for (i = 0; i < count && values[i].noffset != noffset; i++)
+		;
+	if (i < count) {
+		value_len = values[i].value_len;
+		memcpy(value, values[i].value, value_len);
+	} else if (calculate_hash(data, size, algo, value, &value_len)) {
 		*err_msgp = "Unsupported hash algorithm";
 		return -1;
 	}
@@ -987,7 +1003,9 @@ static int fit_image_check_hash(const void *fit, int noffset, const void *data,
  *     1, if all hashes are valid
  *     0, otherwise (or on error)
  */
-int fit_image_verify(const void *fit, int image_noffset)
+static int fit_image_verify_values(const void *fit, int image_noffset,
+				   const struct fit_hash_value *values,
+				   int count)
 {
 	const void	*data;
 	size_t		size;
@@ -1022,7 +1040,7 @@ int fit_image_verify(const void *fit, int image_noffset)
 		if (!strncmp(name, FIT_HASH_NODENAME,
 			     strlen(FIT_HASH_NODENAME))) {
 			if (fit_image_check_hash(fit, noffset, data, size,
-						 &err_msg))
+						 values, count, &err_msg))
 				goto error;
 			puts("+ ");
 		} else if (IMAGE_ENABLE_VERIFY && verify_all &&
@@ -1053,6 +1071,118 @@ error:
 	return 0;
 }
 
+int fit_image_verify(const void *fit, int image_noffset)
+{
+	return fit_image_verify_values(fit, image_noffset, NULL, 0);
+}
+
+/*
+ * Hash all component images up front, handing the buffers of each
+ * algorithm to hash_multi() together. Hash nodes which cannot be done like
+ * this are left out and checked one by one later.
+ *
+ * returns the number of values stored in *valuesp, which must be freed
+ */
+static int fit_hash_all_images(const void *fit, int images_noffset,
+			       struct fit_hash_value **valuesp)
+{
+	struct fit_hash_value *values;
+	struct hash_job *jobs, *group;
+	struct hash_algo *algo;
+	const void *data;
+	size_t size;
+	char **names;
+	int image, noffset, ignore;
+	int i, j, n, count = 0, max = 0;
+
+	*valuesp = NULL;
+	fdt_for_each_subnode(fit, image, images_noffset) {
+		fdt_for_each_subnode(fit, noffset, image) {
+			if (!strncmp(fit_get_name(fit, noffset, NULL),
+				     FIT_HASH_NODENAME,
+				     strlen(FIT_HASH_NODENAME)))
+				max++;
+		}
+	}
+	if (max < 2)
+		return 0;
+
+	values = calloc(max, sizeof(*values));
+	jobs = calloc(max, sizeof(*jobs));
+	group = calloc(max, sizeof(*group));
+	names = calloc(max, sizeof(*names));
+	if (!values || !jobs || !group || !names)
+		goto out;
+
+	fdt_for_each_subnode(fit, image, images_noffset) {
+		if (fit_image_get_data(fit, image, &data, &size))
+			continue;
+		fdt_for_each_subnode(fit, noffset, image) {
+			if (count == max)
+				break;
+			if (strncmp(fit_get_name(fit, noffset, NULL),
+				    FIT_HASH_NODENAME,
+				    strlen(FIT_HASH_NODENAME)))
+				continue;
+			if (fit_image_hash_get_algo(fit, noffset,
+						    &names[count]))
+				continue;
+			if (IMAGE_ENABLE_IGNORE) {
+				fit_image_hash_get_ignore(fit, noffset,
+							  &ignore);
+				if (ignore)
+					continue;
+			}
+			values[count].noffset = noffset;
+			jobs[count].data = data;
+			jobs[count].size = size;
+			count++;
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		if (!names[i])
+			continue;
+
+		/* Gather the buffers hashed with this algorithm */
+		for (n = 0, j = i; j < count; j++) {
+			if (names[j] && !strcmp(names[j], names[i]))
+				group[n++] = jobs[j];
+		}
+
+		if (hash_lookup_algo(names[i], &algo) ||
+		    hash_multi(algo, group, n, NULL, NULL))
+			algo = NULL;
+
+		for (n = 0, j = i; j < count; j++) {
+			if (!names[j] || strcmp(names[j], names[i]))
+				continue;
+			if (!algo) {
+				/* left to fit_image_check_hash() */
+				values[j].noffset = -1;
+			} else {
+				values[j].value_len = algo->digest_size;
+				memcpy(values[j].value, group[n].digest,
+				       algo->digest_size);
+			}
+			n++;
+			if (j != i)
+				names[j] = NULL;
+		}
+		names[i] = NULL;
+	}
+
+	*valuesp = values;
+	values = NULL;
+out:
+	free(names);
+	free(group);
+	free(jobs);
+	free(values);
+
+	return *valuesp ? count : 0;
+}
+
 /**
  * fit_all_image_verify - verify data intergity for all images
  * @fit: pointer to the FIT format image header
@@ -1066,10 +1196,13 @@ error:
  */
 int fit_all_image_verify(const void *fit)
 {
+	struct fit_hash_value *values;
 	int images_noffset;
 	int noffset;
 	int ndepth;
 	int count;
+	int nvalues;
+	int ret = 1;
 
 	/* Find images parent node offset */
 	images_noffset = fdt_path_offset(fit, FIT_IMAGES_PATH);
@@ -1082,6 +1215,7 @@ int fit_all_image_verify(const void *fit)
 	/* Process all image subnodes, check hashes for each */
 	printf("## Checking hash(es) for FIT Image at %08lx ...\n",
 	       (ulong)fit);
+	nvalues = fit_hash_all_images(fit, images_noffset, &values);
 	for (ndepth = 0, count = 0,
 	     noffset = fdt_next_node(fit, images_noffset, &ndepth);
 			(noffset >= 0) && (ndepth > 0);
@@ -1094,12 +1228,17 @@ int fit_all_image_verify(const void *fit)
 			printf("   Hash(es) for Image %u (%s): ", count++,
 			       fit_get_name(fit, noffset, NULL));
 
-			if (!fit_image_verify(fit, noffset))
-				return 0;
+			if (!fit_image_verify_values(fit, noffset, values,
+						     nvalues)) {
+				ret = 0;
+				break;
+			}
 			printf("\n");
 		}
 	}
-	return 1;
+	free(values);
+
+	return ret;
 }
 
 /**
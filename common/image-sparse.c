@@ -45,14 +45,21 @@
 
 #include <linux/math64.h>
 
+/* Largest write used for FILL chunks */
+#define SPARSE_FILL_BUF_SIZE	(1024 * 1024)
+
 typedef struct sparse_buffer {
 	void	*data;
-	u32	length;
-	u32	repeat;
+	u32	length;		/* bytes of data which can be written at once */
+	u32	size;		/* bytes to write, repeating data as needed */
 	u16	type;
 } sparse_buffer_t;
 
-static uint32_t last_offset;
+/* Pattern buffer for FILL chunks, shared by all of them */
+static void *fill_buf;
+static unsigned int fill_buf_len;	/* size of the buffer */
+static unsigned int fill_buf_fill;	/* bytes holding fill_buf_val */
+static uint32_t fill_buf_val;
 
 static unsigned int sparse_get_chunk_data_size(sparse_header_t *sparse,
 					       chunk_header_t *chunk)
@@ -172,29 +179,55 @@ static int sparse_get_fill_buffer(sparse_header_t *sparse,
 				  unsigned int blk_sz,
 				  void *data)
 {
+	uint32_t fill_val = *(uint32_t *)data;
+	unsigned int len;
 	int i;
 
 	buffer->type = CHUNK_TYPE_FILL;
+	buffer->size = chunk->chunk_sz * sparse->blk_sz;
 
 	/*
-	 * We create a buffer of one block, and ask it to be
-	 * repeated as many times as needed.
+	 * The pattern buffer is kept from one chunk to the next, so
+	 * that it only has to be set up again when the value changes.
 	 */
-	buffer->length = blk_sz;
-	buffer->repeat = (chunk->chunk_sz * sparse->blk_sz) / blk_sz;
+	if (!fill_buf) {
+		fill_buf_len = SPARSE_FILL_BUF_SIZE;
+		fill_buf_len -= fill_buf_len % blk_sz;
+		if (!fill_buf_len)
+			fill_buf_len = blk_sz;
+		fill_buf = memalign(ARCH_DMA_MINALIGN,
+				    ROUNDUP(fill_buf_len, ARCH_DMA_MINALIGN));
+		if (!fill_buf) {
+			/* Fall back to writing one block at a time */
+			fill_buf_len = blk_sz;
+			fill_buf = memalign(ARCH_DMA_MINALIGN,
+					    ROUNDUP(blk_sz, ARCH_DMA_MINALIGN));
+			if (!fill_buf)
+				return -ENOMEM;
+		}
+		fill_buf_fill = 0;
+	}
 
-	buffer->data = memalign(ARCH_DMA_MINALIGN,
-				ROUNDUP(blk_sz,
-					ARCH_DMA_MINALIGN));
-	if (!buffer->data)
-		return -ENOMEM;
+	len = min(fill_buf_len, buffer->size);
+	if (len > fill_buf_fill || fill_val != fill_buf_val) {
+		for (i = 0; i < len / sizeof(uint32_t); i++)
+			((uint32_t *)fill_buf)[i] = fill_val;
+		fill_buf_fill = len;
+		fill_buf_val = fill_val;
+	}
 
-	for (i = 0; i < (buffer->length / sizeof(uint32_t)); i++)
-		((uint32_t *)buffer->data)[i] = *(uint32_t *)(data);
+	buffer->data = fill_buf;
+	buffer->length = len;
 
 	return 0;
 }
 
+static void sparse_free_fill_buffer(void)
+{
+	free(fill_buf);
+	fill_buf = NULL;
+}
+
 static int sparse_get_raw_buffer(sparse_header_t *sparse,
 				 chunk_header_t *chunk,
 				 sparse_buffer_t *buffer,
@@ -206,7 +239,7 @@ static int sparse_get_raw_buffer(sparse_header_t *sparse,
 	buffer->type = CHUNK_TYPE_RAW;
 	buffer->length = chunk_data_sz;
 	buffer->data = data;
-	buffer->repeat = 1;
+	buffer->size = chunk_data_sz;
 
 	return 0;
 }
@@ -235,48 +268,213 @@ static sparse_buffer_t *sparse_get_data_buffer(sparse_header_t *sparse,
 		ret = sparse_get_raw_buffer(sparse, chunk, buffer, blk_sz,
 					    data);
 		if (ret)
-			return NULL;
+			goto err;
 		break;
 
 	case CHUNK_TYPE_FILL:
 		ret = sparse_get_fill_buffer(sparse, chunk, buffer, blk_sz,
 					     data);
 		if (ret)
-			return NULL;
+			goto err;
 		break;
 
 	default:
-		return NULL;
+		goto err;
 	}
 
 	debug("=== Buffer ===\n");
 	debug("length: 0x%x\n", buffer->length);
-	debug("repeat: 0x%x\n", buffer->repeat);
+	debug("size: 0x%x\n", buffer->size);
 	debug("type: 0x%x\n", buffer->type);
 	debug("data: 0x%p\n", buffer->data);
 
 	return buffer;
+
+err:
+	free(buffer);
+	return NULL;
 }
 
 static void sparse_put_data_buffer(sparse_buffer_t *buffer)
 {
-	if (buffer->type == CHUNK_TYPE_FILL)
-		free(buffer->data);
-
 	free(buffer);
 }
 
+/*
+ * Ask the storage to erase blocks, if it can. Returns the number of
+ * blocks erased, which is 0 if the blocks have to be written instead.
+ */
+static unsigned int sparse_erase(sparse_storage_t *storage,
+				 void *storage_priv, unsigned int blk,
+				 unsigned int blkcnt)
+{
+	int ret;
+
+	if (!storage->erase)
+		return 0;
+
+	ret = storage->erase(storage, storage_priv, blk, blkcnt);
+	if (ret < 0)
+		return 0;
+
+	return ret;
+}
+
+static int sparse_is_zero_fill(chunk_header_t *chunk, void *data)
+{
+	return chunk->chunk_type == CHUNK_TYPE_FILL && !*(uint32_t *)data;
+}
+
+/*
+ * Write out a buffer, repeating it as needed. Returns the number of blocks
+ * written, or -ve on error.
+ */
+static int sparse_write_buffer(sparse_storage_t *storage, void *storage_priv,
+			       uint32_t blk, sparse_buffer_t *buffer)
+{
+	unsigned long buffer_blk_cnt;
+	unsigned int done;
+	int ret, count = 0;
+
+	/* Fills are written in pieces as large as the pattern buffer */
+	for (done = 0; done < buffer->size; done += buffer->length) {
+		buffer_blk_cnt = min(buffer->length, buffer->size - done) /
+				 storage->block_sz;
+
+		ret = storage->write(storage, storage_priv, blk + count,
+				     buffer_blk_cnt, buffer->data);
+		if (ret < 0) {
+			printf("%s: Write at block 0x%x failed %d\n",
+			       __func__, blk + count, ret);
+			return ret;
+		}
+
+		count += ret;
+	}
+
+	return count;
+}
+
+/*
+ * Store a FILL chunk, given its 32-bit fill value. Returns the number of
+ * blocks written, or -ve on error.
+ */
+static int sparse_write_fill(sparse_storage_t *storage, void *storage_priv,
+			     sparse_header_t *sparse, chunk_header_t *chunk,
+			     uint32_t blk, void *data, uint32_t *erased)
+{
+	sparse_buffer_t *buffer;
+	uint32_t blkcnt;
+	int ret;
+
+	blkcnt = sparse_block_size_to_storage(chunk->chunk_sz, storage,
+					      sparse);
+
+	/* Zero fills need not be written if erased blocks read 0 */
+	if (storage->erase_zeroes && sparse_is_zero_fill(chunk, data) &&
+	    sparse_erase(storage, storage_priv, blk, blkcnt) == blkcnt) {
+		*erased += blkcnt;
+		return blkcnt;
+	}
+
+	buffer = sparse_get_data_buffer(sparse, chunk, storage->block_sz,
+					&data);
+	if (!buffer)
+		return -ENOMEM;
+
+	ret = sparse_write_buffer(storage, storage_priv, blk, buffer);
+	sparse_put_data_buffer(buffer);
+
+	return ret;
+}
+
+/*
+ * Check that a chunk fits in the storage, and discard the blocks of a
+ * DONT_CARE chunk. Returns 1 if the chunk has been dealt with, 0 if its
+ * data still has to be stored, -ve on error.
+ */
+static int sparse_check_chunk(sparse_storage_t *storage, void *storage_priv,
+			      unsigned int session_id, chunk_header_t *chunk,
+			      uint32_t blk, uint32_t blkcnt)
+{
+	if (chunk->chunk_type == CHUNK_TYPE_CRC32)
+		return 1;
+
+	if ((blk + blkcnt) > (storage->start + storage->size)) {
+		printf("%s: Request would exceed partition size!\n", __func__);
+		return -EINVAL;
+	}
+
+	/*
+	 * The contents of DONT_CARE blocks do not matter, so let the storage
+	 * discard them. Later sessions of a split image skip over the blocks
+	 * written by earlier ones, so only do this in the first session.
+	 */
+	if (chunk->chunk_type == CHUNK_TYPE_DONT_CARE) {
+		if (session_id == 0)
+			sparse_erase(storage, storage_priv, blk, blkcnt);
+		return 1;
+	}
+
+	return 0;
+}
+
+static int sparse_check_header(sparse_header_t *sparse,
+			       sparse_storage_t *storage)
+{
+	unsigned int offset;
+
+	/*
+	 * Verify that the sparse block size is a multiple of our
+	 * storage backend block size
+	 */
+	div_u64_rem(sparse->blk_sz, storage->block_sz, &offset);
+	if (offset) {
+		printf("%s: Sparse image block size issue [%u]\n",
+		       __func__, sparse->blk_sz);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int sparse_check_total(sparse_header_t *sparse,
+			      sparse_storage_t *storage,
+			      uint32_t total_blocks, uint32_t skipped,
+			      uint32_t erased)
+{
+	debug("Wrote %d blocks, skipped %d, expected to write %d blocks\n",
+	      total_blocks, skipped,
+	      sparse_block_size_to_storage(sparse->total_blks, storage,
+					   sparse));
+	printf("........ wrote %d blocks to '%s'", total_blocks,
+	       storage->name);
+	if (erased)
+		printf(", %d of them by erasing", erased);
+	putc('\n');
+
+	if ((total_blocks + skipped) !=
+	    sparse_block_size_to_storage(sparse->total_blks, storage,
+					 sparse)) {
+		printf("sparse image write failure\n");
+		return -EIO;
+	}
+
+	return 0;
+}
+
 int store_sparse_image(sparse_storage_t *storage, void *storage_priv,
 		       unsigned int session_id, void *data)
 {
-	unsigned int chunk, offset;
+	unsigned int chunk;
 	sparse_header_t *sparse_header;
 	chunk_header_t *chunk_header;
 	sparse_buffer_t *buffer;
-	uint32_t start;
+	uint32_t blk;
 	uint32_t total_blocks = 0;
 	uint32_t skipped = 0;
-	int i;
+	uint32_t erased = 0;
+	int ret = 0;
 
 	debug("=== Storage ===\n");
 	debug("name: %s\n", storage->name);
@@ -284,6 +482,7 @@ int store_sparse_image(sparse_storage_t *storage, void *storage_priv,
 	debug("start: 0x%x\n", storage->start);
 	debug("size: 0x%x\n", storage->size);
 	debug("write: 0x%p\n", storage->write);
+	debug("erase: 0x%p\n", storage->erase);
 	debug("priv: 0x%p\n", storage_priv);
 
 	sparse_header = sparse_parse_header(&data);
@@ -292,28 +491,19 @@ int store_sparse_image(sparse_storage_t *storage, void *storage_priv,
 		return -EINVAL;
 	}
 
-	/*
-	 * Verify that the sparse block size is a multiple of our
-	 * storage backend block size
-	 */
-	div_u64_rem(sparse_header->blk_sz, storage->block_sz, &offset);
-	if (offset) {
-		printf("%s: Sparse image block size issue [%u]\n",
-		       __func__, sparse_header->blk_sz);
-		return -EINVAL;
-	}
+	ret = sparse_check_header(sparse_header, storage);
+	if (ret)
+		return ret;
 
 	/*
-	 * If it's a new flashing session, start at the beginning of
-	 * the partition. If not, then simply resume where we were.
+	 * Each part of an image which was split for download covers the
+	 * whole partition, with the blocks of the other parts given as
+	 * DONT_CARE, so every session starts at the beginning.
 	 */
-	if (session_id > 0)
-		start = last_offset;
-	else
-		start = storage->start;
+	blk = storage->start;
 
 	printf("Flashing sparse image on partition %s at offset 0x%x (ID: %d)\n",
-	       storage->name, start * storage->block_sz, session_id);
+	       storage->name, blk * storage->block_sz, session_id);
 
 	/* Start processing chunks */
 	for (chunk = 0; chunk < sparse_header->total_chunks; chunk++) {
@@ -322,72 +512,409 @@ int store_sparse_image(sparse_storage_t *storage, void *storage_priv,
 		chunk_header = sparse_parse_chunk(sparse_header, &data);
 		if (!chunk_header) {
 			printf("Unknown chunk type");
-			return -EINVAL;
+			ret = -EINVAL;
+			goto out;
 		}
 
-		/*
-		 * If we have a DONT_CARE type, just skip the blocks
-		 * and go on parsing the rest of the chunks
-		 */
-		if (chunk_header->chunk_type == CHUNK_TYPE_DONT_CARE) {
-			skipped += sparse_block_size_to_storage(chunk_header->chunk_sz,
-								storage,
-								sparse_header);
+		blkcnt = sparse_block_size_to_storage(chunk_header->chunk_sz,
+						      storage, sparse_header);
+		ret = sparse_check_chunk(storage, storage_priv, session_id,
+					 chunk_header, blk, blkcnt);
+		if (ret < 0)
+			goto out;
+		if (ret) {
+			if (chunk_header->chunk_type == CHUNK_TYPE_DONT_CARE) {
+				skipped += blkcnt;
+				blk += blkcnt;
+			}
+			data += sparse_get_chunk_data_size(sparse_header,
+							   chunk_header);
 			continue;
 		}
 
-		/* Retrieve the buffer we're going to write */
-		buffer = sparse_get_data_buffer(sparse_header, chunk_header,
-						storage->block_sz, &data);
-		if (!buffer)
-			continue;
+		if (chunk_header->chunk_type == CHUNK_TYPE_FILL) {
+			ret = sparse_write_fill(storage, storage_priv,
+						sparse_header, chunk_header,
+						blk, data, &erased);
+			data += sparse_get_chunk_data_size(sparse_header,
+							   chunk_header);
+		} else {
+			/* Retrieve the buffer we're going to write */
+			buffer = sparse_get_data_buffer(sparse_header,
+							chunk_header,
+							storage->block_sz,
+							&data);
+			if (!buffer) {
+				ret = -ENOMEM;
+				goto out;
+			}
+			ret = sparse_write_buffer(storage, storage_priv, blk,
+						  buffer);
+			sparse_put_data_buffer(buffer);
+		}
+		if (ret < 0)
+			goto out;
 
-		blkcnt = (buffer->length / storage->block_sz) * buffer->repeat;
+		total_blocks += ret;
+		blk += ret;
+	}
 
-		if ((start + total_blocks + blkcnt) >
-		    (storage->start + storage->size)) {
-			printf("%s: Request would exceed partition size!\n",
-			       __func__);
-			return -EINVAL;
-		}
+	ret = sparse_check_total(sparse_header, storage, total_blocks,
+				 skipped, erased);
+
+out:
+	sparse_free_fill_buffer();
+	return ret;
+}
 
-		for (i = 0; i < buffer->repeat; i++) {
-			unsigned long buffer_blk_cnt;
-			int ret;
+/* Largest file or chunk header of a sparse image we can stream */
+#define SPARSE_STREAM_HDR_MAX	256
 
-			buffer_blk_cnt = buffer->length / storage->block_sz;
+/* States of a sparse_stream */
+enum {
+	SPARSE_STREAM_HEADER,	/* reading the file header */
+	SPARSE_STREAM_CHUNK,	/* reading a chunk header */
+	SPARSE_STREAM_DATA,	/* reading the data of a chunk */
+	SPARSE_STREAM_RAW,	/* not a sparse image, writing it as it is */
+	SPARSE_STREAM_DONE,	/* all chunks seen */
+};
 
-			ret = storage->write(storage, storage_priv,
-					     start + total_blocks,
-					     buffer_blk_cnt,
-					     buffer->data);
-			if (ret < 0) {
-				printf("%s: Write %d failed %d\n",
-				       __func__, i, ret);
-				return ret;
-			}
+/*
+ * Collect data in the stream's partial buffer until it holds @want bytes.
+ * Returns 1 once it does, 0 if more data is needed.
+ */
+static int sparse_stream_collect(struct sparse_stream *ss, void **data,
+				 unsigned int *len, unsigned int want)
+{
+	unsigned int n = min(want - ss->partial_len, *len);
 
-			total_blocks += ret;
-		}
+	memcpy(ss->partial + ss->partial_len, *data, n);
+	ss->partial_len += n;
+	*data += n;
+	*len -= n;
+
+	return ss->partial_len == want;
+}
+
+static void sparse_stream_skip(struct sparse_stream *ss, void **data,
+			       unsigned int *len, unsigned int *left)
+{
+	unsigned int n = min(*left, *len);
+
+	*data += n;
+	*len -= n;
+	*left -= n;
+}
+
+static int sparse_stream_write(struct sparse_stream *ss, void *buf,
+			       uint32_t blkcnt)
+{
+	sparse_storage_t *storage = ss->storage;
+	int ret;
 
-		sparse_put_data_buffer(buffer);
+	if ((ss->blk + blkcnt) > (storage->start + storage->size)) {
+		printf("%s: Request would exceed partition size!\n", __func__);
+		return -EINVAL;
 	}
 
-	debug("Wrote %d blocks, skipped %d, expected to write %d blocks\n",
-	      total_blocks, skipped,
-	      sparse_block_size_to_storage(sparse_header->total_blks,
-					   storage, sparse_header));
-	printf("........ wrote %d blocks to '%s'\n", total_blocks,
-	       storage->name);
+	ret = storage->write(storage, ss->priv, ss->blk, blkcnt, buf);
+	if (ret < 0)
+		return ret;
 
-	if ((total_blocks + skipped) !=
-	    sparse_block_size_to_storage(sparse_header->total_blks,
-					 storage, sparse_header)) {
-		printf("sparse image write failure\n");
-		return -EIO;
+	ss->blk += ret;
+	ss->total_blocks += ret;
+
+	return 0;
+}
+
+/*
+ * Store data which goes straight to the storage: that of a RAW chunk, or
+ * the whole of an image which is not sparse. Whole blocks are written from
+ * where they are, the start of a block is kept until the rest comes.
+ */
+static int sparse_stream_data(struct sparse_stream *ss, void **data,
+			      unsigned int *len)
+{
+	unsigned int blk_sz = ss->storage->block_sz;
+	unsigned int n;
+	int ret;
+
+	if (ss->partial_len) {
+		n = min(*len, ss->chunk_left);
+		n = min(blk_sz, ss->partial_len + n);
+		ss->chunk_left -= n - ss->partial_len;
+		sparse_stream_collect(ss, data, len, n);
+		if (n < blk_sz)
+			return 0;
+		ret = sparse_stream_write(ss, ss->partial, 1);
+		if (ret)
+			return ret;
+		ss->partial_len = 0;
+	}
+
+	n = min(*len, ss->chunk_left);
+	if (n >= blk_sz) {
+		ret = sparse_stream_write(ss, *data, n / blk_sz);
+		if (ret)
+			return ret;
+		n -= n % blk_sz;
+		*data += n;
+		*len -= n;
+		ss->chunk_left -= n;
+	}
+
+	n = min(*len, ss->chunk_left);
+	if (n) {
+		ss->chunk_left -= n;
+		sparse_stream_collect(ss, data, len, n);
+	}
+
+	/* RAW chunks always end on a block boundary */
+	if (ss->state == SPARSE_STREAM_DATA && !ss->chunk_left)
+		ss->state = SPARSE_STREAM_CHUNK;
+
+	return 0;
+}
+
+static int sparse_stream_header(struct sparse_stream *ss)
+{
+	sparse_header_t *sparse = &ss->header;
+	int ret;
+
+	memcpy(sparse, ss->partial, sizeof(*sparse));
+
+	if (!is_sparse_image(sparse)) {
+		/* What we have is the start of the first block */
+		ss->state = SPARSE_STREAM_RAW;
+		ss->chunk_left = UINT_MAX;
+		return 0;
+	}
+	ss->partial_len = 0;
+
+	if (sparse->file_hdr_sz < sizeof(*sparse) ||
+	    sparse->file_hdr_sz > SPARSE_STREAM_HDR_MAX ||
+	    sparse->chunk_hdr_sz < sizeof(chunk_header_t) ||
+	    sparse->chunk_hdr_sz > SPARSE_STREAM_HDR_MAX) {
+		printf("sparse header issue\n");
+		return -EINVAL;
+	}
+
+	ret = sparse_check_header(sparse, ss->storage);
+	if (ret)
+		return ret;
+
+	printf("Flashing sparse image on partition %s at offset 0x%x (ID: %d)\n",
+	       ss->storage->name, ss->blk * ss->storage->block_sz,
+	       ss->session_id);
+
+	ss->skip = sparse->file_hdr_sz - sizeof(*sparse);
+	ss->chunks_left = sparse->total_chunks;
+	ss->state = SPARSE_STREAM_CHUNK;
+
+	return 0;
+}
+
+static int sparse_stream_chunk(struct sparse_stream *ss)
+{
+	sparse_header_t *sparse = &ss->header;
+	chunk_header_t *chunk = &ss->chunk;
+	uint32_t blkcnt;
+	int ret;
+
+	memcpy(chunk, ss->partial, sizeof(*chunk));
+	ss->partial_len = 0;
+
+	switch (chunk->chunk_type) {
+	case CHUNK_TYPE_RAW:
+		ret = sparse_parse_raw_chunk(sparse, chunk);
+		break;
+	case CHUNK_TYPE_FILL:
+		ret = sparse_parse_fill_chunk(sparse, chunk);
+		break;
+	case CHUNK_TYPE_DONT_CARE:
+	case CHUNK_TYPE_CRC32:
+		ret = 0;
+		break;
+	default:
+		printf("%s: Unknown chunk type: %x\n", __func__,
+		       chunk->chunk_type);
+		ret = -EINVAL;
+	}
+	if (ret)
+		return ret;
+
+	blkcnt = sparse_block_size_to_storage(chunk->chunk_sz, ss->storage,
+					      sparse);
+	ret = sparse_check_chunk(ss->storage, ss->priv, ss->session_id, chunk,
+				 ss->blk, blkcnt);
+	if (ret < 0)
+		return ret;
+
+	if (chunk->chunk_type == CHUNK_TYPE_DONT_CARE) {
+		ss->skipped += blkcnt;
+		ss->blk += blkcnt;
 	}
 
-	last_offset = start + total_blocks;
+	ss->chunks_left--;
+	ss->chunk_left = sparse_get_chunk_data_size(sparse, chunk);
+	if (ss->chunk_left)
+		ss->state = SPARSE_STREAM_DATA;
 
 	return 0;
 }
+
+static int sparse_stream_fill(struct sparse_stream *ss)
+{
+	int ret;
+
+	ret = sparse_write_fill(ss->storage, ss->priv, &ss->header, &ss->chunk,
+				ss->blk, ss->partial, &ss->erased);
+	if (ret < 0)
+		return ret;
+
+	ss->blk += ret;
+	ss->total_blocks += ret;
+	ss->partial_len = 0;
+	ss->chunk_left = 0;
+	ss->state = SPARSE_STREAM_CHUNK;
+
+	return 0;
+}
+
+int sparse_stream_start(struct sparse_stream *ss, sparse_storage_t *storage,
+			void *storage_priv, unsigned int session_id)
+{
+	unsigned int size;
+
+	memset(ss, 0, sizeof(*ss));
+	ss->storage = storage;
+	ss->priv = storage_priv;
+	ss->session_id = session_id;
+	ss->state = SPARSE_STREAM_HEADER;
+
+	/*
+	 * As with store_sparse_image(), each session starts at the
+	 * beginning of the partition.
+	 */
+	ss->blk = storage->start;
+
+	size = max_t(unsigned int, storage->block_sz, SPARSE_STREAM_HDR_MAX);
+	ss->partial = memalign(ARCH_DMA_MINALIGN,
+			       ROUNDUP(size, ARCH_DMA_MINALIGN));
+	if (!ss->partial)
+		return -ENOMEM;
+
+	return 0;
+}
+
+int sparse_stream_feed(struct sparse_stream *ss, void *data, unsigned int len)
+{
+	int ret = 0;
+
+	if (ss->err)
+		return ss->err;
+
+	while (len && !ret) {
+		switch (ss->state) {
+		case SPARSE_STREAM_HEADER:
+			if (sparse_stream_collect(ss, &data, &len,
+						  sizeof(sparse_header_t)))
+				ret = sparse_stream_header(ss);
+			break;
+
+		case SPARSE_STREAM_CHUNK:
+			if (ss->skip)
+				sparse_stream_skip(ss, &data, &len, &ss->skip);
+			else if (!ss->chunks_left)
+				ss->state = SPARSE_STREAM_DONE;
+			else if (sparse_stream_collect(ss, &data, &len,
+						ss->header.chunk_hdr_sz))
+				ret = sparse_stream_chunk(ss);
+			break;
+
+		case SPARSE_STREAM_DATA:
+			if (ss->chunk.chunk_type == CHUNK_TYPE_RAW) {
+				ret = sparse_stream_data(ss, &data, &len);
+			} else if (ss->chunk.chunk_type == CHUNK_TYPE_FILL) {
+				/* The fill value */
+				if (sparse_stream_collect(ss, &data, &len,
+							  ss->chunk_left))
+					ret = sparse_stream_fill(ss);
+			} else {
+				sparse_stream_skip(ss, &data, &len,
+						   &ss->chunk_left);
+				if (!ss->chunk_left)
+					ss->state = SPARSE_STREAM_CHUNK;
+			}
+			break;
+
+		case SPARSE_STREAM_RAW:
+			ret = sparse_stream_data(ss, &data, &len);
+			break;
+
+		case SPARSE_STREAM_DONE:
+			/* Ignore anything after the last chunk */
+			len = 0;
+			break;
+		}
+	}
+
+	ss->err = ret;
+
+	return ret;
+}
+
+int sparse_stream_finish(struct sparse_stream *ss)
+{
+	sparse_storage_t *storage = ss->storage;
+	int ret = ss->err;
+
+	if (ret)
+		goto out;
+
+	switch (ss->state) {
+	case SPARSE_STREAM_HEADER:
+		/* A raw image smaller than a sparse header */
+		if (!ss->partial_len)
+			goto truncated;
+		/* fall through */
+	case SPARSE_STREAM_RAW:
+		/* Pad the last block */
+		if (ss->partial_len) {
+			memset(ss->partial + ss->partial_len, 0,
+			       storage->block_sz - ss->partial_len);
+			ret = sparse_stream_write(ss, ss->partial, 1);
+			if (ret)
+				goto out;
+		}
+		printf("........ wrote %d blocks to '%s'\n", ss->total_blocks,
+		       storage->name);
+		break;
+
+	case SPARSE_STREAM_CHUNK:
+		if (ss->chunks_left || ss->skip)
+			goto truncated;
+		/* fall through */
+	case SPARSE_STREAM_DONE:
+		ret = sparse_check_total(&ss->header, storage,
+					 ss->total_blocks, ss->skipped,
+					 ss->erased);
+		break;
+
+	default:
+truncated:
+		printf("%s: Image is truncated\n", __func__);
+		ret = -EINVAL;
+	}
+
+out:
+	sparse_stream_abort(ss);
+	return ret;
+}
+
+void sparse_stream_abort(struct sparse_stream *ss)
+{
+	free(ss->partial);
+	ss->partial = NULL;
+	sparse_free_fill_buffer();
+}
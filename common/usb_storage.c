@@ -34,6 +34,7 @@
 
 
 #include <common.h>
+#include <blkcache.h>
 #include <command.h>
 #include <dm.h>
 #include <errno.h>
@@ -191,6 +192,7 @@ static int usb_stor_probe_device(struct usb_device *dev)
 			struct block_dev_desc *blkdev;
 
 			blkdev = &usb_dev_desc[usb_max_devs];
+			blkcache_invalidate(IF_TYPE_USB, usb_max_devs);
 			memset(blkdev, '\0', sizeof(block_dev_desc_t));
 			blkdev->if_type = IF_TYPE_USB;
 			blkdev->dev = usb_max_devs;
@@ -1051,6 +1053,10 @@ unsigned long usb_stor_read(int device, lbaint_t blknr,
 	}
 	ss = (struct us_data *)dev->privptr;
 
+	if (blkcache_read(IF_TYPE_USB, device, blknr, blkcnt,
+			  usb_dev_desc[device].blksz, buffer))
+		return blkcnt;
+
 	usb_disable_asynch(1); /* asynch transfer not allowed */
 	srb->lun = usb_dev_desc[device].lun;
 	buf_addr = (uintptr_t)buffer;
@@ -1092,6 +1098,9 @@ retry_it:
 	      start, smallblks, buf_addr);
 
 	usb_disable_asynch(0); /* asynch transfer allowed */
+	if (!blks)
+		blkcache_fill(IF_TYPE_USB, device, blknr, blkcnt,
+			      usb_dev_desc[device].blksz, buffer);
 	if (blkcnt >= USB_MAX_XFER_BLK)
 		debug("\n");
 	return blkcnt;
@@ -1162,6 +1171,12 @@ retry_it:
 	      PRIxPTR "\n", start, smallblks, buf_addr);
 
 	usb_disable_asynch(0); /* asynch transfer allowed */
+	/* After an error some of the failed blocks may have been written */
+	if (blks)
+		blkcache_invalidate(IF_TYPE_USB, device);
+	else
+		blkcache_write(IF_TYPE_USB, device, blknr, blkcnt,
+			       usb_dev_desc[device].blksz, buffer);
 	if (blkcnt >= USB_MAX_XFER_BLK)
 		debug("\n");
 	return blkcnt;
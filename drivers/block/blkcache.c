@@ -0,0 +1,257 @@
+/*
+ * Read cache for block devices
+ *
+ * Small reads, as done for partition tables, superblocks, FAT sectors and
+ * other filesystem metadata, are kept in a list of ranges of blocks in
+ * least recently used order. Writes update the cached blocks, so the
+ * cache never has to be flushed to the device.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <blkcache.h>
+#include <malloc.h>
+#include <part.h>
+#include <linux/list.h>
+#include <asm/errno.h>
+
+struct block_cache_node {
+	struct list_head lh;		/* In LRU order, most recent first */
+	struct blkcache_dev_stats *ds;	/* Statistics of the device */
+	int if_type;
+	int dev;
+	lbaint_t start;
+	lbaint_t blkcnt;
+	unsigned long blksz;
+	char *cache;
+};
+
+struct blkcache_dev {
+	struct list_head lh;
+	struct blkcache_dev_stats stats;
+};
+
+static LIST_HEAD(block_cache);
+static LIST_HEAD(blkcache_devs);
+
+static struct blkcache_stats _stats = {
+	.max_blocks = CONFIG_BLOCK_CACHE_MAX_BLOCKS,
+	.max_entries = CONFIG_BLOCK_CACHE_ENTRIES,
+};
+
+/* Find the statistics of a device, adding them if needed */
+static struct blkcache_dev_stats *get_dev_stats(int if_type, int dev)
+{
+	struct blkcache_dev *bd;
+
+	list_for_each_entry(bd, &blkcache_devs, lh) {
+		if (bd->stats.if_type == if_type && bd->stats.dev == dev)
+			return &bd->stats;
+	}
+
+	bd = calloc(1, sizeof(*bd));
+	if (!bd)
+		return NULL;
+	bd->stats.if_type = if_type;
+	bd->stats.dev = dev;
+	list_add_tail(&bd->lh, &blkcache_devs);
+
+	return &bd->stats;
+}
+
+static void remove_node(struct block_cache_node *node)
+{
+	list_del(&node->lh);
+	if (node->ds)
+		node->ds->entries--;
+	_stats.entries--;
+	free(node->cache);
+	free(node);
+}
+
+/* Find the node holding all of the given blocks */
+static struct block_cache_node *cache_find(int if_type, int dev,
+					   lbaint_t start, lbaint_t blkcnt,
+					   unsigned long blksz)
+{
+	struct block_cache_node *node;
+
+	list_for_each_entry(node, &block_cache, lh) {
+		if (node->if_type == if_type && node->dev == dev &&
+		    node->blksz == blksz && node->start <= start &&
+		    node->start + node->blkcnt >= start + blkcnt) {
+			/* Move to the front of the LRU list */
+			if (&node->lh != block_cache.next)
+				list_move(&node->lh, &block_cache);
+			return node;
+		}
+	}
+
+	return NULL;
+}
+
+int blkcache_read(int if_type, int dev, lbaint_t start, lbaint_t blkcnt,
+		  unsigned long blksz, void *buffer)
+{
+	struct blkcache_dev_stats *ds;
+	struct block_cache_node *node;
+
+	if (blkcnt > _stats.max_blocks)
+		return 0;
+
+	node = cache_find(if_type, dev, start, blkcnt, blksz);
+	if (node) {
+		memcpy(buffer, node->cache + (start - node->start) * blksz,
+		       blkcnt * blksz);
+		debug("hit: start " LBAF ", count " LBAF "\n", start, blkcnt);
+		_stats.hits++;
+		node->ds->hits++;
+		return 1;
+	}
+
+	debug("miss: start " LBAF ", count " LBAF "\n", start, blkcnt);
+	_stats.misses++;
+	ds = get_dev_stats(if_type, dev);
+	if (ds)
+		ds->misses++;
+
+	return 0;
+}
+
+void blkcache_fill(int if_type, int dev, lbaint_t start, lbaint_t blkcnt,
+		   unsigned long blksz, const void *buffer)
+{
+	struct block_cache_node *node;
+	struct blkcache_dev_stats *ds;
+	size_t bytes = blkcnt * blksz;
+
+	if (!blkcnt || blkcnt > _stats.max_blocks || !_stats.max_entries)
+		return;
+
+	ds = get_dev_stats(if_type, dev);
+	if (!ds)
+		return;
+
+	/* Reuse the least recently used node if the cache is full */
+	if (_stats.entries >= _stats.max_entries) {
+		node = list_entry(block_cache.prev, struct block_cache_node,
+				  lh);
+		list_del(&node->lh);
+		node->ds->entries--;
+		_stats.entries--;
+		debug("drop: start " LBAF ", count " LBAF "\n", node->start,
+		      node->blkcnt);
+		if (node->blkcnt * node->blksz < bytes) {
+			free(node->cache);
+			node->cache = NULL;
+		}
+	} else {
+		node = calloc(1, sizeof(*node));
+		if (!node)
+			return;
+	}
+
+	if (!node->cache) {
+		node->cache = malloc(bytes);
+		if (!node->cache) {
+			free(node);
+			return;
+		}
+	}
+
+	debug("fill: start " LBAF ", count " LBAF "\n", start, blkcnt);
+	node->ds = ds;
+	node->if_type = if_type;
+	node->dev = dev;
+	node->start = start;
+	node->blkcnt = blkcnt;
+	node->blksz = blksz;
+	memcpy(node->cache, buffer, bytes);
+	list_add(&node->lh, &block_cache);
+	ds->entries++;
+	_stats.entries++;
+}
+
+void blkcache_write(int if_type, int dev, lbaint_t start, lbaint_t blkcnt,
+		    unsigned long blksz, const void *buffer)
+{
+	struct block_cache_node *node, *tmp;
+	lbaint_t first, last;
+
+	list_for_each_entry_safe(node, tmp, &block_cache, lh) {
+		if (node->if_type != if_type || node->dev != dev ||
+		    node->start >= start + blkcnt ||
+		    node->start + node->blkcnt <= start)
+			continue;
+		if (node->blksz != blksz) {
+			remove_node(node);
+			continue;
+		}
+
+		/* Copy the blocks which both ranges have in common */
+		first = max(node->start, start);
+		last = min(node->start + node->blkcnt, start + blkcnt);
+		memcpy(node->cache + (first - node->start) * blksz,
+		       buffer + (first - start) * blksz,
+		       (last - first) * blksz);
+		node->ds->writes++;
+	}
+}
+
+void blkcache_invalidate(int if_type, int dev)
+{
+	struct block_cache_node *node, *tmp;
+
+	list_for_each_entry_safe(node, tmp, &block_cache, lh) {
+		if (node->if_type == if_type && node->dev == dev)
+			remove_node(node);
+	}
+}
+
+void blkcache_invalidate_all(void)
+{
+	struct block_cache_node *node, *tmp;
+
+	list_for_each_entry_safe(node, tmp, &block_cache, lh)
+		remove_node(node);
+}
+
+void blkcache_configure(unsigned max_blocks, unsigned max_entries)
+{
+	blkcache_invalidate_all();
+	_stats.max_blocks = max_blocks;
+	_stats.max_entries = max_entries;
+}
+
+void blkcache_get_stats(struct blkcache_stats *stats)
+{
+	*stats = _stats;
+}
+
+int blkcache_get_dev_stats(int index, struct blkcache_dev_stats *stats)
+{
+	struct blkcache_dev *bd;
+
+	list_for_each_entry(bd, &blkcache_devs, lh) {
+		if (!index--) {
+			*stats = bd->stats;
+			return 0;
+		}
+	}
+
+	return -ENOENT;
+}
+
+void blkcache_reset_stats(void)
+{
+	struct blkcache_dev *bd;
+
+	_stats.hits = 0;
+	_stats.misses = 0;
+	list_for_each_entry(bd, &blkcache_devs, lh) {
+		bd->stats.hits = 0;
+		bd->stats.misses = 0;
+		bd->stats.writes = 0;
+	}
+}
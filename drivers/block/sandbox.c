@@ -6,6 +6,7 @@
 
 #include <config.h>
 #include <common.h>
+#include <blkcache.h>
 #include <part.h>
 #include <os.h>
 #include <malloc.h>
@@ -29,6 +30,9 @@ static unsigned long host_block_read(int dev, unsigned long start,
 
 	if (!host_dev)
 		return -1;
+	if (blkcache_read(IF_TYPE_HOST, dev, start, blkcnt,
+			  host_dev->blk_dev.blksz, buffer))
+		return blkcnt;
 	if (os_lseek(host_dev->fd,
 		     start * host_dev->blk_dev.blksz,
 		     OS_SEEK_SET) == -1) {
@@ -37,8 +41,13 @@ static unsigned long host_block_read(int dev, unsigned long start,
 	}
 	ssize_t len = os_read(host_dev->fd, buffer,
 			      blkcnt * host_dev->blk_dev.blksz);
-	if (len >= 0)
-		return len / host_dev->blk_dev.blksz;
+	if (len >= 0) {
+		len /= host_dev->blk_dev.blksz;
+		if (len == blkcnt)
+			blkcache_fill(IF_TYPE_HOST, dev, start, blkcnt,
+				      host_dev->blk_dev.blksz, buffer);
+		return len;
+	}
 	return -1;
 }
 
@@ -54,8 +63,13 @@ static unsigned long host_block_write(int dev, unsigned long start,
 	}
 	ssize_t len = os_write(host_dev->fd, buffer, blkcnt *
 			       host_dev->blk_dev.blksz);
-	if (len >= 0)
-		return len / host_dev->blk_dev.blksz;
+	if (len >= 0) {
+		len /= host_dev->blk_dev.blksz;
+		blkcache_write(IF_TYPE_HOST, dev, start, len,
+			       host_dev->blk_dev.blksz, buffer);
+		return len;
+	}
+	blkcache_invalidate(IF_TYPE_HOST, dev);
 	return -1;
 }
 
@@ -65,6 +79,7 @@ int host_dev_bind(int dev, char *filename)
 
 	if (!host_dev)
 		return -1;
+	blkcache_invalidate(IF_TYPE_HOST, dev);
 	if (host_dev->blk_dev.priv) {
 		os_close(host_dev->fd);
 		host_dev->blk_dev.priv = NULL;
@@ -14,6 +14,7 @@
 #include <fat.h>
 #include <dfu.h>
 #include <hash.h>
+#include <div64.h>
 #include <linux/list.h>
 #include <linux/compiler.h>
 
@@ -78,8 +79,26 @@ int dfu_init_env_entities(char *interface, char *devstr)
 static unsigned char *dfu_buf;
 static unsigned long dfu_buf_size;
 
+/*
+ * Background writing: a full buffer is handed over to be written in pieces
+ * by dfu_background_write() while data for the next one is received into
+ * the second buffer.
+ */
+static bool dfu_bg_enabled;
+static unsigned char *dfu_bg_buf;	/* second buffer */
+static struct dfu_entity *dfu_bg_dfu;	/* entity with data to write */
+static u8 *dfu_bg_pos;			/* data left to write */
+static u8 *dfu_bg_end;
+static int dfu_bg_err;			/* error to report */
+
+static int dfu_bg_write_all(void);
+
 unsigned char *dfu_free_buf(void)
 {
+	dfu_bg_write_all();
+	dfu_bg_err = 0;
+	free(dfu_bg_buf);
+	dfu_bg_buf = NULL;
 	free(dfu_buf);
 	dfu_buf = NULL;
 	return dfu_buf;
@@ -108,13 +127,28 @@ unsigned char *dfu_get_buf(struct dfu_entity *dfu)
 		dfu_buf_size = dfu->max_buf_size;
 
 	dfu_buf = memalign(CONFIG_SYS_CACHELINE_SIZE, dfu_buf_size);
-	if (dfu_buf == NULL)
+	if (dfu_buf == NULL) {
 		printf("%s: Could not memalign 0x%lx bytes\n",
 		       __func__, dfu_buf_size);
+		return NULL;
+	}
+
+	if (dfu_bg_enabled) {
+		dfu_bg_buf = memalign(CONFIG_SYS_CACHELINE_SIZE, dfu_buf_size);
+		if (!dfu_bg_buf)
+			printf("%s: No second buffer, writing in foreground\n",
+			       __func__);
+	}
 
 	return dfu_buf;
 }
 
+void dfu_set_background_write(bool enable)
+{
+	dfu_free_buf();
+	dfu_bg_enabled = enable;
+}
+
 static char *dfu_get_hash_algo(void)
 {
 	char *s;
@@ -132,6 +166,68 @@ static char *dfu_get_hash_algo(void)
 	return NULL;
 }
 
+static int dfu_write_medium(struct dfu_entity *dfu, void *buf, long len)
+{
+	ulong start = get_timer(0);
+	int ret;
+
+	ret = dfu->write_medium(dfu, dfu->offset, buf, &len);
+	if (ret)
+		debug("%s: Write error!\n", __func__);
+
+	/* update offset */
+	dfu->offset += len;
+
+	dfu->write_ms += get_timer(start);
+	dfu->write_bytes += len;
+
+	return ret;
+}
+
+/* Write the next piece of the data handed over for background writing */
+static int dfu_bg_write_step(void)
+{
+	struct dfu_entity *dfu = dfu_bg_dfu;
+	long len;
+	int ret;
+
+	if (!dfu)
+		return 0;
+
+	len = dfu_bg_end - dfu_bg_pos;
+	if (dfu->max_write_size && len > dfu->max_write_size)
+		len = dfu->max_write_size;
+
+	ret = dfu_write_medium(dfu, dfu_bg_pos, len);
+	dfu_bg_pos += len;
+	if (ret || dfu_bg_pos >= dfu_bg_end) {
+		dfu_bg_dfu = NULL;
+		puts("#");
+	}
+	if (ret && !dfu_bg_err)
+		dfu_bg_err = ret;
+
+	return ret;
+}
+
+static int dfu_bg_write_all(void)
+{
+	int ret;
+
+	while (dfu_bg_dfu)
+		dfu_bg_write_step();
+
+	ret = dfu_bg_err;
+	dfu_bg_err = 0;
+
+	return ret;
+}
+
+int dfu_background_write(void)
+{
+	return dfu_bg_write_step();
+}
+
 static int dfu_write_buffer_drain(struct dfu_entity *dfu)
 {
 	long w_size;
@@ -146,23 +242,60 @@ static int dfu_write_buffer_drain(struct dfu_entity *dfu)
 		dfu_hash_algo->hash_update(dfu_hash_algo, &dfu->crc,
 					   dfu->i_buf_start, w_size, 0);
 
-	ret = dfu->write_medium(dfu, dfu->offset, dfu->i_buf_start, &w_size);
-	if (ret)
-		debug("%s: Write error!\n", __func__);
+	if (dfu_bg_buf) {
+		/* the previous buffer must be written before it is reused */
+		ret = dfu_bg_write_all();
+		if (ret)
+			return ret;
+
+		dfu_bg_dfu = dfu;
+		dfu_bg_pos = dfu->i_buf_start;
+		dfu_bg_end = dfu->i_buf;
+
+		/* fill the other buffer meanwhile */
+		dfu->i_buf_start = dfu->i_buf_start == dfu_buf ? dfu_bg_buf :
+				   dfu_buf;
+		dfu->i_buf_end = dfu->i_buf_start + dfu_buf_size;
+		dfu->i_buf = dfu->i_buf_start;
+
+		return 0;
+	}
+
+	ret = dfu_write_medium(dfu, dfu->i_buf_start, w_size);
 
 	/* point back */
 	dfu->i_buf = dfu->i_buf_start;
 
-	/* update offset */
-	dfu->offset += w_size;
-
 	puts("#");
 
 	return ret;
 }
 
+static void dfu_show_rate(const char *what, u64 bytes, ulong ms)
+{
+	printf(", %s in %lu ms", what, ms);
+	if (ms) {
+		puts(" (");
+		print_size(lldiv(bytes * 1000, ms), "/s)");
+	}
+}
+
+static void dfu_show_stats(struct dfu_entity *dfu)
+{
+	printf("\nDFU %s: ", dfu->name);
+	print_size(dfu->rx_bytes, "");
+	dfu_show_rate("received", dfu->rx_bytes, dfu->rx_ms);
+	dfu_show_rate("written", dfu->write_bytes, dfu->write_ms);
+	puts("\n");
+}
+
 void dfu_write_transaction_cleanup(struct dfu_entity *dfu)
 {
+	/* data handed over for writing is dropped as well */
+	if (dfu_bg_dfu == dfu)
+		dfu_bg_dfu = NULL;
+	dfu_bg_err = 0;
+
 	/* clear everything */
 	dfu->crc = 0;
 	dfu->offset = 0;
@@ -177,16 +310,27 @@ int dfu_flush(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 {
 	int ret = 0;
 
+	dfu->rx_ms = get_timer(dfu->rx_start);
+
 	ret = dfu_write_buffer_drain(dfu);
-	if (ret)
+	if (!ret)
+		ret = dfu_bg_write_all();
+	if (ret) {
+		dfu_write_transaction_cleanup(dfu);
 		return ret;
+	}
+
+	if (dfu->flush_medium) {
+		ulong start = get_timer(0);
 
-	if (dfu->flush_medium)
 		ret = dfu->flush_medium(dfu);
+		dfu->write_ms += get_timer(start);
+	}
 
 	if (dfu_hash_algo)
 		printf("\nDFU complete %s: 0x%08x\n", dfu_hash_algo->name,
 		       dfu->crc);
+	dfu_show_stats(dfu);
 
 	dfu_write_transaction_cleanup(dfu);
 
@@ -213,6 +357,11 @@ int dfu_write(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 		dfu->i_buf_end = dfu_get_buf(dfu) + dfu_buf_size;
 		dfu->i_buf = dfu->i_buf_start;
 
+		dfu->rx_start = get_timer(0);
+		dfu->rx_bytes = 0;
+		dfu->write_bytes = 0;
+		dfu->write_ms = 0;
+
 		dfu->inited = 1;
 	}
 
@@ -223,6 +372,13 @@ int dfu_write(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 		return -1;
 	}
 
+	/* a background write failed */
+	if (dfu_bg_err) {
+		ret = dfu_bg_err;
+		dfu_write_transaction_cleanup(dfu);
+		return ret;
+	}
+
 	/* DFU 1.1 standard says:
 	 * The wBlockNum field is a block sequence number. It increments each
 	 * time a block is transferred, wrapping to zero from 65,535. It is used
@@ -258,6 +414,7 @@ int dfu_write(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 
 	memcpy(dfu->i_buf, buf, size);
 	dfu->i_buf += size;
+	dfu->rx_bytes += size;
 
 	/* if end or if buffer full flush */
 	if (size == 0 || (dfu->i_buf + size) > dfu->i_buf_end) {
@@ -331,6 +488,9 @@ int dfu_read(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 	       __func__, dfu->name, buf, size, blk_seq_num, dfu->i_buf);
 
 	if (!dfu->inited) {
+		/* finish any write before the buffers are reused */
+		dfu_bg_write_all();
+
 		dfu->i_buf_start = dfu_get_buf(dfu);
 		if (dfu->i_buf_start == NULL)
 			return -ENOMEM;
@@ -400,6 +560,7 @@ static int dfu_fill_entity(struct dfu_entity *dfu, char *s, int alt,
 
 	dfu->alt = alt;
 	dfu->max_buf_size = 0;
+	dfu->max_write_size = 0;
 	dfu->free_entity = NULL;
 
 	/* Specific for mmc device */
@@ -17,6 +17,9 @@
 #include <mmc.h>
 
 static unsigned char *dfu_file_buf;
+/* Piece of a full buffer written at a time in the background */
+#define DFU_MMC_BG_WRITE_SIZE	(256 * 1024)
+
 static long dfu_file_buf_len;
 static long dfu_file_buf_filled;
 
@@ -81,8 +84,9 @@ static int mmc_block_op(enum dfu_op op, struct dfu_entity *dfu,
 					      blk_count, buf);
 		break;
 	case DFU_OP_WRITE:
-		n = mmc->block_dev.block_write(dfu->data.mmc.dev_num, blk_start,
-					       blk_count, buf);
+		/* dfu_flush_medium_mmc() writes back the cache at the end */
+		n = mmc_bwrite_cached(dfu->data.mmc.dev_num, blk_start,
+				      blk_count, buf);
 		break;
 	default:
 		error("Operation not supported\n");
@@ -207,9 +211,14 @@ int dfu_write_medium_mmc(struct dfu_entity *dfu,
 
 int dfu_flush_medium_mmc(struct dfu_entity *dfu)
 {
+	struct mmc *mmc;
 	int ret = 0;
 
-	if (dfu->layout != DFU_RAW_ADDR) {
+	if (dfu->layout == DFU_RAW_ADDR) {
+		mmc = find_mmc_device(dfu->data.mmc.dev_num);
+		if (mmc)
+			ret = mmc_flush_cache(mmc);
+	} else {
 		/* Do stuff here. */
 		ret = mmc_file_op(DFU_OP_WRITE, dfu, dfu_file_buf,
 				&dfu_file_buf_len);
@@ -355,6 +364,7 @@ int dfu_fill_entity_mmc(struct dfu_entity *dfu, char *devstr, char *s)
 		dfu->data.mmc.lba_start		= second_arg;
 		dfu->data.mmc.lba_size		= third_arg;
 		dfu->data.mmc.lba_blk_size	= mmc->read_bl_len;
+		dfu->max_write_size		= DFU_MMC_BG_WRITE_SIZE;
 
 		/*
 		 * Check for an extra entry at dfu_alt_info env variable
@@ -381,6 +391,7 @@ int dfu_fill_entity_mmc(struct dfu_entity *dfu, char *devstr, char *s)
 		dfu->data.mmc.lba_start		= partinfo.start;
 		dfu->data.mmc.lba_size		= partinfo.size;
 		dfu->data.mmc.lba_blk_size	= partinfo.blksz;
+		dfu->max_write_size		= DFU_MMC_BG_WRITE_SIZE;
 	} else if (!strcmp(entity_type, "fat")) {
 		dfu->layout = DFU_FS_FAT;
 	} else if (!strcmp(entity_type, "ext4")) {
@@ -407,6 +407,42 @@ static void dwmci_set_ios(struct mmc *mmc)
 		host->clksel(host);
 }
 
+static int dwmci_set_signal_voltage(struct mmc *mmc, uint voltage)
+{
+	struct dwmci_host *host = (struct dwmci_host *)mmc->priv;
+	u32 old, regs;
+
+	old = dwmci_readl(host, DWMCI_UHS_REG);
+	switch (voltage) {
+	case MMC_SIGNAL_VOLTAGE_330:
+		regs = old & ~DWMCI_VOLT_180;
+		break;
+	case MMC_SIGNAL_VOLTAGE_180:
+		regs = old | DWMCI_VOLT_180;
+		break;
+	default:
+		return -ENOSYS;
+	}
+	if (regs == old)
+		return 0;
+	dwmci_writel(host, DWMCI_UHS_REG, regs);
+
+	/* Give the I/O voltage time to settle */
+	mdelay(5);
+
+	return 0;
+}
+
+static int dwmci_execute_tuning(struct mmc *mmc, uint opcode)
+{
+	struct dwmci_host *host = (struct dwmci_host *)mmc->priv;
+
+	if (!host->execute_tuning)
+		return 0;
+
+	return host->execute_tuning(host, opcode);
+}
+
 static int dwmci_init(struct mmc *mmc)
 {
 	struct dwmci_host *host = mmc->priv;
@@ -452,6 +488,8 @@ static const struct mmc_ops dwmci_ops = {
 	.send_cmd	= dwmci_send_cmd,
 	.set_ios	= dwmci_set_ios,
 	.init		= dwmci_init,
+	.set_signal_voltage = dwmci_set_signal_voltage,
+	.execute_tuning	= dwmci_execute_tuning,
 };
 
 int add_dwmci(struct dwmci_host *host, u32 max_clk, u32 min_clk)
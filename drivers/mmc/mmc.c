@@ -9,6 +9,7 @@
 
 #include <config.h>
 #include <common.h>
+#include <blkcache.h>
 #include <command.h>
 #include <dm.h>
 #include <dm/device-internal.h>
@@ -193,31 +194,31 @@ struct mmc *find_mmc_device(int dev_num)
 	return NULL;
 }
 
-static int mmc_read_blocks(struct mmc *mmc, void *dst, lbaint_t start,
-			   lbaint_t blkcnt)
+static void mmc_read_prepare(struct mmc *mmc, struct mmc_cmd *cmd,
+			     struct mmc_data *data, void *dst, lbaint_t start,
+			     lbaint_t blkcnt)
 {
-	struct mmc_cmd cmd;
-	struct mmc_data data;
-
 	if (blkcnt > 1)
-		cmd.cmdidx = MMC_CMD_READ_MULTIPLE_BLOCK;
+		cmd->cmdidx = MMC_CMD_READ_MULTIPLE_BLOCK;
 	else
-		cmd.cmdidx = MMC_CMD_READ_SINGLE_BLOCK;
+		cmd->cmdidx = MMC_CMD_READ_SINGLE_BLOCK;
 
 	if (mmc->high_capacity)
-		cmd.cmdarg = start;
+		cmd->cmdarg = start;
 	else
-		cmd.cmdarg = start * mmc->read_bl_len;
+		cmd->cmdarg = start * mmc->read_bl_len;
 
-	cmd.resp_type = MMC_RSP_R1;
+	cmd->resp_type = MMC_RSP_R1;
 
-	data.dest = dst;
-	data.blocks = blkcnt;
-	data.blocksize = mmc->read_bl_len;
-	data.flags = MMC_DATA_READ;
+	data->dest = dst;
+	data->blocks = blkcnt;
+	data->blocksize = mmc->read_bl_len;
+	data->flags = MMC_DATA_READ;
+}
 
-	if (mmc_send_cmd(mmc, &cmd, &data))
-		return 0;
+static int mmc_read_stop(struct mmc *mmc, lbaint_t blkcnt)
+{
+	struct mmc_cmd cmd;
 
 	if (blkcnt > 1) {
 		cmd.cmdidx = MMC_CMD_STOP_TRANSMISSION;
@@ -227,16 +228,130 @@ static int mmc_read_blocks(struct mmc *mmc, void *dst, lbaint_t start,
 #if !defined(CONFIG_SPL_BUILD) || defined(CONFIG_SPL_LIBCOMMON_SUPPORT)
 			printf("mmc fail to send stop cmd\n");
 #endif
-			return 0;
+			return -1;
 		}
 	}
 
+	return 0;
+}
+
+static int mmc_read_blocks(struct mmc *mmc, void *dst, lbaint_t start,
+			   lbaint_t blkcnt)
+{
+	struct mmc_cmd cmd;
+	struct mmc_data data;
+
+	mmc_read_prepare(mmc, &cmd, &data, dst, start, blkcnt);
+	if (mmc_send_cmd(mmc, &cmd, &data))
+		return 0;
+
+	if (mmc_read_stop(mmc, blkcnt))
+		return 0;
+
+	return blkcnt;
+}
+
+lbaint_t mmc_bread_start(struct mmc *mmc, lbaint_t start, lbaint_t blkcnt,
+			 void *dst)
+{
+	const struct mmc_ops *ops = mmc->cfg->ops;
+	struct mmc_cmd cmd;
+
+	if (mmc->async_blkcnt) {
+		debug("%s: Read already in progress\n", __func__);
+		return 0;
+	}
+
+	if (blkcnt == 0 || start + blkcnt > mmc->block_dev.lba)
+		return 0;
+
+	if (blkcnt > mmc->cfg->b_max)
+		blkcnt = mmc->cfg->b_max;
+
+	if (mmc_set_blocklen(mmc, mmc->read_bl_len)) {
+		debug("%s: Failed to set blocklen\n", __func__);
+		return 0;
+	}
+
+	/* Without help from the host, just read the blocks now */
+	if (!ops->start_data || !ops->wait_data) {
+		if (mmc_read_blocks(mmc, dst, start, blkcnt) != blkcnt)
+			return 0;
+		mmc->async_blkcnt = blkcnt;
+		return blkcnt;
+	}
+
+	mmc_read_prepare(mmc, &cmd, &mmc->async_data, dst, start, blkcnt);
+	if (ops->start_data(mmc, &cmd, &mmc->async_data))
+		return 0;
+	mmc->async_blkcnt = blkcnt;
+	mmc->async_pending = 1;
+
 	return blkcnt;
 }
 
+lbaint_t mmc_bread_wait(struct mmc *mmc)
+{
+	lbaint_t blkcnt = mmc->async_blkcnt;
+
+	if (!blkcnt)
+		return 0;
+
+	mmc->async_blkcnt = 0;
+	if (mmc->async_pending) {
+		mmc->async_pending = 0;
+		if (mmc->cfg->ops->wait_data(mmc, &mmc->async_data))
+			return 0;
+		if (mmc_read_stop(mmc, blkcnt))
+			return 0;
+	}
+
+	return blkcnt;
+}
+
+lbaint_t mmc_bread_stream(struct mmc *mmc, lbaint_t start, lbaint_t blkcnt,
+			  void *dst, lbaint_t chunk, mmc_stream_fn fn,
+			  void *priv)
+{
+	lbaint_t cur, next, done = 0;
+	void *buf = dst;
+
+	if (!chunk || chunk > mmc->cfg->b_max)
+		chunk = mmc->cfg->b_max;
+
+	cur = mmc_bread_start(mmc, start, min(blkcnt, chunk), buf);
+	while (cur) {
+		if (mmc_bread_wait(mmc) != cur)
+			return 0;
+
+		/* Queue the next chunk before handing this one on */
+		next = 0;
+		if (done + cur < blkcnt) {
+			next = mmc_bread_start(mmc, start + done + cur,
+					       min(blkcnt - done - cur, chunk),
+					       buf + cur * mmc->read_bl_len);
+			if (!next)
+				return 0;
+		}
+
+		if (fn && fn(priv, buf, cur)) {
+			if (next)
+				mmc_bread_wait(mmc);
+			return 0;
+		}
+		done += cur;
+		buf += cur * mmc->read_bl_len;
+		cur = next;
+	}
+
+	return done;
+}
+
 static ulong mmc_bread(int dev_num, lbaint_t start, lbaint_t blkcnt, void *dst)
 {
 	lbaint_t cur, blocks_todo = blkcnt;
+	lbaint_t blk = start;
+	void *buf = dst;
 
 	if (blkcnt == 0)
 		return 0;
@@ -253,6 +368,10 @@ static ulong mmc_bread(int dev_num, lbaint_t start, lbaint_t blkcnt, void *dst)
 		return 0;
 	}
 
+	if (blkcache_read(IF_TYPE_MMC, dev_num, start, blkcnt,
+			  mmc->read_bl_len, dst))
+		return blkcnt;
+
 	if (mmc_set_blocklen(mmc, mmc->read_bl_len)) {
 		debug("%s: Failed to set blocklen\n", __func__);
 		return 0;
@@ -261,18 +380,69 @@ static ulong mmc_bread(int dev_num, lbaint_t start, lbaint_t blkcnt, void *dst)
 	do {
 		cur = (blocks_todo > mmc->cfg->b_max) ?
 			mmc->cfg->b_max : blocks_todo;
-		if (mmc_read_blocks(mmc, dst, start, cur) != cur) {
+		if (mmc_read_blocks(mmc, buf, blk, cur) != cur) {
 			debug("%s: Failed to read blocks\n", __func__);
 			return 0;
 		}
 		blocks_todo -= cur;
-		start += cur;
-		dst += cur * mmc->read_bl_len;
+		blk += cur;
+		buf += cur * mmc->read_bl_len;
 	} while (blocks_todo > 0);
 
+	blkcache_fill(IF_TYPE_MMC, dev_num, start, blkcnt, mmc->read_bl_len,
+		      dst);
+
 	return blkcnt;
 }
 
+static int mmc_set_signal_voltage(struct mmc *mmc, uint voltage)
+{
+	const struct mmc_ops *ops = mmc->cfg->ops;
+	int err;
+
+	if (mmc->signal_voltage == voltage)
+		return 0;
+
+	if (!ops->set_signal_voltage)
+		return -ENOSYS;
+
+	err = ops->set_signal_voltage(mmc, voltage);
+	if (err)
+		return err;
+	mmc->signal_voltage = voltage;
+
+	return 0;
+}
+
+/* Check whether the host can run SD cards at UHS-I speeds */
+static bool sd_host_can_uhs(struct mmc *mmc)
+{
+	return IS_ENABLED(CONFIG_MMC_UHS_SUPPORT) && !mmc_host_is_spi(mmc) &&
+		mmc->cfg->ops->set_signal_voltage &&
+		(mmc->cfg->host_caps &
+		 (MMC_MODE_UHS_SDR50 | MMC_MODE_UHS_SDR104));
+}
+
+/*
+ * Switch the card and then the host to 1.8V signalling, once the card has
+ * accepted this in its reply to ACMD41
+ */
+static int sd_switch_uhs_voltage(struct mmc *mmc)
+{
+	struct mmc_cmd cmd;
+	int err;
+
+	cmd.cmdidx = SD_CMD_SWITCH_UHS18V;
+	cmd.resp_type = MMC_RSP_R1;
+	cmd.cmdarg = 0;
+
+	err = mmc_send_cmd(mmc, &cmd, NULL);
+	if (err)
+		return err;
+
+	return mmc_set_signal_voltage(mmc, MMC_SIGNAL_VOLTAGE_180);
+}
+
 static int mmc_go_idle(struct mmc *mmc)
 {
 	struct mmc_cmd cmd;
@@ -294,54 +464,68 @@ static int mmc_go_idle(struct mmc *mmc)
 	return 0;
 }
 
-static int sd_send_op_cond(struct mmc *mmc)
+static int sd_send_op_cond_iter(struct mmc *mmc)
 {
-	int timeout = 1000;
-	int err;
 	struct mmc_cmd cmd;
+	int err;
 
-	while (1) {
-		cmd.cmdidx = MMC_CMD_APP_CMD;
-		cmd.resp_type = MMC_RSP_R1;
-		cmd.cmdarg = 0;
+	cmd.cmdidx = MMC_CMD_APP_CMD;
+	cmd.resp_type = MMC_RSP_R1;
+	cmd.cmdarg = 0;
 
-		err = mmc_send_cmd(mmc, &cmd, NULL);
+	err = mmc_send_cmd(mmc, &cmd, NULL);
 
-		if (err)
-			return err;
+	if (err)
+		return err;
 
-		cmd.cmdidx = SD_CMD_APP_SEND_OP_COND;
-		cmd.resp_type = MMC_RSP_R3;
+	cmd.cmdidx = SD_CMD_APP_SEND_OP_COND;
+	cmd.resp_type = MMC_RSP_R3;
 
-		/*
-		 * Most cards do not answer if some reserved bits
-		 * in the ocr are set. However, Some controller
-		 * can set bit 7 (reserved for low voltages), but
-		 * how to manage low voltages SD card is not yet
-		 * specified.
-		 */
-		cmd.cmdarg = mmc_host_is_spi(mmc) ? 0 :
-			(mmc->cfg->voltages & 0xff8000);
+	/*
+	 * Most cards do not answer if some reserved bits
+	 * in the ocr are set. However, Some controller
+	 * can set bit 7 (reserved for low voltages), but
+	 * how to manage low voltages SD card is not yet
+	 * specified.
+	 */
+	cmd.cmdarg = mmc_host_is_spi(mmc) ? 0 :
+		(mmc->cfg->voltages & 0xff8000);
 
-		if (mmc->version == SD_VERSION_2)
-			cmd.cmdarg |= OCR_HCS;
+	if (mmc->version == SD_VERSION_2)
+		cmd.cmdarg |= OCR_HCS;
 
-		err = mmc_send_cmd(mmc, &cmd, NULL);
+	if (mmc->version == SD_VERSION_2 && sd_host_can_uhs(mmc))
+		cmd.cmdarg |= OCR_S18R;
 
-		if (err)
-			return err;
+	err = mmc_send_cmd(mmc, &cmd, NULL);
 
-		if (cmd.response[0] & OCR_BUSY)
-			break;
+	if (err)
+		return err;
 
-		if (timeout-- <= 0)
-			return UNUSABLE_ERR;
+	mmc->ocr = cmd.response[0];
+	return 0;
+}
 
-		udelay(1000);
-	}
+static int sd_send_op_cond(struct mmc *mmc)
+{
+	int err;
 
+	err = sd_send_op_cond_iter(mmc);
+	if (err)
+		return err;
+
+	/* The card answered, so it is an SD card */
 	if (mmc->version != SD_VERSION_2)
 		mmc->version = SD_VERSION_1_0;
+	mmc->op_cond_pending = 1;
+	return 0;
+}
+
+/* Finish SD card setup once it has reported that it is ready */
+static int sd_op_cond_done(struct mmc *mmc)
+{
+	struct mmc_cmd cmd;
+	int err;
 
 	if (mmc_host_is_spi(mmc)) { /* read OCR for spi */
 		cmd.cmdidx = MMC_CMD_SPI_READ_OCR;
@@ -352,9 +536,18 @@ static int sd_send_op_cond(struct mmc *mmc)
 
 		if (err)
 			return err;
+
+		mmc->ocr = cmd.response[0];
 	}
 
-	mmc->ocr = cmd.response[0];
+	/* A card still at 1.8V from an earlier init must not get CMD11 */
+	if (mmc->version == SD_VERSION_2 && sd_host_can_uhs(mmc) &&
+	    (mmc->ocr & OCR_S18R) &&
+	    mmc->signal_voltage != MMC_SIGNAL_VOLTAGE_180) {
+		err = sd_switch_uhs_voltage(mmc);
+		if (err)
+			return err;
+	}
 
 	mmc->high_capacity = ((mmc->ocr & OCR_HCS) == OCR_HCS);
 	mmc->rca = 0;
@@ -390,6 +583,8 @@ static int mmc_send_op_cond(struct mmc *mmc)
 	/* Some cards seem to need this */
 	mmc_go_idle(mmc);
 
+	mmc->version = MMC_VERSION_UNKNOWN;
+
  	/* Asking to the card its capabilities */
 	for (i = 0; i < 2; i++) {
 		err = mmc_send_op_cond_iter(mmc, i != 0);
@@ -404,28 +599,12 @@ static int mmc_send_op_cond(struct mmc *mmc)
 	return 0;
 }
 
-static int mmc_complete_op_cond(struct mmc *mmc)
+/* Finish MMC card setup once it has reported that it is ready */
+static int mmc_op_cond_done(struct mmc *mmc)
 {
 	struct mmc_cmd cmd;
-	int timeout = 1000;
-	uint start;
 	int err;
 
-	mmc->op_cond_pending = 0;
-	if (!(mmc->ocr & OCR_BUSY)) {
-		start = get_timer(0);
-		while (1) {
-			err = mmc_send_op_cond_iter(mmc, 1);
-			if (err)
-				return err;
-			if (mmc->ocr & OCR_BUSY)
-				break;
-			if (get_timer(start) > timeout)
-				return UNUSABLE_ERR;
-			udelay(100);
-		}
-	}
-
 	if (mmc_host_is_spi(mmc)) { /* read OCR for spi */
 		cmd.cmdidx = MMC_CMD_SPI_READ_OCR;
 		cmd.resp_type = MMC_RSP_R3;
@@ -447,6 +626,48 @@ static int mmc_complete_op_cond(struct mmc *mmc)
 	return 0;
 }
 
+/*
+ * Ask the card once more whether it has finished powering up.
+ *
+ * @return 0 if it has, IN_PROGRESS if not, -ve on error
+ */
+static int mmc_poll_op_cond(struct mmc *mmc)
+{
+	int err;
+
+	if (IS_SD(mmc))
+		err = sd_send_op_cond_iter(mmc);
+	else
+		err = mmc_send_op_cond_iter(mmc, 1);
+	if (err)
+		return err;
+
+	return (mmc->ocr & OCR_BUSY) ? 0 : IN_PROGRESS;
+}
+
+static int mmc_complete_op_cond(struct mmc *mmc)
+{
+	int timeout = 1000;
+	uint start;
+	int err;
+
+	mmc->op_cond_pending = 0;
+	if (!(mmc->ocr & OCR_BUSY)) {
+		start = get_timer(0);
+		while (1) {
+			err = mmc_poll_op_cond(mmc);
+			if (err != IN_PROGRESS)
+				break;
+			if (get_timer(start) > timeout)
+				return UNUSABLE_ERR;
+			udelay(IS_SD(mmc) ? 1000 : 100);
+		}
+		if (err)
+			return err;
+	}
+
+	return IS_SD(mmc) ? sd_op_cond_done(mmc) : mmc_op_cond_done(mmc);
+}
 
 static int mmc_send_ext_csd(struct mmc *mmc, u8 *ext_csd)
 {
@@ -492,10 +713,32 @@ static int mmc_switch(struct mmc *mmc, u8 set, u8 index, u8 value)
 
 }
 
+int mmc_flush_cache(struct mmc *mmc)
+{
+	struct mmc_cmd cmd;
+	int timeout = 10000;
+	int ret;
+
+	if (!mmc->cache_on)
+		return 0;
+
+	/* Writing back a large cache can take longer than other switches */
+	cmd.cmdidx = MMC_CMD_SWITCH;
+	cmd.resp_type = MMC_RSP_R1b;
+	cmd.cmdarg = (MMC_SWITCH_MODE_WRITE_BYTE << 24) |
+		     (EXT_CSD_FLUSH_CACHE << 16) | (1 << 8);
+
+	ret = mmc_send_cmd(mmc, &cmd, NULL);
+	if (!ret)
+		ret = mmc_send_status(mmc, timeout);
+
+	return ret;
+}
+
 static int mmc_change_freq(struct mmc *mmc)
 {
 	ALLOC_CACHE_ALIGN_BUFFER(u8, ext_csd, MMC_MAX_BLOCK_LEN);
-	char cardtype;
+	u8 cardtype;
 	int err;
 
 	mmc->card_caps = 0;
@@ -514,7 +757,7 @@ static int mmc_change_freq(struct mmc *mmc)
 	if (err)
 		return err;
 
-	cardtype = ext_csd[EXT_CSD_CARD_TYPE] & 0xf;
+	cardtype = ext_csd[EXT_CSD_CARD_TYPE];
 
 	err = mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_HS_TIMING, 1);
 
@@ -535,6 +778,12 @@ static int mmc_change_freq(struct mmc *mmc)
 	if (cardtype & EXT_CSD_CARD_TYPE_52) {
 		if (cardtype & EXT_CSD_CARD_TYPE_DDR_1_8V)
 			mmc->card_caps |= MMC_MODE_DDR_52MHz;
+		if (IS_ENABLED(CONFIG_MMC_HS200_SUPPORT) &&
+		    (cardtype & EXT_CSD_CARD_TYPE_HS200_1_8V))
+			mmc->card_caps |= MMC_MODE_HS200;
+		if (IS_ENABLED(CONFIG_MMC_HS400_SUPPORT) &&
+		    (cardtype & EXT_CSD_CARD_TYPE_HS400_1_8V))
+			mmc->card_caps |= MMC_MODE_HS400;
 		mmc->card_caps |= MMC_MODE_HS_52MHz | MMC_MODE_HS;
 	} else {
 		mmc->card_caps |= MMC_MODE_HS;
@@ -609,6 +858,9 @@ int mmc_switch_part(int dev_num, unsigned int part_num)
 			 (mmc->part_config & ~PART_ACCESS_MASK)
 			 | (part_num & PART_ACCESS_MASK));
 
+	/* Cached blocks may belong to the previous hardware partition */
+	blkcache_invalidate(IF_TYPE_MMC, dev_num);
+
 	/*
 	 * Set the capacity if the switch succeeded or was intended
 	 * to return to representing the raw device.
@@ -850,6 +1102,39 @@ static int sd_switch(struct mmc *mmc, int mode, int group, u8 value, u8 *resp)
 }
 
 
+/*
+ * Switch to the fastest UHS-I access mode that both the card, according to
+ * @switch_status from a SWITCH_FUNC check, and the host support
+ */
+static int sd_select_uhs(struct mmc *mmc, uint *switch_status)
+{
+	uint support = __be32_to_cpu(switch_status[3]);
+	uint host_caps = mmc->cfg->host_caps;
+	uint mode, caps;
+	int err;
+
+	if ((support & SD_UHS_SDR104_SUPPORTED) &&
+	    (host_caps & MMC_MODE_UHS_SDR104)) {
+		mode = SD_ACCESS_MODE_SDR104;
+		caps = MMC_MODE_UHS_SDR104;
+	} else if ((support & SD_UHS_SDR50_SUPPORTED) &&
+		   (host_caps & MMC_MODE_UHS_SDR50)) {
+		mode = SD_ACCESS_MODE_SDR50;
+		caps = MMC_MODE_UHS_SDR50;
+	} else {
+		return 0;
+	}
+
+	err = sd_switch(mmc, SD_SWITCH_SWITCH, 0, mode, (u8 *)switch_status);
+	if (err)
+		return err;
+
+	if (((__be32_to_cpu(switch_status[4]) >> 24) & 0xf) == mode)
+		mmc->card_caps |= caps;
+
+	return 0;
+}
+
 static int sd_change_freq(struct mmc *mmc)
 {
 	int err;
@@ -935,6 +1220,14 @@ retry_scr:
 			break;
 	}
 
+	/* A card running at 1.8V may offer the faster UHS-I modes */
+	if (mmc->signal_voltage == MMC_SIGNAL_VOLTAGE_180) {
+		err = sd_select_uhs(mmc, switch_status);
+		if (err || (mmc->card_caps &
+			    (MMC_MODE_UHS_SDR50 | MMC_MODE_UHS_SDR104)))
+			return err;
+	}
+
 	/* If high-speed isn't supported, we return */
 	if (!(__be32_to_cpu(switch_status[3]) & SD_HIGHSPEED_SUPPORTED))
 		return 0;
@@ -1017,6 +1310,138 @@ static void mmc_set_bus_width(struct mmc *mmc, uint width)
 	mmc_set_ios(mmc);
 }
 
+static const u8 tuning_blk_pattern_4bit[] = {
+	0xff, 0x0f, 0xff, 0x00, 0xff, 0xcc, 0xc3, 0xcc,
+	0xc3, 0x3c, 0xcc, 0xff, 0xfe, 0xff, 0xfe, 0xef,
+	0xff, 0xdf, 0xff, 0xdd, 0xff, 0xfb, 0xff, 0xfb,
+	0xbf, 0xff, 0x7f, 0xff, 0x77, 0xf7, 0xbd, 0xef,
+	0xff, 0xf0, 0xff, 0xf0, 0x0f, 0xfc, 0xcc, 0x3c,
+	0xcc, 0x33, 0xcc, 0xcf, 0xff, 0xef, 0xff, 0xee,
+	0xff, 0xfd, 0xff, 0xfd, 0xdf, 0xff, 0xbf, 0xff,
+	0xbb, 0xff, 0xf7, 0xff, 0xf7, 0x7f, 0x7b, 0xde,
+};
+
+static const u8 tuning_blk_pattern_8bit[] = {
+	0xff, 0xff, 0x00, 0xff, 0xff, 0xff, 0x00, 0x00,
+	0xff, 0xff, 0xcc, 0xcc, 0xcc, 0x33, 0xcc, 0xcc,
+	0xcc, 0x33, 0x33, 0xcc, 0xcc, 0xcc, 0xff, 0xff,
+	0xff, 0xee, 0xff, 0xff, 0xff, 0xee, 0xee, 0xff,
+	0xff, 0xff, 0xdd, 0xff, 0xff, 0xff, 0xdd, 0xdd,
+	0xff, 0xff, 0xff, 0xbb, 0xff, 0xff, 0xff, 0xbb,
+	0xbb, 0xff, 0xff, 0xff, 0x77, 0xff, 0xff, 0xff,
+	0x77, 0x77, 0xff, 0x77, 0xbb, 0xdd, 0xee, 0xff,
+	0xff, 0xff, 0xff, 0x00, 0xff, 0xff, 0xff, 0x00,
+	0x00, 0xff, 0xff, 0xcc, 0xcc, 0xcc, 0x33, 0xcc,
+	0xcc, 0xcc, 0x33, 0x33, 0xcc, 0xcc, 0xcc, 0xff,
+	0xff, 0xff, 0xee, 0xff, 0xff, 0xff, 0xee, 0xee,
+	0xff, 0xff, 0xff, 0xdd, 0xff, 0xff, 0xff, 0xdd,
+	0xdd, 0xff, 0xff, 0xff, 0xbb, 0xff, 0xff, 0xff,
+	0xbb, 0xbb, 0xff, 0xff, 0xff, 0x77, 0xff, 0xff,
+	0xff, 0x77, 0x77, 0xff, 0x77, 0xbb, 0xdd, 0xee,
+};
+
+int mmc_send_tuning(struct mmc *mmc, uint opcode)
+{
+	ALLOC_CACHE_ALIGN_BUFFER(u8, buf, sizeof(tuning_blk_pattern_8bit));
+	const u8 *pattern = tuning_blk_pattern_4bit;
+	uint size = sizeof(tuning_blk_pattern_4bit);
+	struct mmc_cmd cmd;
+	struct mmc_data data;
+	int err;
+
+	if (mmc->bus_width == 8) {
+		pattern = tuning_blk_pattern_8bit;
+		size = sizeof(tuning_blk_pattern_8bit);
+	}
+
+	cmd.cmdidx = opcode;
+	cmd.resp_type = MMC_RSP_R1;
+	cmd.cmdarg = 0;
+
+	data.dest = (char *)buf;
+	data.blocks = 1;
+	data.blocksize = size;
+	data.flags = MMC_DATA_READ;
+
+	err = mmc_send_cmd(mmc, &cmd, &data);
+	if (err)
+		return err;
+
+	return memcmp(buf, pattern, size) ? -EIO : 0;
+}
+
+static int mmc_execute_tuning(struct mmc *mmc, uint opcode)
+{
+	int err;
+
+	/* Hosts without a tuning method sample at a fixed point */
+	if (!mmc->cfg->ops->execute_tuning)
+		return 0;
+
+	err = mmc->cfg->ops->execute_tuning(mmc, opcode);
+#if !defined(CONFIG_SPL_BUILD) || defined(CONFIG_SPL_LIBCOMMON_SUPPORT)
+	if (err)
+		printf("MMC: tuning failed (%d)\n", err);
+#endif
+
+	return err;
+}
+
+/* Go from HS200 to HS400, which must be done at high-speed timing */
+static int mmc_select_hs400(struct mmc *mmc)
+{
+	int err;
+
+	err = mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_HS_TIMING,
+			 EXT_CSD_TIMING_HS);
+	if (err)
+		return err;
+	mmc->timing = MMC_TIMING_HS;
+	mmc_set_clock(mmc, 52000000);
+
+	err = mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_BUS_WIDTH,
+			 EXT_CSD_DDR_BUS_WIDTH_8);
+	if (err)
+		return err;
+
+	err = mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_HS_TIMING,
+			 EXT_CSD_TIMING_HS400);
+	if (err)
+		return err;
+	mmc->timing = MMC_TIMING_MMC_HS400;
+	mmc->ddr_mode = 1;
+	mmc->tran_speed = 200000000;
+	mmc_set_clock(mmc, mmc->tran_speed);
+
+	return 0;
+}
+
+/*
+ * Switch an eMMC, already using a 4- or 8-bit bus at 1.8V, to HS200 and
+ * tune the host. Go on to HS400 if both sides can.
+ */
+static int mmc_select_hs200(struct mmc *mmc)
+{
+	int err;
+
+	err = mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_HS_TIMING,
+			 EXT_CSD_TIMING_HS200);
+	if (err)
+		return err;
+	mmc->timing = MMC_TIMING_MMC_HS200;
+	mmc->tran_speed = 200000000;
+	mmc_set_clock(mmc, mmc->tran_speed);
+
+	err = mmc_execute_tuning(mmc, MMC_CMD_SEND_TUNING_BLOCK_HS200);
+	if (err)
+		return err;
+
+	if ((mmc->card_caps & MMC_MODE_HS400) && mmc->bus_width == 8)
+		return mmc_select_hs400(mmc);
+
+	return 0;
+}
+
 static int mmc_startup(struct mmc *mmc)
 {
 	int err, i;
@@ -1177,6 +1602,10 @@ static int mmc_startup(struct mmc *mmc)
 	 */
 	mmc->erase_grp_size = 1;
 	mmc->part_config = MMCPART_NOAVAILABLE;
+	mmc->cache_size = 0;
+	mmc->cache_on = 0;
+	mmc->trim_support = 0;
+	mmc->erased_zero = 0;
 	if (!IS_SD(mmc) && (mmc->version >= MMC_VERSION_4)) {
 		/* check  ext_csd version and capacity */
 		err = mmc_send_ext_csd(mmc, ext_csd);
@@ -1322,6 +1751,35 @@ static int mmc_startup(struct mmc *mmc)
 			* ext_csd[EXT_CSD_HC_WP_GRP_SIZE];
 
 		mmc->wr_rel_set = ext_csd[EXT_CSD_WR_REL_SET];
+
+		mmc->trim_support = !!(ext_csd[EXT_CSD_SEC_FEATURE_SUPPORT] &
+				       EXT_CSD_SEC_GB_CL_EN);
+		mmc->erased_zero = !ext_csd[EXT_CSD_ERASED_MEM_CONT];
+
+		/* The cache was added in eMMC 4.5 */
+		if (ext_csd[EXT_CSD_REV] >= 6)
+			mmc->cache_size = ext_csd[EXT_CSD_CACHE_SIZE]
+				| ext_csd[EXT_CSD_CACHE_SIZE + 1] << 8
+				| ext_csd[EXT_CSD_CACHE_SIZE + 2] << 16
+				| ext_csd[EXT_CSD_CACHE_SIZE + 3] << 24;
+
+#if defined(CONFIG_MMC_WRITE_CACHE) && !defined(CONFIG_SPL_BUILD)
+		/*
+		 * Let the card collect writes in its cache; mmc_bwrite()
+		 * flushes it at the end of each write. The cache only makes
+		 * writes faster, so carry on without it if it cannot be
+		 * turned on.
+		 */
+		if (mmc->cache_size) {
+			err = mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL,
+					 EXT_CSD_CACHE_CTRL, 1);
+			if (err)
+				printf("MMC: cannot enable write cache (%d)\n",
+				       err);
+			else
+				mmc->cache_on = 1;
+		}
+#endif
 	}
 
 	err = mmc_set_capacity(mmc, mmc->part_num);
@@ -1336,6 +1794,12 @@ static int mmc_startup(struct mmc *mmc)
 	if (err)
 		return err;
 
+	/* SD cards erase single blocks; the SCR says what they read back */
+	if (IS_SD(mmc) && !mmc_host_is_spi(mmc)) {
+		mmc->trim_support = 1;
+		mmc->erased_zero = !(mmc->scr[0] & SD_DATA_STAT_AFTER_ERASE);
+	}
+
 	/* Restrict card's capabilities by what the host can do */
 	mmc->card_caps &= mmc->cfg->host_caps;
 
@@ -1359,10 +1823,18 @@ static int mmc_startup(struct mmc *mmc)
 			mmc_set_bus_width(mmc, 4);
 		}
 
-		if (mmc->card_caps & MMC_MODE_HS)
+		if (mmc->card_caps & MMC_MODE_UHS_SDR104) {
+			mmc->timing = MMC_TIMING_UHS_SDR104;
+			mmc->tran_speed = 208000000;
+		} else if (mmc->card_caps & MMC_MODE_UHS_SDR50) {
+			mmc->timing = MMC_TIMING_UHS_SDR50;
+			mmc->tran_speed = 100000000;
+		} else if (mmc->card_caps & MMC_MODE_HS) {
+			mmc->timing = MMC_TIMING_HS;
 			mmc->tran_speed = 50000000;
-		else
+		} else {
 			mmc->tran_speed = 25000000;
+		}
 	} else if (mmc->version >= MMC_VERSION_4) {
 		/* Only version 4 of MMC supports wider bus widths */
 		int idx;
@@ -1391,6 +1863,16 @@ static int mmc_startup(struct mmc *mmc)
 			8, 4, 8, 4, 1,
 		};
 
+		/*
+		 * HS200 needs 1.8V signalling and a single data rate bus,
+		 * which is chosen here before switching the timing
+		 */
+		if ((mmc->card_caps & MMC_MODE_HS200) &&
+		    mmc_set_signal_voltage(mmc, MMC_SIGNAL_VOLTAGE_180))
+			mmc->card_caps &= ~(MMC_MODE_HS200 | MMC_MODE_HS400);
+		if (mmc->card_caps & MMC_MODE_HS200)
+			mmc->card_caps &= ~MMC_MODE_DDR_52MHz;
+
 		for (idx=0; idx < ARRAY_SIZE(ext_csd_bits); idx++) {
 			unsigned int extw = ext_csd_bits[idx];
 			unsigned int caps = ext_to_hostcaps[extw];
@@ -1448,6 +1930,7 @@ static int mmc_startup(struct mmc *mmc)
 			return err;
 
 		if (mmc->card_caps & MMC_MODE_HS) {
+			mmc->timing = MMC_TIMING_HS;
 			if (mmc->card_caps & MMC_MODE_HS_52MHz)
 				mmc->tran_speed = 52000000;
 			else
@@ -1457,6 +1940,18 @@ static int mmc_startup(struct mmc *mmc)
 
 	mmc_set_clock(mmc, mmc->tran_speed);
 
+	if (mmc->timing == MMC_TIMING_UHS_SDR50 ||
+	    mmc->timing == MMC_TIMING_UHS_SDR104) {
+		err = mmc_execute_tuning(mmc, MMC_CMD_SEND_TUNING_BLOCK);
+		if (err)
+			return err;
+	} else if (!IS_SD(mmc) && (mmc->card_caps & MMC_MODE_HS200) &&
+		   mmc->bus_width > 1) {
+		err = mmc_select_hs200(mmc);
+		if (err)
+			return err;
+	}
+
 	/* Fix the block length for DDR mode */
 	if (mmc->ddr_mode) {
 		mmc->read_bl_len = MMC_MAX_BLOCK_LEN;
@@ -1484,6 +1979,8 @@ static int mmc_startup(struct mmc *mmc)
 	mmc->block_dev.product[0] = 0;
 	mmc->block_dev.revision[0] = 0;
 #endif
+	/* This may be a different card than before */
+	blkcache_invalidate(IF_TYPE_MMC, mmc->block_dev.dev);
 #if !defined(CONFIG_SPL_BUILD) || defined(CONFIG_SPL_LIBDISK_SUPPORT)
 	init_part(&mmc->block_dev);
 #endif
@@ -1586,11 +2083,14 @@ __weak void board_mmc_power_init(void)
 
 int mmc_start_init(struct mmc *mmc)
 {
+	uint voltage;
 	int err;
 
 	/* we pretend there's no card when init is NULL */
 	if (mmc_getcd(mmc) == 0 || mmc->cfg->ops->init == NULL) {
 		mmc->has_init = 0;
+		/* the next card starts out at 3.3V */
+		mmc->signal_voltage = MMC_SIGNAL_VOLTAGE_330;
 #if !defined(CONFIG_SPL_BUILD) || defined(CONFIG_SPL_LIBCOMMON_SUPPORT)
 		printf("MMC: no card present\n");
 #endif
@@ -1611,7 +2111,22 @@ int mmc_start_init(struct mmc *mmc)
 	if (err)
 		return err;
 
+	/*
+	 * Cards start out at 3.3V. A card which an earlier init switched to
+	 * 1.8V stays there until its power is cycled, which U-Boot cannot
+	 * do, so keep talking to it at 1.8V. Should it not answer, it may
+	 * have been swapped for another card, so try again at 3.3V.
+	 */
+	voltage = mmc->signal_voltage == MMC_SIGNAL_VOLTAGE_180 ?
+		MMC_SIGNAL_VOLTAGE_180 : MMC_SIGNAL_VOLTAGE_330;
+retry:
 	mmc->ddr_mode = 0;
+	mmc->timing = MMC_TIMING_LEGACY;
+	mmc->signal_voltage = voltage;
+	if ((IS_ENABLED(CONFIG_MMC_UHS_SUPPORT) ||
+	     IS_ENABLED(CONFIG_MMC_HS200_SUPPORT)) &&
+	    mmc->cfg->ops->set_signal_voltage)
+		mmc->cfg->ops->set_signal_voltage(mmc, voltage);
 	mmc_set_bus_width(mmc, 1);
 	mmc_set_clock(mmc, 1);
 
@@ -1634,6 +2149,10 @@ int mmc_start_init(struct mmc *mmc)
 	if (err == TIMEOUT) {
 		err = mmc_send_op_cond(mmc);
 
+		if (err && voltage == MMC_SIGNAL_VOLTAGE_180) {
+			voltage = MMC_SIGNAL_VOLTAGE_330;
+			goto retry;
+		}
 		if (err) {
 #if !defined(CONFIG_SPL_BUILD) || defined(CONFIG_SPL_LIBCOMMON_SUPPORT)
 			printf("Card did not respond to voltage select!\n");
@@ -1746,6 +2265,65 @@ void mmc_set_preinit(struct mmc *mmc, int preinit)
 	mmc->preinit = preinit;
 }
 
+#if defined(CONFIG_MMC_PARALLEL_INIT) && !defined(CONFIG_SPL_BUILD)
+/*
+ * Start the op-cond sequence on every device, then poll them all in turn,
+ * finishing each one as soon as its card is ready. This way the power-up
+ * delays of the cards overlap instead of adding up.
+ */
+static void mmc_init_parallel(void)
+{
+	struct mmc *m;
+	uint start;
+	int pending, err;
+
+	bootstage_mark_name(BOOTSTAGE_ID_MMC_START, "mmc_start");
+	list_for_each_entry(m, &mmc_devices, link) {
+		if (!m->has_init && !m->init_in_progress)
+			mmc_start_init(m);
+	}
+
+	bootstage_mark_name(BOOTSTAGE_ID_MMC_OP_COND, "mmc_op_cond");
+	start = get_timer(0);
+	do {
+		pending = 0;
+		list_for_each_entry(m, &mmc_devices, link) {
+			if (!m->init_in_progress)
+				continue;
+
+			if (m->op_cond_pending && !(m->ocr & OCR_BUSY)) {
+				err = mmc_poll_op_cond(m);
+				if (err == IN_PROGRESS) {
+					pending++;
+					continue;
+				}
+				if (err) {
+					m->op_cond_pending = 0;
+					m->init_in_progress = 0;
+					continue;
+				}
+			}
+
+			err = mmc_complete_init(m);
+			debug("%s: %s: %d, time %lu\n", __func__, m->cfg->name,
+			      err, get_timer(start));
+		}
+		if (pending)
+			udelay(100);
+	} while (pending && get_timer(start) < 1000);
+
+	/* Give up on cards which never became ready */
+	list_for_each_entry(m, &mmc_devices, link) {
+		if (m->init_in_progress) {
+			printf("MMC: %s: card did not power up\n",
+			       m->cfg->name);
+			m->op_cond_pending = 0;
+			m->init_in_progress = 0;
+		}
+	}
+	bootstage_mark_name(BOOTSTAGE_ID_MMC_DONE, "mmc_done");
+}
+#else
 static void do_preinit(void)
 {
 	struct mmc *m;
@@ -1761,6 +2339,7 @@ static void do_preinit(void)
 			mmc_start_init(m);
 	}
 }
+#endif
 
 #if defined(CONFIG_DM_MMC) && defined(CONFIG_SPL_BUILD)
 static int mmc_probe(bd_t *bis)
@@ -1815,7 +2394,11 @@ int mmc_initialize(bd_t *bis)
 	print_mmc_devices(',');
 #endif
 
+#if defined(CONFIG_MMC_PARALLEL_INIT) && !defined(CONFIG_SPL_BUILD)
+	mmc_init_parallel();
+#else
 	do_preinit();
+#endif
 	return 0;
 }
 
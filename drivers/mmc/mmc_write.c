@@ -9,12 +9,14 @@
 
 #include <config.h>
 #include <common.h>
+#include <blkcache.h>
 #include <part.h>
 #include <div64.h>
 #include <linux/math64.h>
 #include "mmc_private.h"
 
-static ulong mmc_erase_t(struct mmc *mmc, ulong start, lbaint_t blkcnt)
+static ulong mmc_erase_t(struct mmc *mmc, ulong start, lbaint_t blkcnt,
+			 u32 arg)
 {
 	struct mmc_cmd cmd;
 	ulong end;
@@ -51,7 +53,7 @@ static ulong mmc_erase_t(struct mmc *mmc, ulong start, lbaint_t blkcnt)
 		goto err_out;
 
 	cmd.cmdidx = MMC_CMD_ERASE;
-	cmd.cmdarg = SECURE_ERASE;
+	cmd.cmdarg = arg;
 	cmd.resp_type = MMC_RSP_R1b;
 
 	err = mmc_send_cmd(mmc, &cmd, NULL);
@@ -76,6 +78,9 @@ unsigned long mmc_berase(int dev_num, lbaint_t start, lbaint_t blkcnt)
 	if (!mmc)
 		return -1;
 
+	/* The erase range may be widened to whole erase groups */
+	blkcache_invalidate(IF_TYPE_MMC, dev_num);
+
 	/*
 	 * We want to see if the requested start or total block count are
 	 * unaligned.  We discard the whole numbers and only care about the
@@ -94,7 +99,7 @@ unsigned long mmc_berase(int dev_num, lbaint_t start, lbaint_t blkcnt)
 	while (blk < blkcnt) {
 		blk_r = ((blkcnt - blk) > mmc->erase_grp_size) ?
 			mmc->erase_grp_size : (blkcnt - blk);
-		err = mmc_erase_t(mmc, start + blk, blk_r);
+		err = mmc_erase_t(mmc, start + blk, blk_r, SECURE_ERASE);
 		if (err)
 			break;
 
@@ -108,6 +113,48 @@ unsigned long mmc_berase(int dev_num, lbaint_t start, lbaint_t blkcnt)
 	return blk;
 }
 
+ulong mmc_btrim(int dev_num, lbaint_t start, lbaint_t blkcnt)
+{
+	struct mmc *mmc = find_mmc_device(dev_num);
+	lbaint_t blk = 0, blk_r, chunk;
+	int timeout = 3000;
+	u32 arg;
+
+	if (!mmc || !mmc->trim_support)
+		return 0;
+
+	if ((start + blkcnt) > mmc->block_dev.lba) {
+		printf("MMC: block number 0x" LBAF " exceeds max(0x" LBAF ")\n",
+		       start + blkcnt, mmc->block_dev.lba);
+		return 0;
+	}
+
+	blkcache_invalidate(IF_TYPE_MMC, dev_num);
+
+	/*
+	 * Keep each command to about one erase group (or a typical SD
+	 * allocation unit), so that it finishes within the timeout.
+	 */
+	if (IS_SD(mmc)) {
+		arg = MMC_ERASE_ARG;
+		chunk = 8192;
+	} else {
+		arg = MMC_TRIM_ARG;
+		chunk = mmc->erase_grp_size;
+	}
+
+	while (blk < blkcnt) {
+		blk_r = min(blkcnt - blk, chunk);
+		if (mmc_erase_t(mmc, start + blk, blk_r, arg))
+			break;
+		if (mmc_send_status(mmc, timeout))
+			break;
+		blk += blk_r;
+	}
+
+	return blk;
+}
+
 static ulong mmc_write_blocks(struct mmc *mmc, lbaint_t start,
 		lbaint_t blkcnt, const void *src)
 {
@@ -156,6 +203,20 @@ static ulong mmc_write_blocks(struct mmc *mmc, lbaint_t start,
 			printf("mmc fail to send stop cmd\n");
 			return 0;
 		}
+
+		/*
+		 * If the host waited for the end of busy the card is back in
+		 * the transfer state, so the next chunk can go straight away.
+		 * The stop response still tells us about write errors.
+		 */
+		if (mmc->cfg->host_caps & MMC_MODE_BUSY_END) {
+			if (cmd.response[0] & MMC_STATUS_MASK) {
+				printf("mmc write error: 0x%08x\n",
+				       cmd.response[0]);
+				return 0;
+			}
+			return blkcnt;
+		}
 	}
 
 	/* Waiting for the ready status */
@@ -165,9 +226,12 @@ static ulong mmc_write_blocks(struct mmc *mmc, lbaint_t start,
 	return blkcnt;
 }
 
-ulong mmc_bwrite(int dev_num, lbaint_t start, lbaint_t blkcnt, const void *src)
+ulong mmc_bwrite_cached(int dev_num, lbaint_t start, lbaint_t blkcnt,
+			const void *src)
 {
 	lbaint_t cur, blocks_todo = blkcnt;
+	lbaint_t blk = start;
+	const void *buf = src;
 
 	struct mmc *mmc = find_mmc_device(dev_num);
 	if (!mmc)
@@ -179,12 +243,35 @@ ulong mmc_bwrite(int dev_num, lbaint_t start, lbaint_t blkcnt, const void *src)
 	do {
 		cur = (blocks_todo > mmc->cfg->b_max) ?
 			mmc->cfg->b_max : blocks_todo;
-		if (mmc_write_blocks(mmc, start, cur, src) != cur)
+		if (mmc_write_blocks(mmc, blk, cur, buf) != cur) {
+			/* Some of the blocks may have been written */
+			blkcache_invalidate(IF_TYPE_MMC, dev_num);
 			return 0;
+		}
 		blocks_todo -= cur;
-		start += cur;
-		src += cur * mmc->write_bl_len;
+		blk += cur;
+		buf += cur * mmc->write_bl_len;
 	} while (blocks_todo > 0);
 
+	blkcache_write(IF_TYPE_MMC, dev_num, start, blkcnt, mmc->write_bl_len,
+		       src);
+
+	return blkcnt;
+}
+
+ulong mmc_bwrite(int dev_num, lbaint_t start, lbaint_t blkcnt, const void *src)
+{
+	struct mmc *mmc;
+
+	if (mmc_bwrite_cached(dev_num, start, blkcnt, src) != blkcnt)
+		return 0;
+
+	mmc = find_mmc_device(dev_num);
+	if (mmc && mmc_flush_cache(mmc)) {
+		printf("mmc cache flush failed\n");
+		blkcache_invalidate(IF_TYPE_MMC, dev_num);
+		return 0;
+	}
+
 	return blkcnt;
 }
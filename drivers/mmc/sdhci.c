@@ -9,7 +9,9 @@
  */
 
 #include <common.h>
+#include <errno.h>
 #include <malloc.h>
+#include <memalign.h>
 #include <mmc.h>
 #include <sdhci.h>
 
@@ -71,12 +73,6 @@ static int sdhci_transfer_data(struct sdhci_host *host, struct mmc_data *data,
 				unsigned int start_addr)
 {
 	unsigned int stat, rdy, mask, timeout, block = 0;
-#ifdef CONFIG_MMC_SDMA
-	unsigned char ctrl;
-	ctrl = sdhci_readb(host, SDHCI_HOST_CONTROL);
-	ctrl &= ~SDHCI_CTRL_DMA_MASK;
-	sdhci_writeb(host, ctrl, SDHCI_HOST_CONTROL);
-#endif
 
 	timeout = 1000000;
 	rdy = SDHCI_INT_SPACE_AVAIL | SDHCI_INT_DATA_AVAIL;
@@ -115,6 +111,107 @@ static int sdhci_transfer_data(struct sdhci_host *host, struct mmc_data *data,
 	return 0;
 }
 
+#ifdef CONFIG_MMC_SDMA
+static void sdhci_prepare_sdma(struct sdhci_host *host, struct mmc_data *data)
+{
+	unsigned int start_addr;
+	unsigned char ctrl;
+	int trans_bytes = data->blocks * data->blocksize;
+
+	ctrl = sdhci_readb(host, SDHCI_HOST_CONTROL);
+	ctrl &= ~SDHCI_CTRL_DMA_MASK;
+	sdhci_writeb(host, ctrl, SDHCI_HOST_CONTROL);
+
+	if (data->flags == MMC_DATA_READ)
+		start_addr = (unsigned long)data->dest;
+	else
+		start_addr = (unsigned long)data->src;
+	if ((host->quirks & SDHCI_QUIRK_32BIT_DMA_ADDR) &&
+			(start_addr & 0x7) != 0x0) {
+		host->is_aligned = 0;
+		start_addr = (unsigned long)aligned_buffer;
+		if (data->flags != MMC_DATA_READ)
+			memcpy(aligned_buffer, data->src, trans_bytes);
+	}
+
+#if defined(CONFIG_FIXED_SDHCI_ALIGNED_BUFFER)
+	/*
+	 * Always use this bounce-buffer when
+	 * CONFIG_FIXED_SDHCI_ALIGNED_BUFFER is defined
+	 */
+	host->is_aligned = 0;
+	start_addr = (unsigned long)aligned_buffer;
+	if (data->flags != MMC_DATA_READ)
+		memcpy(aligned_buffer, data->src, trans_bytes);
+#endif
+
+	sdhci_writel(host, start_addr, SDHCI_DMA_ADDRESS);
+	host->start_addr = start_addr;
+	host->trans_bytes = trans_bytes;
+	flush_cache(start_addr, trans_bytes);
+}
+#endif
+
+#ifdef CONFIG_MMC_SDHCI_ADMA
+/*
+ * Describe the buffer of @data to the controller as a chain of ADMA2
+ * descriptors, so that the whole transfer runs without help from the CPU.
+ * Returns 0 if the transfer is set up, -1 if it must be done another way.
+ */
+static int sdhci_prepare_adma(struct sdhci_host *host, struct mmc_data *data)
+{
+	ulong addr = (ulong)data->dest;
+	uint len = data->blocks * data->blocksize;
+	struct sdhci_adma_desc *desc;
+	uint i, desc_len;
+	u16 attr;
+	u8 ctrl;
+
+	if (!host->adma_desc_size || (addr & 3))
+		return -1;
+	if (DIV_ROUND_UP(len, SDHCI_ADMA_MAX_LEN) > host->adma_desc_count)
+		return -1;
+	if (host->adma_desc_size == SDHCI_ADMA_DESC_SIZE_32 &&
+	    upper_32_bits((u64)addr + len - 1))
+		return -1;
+
+	flush_cache(addr, len);
+	for (i = 0; len; i++) {
+		desc = host->adma_desc + i * host->adma_desc_size;
+		desc_len = min(len, (uint)SDHCI_ADMA_MAX_LEN);
+		attr = SDHCI_ADMA_VALID | SDHCI_ADMA_ACT_TRAN;
+		if (desc_len == len)
+			attr |= SDHCI_ADMA_END;
+
+		desc->attr = cpu_to_le16(attr);
+		desc->len = cpu_to_le16(desc_len);
+		desc->addr_lo = cpu_to_le32(lower_32_bits((u64)addr));
+		if (host->adma_desc_size != SDHCI_ADMA_DESC_SIZE_32)
+			desc->addr_hi = cpu_to_le32(upper_32_bits((u64)addr));
+		addr += desc_len;
+		len -= desc_len;
+	}
+	flush_cache((ulong)host->adma_desc,
+		    ALIGN(i * host->adma_desc_size, ARCH_DMA_MINALIGN));
+
+	ctrl = sdhci_readb(host, SDHCI_HOST_CONTROL);
+	ctrl &= ~SDHCI_CTRL_DMA_MASK;
+	if (host->adma_desc_size == SDHCI_ADMA_DESC_SIZE_32)
+		ctrl |= SDHCI_CTRL_ADMA32;
+	else
+		ctrl |= SDHCI_CTRL_ADMA64;
+	sdhci_writeb(host, ctrl, SDHCI_HOST_CONTROL);
+
+	addr = (ulong)host->adma_desc;
+	sdhci_writel(host, lower_32_bits((u64)addr), SDHCI_ADMA_ADDRESS);
+	if (host->adma_desc_size != SDHCI_ADMA_DESC_SIZE_32)
+		sdhci_writel(host, upper_32_bits((u64)addr),
+			     SDHCI_ADMA_ADDRESS_HI);
+
+	return 0;
+}
+#endif
+
 /*
  * No command will be sent by driver if card is busy, so driver must wait
  * for card ready state.
@@ -128,21 +225,53 @@ static int sdhci_transfer_data(struct sdhci_host *host, struct mmc_data *data,
 #endif
 #define CONFIG_SDHCI_CMD_DEFAULT_TIMEOUT	100
 
-static int sdhci_send_command(struct mmc *mmc, struct mmc_cmd *cmd,
-		       struct mmc_data *data)
+static int sdhci_finish_command(struct sdhci_host *host,
+				struct mmc_data *data, int ret)
+{
+	unsigned int stat;
+
+	if (host->quirks & SDHCI_QUIRK_WAIT_SEND_CMD)
+		udelay(1000);
+
+	stat = sdhci_readl(host, SDHCI_INT_STATUS);
+	sdhci_writel(host, SDHCI_INT_ALL_MASK, SDHCI_INT_STATUS);
+	if (!ret) {
+		if ((host->quirks & SDHCI_QUIRK_32BIT_DMA_ADDR) &&
+				!host->is_aligned && (data->flags == MMC_DATA_READ))
+			memcpy(data->dest, aligned_buffer, host->trans_bytes);
+		return 0;
+	}
+
+	sdhci_reset(host, SDHCI_RESET_CMD);
+	sdhci_reset(host, SDHCI_RESET_DATA);
+	if (stat & SDHCI_INT_TIMEOUT)
+		return TIMEOUT;
+	else
+		return COMM_ERR;
+}
+
+/*
+ * Send a command. If @nowait is set, return as soon as the command has been
+ * accepted and leave its data transfer to sdhci_wait_data().
+ */
+static int sdhci_issue_command(struct mmc *mmc, struct mmc_cmd *cmd,
+			       struct mmc_data *data, int nowait)
 {
 	struct sdhci_host *host = mmc->priv;
 	unsigned int stat = 0;
 	int ret = 0;
-	int trans_bytes = 0, is_aligned = 1;
 	u32 mask, flags, mode;
-	unsigned int time = 0, start_addr = 0;
+	unsigned int time = 0;
 	int mmc_dev = mmc->block_dev.dev;
 	unsigned start = get_timer(0);
 
 	/* Timeout unit - ms */
 	static unsigned int cmd_timeout = CONFIG_SDHCI_CMD_DEFAULT_TIMEOUT;
 
+	host->start_addr = 0;
+	host->trans_bytes = 0;
+	host->is_aligned = 1;
+
 	sdhci_writel(host, SDHCI_INT_ALL_MASK, SDHCI_INT_STATUS);
 	mask = SDHCI_CMD_INHIBIT | SDHCI_DATA_INHIBIT;
 
@@ -189,39 +318,21 @@ static int sdhci_send_command(struct mmc *mmc, struct mmc_cmd *cmd,
 	if (data != 0) {
 		sdhci_writeb(host, 0xe, SDHCI_TIMEOUT_CONTROL);
 		mode = SDHCI_TRNS_BLK_CNT_EN;
-		trans_bytes = data->blocks * data->blocksize;
 		if (data->blocks > 1)
 			mode |= SDHCI_TRNS_MULTI;
 
 		if (data->flags == MMC_DATA_READ)
 			mode |= SDHCI_TRNS_READ;
 
+#ifdef CONFIG_MMC_SDHCI_ADMA
+		if (!sdhci_prepare_adma(host, data))
+			mode |= SDHCI_TRNS_DMA;
+#endif
 #ifdef CONFIG_MMC_SDMA
-		if (data->flags == MMC_DATA_READ)
-			start_addr = (unsigned long)data->dest;
-		else
-			start_addr = (unsigned long)data->src;
-		if ((host->quirks & SDHCI_QUIRK_32BIT_DMA_ADDR) &&
-				(start_addr & 0x7) != 0x0) {
-			is_aligned = 0;
-			start_addr = (unsigned long)aligned_buffer;
-			if (data->flags != MMC_DATA_READ)
-				memcpy(aligned_buffer, data->src, trans_bytes);
+		if (!(mode & SDHCI_TRNS_DMA)) {
+			sdhci_prepare_sdma(host, data);
+			mode |= SDHCI_TRNS_DMA;
 		}
-
-#if defined(CONFIG_FIXED_SDHCI_ALIGNED_BUFFER)
-		/*
-		 * Always use this bounce-buffer when
-		 * CONFIG_FIXED_SDHCI_ALIGNED_BUFFER is defined
-		 */
-		is_aligned = 0;
-		start_addr = (unsigned long)aligned_buffer;
-		if (data->flags != MMC_DATA_READ)
-			memcpy(aligned_buffer, data->src, trans_bytes);
-#endif
-
-		sdhci_writel(host, start_addr, SDHCI_DMA_ADDRESS);
-		mode |= SDHCI_TRNS_DMA;
 #endif
 		sdhci_writew(host, SDHCI_MAKE_BLKSZ(SDHCI_DEFAULT_BOUNDARY_ARG,
 				data->blocksize),
@@ -233,9 +344,6 @@ static int sdhci_send_command(struct mmc *mmc, struct mmc_cmd *cmd,
 	}
 
 	sdhci_writel(host, cmd->cmdarg, SDHCI_ARGUMENT);
-#ifdef CONFIG_MMC_SDMA
-	flush_cache(start_addr, trans_bytes);
-#endif
 	sdhci_writew(host, SDHCI_MAKE_CMD(cmd->cmdidx, flags), SDHCI_COMMAND);
 	start = get_timer(0);
 	do {
@@ -260,28 +368,38 @@ static int sdhci_send_command(struct mmc *mmc, struct mmc_cmd *cmd,
 	} else
 		ret = -1;
 
-	if (!ret && data)
-		ret = sdhci_transfer_data(host, data, start_addr);
+	if (!ret && data) {
+		if (nowait)
+			return 0;
+		ret = sdhci_transfer_data(host, data, host->start_addr);
+	}
 
-	if (host->quirks & SDHCI_QUIRK_WAIT_SEND_CMD)
-		udelay(1000);
+	return sdhci_finish_command(host, data, ret);
+}
 
-	stat = sdhci_readl(host, SDHCI_INT_STATUS);
-	sdhci_writel(host, SDHCI_INT_ALL_MASK, SDHCI_INT_STATUS);
-	if (!ret) {
-		if ((host->quirks & SDHCI_QUIRK_32BIT_DMA_ADDR) &&
-				!is_aligned && (data->flags == MMC_DATA_READ))
-			memcpy(data->dest, aligned_buffer, trans_bytes);
-		return 0;
-	}
+static int sdhci_send_command(struct mmc *mmc, struct mmc_cmd *cmd,
+			      struct mmc_data *data)
+{
+	return sdhci_issue_command(mmc, cmd, data, 0);
+}
 
-	sdhci_reset(host, SDHCI_RESET_CMD);
-	sdhci_reset(host, SDHCI_RESET_DATA);
-	if (stat & SDHCI_INT_TIMEOUT)
-		return TIMEOUT;
-	else
-		return COMM_ERR;
+#if defined(CONFIG_MMC_SDMA) || defined(CONFIG_MMC_SDHCI_ADMA)
+static int sdhci_start_data(struct mmc *mmc, struct mmc_cmd *cmd,
+			    struct mmc_data *data)
+{
+	return sdhci_issue_command(mmc, cmd, data, 1);
+}
+
+static int sdhci_wait_data(struct mmc *mmc, struct mmc_data *data)
+{
+	struct sdhci_host *host = mmc->priv;
+	int ret;
+
+	ret = sdhci_transfer_data(host, data, host->start_addr);
+
+	return sdhci_finish_command(host, data, ret);
 }
+#endif
 
 static int sdhci_set_clock(struct mmc *mmc, unsigned int clock)
 {
@@ -388,6 +506,123 @@ static void sdhci_set_power(struct sdhci_host *host, unsigned short power)
 	sdhci_writeb(host, pwr, SDHCI_POWER_CONTROL);
 }
 
+static void sdhci_set_uhs_timing(struct sdhci_host *host, uint timing)
+{
+	u16 ctrl2;
+
+	ctrl2 = sdhci_readw(host, SDHCI_HOST_CONTROL2);
+	ctrl2 &= ~SDHCI_CTRL_UHS_MASK;
+	switch (timing) {
+	case MMC_TIMING_UHS_SDR50:
+		ctrl2 |= SDHCI_CTRL_UHS_SDR50;
+		break;
+	case MMC_TIMING_UHS_SDR104:
+	case MMC_TIMING_MMC_HS200:
+		ctrl2 |= SDHCI_CTRL_UHS_SDR104;
+		break;
+	case MMC_TIMING_MMC_HS400:
+		ctrl2 |= SDHCI_CTRL_HS400;
+		break;
+	}
+	sdhci_writew(host, ctrl2, SDHCI_HOST_CONTROL2);
+}
+
+static int sdhci_set_signal_voltage(struct mmc *mmc, uint voltage)
+{
+	struct sdhci_host *host = mmc->priv;
+	u16 clk, ctrl2;
+
+	if (SDHCI_GET_VERSION(host) < SDHCI_SPEC_300)
+		return voltage == MMC_SIGNAL_VOLTAGE_330 ? 0 : -ENOSYS;
+
+	ctrl2 = sdhci_readw(host, SDHCI_HOST_CONTROL2);
+	switch (voltage) {
+	case MMC_SIGNAL_VOLTAGE_330:
+		ctrl2 &= ~SDHCI_CTRL_VDD_180;
+		sdhci_writew(host, ctrl2, SDHCI_HOST_CONTROL2);
+		return 0;
+	case MMC_SIGNAL_VOLTAGE_180:
+		/* Stop the card clock while the I/O voltage changes */
+		clk = sdhci_readw(host, SDHCI_CLOCK_CONTROL);
+		sdhci_writew(host, clk & ~SDHCI_CLOCK_CARD_EN,
+			     SDHCI_CLOCK_CONTROL);
+
+		ctrl2 |= SDHCI_CTRL_VDD_180;
+		sdhci_writew(host, ctrl2, SDHCI_HOST_CONTROL2);
+		mdelay(5);
+
+		ctrl2 = sdhci_readw(host, SDHCI_HOST_CONTROL2);
+		sdhci_writew(host, clk, SDHCI_CLOCK_CONTROL);
+		mdelay(1);
+		if (!(ctrl2 & SDHCI_CTRL_VDD_180)) {
+			printf("%s: 1.8V signalling not enabled\n", __func__);
+			return -EIO;
+		}
+		return 0;
+	default:
+		return -ENOSYS;
+	}
+}
+
+/* Give up on tuning after this many tuning blocks */
+#define SDHCI_TUNING_LOOP_COUNT		40
+
+/*
+ * Run the controller's tuning procedure: it moves its sampling point on
+ * each tuning block received, until it clears EXEC_TUNING.
+ */
+static int sdhci_execute_tuning(struct mmc *mmc, uint opcode)
+{
+	struct sdhci_host *host = mmc->priv;
+	u32 flags = SDHCI_CMD_RESP_SHORT | SDHCI_CMD_CRC | SDHCI_CMD_INDEX |
+		SDHCI_CMD_DATA;
+	uint blksz = 64;
+	ulong start;
+	u32 stat;
+	u16 ctrl2;
+	int i;
+
+	if (opcode == MMC_CMD_SEND_TUNING_BLOCK_HS200 && mmc->bus_width == 8)
+		blksz = 128;
+
+	ctrl2 = sdhci_readw(host, SDHCI_HOST_CONTROL2);
+	ctrl2 |= SDHCI_CTRL_EXEC_TUNING;
+	sdhci_writew(host, ctrl2, SDHCI_HOST_CONTROL2);
+
+	for (i = 0; i < SDHCI_TUNING_LOOP_COUNT; i++) {
+		sdhci_writel(host, SDHCI_INT_ALL_MASK, SDHCI_INT_STATUS);
+		sdhci_writew(host, SDHCI_MAKE_BLKSZ(SDHCI_DEFAULT_BOUNDARY_ARG,
+				blksz), SDHCI_BLOCK_SIZE);
+		sdhci_writew(host, 1, SDHCI_BLOCK_COUNT);
+		sdhci_writew(host, SDHCI_TRNS_READ, SDHCI_TRANSFER_MODE);
+		sdhci_writel(host, 0, SDHCI_ARGUMENT);
+		sdhci_writew(host, SDHCI_MAKE_CMD(opcode, flags), SDHCI_COMMAND);
+
+		/* The controller swallows the block itself */
+		start = get_timer(0);
+		do {
+			stat = sdhci_readl(host, SDHCI_INT_STATUS);
+		} while (!(stat & SDHCI_INT_DATA_AVAIL) &&
+			 get_timer(start) < 50);
+
+		ctrl2 = sdhci_readw(host, SDHCI_HOST_CONTROL2);
+		if (!(ctrl2 & SDHCI_CTRL_EXEC_TUNING))
+			break;
+	}
+	sdhci_writel(host, SDHCI_INT_ALL_MASK, SDHCI_INT_STATUS);
+
+	if ((ctrl2 & SDHCI_CTRL_EXEC_TUNING) ||
+	    !(ctrl2 & SDHCI_CTRL_TUNED_CLK)) {
+		ctrl2 &= ~(SDHCI_CTRL_EXEC_TUNING | SDHCI_CTRL_TUNED_CLK);
+		sdhci_writew(host, ctrl2, SDHCI_HOST_CONTROL2);
+		sdhci_reset(host, SDHCI_RESET_CMD);
+		sdhci_reset(host, SDHCI_RESET_DATA);
+		return -EIO;
+	}
+
+	return 0;
+}
+
 static void sdhci_set_ios(struct mmc *mmc)
 {
 	u32 ctrl;
@@ -425,6 +660,11 @@ static void sdhci_set_ios(struct mmc *mmc)
 		ctrl &= ~SDHCI_CTRL_HISPD;
 
 	sdhci_writeb(host, ctrl, SDHCI_HOST_CONTROL);
+
+	if ((IS_ENABLED(CONFIG_MMC_UHS_SUPPORT) ||
+	     IS_ENABLED(CONFIG_MMC_HS200_SUPPORT)) &&
+	    SDHCI_GET_VERSION(host) >= SDHCI_SPEC_300)
+		sdhci_set_uhs_timing(host, mmc->timing);
 }
 
 static int sdhci_init(struct mmc *mmc)
@@ -440,6 +680,22 @@ static int sdhci_init(struct mmc *mmc)
 		}
 	}
 
+#ifdef CONFIG_MMC_SDHCI_ADMA
+	if (host->adma_desc_size && !host->adma_desc) {
+		host->adma_desc_count = DIV_ROUND_UP(mmc->cfg->b_max *
+				MMC_MAX_BLOCK_LEN, SDHCI_ADMA_MAX_LEN);
+		host->adma_desc = memalign(ARCH_DMA_MINALIGN,
+				ALIGN(host->adma_desc_count *
+				      host->adma_desc_size,
+				      ARCH_DMA_MINALIGN));
+		if (!host->adma_desc) {
+			printf("%s: ADMA descriptor alloc failed, not using ADMA\n",
+			       __func__);
+			host->adma_desc_size = 0;
+		}
+	}
+#endif
+
 	sdhci_set_power(host, fls(mmc->cfg->voltages) - 1);
 
 	if (host->quirks & SDHCI_QUIRK_NO_CD) {
@@ -469,6 +725,12 @@ static const struct mmc_ops sdhci_ops = {
 	.send_cmd	= sdhci_send_command,
 	.set_ios	= sdhci_set_ios,
 	.init		= sdhci_init,
+	.set_signal_voltage = sdhci_set_signal_voltage,
+	.execute_tuning	= sdhci_execute_tuning,
+#if defined(CONFIG_MMC_SDMA) || defined(CONFIG_MMC_SDHCI_ADMA)
+	.start_data	= sdhci_start_data,
+	.wait_data	= sdhci_wait_data,
+#endif
 };
 
 int add_sdhci(struct sdhci_host *host, u32 max_clk, u32 min_clk)
@@ -487,6 +749,17 @@ int add_sdhci(struct sdhci_host *host, u32 max_clk, u32 min_clk)
 	}
 #endif
 
+#ifdef CONFIG_MMC_SDHCI_ADMA
+	host->adma_desc_size = 0;
+	if (SDHCI_GET_VERSION(host) >= SDHCI_SPEC_200 &&
+	    (caps & SDHCI_CAN_DO_ADMA2)) {
+		if (sizeof(ulong) > 4 && (caps & SDHCI_CAN_64BIT))
+			host->adma_desc_size = SDHCI_ADMA_DESC_SIZE_64;
+		else
+			host->adma_desc_size = SDHCI_ADMA_DESC_SIZE_32;
+	}
+#endif
+
 	if (max_clk)
 		host->cfg.f_max = max_clk;
 	else {
@@ -530,6 +803,22 @@ int add_sdhci(struct sdhci_host *host, u32 max_clk, u32 min_clk)
 		if (caps & SDHCI_CAN_DO_8BIT)
 			host->cfg.host_caps |= MMC_MODE_8BIT;
 	}
+	if (SDHCI_GET_VERSION(host) >= SDHCI_SPEC_300) {
+		caps = sdhci_readl(host, SDHCI_CAPABILITIES_1);
+		if (IS_ENABLED(CONFIG_MMC_UHS_SUPPORT)) {
+			if (caps & SDHCI_SUPPORT_SDR50)
+				host->cfg.host_caps |= MMC_MODE_UHS_SDR50;
+			if (caps & SDHCI_SUPPORT_SDR104)
+				host->cfg.host_caps |= MMC_MODE_UHS_SDR104;
+		}
+		/*
+		 * SDR104 does not mean that the board runs the eMMC I/O
+		 * lines at 1.8V, so HS200 is left to host->host_caps.
+		 */
+	}
+	/* Commands with a busy response complete when the card is ready */
+	if (!(host->quirks & SDHCI_QUIRK_BROKEN_R1B))
+		host->cfg.host_caps |= MMC_MODE_BUSY_END;
 	if (host->host_caps)
 		host->cfg.host_caps |= host->host_caps;
 
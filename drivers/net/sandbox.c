@@ -12,6 +12,10 @@
 #include <malloc.h>
 #include <net.h>
 #include <asm/test.h>
+#ifdef CONFIG_PROT_TCP
+#include <asm/unaligned.h>
+#include "../../net/tcp.h"
+#endif
 
 DECLARE_GLOBAL_DATA_PTR;
 
@@ -54,6 +58,102 @@ void sandbox_eth_skip_timeout(void)
 	skip_timeout = true;
 }
 
+#ifdef CONFIG_PROT_TCP
+/* What the fake host serves over HTTP, whatever is asked for */
+static const char sb_eth_http_reply[] =
+	"HTTP/1.1 200 OK\r\nContent-Length: 11\r\n\r\nhello world";
+#define SB_ETH_HTTP_REPLY_LEN	(sizeof(sb_eth_http_reply) - 1)
+
+/* Initial sequence number of the fake host */
+#define SB_ETH_TCP_ISS		0x10000000
+
+static u16 sb_eth_tcp_checksum(struct ip_tcp_hdr *ip, int tcp_len)
+{
+	struct {
+		struct in_addr src;
+		struct in_addr dst;
+		u8 zero;
+		u8 proto;
+		u16 len;
+	} ph;
+
+	net_copy_ip(&ph.src, &ip->ip_src);
+	net_copy_ip(&ph.dst, &ip->ip_dst);
+	ph.zero = 0;
+	ph.proto = IPPROTO_TCP;
+	ph.len = htons(tcp_len);
+
+	return add_ip_checksums(sizeof(ph),
+				compute_ip_checksum(&ph, sizeof(ph)),
+				compute_ip_checksum(&ip->tcp_src, tcp_len));
+}
+
+/*
+ * sb_eth_tcp_reply()
+ *
+ * Act as a one-shot HTTP server. A SYN gets a SYN-ACK, the request gets
+ * the whole reply and a FIN in one segment, and U-Boot's FIN gets an ACK.
+ * No segment needs more than one packet in reply, as there is only one
+ * receive buffer.
+ */
+static void sb_eth_tcp_reply(struct eth_sandbox_priv *priv,
+			     struct ethernet_hdr *eth, struct ip_tcp_hdr *ip)
+{
+	struct ethernet_hdr *eth_recv = (void *)priv->recv_packet_buffer;
+	struct ip_tcp_hdr *ipr = (void *)priv->recv_packet_buffer +
+		ETHER_HDR_SIZE;
+	int hdr_len = (ip->tcp_hlen >> 4) * 4;
+	int len = ntohs(ip->ip_len) - IP_HDR_SIZE - hdr_len;
+	u32 seq = get_unaligned_be32(&ip->tcp_seq);
+	u32 ack, our_seq;
+	int data_len = 0;
+	u8 flags;
+
+	if (ip->tcp_flags & TCP_SYN) {
+		flags = TCP_SYN | TCP_ACK;
+		our_seq = SB_ETH_TCP_ISS;
+		ack = seq + 1;
+	} else if (len) {
+		flags = TCP_ACK | TCP_PSH | TCP_FIN;
+		our_seq = SB_ETH_TCP_ISS + 1;
+		ack = seq + len;
+		data_len = SB_ETH_HTTP_REPLY_LEN;
+	} else if (ip->tcp_flags & TCP_FIN) {
+		flags = TCP_ACK;
+		our_seq = SB_ETH_TCP_ISS + 1 + SB_ETH_HTTP_REPLY_LEN + 1;
+		ack = seq + 1;
+	} else {
+		return;
+	}
+
+	memcpy(eth_recv->et_dest, eth->et_src, ARP_HLEN);
+	memcpy(eth_recv->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth_recv->et_protlen = htons(PROT_IP);
+
+	net_set_ip_header((uchar *)ipr, net_read_ip(&ip->ip_src),
+			  net_read_ip(&ip->ip_dst));
+	ipr->ip_len = htons(IP_TCP_HDR_SIZE + data_len);
+	ipr->ip_p = IPPROTO_TCP;
+	ipr->ip_sum = compute_ip_checksum(ipr, IP_HDR_SIZE);
+
+	ipr->tcp_src = ip->tcp_dst;
+	ipr->tcp_dst = ip->tcp_src;
+	put_unaligned_be32(our_seq, &ipr->tcp_seq);
+	put_unaligned_be32(ack, &ipr->tcp_ack);
+	ipr->tcp_hlen = (TCP_HDR_SIZE / 4) << 4;
+	ipr->tcp_flags = flags;
+	ipr->tcp_win = htons(0xffff);
+	ipr->tcp_urg = 0;
+	memcpy(ipr + 1, sb_eth_http_reply, data_len);
+	/* zero the byte after odd-sized data so that the checksum works */
+	((uchar *)(ipr + 1))[data_len] = 0;
+	ipr->tcp_xsum = 0;
+	ipr->tcp_xsum = sb_eth_tcp_checksum(ipr, TCP_HDR_SIZE + data_len);
+
+	priv->recv_packet_length = ETHER_HDR_SIZE + IP_TCP_HDR_SIZE + data_len;
+}
+#endif
+
 static int sb_eth_start(struct udevice *dev)
 {
 	struct eth_sandbox_priv *priv = dev_get_priv(dev);
@@ -146,6 +246,10 @@ static int sb_eth_send(struct udevice *dev, void *packet, int length)
 
 				priv->recv_packet_length = length;
 			}
+#ifdef CONFIG_PROT_TCP
+		} else if (ip->ip_p == IPPROTO_TCP) {
+			sb_eth_tcp_reply(priv, eth, packet + ETHER_HDR_SIZE);
+#endif
 		}
 	}
 
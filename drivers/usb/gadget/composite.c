@@ -11,7 +11,12 @@
 #include <linux/bitops.h>
 #include <linux/usb/composite.h>
 
+/* DFU moves its data through ep0, in blocks of up to its transfer size */
+#if defined(CONFIG_SYS_DFU_TRANSFER_SIZE) && CONFIG_SYS_DFU_TRANSFER_SIZE > 4096
+#define USB_BUFSIZ	CONFIG_SYS_DFU_TRANSFER_SIZE
+#else
 #define USB_BUFSIZ	4096
+#endif
 
 static struct usb_composite_driver *composite;
 
@@ -62,7 +62,7 @@ static const struct dfu_function_descriptor dfu_func = {
 				DFU_BIT_CAN_UPLOAD |
 				DFU_BIT_CAN_DNLOAD,
 	.wDetachTimeOut =	0,
-	.wTransferSize =	DFU_USB_BUFSIZ,
+	.wTransferSize =	DFU_TRANSFER_SIZE,
 	.bcdDFUVersion =	__constant_cpu_to_le16(0x0110),
 };
 
@@ -208,7 +208,7 @@ static void handle_getstatus(struct usb_request *req)
 
 	if (f_dfu->poll_timeout)
 		if (!(f_dfu->blk_seq_num %
-		      (dfu_get_buf_size() / DFU_USB_BUFSIZ)))
+		      (dfu_get_buf_size() / DFU_TRANSFER_SIZE)))
 			dfu_set_poll_timeout(dstat, f_dfu->poll_timeout);
 
 	/* send status response */
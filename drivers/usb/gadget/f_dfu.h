@@ -24,6 +24,13 @@
 /* big enough to hold our biggest descriptor */
 #define DFU_USB_BUFSIZ			4096
 
+/* largest block of data in one DNLOAD/UPLOAD request */
+#ifdef CONFIG_SYS_DFU_TRANSFER_SIZE
+#define DFU_TRANSFER_SIZE		CONFIG_SYS_DFU_TRANSFER_SIZE
+#else
+#define DFU_TRANSFER_SIZE		DFU_USB_BUFSIZ
+#endif
+
 #define USB_REQ_DFU_DETACH		0x00
 #define USB_REQ_DFU_DNLOAD		0x01
 #define USB_REQ_DFU_UPLOAD		0x02
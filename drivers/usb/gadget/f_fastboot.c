@@ -40,12 +40,25 @@
 
 #define EP_BUFFER_SIZE			4096
 
+/* Largest USB request used to receive a download */
+#ifdef CONFIG_FASTBOOT_DL_REQ_SIZE
+#define DL_REQ_SIZE			CONFIG_FASTBOOT_DL_REQ_SIZE
+#else
+#define DL_REQ_SIZE			(1024 * 1024)
+#endif
+
+/* Download size allowed while images are flashed as they are downloaded */
+#define STREAM_DOWNLOAD_SIZE		0x7ffff000
+
 struct f_fastboot {
 	struct usb_function usb_function;
 
 	/* IN/OUT EP's and corresponding requests */
 	struct usb_ep *in_ep, *out_ep;
 	struct usb_request *in_req, *out_req;
+
+	/* OUT requests receiving a download */
+	struct usb_request *dl_req[2];
 };
 
 static inline struct f_fastboot *func_to_fastboot(struct usb_function *f)
@@ -57,7 +70,14 @@ static struct f_fastboot *fastboot_func;
 static unsigned int fastboot_flash_session_id;
 static unsigned int download_size;
 static unsigned int download_bytes;
+static unsigned int download_queued;	/* bytes asked for by queued reqs */
 static bool is_high_speed;
+#ifdef CONFIG_FASTBOOT_FLASH_MMC_DEV
+/* Partition which downloads are flashed to as they arrive, if any */
+static char stream_part[33];
+static bool download_streamed;
+static char stream_response[FASTBOOT_RESPONSE_LEN];
+#endif
 
 static struct usb_endpoint_descriptor fs_ep_in = {
 	.bLength            = USB_DT_ENDPOINT_SIZE,
@@ -125,6 +145,7 @@ static struct usb_gadget_strings *fastboot_strings[] = {
 };
 
 static void rx_handler_command(struct usb_ep *ep, struct usb_request *req);
+static void rx_handler_dl_image(struct usb_ep *ep, struct usb_request *req);
 static int strcmp_l1(const char *s1, const char *s2);
 
 
@@ -194,10 +215,19 @@ static void fastboot_unbind(struct usb_configuration *c, struct usb_function *f)
 static void fastboot_disable(struct usb_function *f)
 {
 	struct f_fastboot *f_fb = func_to_fastboot(f);
+	int i;
 
 	usb_ep_disable(f_fb->out_ep);
 	usb_ep_disable(f_fb->in_ep);
 
+	/* These point into the download buffer */
+	for (i = 0; i < ARRAY_SIZE(f_fb->dl_req); i++) {
+		if (f_fb->dl_req[i]) {
+			usb_ep_free_request(f_fb->out_ep, f_fb->dl_req[i]);
+			f_fb->dl_req[i] = NULL;
+		}
+	}
+
 	if (f_fb->out_req) {
 		free(f_fb->out_req->buf);
 		usb_ep_free_request(f_fb->out_ep, f_fb->out_req);
@@ -232,7 +262,7 @@ static struct usb_request *fastboot_start_ep(struct usb_ep *ep)
 static int fastboot_set_alt(struct usb_function *f,
 			    unsigned interface, unsigned alt)
 {
-	int ret;
+	int ret, i;
 	struct usb_composite_dev *cdev = f->config->cdev;
 	struct usb_gadget *gadget = cdev->gadget;
 	struct f_fastboot *f_fb = func_to_fastboot(f);
@@ -261,6 +291,16 @@ static int fastboot_set_alt(struct usb_function *f,
 	}
 	f_fb->out_req->complete = rx_handler_command;
 
+	for (i = 0; i < ARRAY_SIZE(f_fb->dl_req); i++) {
+		f_fb->dl_req[i] = usb_ep_alloc_request(f_fb->out_ep, 0);
+		if (!f_fb->dl_req[i]) {
+			puts("failed to alloc download req\n");
+			ret = -EINVAL;
+			goto err;
+		}
+		f_fb->dl_req[i]->complete = rx_handler_dl_image;
+	}
+
 	ret = usb_ep_enable(f_fb->in_ep, &fs_ep_in);
 	if (ret) {
 		puts("failed to enable in ep\n");
@@ -370,6 +410,15 @@ static int strcmp_l1(const char *s1, const char *s2)
 	return strncmp(s1, s2, strlen(s1));
 }
 
+static unsigned int max_download_size(void)
+{
+#ifdef CONFIG_FASTBOOT_FLASH_MMC_DEV
+	if (stream_part[0])
+		return STREAM_DOWNLOAD_SIZE;
+#endif
+	return CONFIG_FASTBOOT_BUF_SIZE;
+}
+
 static void cb_getvar(struct usb_ep *ep, struct usb_request *req)
 {
 	char *cmd = req->buf;
@@ -395,7 +444,7 @@ static void cb_getvar(struct usb_ep *ep, struct usb_request *req)
 		!strcmp_l1("max-download-size", cmd)) {
 		char str_num[12];
 
-		sprintf(str_num, "0x%08x", CONFIG_FASTBOOT_BUF_SIZE);
+		sprintf(str_num, "0x%08x", max_download_size());
 		strncat(response, str_num, chars_left);
 
 		/*
@@ -419,14 +468,15 @@ static void cb_getvar(struct usb_ep *ep, struct usb_request *req)
 	fastboot_tx_write_str(response);
 }
 
-static unsigned int rx_bytes_expected(unsigned int maxpacket)
+static unsigned int rx_bytes_expected(unsigned int maxpacket,
+				      unsigned int size)
 {
-	int rx_remain = download_size - download_bytes;
+	int rx_remain = download_size - download_bytes - download_queued;
 	int rem = 0;
-	if (rx_remain < 0)
+	if (rx_remain <= 0)
 		return 0;
-	if (rx_remain > EP_BUFFER_SIZE)
-		return EP_BUFFER_SIZE;
+	if (rx_remain > size)
+		return size;
 	if (rx_remain < maxpacket) {
 		rx_remain = maxpacket;
 	} else if (rx_remain % maxpacket != 0) {
@@ -436,6 +486,62 @@ static unsigned int rx_bytes_expected(unsigned int maxpacket)
 	return rx_remain;
 }
 
+/*
+ * Queue a request for the next part of the download, if any is left. The
+ * data goes straight into the download buffer. When it is flashed as it
+ * arrives, each of the two requests has its own half of the buffer and
+ * one is filled while the data of the other is written out.
+ */
+static void rx_queue_dl(struct usb_ep *ep, struct usb_request *req)
+{
+	unsigned int max, size = DL_REQ_SIZE;
+	void *buf = (void *)CONFIG_FASTBOOT_BUF_ADDR;
+	void *end = buf + CONFIG_FASTBOOT_BUF_SIZE;
+
+	max = is_high_speed ? hs_ep_out.wMaxPacketSize :
+			fs_ep_out.wMaxPacketSize;
+
+#ifdef CONFIG_FASTBOOT_FLASH_MMC_DEV
+	if (download_streamed) {
+		size = min(size, (unsigned int)CONFIG_FASTBOOT_BUF_SIZE / 2);
+		size -= size % max;
+		if (req == fastboot_func->dl_req[1])
+			buf += size;
+	} else
+#endif
+	{
+		buf += download_bytes;
+	}
+
+	req->length = rx_bytes_expected(max, size);
+	if (!req->length)
+		return;
+	if (req->length < ep->maxpacket)
+		req->length = ep->maxpacket;
+
+	/*
+	 * Don't let the last packet run past the end of the buffer: receive
+	 * the whole packets which fit in place, then the final short packet
+	 * into the command buffer, from where it is copied.
+	 */
+	if (buf + req->length > end) {
+		size = end - buf;
+		size -= size % max;
+		if (size) {
+			req->length = size;
+		} else {
+			req->length = min_t(unsigned int, req->length,
+					    EP_BUFFER_SIZE);
+			buf = fastboot_func->out_req->buf;
+		}
+	}
+
+	req->buf = buf;
+	req->actual = 0;
+	download_queued += req->length;
+	usb_ep_queue(ep, req, 0);
+}
+
 #define BYTES_PER_DOT	0x20000
 static void rx_handler_dl_image(struct usb_ep *ep, struct usb_request *req)
 {
@@ -444,18 +550,25 @@ static void rx_handler_dl_image(struct usb_ep *ep, struct usb_request *req)
 	const unsigned char *buffer = req->buf;
 	unsigned int buffer_size = req->actual;
 	unsigned int pre_dot_num, now_dot_num;
-	unsigned int max;
 
 	if (req->status != 0) {
 		printf("Bad status: %d\n", req->status);
 		return;
 	}
 
+	download_queued -= req->length;
 	if (buffer_size < transfer_size)
 		transfer_size = buffer_size;
 
-	memcpy((void *)CONFIG_FASTBOOT_BUF_ADDR + download_bytes,
-	       buffer, transfer_size);
+#ifdef CONFIG_FASTBOOT_FLASH_MMC_DEV
+	/* Errors are reported once the download is complete */
+	if (download_streamed)
+		fb_mmc_stream_write(req->buf, transfer_size);
+	else
+#endif
+	if (buffer == fastboot_func->out_req->buf)
+		memcpy((void *)CONFIG_FASTBOOT_BUF_ADDR + download_bytes,
+		       buffer, transfer_size);
 
 	pre_dot_num = download_bytes / BYTES_PER_DOT;
 	download_bytes += transfer_size;
@@ -474,50 +587,68 @@ static void rx_handler_dl_image(struct usb_ep *ep, struct usb_request *req)
 		 * it will be used in the next possible flashing command
 		 */
 		download_size = 0;
-		req->complete = rx_handler_command;
+
+		/* Go back to receiving commands */
+		req = fastboot_func->out_req;
 		req->length = EP_BUFFER_SIZE;
+		req->actual = 0;
+		usb_ep_queue(ep, req, 0);
 
 		sprintf(response, "OKAY");
+#ifdef CONFIG_FASTBOOT_FLASH_MMC_DEV
+		if (download_streamed) {
+			fb_mmc_stream_finish(stream_response);
+			if (strncmp(stream_response, "OKAY", 4))
+				strcpy(response, stream_response);
+		}
+#endif
 		fastboot_tx_write_str(response);
 
 		printf("\ndownloading of %d bytes finished\n", download_bytes);
 	} else {
-		max = is_high_speed ? hs_ep_out.wMaxPacketSize :
-				fs_ep_out.wMaxPacketSize;
-		req->length = rx_bytes_expected(max);
-		if (req->length < ep->maxpacket)
-			req->length = ep->maxpacket;
+		rx_queue_dl(ep, req);
 	}
-
-	req->actual = 0;
-	usb_ep_queue(ep, req, 0);
 }
 
 static void cb_download(struct usb_ep *ep, struct usb_request *req)
 {
 	char *cmd = req->buf;
 	char response[FASTBOOT_RESPONSE_LEN];
-	unsigned int max;
 
 	strsep(&cmd, ":");
 	download_size = simple_strtoul(cmd, NULL, 16);
 	download_bytes = 0;
+	download_queued = 0;
 
 	printf("Starting download of %d bytes\n", download_size);
 
+#ifdef CONFIG_FASTBOOT_FLASH_MMC_DEV
+	download_streamed = false;
+#endif
 	if (0 == download_size) {
 		sprintf(response, "FAILdata invalid size");
-	} else if (download_size > CONFIG_FASTBOOT_BUF_SIZE) {
+	} else if (download_size > max_download_size()) {
 		download_size = 0;
 		sprintf(response, "FAILdata too large");
 	} else {
+#ifdef CONFIG_FASTBOOT_FLASH_MMC_DEV
+		if (stream_part[0]) {
+			if (fb_mmc_stream_start(stream_part,
+						fastboot_flash_session_id,
+						response)) {
+				download_size = 0;
+				fastboot_tx_write_str(response);
+				return;
+			}
+			download_streamed = true;
+		}
+#endif
 		sprintf(response, "DATA%08x", download_size);
-		req->complete = rx_handler_dl_image;
-		max = is_high_speed ? hs_ep_out.wMaxPacketSize :
-			fs_ep_out.wMaxPacketSize;
-		req->length = rx_bytes_expected(max);
-		if (req->length < ep->maxpacket)
-			req->length = ep->maxpacket;
+		rx_queue_dl(ep, fastboot_func->dl_req[0]);
+#ifdef CONFIG_FASTBOOT_FLASH_MMC_DEV
+		if (download_streamed)
+			rx_queue_dl(ep, fastboot_func->dl_req[1]);
+#endif
 	}
 	fastboot_tx_write_str(response);
 }
@@ -566,6 +697,19 @@ static void cb_flash(struct usb_ep *ep, struct usb_request *req)
 		return;
 	}
 
+#ifdef CONFIG_FASTBOOT_FLASH_MMC_DEV
+	/* The image was written while it was downloaded */
+	if (download_streamed) {
+		if (strcmp(cmd, stream_part))
+			strcpy(response, "FAILimage went to another partition");
+		else
+			strcpy(response, stream_response);
+		fastboot_flash_session_id++;
+		fastboot_tx_write_str(response);
+		return;
+	}
+#endif
+
 	strcpy(response, "FAILno flash device defined");
 #ifdef CONFIG_FASTBOOT_FLASH_MMC_DEV
 	fb_mmc_flash_write(cmd, fastboot_flash_session_id,
@@ -582,6 +726,27 @@ static void cb_flash(struct usb_ep *ep, struct usb_request *req)
 }
 #endif
 
+#ifdef CONFIG_FASTBOOT_FLASH_MMC_DEV
+/*
+ * "oem stream <partition>" makes the following downloads go to the
+ * partition as they arrive, "oem stream" on its own stops this.
+ */
+static void oem_stream(const char *arg)
+{
+	while (*arg == ' ' || *arg == ':')
+		arg++;
+
+	strlcpy(stream_part, arg, sizeof(stream_part));
+	if (stream_part[0])
+		printf("Flashing downloads to '%s' as they arrive\n",
+		       stream_part);
+	else
+		puts("Keeping downloads in memory\n");
+
+	fastboot_tx_write_str("OKAY");
+}
+#endif
+
 static void cb_oem(struct usb_ep *ep, struct usb_request *req)
 {
 	char *cmd = req->buf;
@@ -594,6 +759,8 @@ static void cb_oem(struct usb_ep *ep, struct usb_request *req)
 			fastboot_tx_write_str("FAIL");
                 else
 			fastboot_tx_write_str("OKAY");
+	} else if (strncmp("stream", cmd + 4, 6) == 0) {
+		oem_stream(cmd + 10);
 	} else
 #endif
 	if (strncmp("unlock", cmd + 4, 8) == 0) {
@@ -698,5 +865,8 @@ static void rx_handler_command(struct usb_ep *ep, struct usb_request *req)
 
 	*cmdbuf = '\0';
 	req->actual = 0;
-	usb_ep_queue(ep, req, 0);
+
+	/* A download is received with its own requests */
+	if (!download_size)
+		usb_ep_queue(ep, req, 0);
 }
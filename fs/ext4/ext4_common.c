@@ -46,6 +46,131 @@ int ext4fs_indir3_blkno = -1;
 struct ext2_inode *g_parent_inode;
 static int symlinknest;
 
+/*
+ * Metadata blocks (group descriptors, inode tables, directories and extent
+ * trees) are kept in an LRU cache while the filesystem is mounted, so that
+ * path lookups and block mapping do not read them from the device again.
+ */
+struct ext4_cache_entry {
+	unsigned long long blkno;	/* filesystem block, 0 if unused */
+	unsigned long last_use;
+	char *buf;
+};
+
+static struct ext4_cache_entry ext4fs_cache[CONFIG_EXT4_CACHE_BLOCKS];
+static int ext4fs_cache_blksz;
+static unsigned long ext4fs_cache_clock;
+static struct ext4_cache_stats ext4fs_cache_stats;
+
+#if defined(CONFIG_EXT4_WRITE)
+/* Forget cached blocks which overlap [first, last] */
+static void ext4fs_cache_invalidate(unsigned long long first,
+				    unsigned long long last)
+{
+	int i;
+
+	for (i = 0; i < CONFIG_EXT4_CACHE_BLOCKS; i++) {
+		if (ext4fs_cache[i].blkno >= first &&
+		    ext4fs_cache[i].blkno <= last)
+			ext4fs_cache[i].blkno = 0;
+	}
+}
+#endif
+
+static void ext4fs_cache_free(void)
+{
+	int i;
+
+	for (i = 0; i < CONFIG_EXT4_CACHE_BLOCKS; i++) {
+		free(ext4fs_cache[i].buf);
+		ext4fs_cache[i].buf = NULL;
+		ext4fs_cache[i].blkno = 0;
+	}
+	ext4fs_cache_blksz = 0;
+}
+
+/*
+ * Get a filesystem block through the cache. The buffer returned stays
+ * valid until the next call.
+ */
+static char *ext4fs_cache_get(struct ext2_data *data,
+			      unsigned long long blkno)
+{
+	struct ext4_cache_entry *entry, *victim;
+	int blksz = EXT2_BLOCK_SIZE(data);
+	int log2_blksz = LOG2_BLOCK_SIZE(data) - get_fs()->dev_desc->log2blksz;
+	int i;
+
+	if (blksz != ext4fs_cache_blksz) {
+		ext4fs_cache_free();
+		ext4fs_cache_blksz = blksz;
+	}
+
+	victim = &ext4fs_cache[0];
+	for (i = 0; i < CONFIG_EXT4_CACHE_BLOCKS; i++) {
+		entry = &ext4fs_cache[i];
+		if (entry->blkno == blkno) {
+			entry->last_use = ++ext4fs_cache_clock;
+			ext4fs_cache_stats.hits++;
+			return entry->buf;
+		}
+		if (!entry->blkno) {
+			if (victim->blkno)
+				victim = entry;
+		} else if (victim->blkno &&
+			   entry->last_use < victim->last_use) {
+			victim = entry;
+		}
+	}
+
+	ext4fs_cache_stats.misses++;
+	if (!victim->buf) {
+		victim->buf = zalloc(blksz);
+		if (!victim->buf)
+			return NULL;
+	}
+	victim->blkno = 0;
+	if (!ext4fs_devread((lbaint_t)blkno << log2_blksz, 0, blksz,
+			    victim->buf))
+		return NULL;
+	victim->blkno = blkno;
+	victim->last_use = ++ext4fs_cache_clock;
+
+	return victim->buf;
+}
+
+int ext4fs_cache_read(struct ext2_data *data, unsigned long long blkno,
+		      int byte_offset, int byte_len, char *buf)
+{
+	char *block = ext4fs_cache_get(data, blkno);
+
+	if (!block)
+		return 0;
+	memcpy(buf, block + byte_offset, byte_len);
+
+	return 1;
+}
+
+const struct ext4_cache_stats *ext4fs_get_cache_stats(void)
+{
+	int i;
+
+	ext4fs_cache_stats.size = CONFIG_EXT4_CACHE_BLOCKS;
+	ext4fs_cache_stats.used = 0;
+	for (i = 0; i < CONFIG_EXT4_CACHE_BLOCKS; i++) {
+		if (ext4fs_cache[i].blkno)
+			ext4fs_cache_stats.used++;
+	}
+
+	return &ext4fs_cache_stats;
+}
+
+void ext4fs_reset_cache_stats(void)
+{
+	ext4fs_cache_stats.hits = 0;
+	ext4fs_cache_stats.misses = 0;
+}
+
 #if defined(CONFIG_EXT4_WRITE)
 uint32_t ext4fs_div_roundup(uint32_t size, uint32_t n)
 {
@@ -65,6 +190,12 @@ void put_ext4(uint64_t off, void *buf, uint32_t size)
 	int log2blksz = fs->dev_desc->log2blksz;
 	ALLOC_CACHE_ALIGN_BUFFER(unsigned char, sec_buf, fs->dev_desc->blksz);
 
+	/* Do not let the cache return what was there before */
+	if (size)
+		ext4fs_cache_invalidate(off >> LOG2_BLOCK_SIZE(ext4fs_root),
+					(off + size - 1) >>
+					LOG2_BLOCK_SIZE(ext4fs_root));
+
 	startblock = off >> log2blksz;
 	startblock += part_offset;
 	remainder = off & (uint64_t)(fs->dev_desc->blksz - 1);
@@ -1411,13 +1542,11 @@ void ext4fs_allocate_blocks(struct ext2_inode *file_inode,
 #endif
 
 static struct ext4_extent_header *ext4fs_get_extent_block
-	(struct ext2_data *data, char *buf,
-		struct ext4_extent_header *ext_block,
-		uint32_t fileblock, int log2_blksz)
+	(struct ext4_extent_header *ext_block, uint32_t fileblock)
 {
 	struct ext4_extent_idx *index;
 	unsigned long long block;
-	int blksz = EXT2_BLOCK_SIZE(data);
+	char *buf;
 	int i;
 
 	while (1) {
@@ -1441,20 +1570,79 @@ static struct ext4_extent_header *ext4fs_get_extent_block
 		block = le16_to_cpu(index[i].ei_leaf_hi);
 		block = (block << 32) + le32_to_cpu(index[i].ei_leaf_lo);
 
-		if (ext4fs_devread((lbaint_t)block << log2_blksz, 0, blksz,
-				   buf))
-			ext_block = (struct ext4_extent_header *)buf;
-		else
+		buf = ext4fs_cache_get(ext4fs_root, block);
+		if (!buf)
 			return 0;
+		ext_block = (struct ext4_extent_header *)buf;
 	}
 }
 
+/*
+ * Map a block of an extent-mapped file. On success *count is the number of
+ * blocks from @fileblock on which are mapped contiguously, or which are all
+ * a hole (or unwritten) if the return value is 0. Returns the physical
+ * block number, 0 for a hole, or a negative error.
+ */
+long int ext4fs_map_extent(struct ext2_inode *inode, uint32_t fileblock,
+			   uint32_t *count)
+{
+	struct ext4_extent_header *ext_block;
+	struct ext4_extent *extent;
+	unsigned long long start;
+	uint32_t len;
+	int entries;
+	int i = -1;
+
+	ext_block = ext4fs_get_extent_block((struct ext4_extent_header *)
+					    inode->b.blocks.dir_blocks,
+					    fileblock);
+	if (!ext_block) {
+		printf("invalid extent block\n");
+		return -EINVAL;
+	}
+
+	extent = (struct ext4_extent *)(ext_block + 1);
+	entries = le16_to_cpu(ext_block->eh_entries);
+
+	do {
+		i++;
+		if (i >= entries)
+			break;
+	} while (fileblock >= le32_to_cpu(extent[i].ee_block));
+
+	/* A hole runs up to the next extent of this leaf, if there is one */
+	if (i < entries)
+		*count = le32_to_cpu(extent[i].ee_block) - fileblock;
+	else
+		*count = 1;
+
+	if (--i < 0)
+		return 0;
+
+	len = le16_to_cpu(extent[i].ee_len);
+	/* Unwritten extents read as zeroes */
+	if (len > EXT_INIT_MAX_LEN) {
+		len -= EXT_INIT_MAX_LEN;
+		start = 0;
+	} else {
+		start = le16_to_cpu(extent[i].ee_start_hi);
+		start = (start << 32) + le32_to_cpu(extent[i].ee_start_lo);
+	}
+
+	fileblock -= le32_to_cpu(extent[i].ee_block);
+	if (fileblock >= len)
+		return 0;
+
+	*count = len - fileblock;
+
+	return start ? fileblock + start : 0;
+}
+
 static int ext4fs_blockgroup
 	(struct ext2_data *data, int group, struct ext2_block_group *blkgrp)
 {
 	long int blkno;
 	unsigned int blkoff, desc_per_blk;
-	int log2blksz = get_fs()->dev_desc->log2blksz;
 
 	desc_per_blk = EXT2_BLOCK_SIZE(data) / sizeof(struct ext2_block_group);
 
@@ -1465,10 +1653,9 @@ static int ext4fs_blockgroup
 	debug("ext4fs read %d group descriptor (blkno %ld blkoff %u)\n",
 	      group, blkno, blkoff);
 
-	return ext4fs_devread((lbaint_t)blkno <<
-			      (LOG2_BLOCK_SIZE(data) - log2blksz),
-			      blkoff, sizeof(struct ext2_block_group),
-			      (char *)blkgrp);
+	return ext4fs_cache_read(data, blkno, blkoff,
+				 sizeof(struct ext2_block_group),
+				 (char *)blkgrp);
 }
 
 int ext4fs_read_inode(struct ext2_data *data, int ino, struct ext2_inode *inode)
@@ -1476,7 +1663,6 @@ int ext4fs_read_inode(struct ext2_data *data, int ino, struct ext2_inode *inode)
 	struct ext2_block_group blkgrp;
 	struct ext2_sblock *sblock = &data->sblock;
 	struct ext_filesystem *fs = get_fs();
-	int log2blksz = get_fs()->dev_desc->log2blksz;
 	int inodes_per_block, status;
 	long int blkno;
 	unsigned int blkoff;
@@ -1493,9 +1679,8 @@ int ext4fs_read_inode(struct ext2_data *data, int ino, struct ext2_inode *inode)
 	    (ino % __le32_to_cpu(sblock->inodes_per_group)) / inodes_per_block;
 	blkoff = (ino % inodes_per_block) * fs->inodesz;
 	/* Read the inode. */
-	status = ext4fs_devread((lbaint_t)blkno << (LOG2_BLOCK_SIZE(data) -
-				log2blksz), blkoff,
-				sizeof(struct ext2_inode), (char *)inode);
+	status = ext4fs_cache_read(data, blkno, blkoff,
+				   sizeof(struct ext2_inode), (char *)inode);
 	if (status == 0)
 		return 0;
 
@@ -1511,54 +1696,15 @@ long int read_allocated_block(struct ext2_inode *inode, int fileblock)
 	long int rblock;
 	long int perblock_parent;
 	long int perblock_child;
-	unsigned long long start;
 	/* get the blocksize of the filesystem */
 	blksz = EXT2_BLOCK_SIZE(ext4fs_root);
 	log2_blksz = LOG2_BLOCK_SIZE(ext4fs_root)
 		- get_fs()->dev_desc->log2blksz;
 
 	if (le32_to_cpu(inode->flags) & EXT4_EXTENTS_FL) {
-		char *buf = zalloc(blksz);
-		if (!buf)
-			return -ENOMEM;
-		struct ext4_extent_header *ext_block;
-		struct ext4_extent *extent;
-		int i = -1;
-		ext_block =
-			ext4fs_get_extent_block(ext4fs_root, buf,
-						(struct ext4_extent_header *)
-						inode->b.blocks.dir_blocks,
-						fileblock, log2_blksz);
-		if (!ext_block) {
-			printf("invalid extent block\n");
-			free(buf);
-			return -EINVAL;
-		}
-
-		extent = (struct ext4_extent *)(ext_block + 1);
+		uint32_t count;
 
-		do {
-			i++;
-			if (i >= le16_to_cpu(ext_block->eh_entries))
-				break;
-		} while (fileblock >= le32_to_cpu(extent[i].ee_block));
-		if (--i >= 0) {
-			fileblock -= le32_to_cpu(extent[i].ee_block);
-			if (fileblock >= le16_to_cpu(extent[i].ee_len)) {
-				free(buf);
-				return 0;
-			}
-
-			start = le16_to_cpu(extent[i].ee_start_hi);
-			start = (start << 32) +
-					le32_to_cpu(extent[i].ee_start_lo);
-			free(buf);
-			return fileblock + start;
-		}
-
-		printf("Extent Error\n");
-		free(buf);
-		return -1;
+		return ext4fs_map_extent(inode, fileblock, &count);
 	}
 
 	/* Direct blocks. */
@@ -1860,6 +2006,7 @@ long int read_allocated_block(struct ext2_inode *inode, int fileblock)
  */
 void ext4fs_reinit_global(void)
 {
+	ext4fs_cache_free();
 	if (ext4fs_indir1_block != NULL) {
 		free(ext4fs_indir1_block);
 		ext4fs_indir1_block = NULL;
@@ -2223,6 +2370,9 @@ int ext4fs_mount(unsigned part_length)
 	if (!data)
 		return 0;
 
+	/* Nothing cached may come from another filesystem */
+	ext4fs_cache_free();
+
 	/* Read the superblock. */
 	status = ext4_read_superblock((char *)&data->sblock);
 
@@ -56,6 +56,10 @@ int ext4fs_find_file(const char *path, struct ext2fs_node *rootnode,
 			struct ext2fs_node **foundnode, int expecttype);
 int ext4fs_iterate_dir(struct ext2fs_node *dir, char *name,
 			struct ext2fs_node **fnode, int *ftype);
+int ext4fs_cache_read(struct ext2_data *data, unsigned long long blkno,
+		      int byte_offset, int byte_len, char *buf);
+long int ext4fs_map_extent(struct ext2_inode *inode, uint32_t fileblock,
+			   uint32_t *count);
 
 #if defined(CONFIG_EXT4_WRITE)
 uint32_t ext4fs_div_roundup(uint32_t size, uint32_t n);
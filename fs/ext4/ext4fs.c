@@ -26,6 +26,7 @@
 #include <ext4fs.h>
 #include "ext4_common.h"
 #include <div64.h>
+#include <linux/stat.h>
 
 int ext4fs_symlinknest;
 struct ext_filesystem ext_fs;
@@ -41,6 +42,87 @@ void ext4fs_free_node(struct ext2fs_node *node, struct ext2fs_node *currroot)
 		free(node);
 }
 
+/*
+ * Read an extent-mapped file one extent at a time: every run of contiguous
+ * blocks is fetched with a single device read, and holes are zero-filled.
+ */
+static int ext4fs_read_extents(struct ext2fs_node *node, loff_t pos,
+			       loff_t len, char *buf)
+{
+	struct ext_filesystem *fs = get_fs();
+	int log2blksz = fs->dev_desc->log2blksz;
+	int log2_fs_blocksize = LOG2_BLOCK_SIZE(node->data) - log2blksz;
+	int blocksize = (1 << (log2_fs_blocksize + log2blksz));
+	loff_t end = pos + len;
+
+	while (pos < end) {
+		uint32_t fileblock = lldiv(pos, blocksize);
+		int skipfirst = pos - (loff_t)fileblock * blocksize;
+		uint32_t count;
+		long int blknr;
+		loff_t run;
+
+		blknr = ext4fs_map_extent(&node->inode, fileblock, &count);
+		if (blknr < 0)
+			return -1;
+
+		run = (loff_t)count * blocksize - skipfirst;
+		if (run > end - pos)
+			run = end - pos;
+		/* ext4fs_devread() takes an int length */
+		if (run > (1 << 30))
+			run = 1 << 30;
+
+		if (blknr) {
+			if (!ext4fs_devread((lbaint_t)blknr << log2_fs_blocksize,
+					    skipfirst, run, buf))
+				return -1;
+		} else {
+			memset(buf, 0, run);
+		}
+		buf += run;
+		pos += run;
+	}
+
+	return 0;
+}
+
+/*
+ * Directories are read in small pieces, one entry at a time, so their
+ * blocks go through the metadata cache.
+ */
+static int ext4fs_read_dir(struct ext2fs_node *node, loff_t pos,
+			   loff_t len, char *buf)
+{
+	int blocksize = EXT2_BLOCK_SIZE(node->data);
+	loff_t end = pos + len;
+
+	while (pos < end) {
+		int fileblock = lldiv(pos, blocksize);
+		int skipfirst = pos - (loff_t)fileblock * blocksize;
+		int run = blocksize - skipfirst;
+		long int blknr;
+
+		if (run > end - pos)
+			run = end - pos;
+
+		blknr = read_allocated_block(&node->inode, fileblock);
+		if (blknr < 0)
+			return -1;
+		if (blknr) {
+			if (!ext4fs_cache_read(node->data, blknr, skipfirst,
+					       run, buf))
+				return -1;
+		} else {
+			memset(buf, 0, run);
+		}
+		buf += run;
+		pos += run;
+	}
+
+	return 0;
+}
+
 /*
  * Taken from openmoko-kernel mailing list: By Andy green
  * Optimized read file API : collects and defers contiguous sector
@@ -68,6 +150,20 @@ int ext4fs_read_file(struct ext2fs_node *node, loff_t pos,
 	if (len > filesize)
 		len = filesize;
 
+	if (S_ISDIR(le16_to_cpu(node->inode.mode))) {
+		if (ext4fs_read_dir(node, pos, len, buf))
+			return -1;
+		*actread = len;
+		return 0;
+	}
+
+	if (le32_to_cpu(node->inode.flags) & EXT4_EXTENTS_FL) {
+		if (ext4fs_read_extents(node, pos, len, buf))
+			return -1;
+		*actread = len;
+		return 0;
+	}
+
 	blockcnt = lldiv(((len + pos) + blocksize - 1), blocksize);
 
 	for (i = lldiv(pos, blocksize); i < blockcnt; i++) {
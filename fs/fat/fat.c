@@ -40,6 +40,12 @@ static void downcase(char *str)
 static block_dev_desc_t *cur_dev;
 static disk_partition_t cur_part_info;
 
+#ifdef CONFIG_FAT_WRITE
+static void free_clust_map(void);	/* in fat_write.c */
+#else
+static inline void free_clust_map(void) {}
+#endif
+
 #define DOS_BOOT_MAGIC_OFFSET	0x1fe
 #define DOS_FS_TYPE_OFFSET	0x36
 #define DOS_FS32_TYPE_OFFSET	0x52
@@ -64,6 +70,9 @@ int fat_set_blk_dev(block_dev_desc_t *dev_desc, disk_partition_t *info)
 {
 	ALLOC_CACHE_ALIGN_BUFFER(unsigned char, buffer, dev_desc->blksz);
 
+	/* Anything known about the previous filesystem is stale now */
+	free_clust_map();
+
 	cur_dev = dev_desc;
 	cur_part_info = *info;
 
@@ -162,6 +171,48 @@ static void get_name(dir_entry *dirent, char *s_name)
 	downcase(s_name);
 }
 
+/*
+ * Get window 'bufnum' of the FAT from the cache, reading it if needed.
+ * Return NULL on failure.
+ */
+static __u8 *get_fatcache(fsdata *mydata, __u32 bufnum)
+{
+	__u32 getsize = FATCACHE_BLOCKS;
+	__u32 fatlength = mydata->fatlength;
+	__u32 startblock = bufnum * FATCACHE_BLOCKS;
+	int i, victim = 0;
+
+	for (i = 0; i < FATCACHE_WINDOWS; i++) {
+		if (mydata->fatcache_num[i] == (int)bufnum) {
+			mydata->fatcache_use[i] = ++mydata->fatcache_clock;
+			return mydata->fatbuf + i * FATCACHE_WINSIZE;
+		}
+		if (mydata->fatcache_use[i] < mydata->fatcache_use[victim])
+			victim = i;
+	}
+
+	if (startblock >= fatlength) {
+		debug("FAT entry beyond the end of the FAT\n");
+		return NULL;
+	}
+	if (startblock + getsize > fatlength)
+		getsize = fatlength - startblock;
+
+	startblock += mydata->fat_sect;	/* Offset from start of disk */
+
+	mydata->fatcache_num[victim] = -1;
+	mydata->fatcache_use[victim] = 0;
+	if (disk_read(startblock, getsize,
+		      mydata->fatbuf + victim * FATCACHE_WINSIZE) < 0) {
+		debug("Error reading FAT blocks\n");
+		return NULL;
+	}
+	mydata->fatcache_num[victim] = bufnum;
+	mydata->fatcache_use[victim] = ++mydata->fatcache_clock;
+
+	return mydata->fatbuf + victim * FATCACHE_WINSIZE;
+}
+
 /*
  * Get the entry at index 'entry' in a FAT (12/16/32) table.
  * On failure 0x00 is returned.
@@ -172,80 +223,66 @@ static __u32 get_fatent(fsdata *mydata, __u32 entry)
 	__u32 off16, offset;
 	__u32 ret = 0x00;
 	__u16 val1, val2;
+	__u8 *fatbuf;
+	__u32 entries;
 
 	switch (mydata->fatsize) {
 	case 32:
-		bufnum = entry / FAT32BUFSIZE;
-		offset = entry - bufnum * FAT32BUFSIZE;
+		entries = FATCACHE_WINSIZE / 4;
 		break;
 	case 16:
-		bufnum = entry / FAT16BUFSIZE;
-		offset = entry - bufnum * FAT16BUFSIZE;
+		entries = FATCACHE_WINSIZE / 2;
 		break;
 	case 12:
-		bufnum = entry / FAT12BUFSIZE;
-		offset = entry - bufnum * FAT12BUFSIZE;
+		entries = FATCACHE_WINSIZE * 2 / 3;
 		break;
 
 	default:
 		/* Unsupported FAT size */
 		return ret;
 	}
+	bufnum = entry / entries;
+	offset = entry - bufnum * entries;
 
 	debug("FAT%d: entry: 0x%04x = %d, offset: 0x%04x = %d\n",
 	       mydata->fatsize, entry, entry, offset, offset);
 
-	/* Read a new block of FAT entries into the cache. */
-	if (bufnum != mydata->fatbufnum) {
-		__u32 getsize = FATBUFBLOCKS;
-		__u8 *bufptr = mydata->fatbuf;
-		__u32 fatlength = mydata->fatlength;
-		__u32 startblock = bufnum * FATBUFBLOCKS;
-
-		if (startblock + getsize > fatlength)
-			getsize = fatlength - startblock;
-
-		startblock += mydata->fat_sect;	/* Offset from start of disk */
-
-		if (disk_read(startblock, getsize, bufptr) < 0) {
-			debug("Error reading FAT blocks\n");
-			return ret;
-		}
-		mydata->fatbufnum = bufnum;
-	}
+	fatbuf = get_fatcache(mydata, bufnum);
+	if (!fatbuf)
+		return ret;
 
 	/* Get the actual entry from the table */
 	switch (mydata->fatsize) {
 	case 32:
-		ret = FAT2CPU32(((__u32 *) mydata->fatbuf)[offset]);
+		ret = FAT2CPU32(((__u32 *) fatbuf)[offset]);
 		break;
 	case 16:
-		ret = FAT2CPU16(((__u16 *) mydata->fatbuf)[offset]);
+		ret = FAT2CPU16(((__u16 *) fatbuf)[offset]);
 		break;
 	case 12:
 		off16 = (offset * 3) / 4;
 
 		switch (offset & 0x3) {
 		case 0:
-			ret = FAT2CPU16(((__u16 *) mydata->fatbuf)[off16]);
+			ret = FAT2CPU16(((__u16 *) fatbuf)[off16]);
 			ret &= 0xfff;
 			break;
 		case 1:
-			val1 = FAT2CPU16(((__u16 *)mydata->fatbuf)[off16]);
+			val1 = FAT2CPU16(((__u16 *)fatbuf)[off16]);
 			val1 &= 0xf000;
-			val2 = FAT2CPU16(((__u16 *)mydata->fatbuf)[off16 + 1]);
+			val2 = FAT2CPU16(((__u16 *)fatbuf)[off16 + 1]);
 			val2 &= 0x00ff;
 			ret = (val2 << 4) | (val1 >> 12);
 			break;
 		case 2:
-			val1 = FAT2CPU16(((__u16 *)mydata->fatbuf)[off16]);
+			val1 = FAT2CPU16(((__u16 *)fatbuf)[off16]);
 			val1 &= 0xff00;
-			val2 = FAT2CPU16(((__u16 *)mydata->fatbuf)[off16 + 1]);
+			val2 = FAT2CPU16(((__u16 *)fatbuf)[off16 + 1]);
 			val2 &= 0x000f;
 			ret = (val2 << 8) | (val1 >> 8);
 			break;
 		case 3:
-			ret = FAT2CPU16(((__u16 *)mydata->fatbuf)[off16]);
+			ret = FAT2CPU16(((__u16 *)fatbuf)[off16]);
 			ret = (ret & 0xfff0) >> 4;
 			break;
 		default:
@@ -322,6 +359,73 @@ get_cluster(fsdata *mydata, __u32 clustnum, __u8 *buffer, unsigned long size)
 	return 0;
 }
 
+/* A run of consecutive clusters in a cluster chain */
+struct fat_run {
+	__u32 start;
+	__u32 count;
+};
+
+/*
+ * Follow the cluster chain from 'clust' for at most 'nclust' clusters and
+ * collect it as a list of runs of consecutive clusters in *runsp, which
+ * the caller has to free. The chain may end early if the FAT is broken;
+ * *nclust is set to the number of clusters found.
+ * Return the number of runs, or -1 if out of memory.
+ */
+static int get_fat_runs(fsdata *mydata, __u32 clust, __u32 *nclust,
+			struct fat_run **runsp)
+{
+	struct fat_run *runs, *newruns;
+	int max = 16, n = 0;
+	__u32 found = 0;
+	__u32 next;
+
+	runs = malloc(max * sizeof(*runs));
+	if (!runs)
+		return -1;
+
+	if (CHECK_CLUST(clust, mydata->fatsize)) {
+		debug("Invalid start cluster: 0x%x\n", clust);
+		goto out;
+	}
+
+	runs[0].start = clust;
+	runs[0].count = 1;
+	n = 1;
+	for (found = 1; found < *nclust; found++) {
+		next = get_fatent(mydata, clust);
+		if (CHECK_CLUST(next, mydata->fatsize)) {
+			debug("curclust: 0x%x\n", next);
+			debug("Invalid FAT entry\n");
+			break;
+		}
+		if (next == clust + 1) {
+			runs[n - 1].count++;
+		} else {
+			if (n == max) {
+				max *= 2;
+				newruns = realloc(runs, max * sizeof(*runs));
+				if (!newruns) {
+					free(runs);
+					return -1;
+				}
+				runs = newruns;
+			}
+			runs[n].start = next;
+			runs[n].count = 1;
+			n++;
+		}
+		clust = next;
+	}
+
+out:
+	*nclust = found;
+	*runsp = runs;
+	debug("%u clusters in %d runs\n", found, n);
+
+	return n;
+}
+
 /*
  * Read at most 'maxsize' bytes from 'pos' in the file associated with 'dentptr'
  * into 'buffer'.
@@ -335,9 +439,11 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 {
 	loff_t filesize = FAT2CPU32(dentptr->size);
 	unsigned int bytesperclust = mydata->clust_size * mydata->sect_size;
-	__u32 curclust = START(dentptr);
-	__u32 endclust, newclust;
+	struct fat_run *runs;
+	loff_t runpos, runend;
 	loff_t actsize;
+	__u32 nclust, clust, off;
+	int nruns, i;
 
 	*gotsize = 0;
 	debug("Filesize: %llu bytes\n", filesize);
@@ -352,92 +458,71 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 
 	debug("%llu bytes\n", filesize);
 
-	actsize = bytesperclust;
-
-	/* go to cluster at pos */
-	while (actsize <= pos) {
-		curclust = get_fatent(mydata, curclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			debug("Invalid FAT entry\n");
-			return 0;
-		}
-		actsize += bytesperclust;
+	/* Map the whole part of the chain we need before reading any data */
+	nclust = (__u32)filesize / bytesperclust;
+	if ((__u32)filesize % bytesperclust)
+		nclust++;
+	nruns = get_fat_runs(mydata, START(dentptr), &nclust, &runs);
+	if (nruns < 0) {
+		printf("Error: allocating memory\n");
+		return -1;
 	}
-
-	/* actsize > pos */
-	actsize -= bytesperclust;
-	filesize -= actsize;
-	pos -= actsize;
-
-	/* align to beginning of next cluster if any */
-	if (pos) {
-		actsize = min(filesize, (loff_t)bytesperclust);
-		if (get_cluster(mydata, curclust, get_contents_vfatname_block,
-				(int)actsize) != 0) {
-			printf("Error reading cluster\n");
-			return -1;
+	/* A broken chain ends the file early */
+	if (filesize > (loff_t)nclust * bytesperclust)
+		filesize = (loff_t)nclust * bytesperclust;
+
+	runpos = 0;
+	for (i = 0; i < nruns && pos < filesize; i++) {
+		runend = runpos + (loff_t)runs[i].count * bytesperclust;
+		if (runend > filesize)
+			runend = filesize;
+		if (runend <= pos) {
+			runpos = runend;
+			continue;
 		}
-		filesize -= actsize;
-		actsize -= pos;
-		memcpy(buffer, get_contents_vfatname_block + pos, actsize);
-		*gotsize += actsize;
-		if (!filesize)
-			return 0;
-		buffer += actsize;
 
-		curclust = get_fatent(mydata, curclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			debug("Invalid FAT entry\n");
-			return 0;
+		off = pos - runpos;
+		clust = runs[i].start + off / bytesperclust;
+		off %= bytesperclust;
+
+		/* Read up to the beginning of the next cluster, if needed */
+		if (off) {
+			actsize = min(runend - (pos - off), (loff_t)bytesperclust);
+			if (get_cluster(mydata, clust,
+					get_contents_vfatname_block,
+					(int)actsize) != 0) {
+				printf("Error reading cluster\n");
+				free(runs);
+				return -1;
+			}
+			actsize -= off;
+			memcpy(buffer, get_contents_vfatname_block + off,
+			       actsize);
+			*gotsize += actsize;
+			buffer += actsize;
+			pos += actsize;
+			clust++;
 		}
-	}
-
-	actsize = bytesperclust;
-	endclust = curclust;
 
-	do {
-		/* search for consecutive clusters */
-		while (actsize < filesize) {
-			newclust = get_fatent(mydata, endclust);
-			if ((newclust - 1) != endclust)
-				goto getit;
-			if (CHECK_CLUST(newclust, mydata->fatsize)) {
-				debug("curclust: 0x%x\n", newclust);
-				debug("Invalid FAT entry\n");
-				return 0;
+		/* Then the rest of the run in one go */
+		if (pos < runend) {
+			actsize = runend - pos;
+			if (get_cluster(mydata, clust, buffer,
+					(unsigned long)actsize) != 0) {
+				printf("Error reading cluster\n");
+				free(runs);
+				return -1;
 			}
-			endclust = newclust;
-			actsize += bytesperclust;
+			*gotsize += actsize;
+			buffer += actsize;
+			pos += actsize;
 		}
+		runpos = runend;
+	}
 
-		/* get remaining bytes */
-		actsize = filesize;
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
-			printf("Error reading cluster\n");
-			return -1;
-		}
-		*gotsize += actsize;
-		return 0;
-getit:
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
-			printf("Error reading cluster\n");
-			return -1;
-		}
-		*gotsize += (int)actsize;
-		filesize -= actsize;
-		buffer += actsize;
+	free(runs);
 
-		curclust = get_fatent(mydata, endclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			printf("Invalid FAT entry\n");
-			return 0;
-		}
-		actsize = bytesperclust;
-		endclust = curclust;
-	} while (1);
+	return 0;
 }
 
 /*
@@ -875,8 +960,13 @@ int do_fat_read_at(const char *filename, loff_t pos, void *buffer,
 					(mydata->clust_size * 2);
 	}
 
-	mydata->fatbufnum = -1;
-	mydata->fatbuf = memalign(ARCH_DMA_MINALIGN, FATBUFSIZE);
+	for (idx = 0; idx < FATCACHE_WINDOWS; idx++) {
+		mydata->fatcache_num[idx] = -1;
+		mydata->fatcache_use[idx] = 0;
+	}
+	mydata->fatcache_clock = 0;
+	mydata->fatbuf = memalign(ARCH_DMA_MINALIGN,
+				  FATCACHE_WINDOWS * FATCACHE_WINSIZE);
 	if (mydata->fatbuf == NULL) {
 		debug("Error: allocating memory\n");
 		return -1;
@@ -1357,4 +1447,5 @@ int fat_read_file(const char *filename, void *buf, loff_t offset, loff_t len,
 
 void fat_close(void)
 {
+	free_clust_map();
 }
@@ -103,43 +103,177 @@ static void set_name(dir_entry *dirent, const char *filename)
 }
 
 static __u8 num_of_fats;
+
 /*
- * Write fat buffer into block device
+ * Map of the clusters in use, one bit per cluster. It is built by the
+ * first write after the filesystem is mounted and dropped by fat_close(),
+ * so that free clusters never have to be searched for in the FAT itself.
  */
-static int flush_fat_buffer(fsdata *mydata)
+static __u8 *clust_map;
+static __u32 clust_map_size;	/* Number of clusters + 2 */
+
+/*
+ * FAT sectors changed by the current write, sorted by sector number.
+ * They are all written back at once by flush_fat_buffer().
+ */
+struct fat_dirty_sect {
+	__u32 sect;	/* Sector number within the FAT */
+	__u8 *buf;
+};
+static struct fat_dirty_sect *dirty_sects;
+static int num_dirty_sects, max_dirty_sects;
+
+/* Number of sectors written to the disk at once when flushing the FAT */
+#define FATFLUSH_BLOCKS	64
+
+static void free_dirty_sects(void)
+{
+	int i;
+
+	for (i = 0; i < num_dirty_sects; i++)
+		free(dirty_sects[i].buf);
+	free(dirty_sects);
+	dirty_sects = NULL;
+	num_dirty_sects = 0;
+	max_dirty_sects = 0;
+}
+
+static void free_clust_map(void)
+{
+	free(clust_map);
+	clust_map = NULL;
+	clust_map_size = 0;
+}
+
+/*
+ * Get FAT sector 'sect' as it is on the disk. Sectors are read through
+ * the FAT buffer, FATBUFBLOCKS at a time.
+ * Return NULL on failure.
+ */
+static __u8 *read_fat_sect(fsdata *mydata, __u32 sect)
 {
-	int getsize = FATBUFBLOCKS;
-	__u32 fatlength = mydata->fatlength;
-	__u8 *bufptr = mydata->fatbuf;
-	__u32 startblock = mydata->fatbufnum * FATBUFBLOCKS;
+	__u32 bufnum = sect / FATBUFBLOCKS;
+
+	if ((int)bufnum != mydata->fatbufnum) {
+		__u32 getsize = FATBUFBLOCKS;
+		__u32 startblock = bufnum * FATBUFBLOCKS;
 
-	startblock += mydata->fat_sect;
+		if (startblock + getsize > mydata->fatlength)
+			getsize = mydata->fatlength - startblock;
 
-	if (getsize > fatlength)
-		getsize = fatlength;
+		startblock += mydata->fat_sect;	/* Offset from start of disk */
 
-	/* Write FAT buf */
-	if (disk_write(startblock, getsize, bufptr) < 0) {
-		debug("error: writing FAT blocks\n");
+		if (disk_read(startblock, getsize, mydata->fatbuf) < 0) {
+			debug("Error reading FAT blocks\n");
+			mydata->fatbufnum = -1;
+			return NULL;
+		}
+		mydata->fatbufnum = bufnum;
+	}
+
+	return mydata->fatbuf +
+		(sect - bufnum * FATBUFBLOCKS) * mydata->sect_size;
+}
+
+/*
+ * Get the copy of FAT sector 'sect' which the current write has changed.
+ * If there is none, return NULL, or with 'create' set, make one.
+ */
+static __u8 *get_dirty_sect(fsdata *mydata, __u32 sect, int create)
+{
+	struct fat_dirty_sect *newsects;
+	int lo = 0, hi = num_dirty_sects, mid;
+	__u8 *buf, *orig;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (dirty_sects[mid].sect == sect)
+			return dirty_sects[mid].buf;
+		if (dirty_sects[mid].sect < sect)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (!create)
+		return NULL;
+
+	if (num_dirty_sects == max_dirty_sects) {
+		newsects = realloc(dirty_sects, (max_dirty_sects + 64) *
+				   sizeof(*dirty_sects));
+		if (!newsects)
+			return NULL;
+		dirty_sects = newsects;
+		max_dirty_sects += 64;
+	}
+
+	orig = read_fat_sect(mydata, sect);
+	if (!orig)
+		return NULL;
+	buf = memalign(ARCH_DMA_MINALIGN, mydata->sect_size);
+	if (!buf)
+		return NULL;
+	memcpy(buf, orig, mydata->sect_size);
+
+	/* Keep the list sorted; 'lo' is where the sector belongs */
+	memmove(&dirty_sects[lo + 1], &dirty_sects[lo],
+		(num_dirty_sects - lo) * sizeof(*dirty_sects));
+	dirty_sects[lo].sect = sect;
+	dirty_sects[lo].buf = buf;
+	num_dirty_sects++;
+
+	return buf;
+}
+
+/*
+ * Write the changed FAT sectors into every copy of the FAT on the block
+ * device, with one write for each run of consecutive sectors
+ */
+static int flush_fat_buffer(fsdata *mydata)
+{
+	__u8 *buf;
+	int i, n, fat;
+	__u32 startblock;
+
+	if (!num_dirty_sects)
+		return 0;
+
+	buf = memalign(ARCH_DMA_MINALIGN, mydata->sect_size * FATFLUSH_BLOCKS);
+	if (!buf) {
+		debug("Error: allocating memory\n");
 		return -1;
 	}
 
-	if (num_of_fats == 2) {
-		/* Update corresponding second FAT blocks */
-		startblock += mydata->fatlength;
-		if (disk_write(startblock, getsize, bufptr) < 0) {
-			debug("error: writing second FAT blocks\n");
-			return -1;
+	for (i = 0; i < num_dirty_sects; i += n) {
+		for (n = 0; n < FATFLUSH_BLOCKS && i + n < num_dirty_sects &&
+		     dirty_sects[i + n].sect == dirty_sects[i].sect + n; n++)
+			memcpy(buf + n * mydata->sect_size,
+			       dirty_sects[i + n].buf, mydata->sect_size);
+
+		startblock = mydata->fat_sect + dirty_sects[i].sect;
+		for (fat = 0; fat < num_of_fats; fat++) {
+			if (disk_write(startblock, n, buf) < 0) {
+				debug("error: writing FAT blocks\n");
+				free(buf);
+				return -1;
+			}
+			/* Update the corresponding blocks of the next FAT */
+			startblock += mydata->fatlength;
 		}
 	}
+	free(buf);
+
+	/* The FAT buffer may hold what was on the disk before */
+	mydata->fatbufnum = -1;
+	free_dirty_sects();
 
 	return 0;
 }
 
 /*
- * Get the entry at index 'entry' in a FAT (12/16/32) table.
+ * Get the entry at index 'entry' in a FAT (12/16/32) table, including the
+ * changes made by the current write.
  * On failure 0x00 is returned.
- * When bufnum is changed, write back the previous fatbuf to the disk.
  */
 static __u32 get_fatent_value(fsdata *mydata, __u32 entry)
 {
@@ -147,6 +281,7 @@ static __u32 get_fatent_value(fsdata *mydata, __u32 entry)
 	__u32 off16, offset;
 	__u32 ret = 0x00;
 	__u16 val1, val2;
+	__u8 *fatbuf;
 
 	if (CHECK_CLUST(entry, mydata->fatsize)) {
 		printf("Error: Invalid FAT entry: 0x%08x\n", entry);
@@ -155,16 +290,18 @@ static __u32 get_fatent_value(fsdata *mydata, __u32 entry)
 
 	switch (mydata->fatsize) {
 	case 32:
-		bufnum = entry / FAT32BUFSIZE;
-		offset = entry - bufnum * FAT32BUFSIZE;
+		bufnum = entry * 4 / mydata->sect_size;
+		offset = entry - bufnum * (mydata->sect_size / 4);
 		break;
 	case 16:
-		bufnum = entry / FAT16BUFSIZE;
-		offset = entry - bufnum * FAT16BUFSIZE;
+		bufnum = entry * 2 / mydata->sect_size;
+		offset = entry - bufnum * (mydata->sect_size / 2);
 		break;
 	case 12:
+		/* FAT12 entries may cross sectors, but never FAT buffers */
 		bufnum = entry / FAT12BUFSIZE;
 		offset = entry - bufnum * FAT12BUFSIZE;
+		bufnum *= FATBUFBLOCKS;
 		break;
 
 	default:
@@ -175,64 +312,47 @@ static __u32 get_fatent_value(fsdata *mydata, __u32 entry)
 	debug("FAT%d: entry: 0x%04x = %d, offset: 0x%04x = %d\n",
 	       mydata->fatsize, entry, entry, offset, offset);
 
-	/* Read a new block of FAT entries into the cache. */
-	if (bufnum != mydata->fatbufnum) {
-		int getsize = FATBUFBLOCKS;
-		__u8 *bufptr = mydata->fatbuf;
-		__u32 fatlength = mydata->fatlength;
-		__u32 startblock = bufnum * FATBUFBLOCKS;
-
-		if (getsize > fatlength)
-			getsize = fatlength;
-
-		fatlength *= mydata->sect_size;	/* We want it in bytes now */
-		startblock += mydata->fat_sect;	/* Offset from start of disk */
-
-		/* Write back the fatbuf to the disk */
-		if (mydata->fatbufnum != -1) {
-			if (flush_fat_buffer(mydata) < 0)
-				return -1;
-		}
-
-		if (disk_read(startblock, getsize, bufptr) < 0) {
-			debug("Error reading FAT blocks\n");
-			return ret;
-		}
-		mydata->fatbufnum = bufnum;
-	}
+	/* 'bufnum' is the FAT sector holding the entry */
+	fatbuf = NULL;
+	if (mydata->fatsize != 12)
+		fatbuf = get_dirty_sect(mydata, bufnum, 0);
+	if (!fatbuf)
+		fatbuf = read_fat_sect(mydata, bufnum);
+	if (!fatbuf)
+		return ret;
 
 	/* Get the actual entry from the table */
 	switch (mydata->fatsize) {
 	case 32:
-		ret = FAT2CPU32(((__u32 *) mydata->fatbuf)[offset]);
+		ret = FAT2CPU32(((__u32 *) fatbuf)[offset]);
 		break;
 	case 16:
-		ret = FAT2CPU16(((__u16 *) mydata->fatbuf)[offset]);
+		ret = FAT2CPU16(((__u16 *) fatbuf)[offset]);
 		break;
 	case 12:
 		off16 = (offset * 3) / 4;
 
 		switch (offset & 0x3) {
 		case 0:
-			ret = FAT2CPU16(((__u16 *) mydata->fatbuf)[off16]);
+			ret = FAT2CPU16(((__u16 *) fatbuf)[off16]);
 			ret &= 0xfff;
 			break;
 		case 1:
-			val1 = FAT2CPU16(((__u16 *)mydata->fatbuf)[off16]);
+			val1 = FAT2CPU16(((__u16 *)fatbuf)[off16]);
 			val1 &= 0xf000;
-			val2 = FAT2CPU16(((__u16 *)mydata->fatbuf)[off16 + 1]);
+			val2 = FAT2CPU16(((__u16 *)fatbuf)[off16 + 1]);
 			val2 &= 0x00ff;
 			ret = (val2 << 4) | (val1 >> 12);
 			break;
 		case 2:
-			val1 = FAT2CPU16(((__u16 *)mydata->fatbuf)[off16]);
+			val1 = FAT2CPU16(((__u16 *)fatbuf)[off16]);
 			val1 &= 0xff00;
-			val2 = FAT2CPU16(((__u16 *)mydata->fatbuf)[off16 + 1]);
+			val2 = FAT2CPU16(((__u16 *)fatbuf)[off16 + 1]);
 			val2 &= 0x000f;
 			ret = (val2 << 8) | (val1 >> 8);
 			break;
 		case 3:
-			ret = FAT2CPU16(((__u16 *)mydata->fatbuf)[off16]);
+			ret = FAT2CPU16(((__u16 *)fatbuf)[off16]);
 			ret = (ret & 0xfff0) >> 4;
 			break;
 		default:
@@ -467,57 +587,40 @@ get_long_file_name(fsdata *mydata, int curclust, __u8 *cluster,
 
 /*
  * Set the entry at index 'entry' in a FAT (16/32) table.
+ * The change is kept in memory until flush_fat_buffer() is called.
  */
 static int set_fatent_value(fsdata *mydata, __u32 entry, __u32 entry_value)
 {
-	__u32 bufnum, offset;
+	__u32 sect, offset;
+	__u8 *fatbuf;
 
 	switch (mydata->fatsize) {
 	case 32:
-		bufnum = entry / FAT32BUFSIZE;
-		offset = entry - bufnum * FAT32BUFSIZE;
+		sect = entry * 4 / mydata->sect_size;
+		offset = entry - sect * (mydata->sect_size / 4);
 		break;
 	case 16:
-		bufnum = entry / FAT16BUFSIZE;
-		offset = entry - bufnum * FAT16BUFSIZE;
+		sect = entry * 2 / mydata->sect_size;
+		offset = entry - sect * (mydata->sect_size / 2);
 		break;
 	default:
 		/* Unsupported FAT size */
 		return -1;
 	}
 
-	/* Read a new block of FAT entries into the cache. */
-	if (bufnum != mydata->fatbufnum) {
-		int getsize = FATBUFBLOCKS;
-		__u8 *bufptr = mydata->fatbuf;
-		__u32 fatlength = mydata->fatlength;
-		__u32 startblock = bufnum * FATBUFBLOCKS;
-
-		fatlength *= mydata->sect_size;
-		startblock += mydata->fat_sect;
-
-		if (getsize > fatlength)
-			getsize = fatlength;
-
-		if (mydata->fatbufnum != -1) {
-			if (flush_fat_buffer(mydata) < 0)
-				return -1;
-		}
-
-		if (disk_read(startblock, getsize, bufptr) < 0) {
-			debug("Error reading FAT blocks\n");
-			return -1;
-		}
-		mydata->fatbufnum = bufnum;
+	fatbuf = get_dirty_sect(mydata, sect, 1);
+	if (!fatbuf) {
+		debug("Error: changing FAT sector %u\n", sect);
+		return -1;
 	}
 
 	/* Set the actual entry */
 	switch (mydata->fatsize) {
 	case 32:
-		((__u32 *) mydata->fatbuf)[offset] = cpu_to_le32(entry_value);
+		((__u32 *) fatbuf)[offset] = cpu_to_le32(entry_value);
 		break;
 	case 16:
-		((__u16 *) mydata->fatbuf)[offset] = cpu_to_le16(entry_value);
+		((__u16 *) fatbuf)[offset] = cpu_to_le16(entry_value);
 		break;
 	default:
 		return -1;
@@ -526,25 +629,184 @@ static int set_fatent_value(fsdata *mydata, __u32 entry, __u32 entry_value)
 	return 0;
 }
 
+static inline int clust_used(__u32 clust)
+{
+	return clust_map[clust >> 3] & (1 << (clust & 7));
+}
+
+static void set_clust_used(__u32 clust, int used)
+{
+	if (clust >= clust_map_size)
+		return;
+	if (used)
+		clust_map[clust >> 3] |= 1 << (clust & 7);
+	else
+		clust_map[clust >> 3] &= ~(1 << (clust & 7));
+}
+
 /*
- * Determine the entry value at index 'entry' in a FAT (16/32) table
+ * Find the first cluster from 'clust' on which is in use if 'used' is
+ * set, or free otherwise. Return clust_map_size if there is none.
  */
-static __u32 determine_fatent(fsdata *mydata, __u32 entry)
+static __u32 find_clust(__u32 clust, int used)
 {
-	__u32 next_fat, next_entry = entry + 1;
+	__u8 skip = used ? 0x00 : 0xff;
 
-	while (1) {
-		next_fat = get_fatent_value(mydata, next_entry);
-		if (next_fat == 0) {
-			set_fatent_value(mydata, entry, next_entry);
-			break;
+	while (clust < clust_map_size) {
+		/* Skip whole bytes of clusters which do not match */
+		if (!(clust & 7) && clust_map[clust >> 3] == skip) {
+			clust += 8;
+			continue;
 		}
-		next_entry++;
+		if (!clust_used(clust) == !used)
+			return clust;
+		clust++;
 	}
-	debug("FAT%d: entry: %08x, entry_value: %04x\n",
-	       mydata->fatsize, entry, next_entry);
 
-	return next_entry;
+	return clust_map_size;
+}
+
+/*
+ * Read the whole FAT once and build the map of clusters in use.
+ * Return 0 on success, -1 otherwise.
+ */
+static int build_clust_map(fsdata *mydata)
+{
+	__u32 nclust, clust, sect, getsize, entries, i, val;
+	__u8 *buf;
+
+	/* Clusters in the data area, which is all the FAT can describe */
+	nclust = (total_sector - mydata->data_begin) / mydata->clust_size;
+	entries = mydata->fatlength * mydata->sect_size;
+	if (mydata->fatsize == 12)
+		entries = entries * 2 / 3;
+	else
+		entries /= mydata->fatsize / 8;
+	if (nclust > entries)
+		nclust = entries;
+	if (nclust <= 2) {
+		debug("error: no data clusters\n");
+		return -1;
+	}
+
+	/* Bits past the last cluster are set, so they are never free */
+	clust_map = malloc(DIV_ROUND_UP(nclust, 8));
+	buf = memalign(ARCH_DMA_MINALIGN, FATCACHE_WINSIZE);
+	if (!clust_map || !buf) {
+		debug("Error: allocating memory\n");
+		free(buf);
+		free_clust_map();
+		return -1;
+	}
+	memset(clust_map, 0xff, DIV_ROUND_UP(nclust, 8));
+	clust_map_size = nclust;
+
+	/*
+	 * FATCACHE_BLOCKS is a multiple of three sectors, so FAT12 entries
+	 * never cross the end of 'buf'
+	 */
+	for (sect = 0, clust = 0; clust < nclust; sect += FATCACHE_BLOCKS) {
+		getsize = FATCACHE_BLOCKS;
+		if (sect + getsize > mydata->fatlength)
+			getsize = mydata->fatlength - sect;
+		if (disk_read(mydata->fat_sect + sect, getsize, buf) < 0) {
+			debug("Error reading FAT blocks\n");
+			free(buf);
+			free_clust_map();
+			return -1;
+		}
+
+		entries = getsize * mydata->sect_size;
+		if (mydata->fatsize == 12)
+			entries = entries * 2 / 3;
+		else
+			entries /= mydata->fatsize / 8;
+
+		for (i = 0; i < entries && clust < nclust; i++, clust++) {
+			switch (mydata->fatsize) {
+			case 32:
+				val = FAT2CPU32(((__u32 *)buf)[i]) & 0xfffffff;
+				break;
+			case 16:
+				val = FAT2CPU16(((__u16 *)buf)[i]);
+				break;
+			default:
+				val = buf[i * 3 / 2] | buf[i * 3 / 2 + 1] << 8;
+				val = (i & 1) ? val >> 4 : val & 0xfff;
+				break;
+			}
+			if (clust >= 2 && !val)
+				set_clust_used(clust, 0);
+		}
+	}
+	free(buf);
+
+	debug("FAT%d: %u clusters\n", mydata->fatsize, nclust - 2);
+
+	return 0;
+}
+
+/*
+ * Allocate 'count' clusters: the first run of free clusters which is large
+ * enough if there is one, otherwise free runs from the start of the data
+ * area until there are enough. The list of runs is returned in *runsp and
+ * has to be freed by the caller.
+ * Return the number of runs, or -1 if there is not enough room.
+ */
+static int alloc_clusters(__u32 count, struct fat_run **runsp)
+{
+	struct fat_run *runs, *newruns;
+	__u32 start, end, left;
+	int max = 16, n = 0, i;
+
+	runs = malloc(max * sizeof(*runs));
+	if (!runs)
+		return -1;
+
+	for (start = find_clust(2, 0); start < clust_map_size;
+	     start = find_clust(end, 0)) {
+		end = find_clust(start, 1);
+		if (end - start >= count) {
+			runs[0].start = start;
+			runs[0].count = count;
+			n = 1;
+			goto found;
+		}
+	}
+
+	/* The file has to be fragmented */
+	left = count;
+	for (start = find_clust(2, 0); left && start < clust_map_size;
+	     start = find_clust(end, 0)) {
+		end = find_clust(start, 1);
+		if (n == max) {
+			max *= 2;
+			newruns = realloc(runs, max * sizeof(*runs));
+			if (!newruns) {
+				free(runs);
+				return -1;
+			}
+			runs = newruns;
+		}
+		runs[n].start = start;
+		runs[n].count = min(end - start, left);
+		left -= runs[n].count;
+		n++;
+	}
+	if (left) {
+		free(runs);
+		return -1;
+	}
+
+found:
+	for (i = 0; i < n; i++)
+		for (start = 0; start < runs[i].count; start++)
+			set_clust_used(runs[i].start + start, 1);
+
+	debug("allocated %u clusters in %d runs\n", count, n);
+	*runsp = runs;
+
+	return n;
 }
 
 /*
@@ -612,18 +874,15 @@ set_cluster(fsdata *mydata, __u32 clustnum, __u8 *buffer,
 }
 
 /*
- * Find the first empty cluster
+ * Find the first empty cluster and mark it as used
  */
 static int find_empty_cluster(fsdata *mydata)
 {
-	__u32 fat_val, entry = 3;
+	__u32 entry = find_clust(2, 0);
 
-	while (1) {
-		fat_val = get_fatent_value(mydata, entry);
-		if (fat_val == 0)
-			break;
-		entry++;
-	}
+	if (entry >= clust_map_size)
+		return -1;
+	set_clust_used(entry, 1);
 
 	return entry;
 }
@@ -642,6 +901,10 @@ static void flush_dir_table(fsdata *mydata, dir_entry **dentptr)
 		return;
 	}
 	dir_newclust = find_empty_cluster(mydata);
+	if (dir_newclust < 0) {
+		printf("error: no room for directory entry\n");
+		return;
+	}
 	set_fatent_value(mydata, dir_curclust, dir_newclust);
 	if (mydata->fatsize == 32)
 		set_fatent_value(mydata, dir_newclust, 0xffffff8);
@@ -650,9 +913,6 @@ static void flush_dir_table(fsdata *mydata, dir_entry **dentptr)
 
 	dir_curclust = dir_newclust;
 
-	if (flush_fat_buffer(mydata) < 0)
-		return;
-
 	memset(get_dentfromdir_block, 0x00,
 		mydata->clust_size * mydata->sect_size);
 
@@ -668,27 +928,41 @@ static int clear_fatent(fsdata *mydata, __u32 entry)
 
 	while (1) {
 		fat_val = get_fatent_value(mydata, entry);
-		if (fat_val != 0)
-			set_fatent_value(mydata, entry, 0);
-		else
+		if (fat_val != 0) {
+			if (set_fatent_value(mydata, entry, 0))
+				return -1;
+			set_clust_used(entry, 0);
+		} else {
 			break;
+		}
 
-		if (fat_val == 0xfffffff || fat_val == 0xffff)
+		/* End of the chain, or a broken one */
+		if (CHECK_CLUST(fat_val, mydata->fatsize))
 			break;
 
 		entry = fat_val;
 	}
 
-	/* Flush fat buffer */
-	if (flush_fat_buffer(mydata) < 0)
-		return -1;
-
 	return 0;
 }
 
+/*
+ * Set start cluster in directory entry
+ */
+static void set_start_cluster(const fsdata *mydata, dir_entry *dentptr,
+				__u32 start_cluster)
+{
+	if (mydata->fatsize == 32)
+		dentptr->starthi =
+			cpu_to_le16((start_cluster & 0xffff0000) >> 16);
+	dentptr->start = cpu_to_le16(start_cluster & 0xffff);
+}
+
 /*
  * Write at most 'maxsize' bytes from 'buffer' into
- * the file associated with 'dentptr'
+ * the file associated with 'dentptr', which has no clusters yet
+ * Clusters are allocated for the whole file at once and every run of
+ * consecutive clusters is written with a single request.
  * Update the number of bytes written in *gotsize and return 0
  * or return -1 on fatal errors.
  */
@@ -698,9 +972,10 @@ set_contents(fsdata *mydata, dir_entry *dentptr, __u8 *buffer,
 {
 	loff_t filesize = FAT2CPU32(dentptr->size);
 	unsigned int bytesperclust = mydata->clust_size * mydata->sect_size;
-	__u32 curclust = START(dentptr);
-	__u32 endclust = 0, newclust = 0;
+	struct fat_run *runs;
+	__u32 nclust, clust, endclust;
 	loff_t actsize;
+	int nruns, i;
 
 	*gotsize = 0;
 	debug("Filesize: %llu bytes\n", filesize);
@@ -710,78 +985,55 @@ set_contents(fsdata *mydata, dir_entry *dentptr, __u8 *buffer,
 
 	debug("%llu bytes\n", filesize);
 
-	if (!curclust) {
-		if (filesize) {
-			debug("error: nonempty clusterless file!\n");
-			return -1;
-		}
+	if (!filesize) {
+		set_start_cluster(mydata, dentptr, 0);
 		return 0;
 	}
 
-	actsize = bytesperclust;
-	endclust = curclust;
-	do {
-		/* search for consecutive clusters */
-		while (actsize < filesize) {
-			newclust = determine_fatent(mydata, endclust);
-
-			if ((newclust - 1) != endclust)
-				goto getit;
-
-			if (CHECK_CLUST(newclust, mydata->fatsize)) {
-				debug("newclust: 0x%x\n", newclust);
-				debug("Invalid FAT entry\n");
-				return 0;
-			}
-			endclust = newclust;
-			actsize += bytesperclust;
-		}
-
-		/* set remaining bytes */
-		actsize = filesize;
-		if (set_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
-			debug("error: writing cluster\n");
-			return -1;
-		}
-		*gotsize += actsize;
-
-		/* Mark end of file in FAT */
-		if (mydata->fatsize == 16)
-			newclust = 0xffff;
-		else if (mydata->fatsize == 32)
-			newclust = 0xfffffff;
-		set_fatent_value(mydata, endclust, newclust);
+	nclust = (__u32)filesize / bytesperclust;
+	if ((__u32)filesize % bytesperclust)
+		nclust++;
+	nruns = alloc_clusters(nclust, &runs);
+	if (nruns < 0) {
+		printf("Error: no room for %llu bytes\n", filesize);
+		return -1;
+	}
+	set_start_cluster(mydata, dentptr, runs[0].start);
 
-		return 0;
-getit:
-		if (set_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
+	for (i = 0; i < nruns; i++) {
+		actsize = min(filesize, (loff_t)runs[i].count * bytesperclust);
+		if (set_cluster(mydata, runs[i].start, buffer,
+				(unsigned long)actsize) != 0) {
 			debug("error: writing cluster\n");
+			free(runs);
 			return -1;
 		}
 		*gotsize += actsize;
 		filesize -= actsize;
 		buffer += actsize;
 
-		if (CHECK_CLUST(newclust, mydata->fatsize)) {
-			debug("newclust: 0x%x\n", newclust);
-			debug("Invalid FAT entry\n");
-			return 0;
-		}
-		actsize = bytesperclust;
-		curclust = endclust = newclust;
-	} while (1);
-}
+		/* Chain the run, and link it to the next one */
+		endclust = runs[i].start + runs[i].count - 1;
+		for (clust = runs[i].start; clust < endclust; clust++)
+			if (set_fatent_value(mydata, clust, clust + 1))
+				goto fat_error;
+		if (i + 1 < nruns)
+			clust = runs[i + 1].start;
+		else if (mydata->fatsize == 16)
+			clust = 0xffff;	/* Mark end of file in FAT */
+		else
+			clust = 0xfffffff;
+		if (set_fatent_value(mydata, endclust, clust))
+			goto fat_error;
+	}
+	free(runs);
 
-/*
- * Set start cluster in directory entry
- */
-static void set_start_cluster(const fsdata *mydata, dir_entry *dentptr,
-				__u32 start_cluster)
-{
-	if (mydata->fatsize == 32)
-		dentptr->starthi =
-			cpu_to_le16((start_cluster & 0xffff0000) >> 16);
-	dentptr->start = cpu_to_le16(start_cluster & 0xffff);
+	return 0;
+
+fat_error:
+	debug("error: updating FAT\n");
+	free(runs);
+	return -1;
 }
 
 /*
@@ -798,32 +1050,6 @@ static void fill_dentry(fsdata *mydata, dir_entry *dentptr,
 	set_name(dentptr, filename);
 }
 
-/*
- * Check whether adding a file makes the file system to
- * exceed the size of the block device
- * Return -1 when overflow occurs, otherwise return 0
- */
-static int check_overflow(fsdata *mydata, __u32 clustnum, loff_t size)
-{
-	__u32 startsect, sect_num, offset;
-
-	if (clustnum > 0) {
-		startsect = mydata->data_begin +
-				clustnum * mydata->clust_size;
-	} else {
-		startsect = mydata->rootdir_sect;
-	}
-
-	sect_num = div_u64_rem(size, mydata->sect_size, &offset);
-
-	if (offset != 0)
-		sect_num++;
-
-	if (startsect + sect_num > cur_part_info.start + total_sector)
-		return -1;
-	return 0;
-}
-
 /*
  * Check if adding several entries exceed one cluster boundary
  */
@@ -1022,6 +1248,12 @@ static int do_fat_write(const char *filename, void *buffer, loff_t size,
 		return -1;
 	}
 
+	/* Find out once per mount which clusters are free */
+	if (!clust_map && build_clust_map(mydata)) {
+		printf("Error: reading FAT\n");
+		goto exit;
+	}
+
 	if (disk_read(cursect,
 		(mydata->fatsize == 32) ?
 		(mydata->clust_size) :
@@ -1047,63 +1279,21 @@ static int do_fat_write(const char *filename, void *buffer, loff_t size,
 		retdent->size = cpu_to_le32(size);
 		start_cluster = START(retdent);
 
+		/* The file gets new clusters, so free the old ones */
 		if (start_cluster) {
-			if (size) {
-				ret = check_overflow(mydata, start_cluster,
-							size);
-				if (ret) {
-					printf("Error: %llu overflow\n", size);
-					goto exit;
-				}
-			}
-
 			ret = clear_fatent(mydata, start_cluster);
 			if (ret) {
 				printf("Error: clearing FAT entries\n");
 				goto exit;
 			}
-
-			if (!size)
-				set_start_cluster(mydata, retdent, 0);
-		} else if (size) {
-			ret = start_cluster = find_empty_cluster(mydata);
-			if (ret < 0) {
-				printf("Error: finding empty cluster\n");
-				goto exit;
-			}
-
-			ret = check_overflow(mydata, start_cluster, size);
-			if (ret) {
-				printf("Error: %llu overflow\n", size);
-				goto exit;
-			}
-
-			set_start_cluster(mydata, retdent, start_cluster);
 		}
 	} else {
 		/* Set short name to set alias checksum field in dir_slot */
 		set_name(empty_dentptr, filename);
 		fill_dir_slot(mydata, &empty_dentptr, filename);
 
-		if (size) {
-			ret = start_cluster = find_empty_cluster(mydata);
-			if (ret < 0) {
-				printf("Error: finding empty cluster\n");
-				goto exit;
-			}
-
-			ret = check_overflow(mydata, start_cluster, size);
-			if (ret) {
-				printf("Error: %llu overflow\n", size);
-				goto exit;
-			}
-		} else {
-			start_cluster = 0;
-		}
-
 		/* Set attribute as archieve for regular file */
-		fill_dentry(mydata, empty_dentptr, filename,
-			start_cluster, size, 0x20);
+		fill_dentry(mydata, empty_dentptr, filename, 0, size, 0x20);
 
 		retdent = empty_dentptr;
 	}
@@ -1115,7 +1305,7 @@ static int do_fat_write(const char *filename, void *buffer, loff_t size,
 	}
 	debug("attempt to write 0x%llx bytes\n", *actwrite);
 
-	/* Flush fat buffer */
+	/* Write all FAT changes at once, after the data */
 	ret = flush_fat_buffer(mydata);
 	if (ret) {
 		printf("Error: flush fat buffer\n");
@@ -1129,6 +1319,11 @@ static int do_fat_write(const char *filename, void *buffer, loff_t size,
 		printf("Error: writing directory entry\n");
 
 exit:
+	if (ret) {
+		/* The cluster map may not match the disk any more */
+		free_dirty_sects();
+		free_clust_map();
+	}
 	free(mydata->fatbuf);
 	return ret;
 }
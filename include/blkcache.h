@@ -0,0 +1,168 @@
+/*
+ * Read cache for block devices
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef _BLKCACHE_H
+#define _BLKCACHE_H
+
+#include <part.h>
+
+/**
+ * struct blkcache_stats - overall state of the block cache
+ *
+ * @hits:		Reads served from the cache
+ * @misses:		Reads which went to the device
+ * @entries:		Number of ranges of blocks held now
+ * @max_blocks:		Largest read which is cached, in blocks
+ * @max_entries:	Number of ranges held at most
+ */
+struct blkcache_stats {
+	ulong hits;
+	ulong misses;
+	unsigned entries;
+	unsigned max_blocks;
+	unsigned max_entries;
+};
+
+/**
+ * struct blkcache_dev_stats - block cache statistics of one device
+ *
+ * @if_type:		Interface type of the device (IF_TYPE_...)
+ * @dev:		Device number
+ * @hits:		Reads served from the cache
+ * @misses:		Reads which went to the device
+ * @writes:		Writes which updated cached blocks
+ * @entries:		Number of ranges of blocks held now
+ */
+struct blkcache_dev_stats {
+	int if_type;
+	int dev;
+	ulong hits;
+	ulong misses;
+	ulong writes;
+	unsigned entries;
+};
+
+#if defined(CONFIG_BLOCK_CACHE) && !defined(CONFIG_SPL_BUILD)
+/**
+ * blkcache_read() - Read blocks from the cache
+ *
+ * Drivers call this at the start of their block_read() method. If it fails
+ * the blocks must be read from the device and handed to blkcache_fill().
+ *
+ * @if_type:	Interface type of the device (IF_TYPE_...)
+ * @dev:	Device number
+ * @start:	First block to read
+ * @blkcnt:	Number of blocks to read
+ * @blksz:	Block size in bytes
+ * @buffer:	Where to put the data
+ * @return 1 if the blocks were found in the cache, 0 if not
+ */
+int blkcache_read(int if_type, int dev, lbaint_t start, lbaint_t blkcnt,
+		  unsigned long blksz, void *buffer);
+
+/**
+ * blkcache_fill() - Add blocks just read from a device to the cache
+ *
+ * Reads larger than the configured maximum are not cached, so that bulk
+ * data does not push out filesystem metadata.
+ *
+ * @if_type:	Interface type of the device (IF_TYPE_...)
+ * @dev:	Device number
+ * @start:	First block which was read
+ * @blkcnt:	Number of blocks which were read
+ * @blksz:	Block size in bytes
+ * @buffer:	The data
+ */
+void blkcache_fill(int if_type, int dev, lbaint_t start, lbaint_t blkcnt,
+		   unsigned long blksz, const void *buffer);
+
+/**
+ * blkcache_write() - Update the cache after blocks were written
+ *
+ * Drivers call this from their block_write() method once the blocks are
+ * on the device, so that cached copies of them stay valid.
+ *
+ * @if_type:	Interface type of the device (IF_TYPE_...)
+ * @dev:	Device number
+ * @start:	First block which was written
+ * @blkcnt:	Number of blocks which were written
+ * @blksz:	Block size in bytes
+ * @buffer:	The data
+ */
+void blkcache_write(int if_type, int dev, lbaint_t start, lbaint_t blkcnt,
+		    unsigned long blksz, const void *buffer);
+
+/**
+ * blkcache_invalidate() - Drop everything cached for a device
+ *
+ * This must be called whenever the contents of the device may have changed
+ * in other ways than through block_write(), e.g. when a new card is
+ * inserted, a different hardware partition is selected or blocks are
+ * erased.
+ *
+ * @if_type:	Interface type of the device (IF_TYPE_...)
+ * @dev:	Device number
+ */
+void blkcache_invalidate(int if_type, int dev);
+
+/**
+ * blkcache_invalidate_all() - Drop everything cached for all devices
+ */
+void blkcache_invalidate_all(void);
+
+/**
+ * blkcache_configure() - Change the size of the cache
+ *
+ * Everything cached so far is dropped.
+ *
+ * @max_blocks:		Largest read which is cached, in blocks
+ * @max_entries:	Number of ranges of blocks held at most
+ */
+void blkcache_configure(unsigned max_blocks, unsigned max_entries);
+
+/**
+ * blkcache_get_stats() - Get the overall statistics of the cache
+ *
+ * @stats:	Returns the statistics
+ */
+void blkcache_get_stats(struct blkcache_stats *stats);
+
+/**
+ * blkcache_get_dev_stats() - Get the statistics of a device
+ *
+ * @index:	Index of the device, starting at 0, in the order in which the
+ *		devices were first used
+ * @stats:	Returns the statistics
+ * @return 0 if OK, -ENOENT if there is no device with that index
+ */
+int blkcache_get_dev_stats(int index, struct blkcache_dev_stats *stats);
+
+/**
+ * blkcache_reset_stats() - Clear all hit, miss and write counters
+ */
+void blkcache_reset_stats(void);
+#else
+static inline int blkcache_read(int if_type, int dev, lbaint_t start,
+				lbaint_t blkcnt, unsigned long blksz,
+				void *buffer)
+{
+	return 0;
+}
+
+static inline void blkcache_fill(int if_type, int dev, lbaint_t start,
+				 lbaint_t blkcnt, unsigned long blksz,
+				 const void *buffer) {}
+
+static inline void blkcache_write(int if_type, int dev, lbaint_t start,
+				  lbaint_t blkcnt, unsigned long blksz,
+				  const void *buffer) {}
+
+static inline void blkcache_invalidate(int if_type, int dev) {}
+
+static inline void blkcache_invalidate_all(void) {}
+#endif
+
+#endif /* _BLKCACHE_H */
@@ -194,6 +194,10 @@ enum bootstage_id {
 	BOOTSTAGE_ID_MAIN_CPU_AWAKE,
 	BOOTSTAGE_ID_MAIN_CPU_READY,
 
+	BOOTSTAGE_ID_MMC_START,
+	BOOTSTAGE_ID_MMC_OP_COND,
+	BOOTSTAGE_ID_MMC_DONE,
+
 	BOOTSTAGE_ID_ACCUM_LCD,
 	BOOTSTAGE_ID_ACCUM_SCSI,
 	BOOTSTAGE_ID_ACCUM_SPI,
@@ -830,6 +830,19 @@ int gzwrite(unsigned char *src, int len,
 /* lib/lz4_wrapper.c */
 int ulz4fn(const void *src, size_t srcn, void *dst, size_t *dstn);
 
+/**
+ * ulz4_decompress_block() - Decompress one block of an LZ4 frame
+ *
+ * @src:	Compressed block, without its header
+ * @srcn:	Size of the compressed block
+ * @dst:	Where to put the output
+ * @dstn:	Space available at @dst
+ * @return number of bytes written, or -EPROTO if the block is corrupt or
+ *	does not fit
+ */
+int ulz4_decompress_block(const void *src, size_t srcn, void *dst,
+			  size_t dstn);
+
 /* lib/qsort.c */
 void qsort(void *base, size_t nmemb, size_t size,
 	   int(*compar)(const void *, const void *));
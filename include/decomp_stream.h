@@ -0,0 +1,66 @@
+/*
+ * Streaming decompression of gzip, LZMA, LZO, LZ4 and zstd images
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef __DECOMP_STREAM_H
+#define __DECOMP_STREAM_H
+
+struct decomp_stream;
+
+/**
+ * decomp_stream_init() - Start decompressing an image which arrives in pieces
+ *
+ * This allows a loader to decompress data as it is read, rather than
+ * first reading the whole compressed image into memory. The output is
+ * written to a single contiguous buffer.
+ *
+ * @dsp:	Returns the new stream
+ * @comp:	Compression type (IH_COMP_...)
+ * @dst:	Where to put the decompressed data
+ * @dst_len:	Space available at @dst
+ * @return 0 if OK, -EPROTONOSUPPORT if @comp is not supported by this
+ *	build, -ENOMEM if out of memory
+ */
+int decomp_stream_init(struct decomp_stream **dsp, int comp, void *dst,
+		       ulong dst_len);
+
+/**
+ * decomp_stream_feed() - Decompress the next piece of the image
+ *
+ * Pieces may be any size. Where a format needs a whole block at once and
+ * a block is split across pieces, it is gathered in an internal buffer;
+ * otherwise the data is decompressed straight from @src. Data after the
+ * end of the compressed stream is ignored.
+ *
+ * Once an error is returned, all further calls return the same error.
+ *
+ * @ds:		Stream to feed
+ * @src:	Compressed data
+ * @len:	Number of bytes at @src
+ * @return 0 if OK, -EINVAL if the data is corrupt, -ENOSPC if the output
+ *	does not fit, -ENOMEM if out of memory
+ */
+int decomp_stream_feed(struct decomp_stream *ds, const void *src, ulong len);
+
+/**
+ * decomp_stream_done() - Check whether the end of the stream has been seen
+ *
+ * @ds:		Stream to check
+ * @return true if all the compressed data has been decompressed
+ */
+bool decomp_stream_done(struct decomp_stream *ds);
+
+/**
+ * decomp_stream_finish() - Finish decompressing and free the stream
+ *
+ * @ds:		Stream to finish; this is freed in any case
+ * @out_len:	Returns the number of bytes written to the output buffer,
+ *	which is valid even on error. May be NULL.
+ * @return 0 if OK, the error from decomp_stream_feed() if there was one,
+ *	else -EINVAL if the compressed data ended early
+ */
+int decomp_stream_finish(struct decomp_stream *ds, ulong *out_len);
+
+#endif
@@ -102,6 +102,7 @@ struct dfu_entity {
 	enum dfu_device_type    dev_type;
 	enum dfu_layout         layout;
 	unsigned long           max_buf_size;
+	unsigned long		max_write_size;	/* background write piece */
 
 	union {
 		struct mmc_internal_data mmc;
@@ -137,6 +138,13 @@ struct dfu_entity {
 
 	u32 bad_skip;	/* for nand use */
 
+	/* statistics of the last download */
+	ulong rx_start;		/* get_timer() at the first block */
+	ulong rx_ms;		/* time from the first block to the flush */
+	u64 rx_bytes;
+	ulong write_ms;		/* time spent writing to the medium */
+	u64 write_bytes;
+
 	unsigned int inited:1;
 };
 
@@ -159,6 +167,31 @@ unsigned char *dfu_free_buf(void);
 unsigned long dfu_get_buf_size(void);
 bool dfu_usb_get_reset(void);
 
+/**
+ * dfu_set_background_write() - Let full buffers be written in the background
+ *
+ * With this enabled a second buffer is allocated, so that data can be
+ * received into it while the full one is written out by
+ * dfu_background_write(). The caller must call that regularly, e.g. in the
+ * loop polling the USB controller, and must not put data into the buffer
+ * returned by dfu_get_buf() itself. Any buffers are freed, so this must be
+ * called before the entities are set up.
+ *
+ * @enable:	true to write in the background, false to write full buffers
+ *		before dfu_write() returns
+ */
+void dfu_set_background_write(bool enable);
+
+/**
+ * dfu_background_write() - Write the next piece of a full buffer
+ *
+ * This does nothing unless dfu_write() handed a buffer over. An error is
+ * also reported by the next dfu_write() or dfu_flush().
+ *
+ * @return 0 if OK, -ve on error
+ */
+int dfu_background_write(void);
+
 int dfu_read(struct dfu_entity *de, void *buf, int size, int blk_seq_num);
 int dfu_write(struct dfu_entity *de, void *buf, int size, int blk_seq_num);
 int dfu_flush(struct dfu_entity *de, void *buf, int size, int blk_seq_num);
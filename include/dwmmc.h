@@ -126,6 +126,7 @@
 #define DWMCI_BMOD_IDMAC_EN	(1 << 7)
 
 /* UHS register */
+#define DWMCI_VOLT_180	(1 << 0)
 #define DWMCI_DDR_MODE	(1 << 16)
 
 /* quirks */
@@ -181,6 +182,21 @@ struct dwmci_host {
 	 */
 	unsigned int (*get_mmc_clk)(struct dwmci_host *host, uint freq);
 
+	/**
+	 * Find the sampling point for HS200 / SDR104
+	 *
+	 * The way of moving the sampling point is specific to each SoC, so
+	 * this is left to the controller driver. It will usually try each
+	 * phase with mmc_send_tuning() and settle in the middle of the
+	 * widest passing window. If NULL, the clock phase set by @clksel
+	 * is used as it is.
+	 *
+	 * @host:	DWMMC host
+	 * @opcode:	Tuning command to send
+	 * @return 0 if OK, -ve on error
+	 */
+	int (*execute_tuning)(struct dwmci_host *host, uint opcode);
+
 	struct mmc_config cfg;
 
 	/* use fifo mode to read and write data */
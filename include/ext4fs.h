@@ -30,6 +30,8 @@
 
 #define EXT4_EXTENTS_FL		0x00080000 /* Inode uses extents */
 #define EXT4_EXT_MAGIC			0xf30a
+/* Longer extents are unwritten, with length ee_len - EXT_INIT_MAX_LEN */
+#define EXT_INIT_MAX_LEN		(1U << 15)
 #define EXT4_FEATURE_RO_COMPAT_GDT_CSUM	0x0010
 #define EXT4_FEATURE_INCOMPAT_EXTENTS	0x0040
 #define EXT4_INDIRECT_BLOCKS		12
@@ -113,6 +115,21 @@ struct ext_filesystem {
 	block_dev_desc_t *dev_desc;
 };
 
+/**
+ * struct ext4_cache_stats - ext4 metadata block cache statistics
+ *
+ * @size:	Number of blocks the cache can hold
+ * @used:	Number of blocks currently cached
+ * @hits:	Lookups satisfied from the cache
+ * @misses:	Lookups which had to read the device
+ */
+struct ext4_cache_stats {
+	int size;
+	int used;
+	ulong hits;
+	ulong misses;
+};
+
 extern struct ext2_data *ext4fs_root;
 extern struct ext2fs_node *ext4fs_file;
 
@@ -149,4 +166,6 @@ int ext4_read_file(const char *filename, void *buf, loff_t offset, loff_t len,
 		   loff_t *actread);
 int ext4_read_superblock(char *buffer);
 int ext4fs_uuid(char *uuid_str);
+const struct ext4_cache_stats *ext4fs_get_cache_stats(void);
+void ext4fs_reset_cache_stats(void);
 #endif
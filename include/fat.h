@@ -33,6 +33,15 @@
 #define FAT16BUFSIZE	(FATBUFSIZE/2)
 #define FAT32BUFSIZE	(FATBUFSIZE/4)
 
+/*
+ * The read path caches several larger windows of the FAT, so that cluster
+ * chains which jump around the table do not re-read the same sectors.
+ * The window size has to be a multiple of 3 sectors for FAT12.
+ */
+#define FATCACHE_WINDOWS	4
+#define FATCACHE_BLOCKS		24
+#define FATCACHE_WINSIZE	(mydata->sect_size * FATCACHE_BLOCKS)
+
 
 /* Filesystem identifiers */
 #define FAT12_SIGN	"FAT12   "
@@ -173,7 +182,11 @@ typedef struct {
 	__u16	sect_size;	/* Size of sectors in bytes */
 	__u16	clust_size;	/* Size of clusters in sectors */
 	int	data_begin;	/* The sector of the first cluster, can be negative */
-	int	fatbufnum;	/* Used by get_fatent, init to -1 */
+	int	fatbufnum;	/* Used by get_fatent_value, init to -1 */
+	/* FAT windows cached by get_fatent, in fatbuf, -1 if unused */
+	int	fatcache_num[FATCACHE_WINDOWS];
+	ulong	fatcache_use[FATCACHE_WINDOWS];
+	ulong	fatcache_clock;
 } fsdata;
 
 typedef int	(file_detectfs_func)(void);
@@ -8,3 +8,13 @@ void fb_mmc_flash_write(const char *cmd, unsigned int session_id,
 			void *download_buffer, unsigned int download_bytes,
 			char *response);
 void fb_mmc_erase(const char *cmd, char *response);
+
+/*
+ * Flashing an image as it is downloaded: fb_mmc_stream_start() is called
+ * before the download, fb_mmc_stream_write() with each piece of data as it
+ * arrives and fb_mmc_stream_finish() once it is complete.
+ */
+int fb_mmc_stream_start(const char *cmd, unsigned int session_id,
+			char *response);
+int fb_mmc_stream_write(void *buffer, unsigned int len);
+void fb_mmc_stream_finish(char *response);
@@ -74,8 +74,70 @@ struct hash_algo {
 	 */
 	int (*hash_finish)(struct hash_algo *algo, void *ctx, void *dest_buf,
 			   int size);
+	/*
+	 * hash_update_multi: Perform hashing on several independent buffers
+	 *
+	 * This is optional. It has the same effect as calling hash_update()
+	 * for each context, but lets the implementation work on the buffers
+	 * at the same time, e.g. interleaved in software or on several
+	 * hardware channels. The contexts are freed by this function if an
+	 * error occurs.
+	 *
+	 * @algo: Pointer to the hash_algo struct
+	 * @ctx: Contexts for hashing
+	 * @buf: Buffer to hash for each context
+	 * @size: Size of each buffer
+	 * @count: Number of contexts
+	 * @return 0 if ok, -1 on error
+	 */
+	int (*hash_update_multi)(struct hash_algo *algo, void *ctx[],
+				 const void *buf[], const unsigned int size[],
+				 int count);
 };
 
+/* Most buffers hash_multi() hashes at the same time */
+#define HASH_MULTI_MAX		8
+
+/**
+ * struct hash_job - A buffer to hash with hash_multi()
+ *
+ * @data:	Data to hash
+ * @size:	Length of data in bytes
+ * @digest:	Returns the hash value (algo->digest_size bytes)
+ */
+struct hash_job {
+	const void *data;
+	unsigned int size;
+	uint8_t digest[HASH_MAX_DIGEST_SIZE];
+};
+
+/**
+ * hash_progress_func - Report the progress of hash_multi()
+ *
+ * @priv:	Private data passed to hash_multi()
+ * @done:	Number of bytes hashed so far
+ * @total:	Number of bytes to hash in all
+ */
+typedef void (*hash_progress_func)(void *priv, ulong done, ulong total);
+
+/**
+ * hash_multi() - Hash several independent buffers in one pass
+ *
+ * Up to HASH_MULTI_MAX buffers are hashed at the same time, using the
+ * hash_update_multi() method of the algorithm if there is one. The
+ * watchdog is reset and @progress is called after each chunk of
+ * algo->chunk_size bytes of every buffer.
+ *
+ * @algo:	Hash algorithm to use
+ * @jobs:	Buffers to hash, the results are stored here too
+ * @count:	Number of buffers
+ * @progress:	Function to call with the progress, or NULL
+ * @priv:	Private data for @progress
+ * @return 0 if ok, -ve on error
+ */
+int hash_multi(struct hash_algo *algo, struct hash_job *jobs, int count,
+	       hash_progress_func progress, void *priv);
+
 #ifndef USE_HOSTCC
 /**
  * hash_command: Process a hash command for a particular algorithm
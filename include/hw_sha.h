@@ -73,4 +73,19 @@ int hw_sha_update(struct hash_algo *algo, void *ctx, const void *buf,
 int hw_sha_finish(struct hash_algo *algo, void *ctx, void *dest_buf,
 		     int size);
 
+/*
+ * Update several independent sha progressive hashes using h/w acceleration
+ *
+ * The contexts are freed by this function if an error occurs.
+ *
+ * @algo: Pointer to the hash_algo struct
+ * @ctx: Contexts for hashing
+ * @buf: Buffer to hash for each context
+ * @size: Size of each buffer
+ * @count: Number of contexts
+ * @return 0 if ok, -ve on error
+ */
+int hw_sha_update_multi(struct hash_algo *algo, void *ctx[], const void *buf[],
+			const unsigned int size[], int count);
+
 #endif
@@ -18,6 +18,14 @@ typedef struct sparse_storage {
 	int	(*write)(struct sparse_storage *storage, void *priv,
 			 unsigned int offset, unsigned int size,
 			 char *data);
+	/*
+	 * Optional: erase (discard) blocks, returning the number erased.
+	 * Used for DONT_CARE chunks, and for FILL chunks of zeros if
+	 * erase_zeroes is set, i.e. erased blocks read back as zeros.
+	 */
+	int	(*erase)(struct sparse_storage *storage, void *priv,
+			 unsigned int offset, unsigned int size);
+	bool	erase_zeroes;
 } sparse_storage_t;
 
 static inline int is_sparse_image(void *buf)
@@ -33,3 +41,70 @@ static inline int is_sparse_image(void *buf)
 
 int store_sparse_image(sparse_storage_t *storage, void *storage_priv,
 		       unsigned int session_id, void *data);
+
+/*
+ * State of an image which is stored as it arrives, see sparse_stream_feed().
+ * Images which are not sparse are written out as they are.
+ */
+struct sparse_stream {
+	sparse_storage_t	*storage;
+	void			*priv;
+	unsigned int		session_id;
+	int			state;
+	int			err;		/* first error seen, if any */
+	sparse_header_t		header;
+	chunk_header_t		chunk;		/* the current chunk */
+	unsigned int		chunk_left;	/* bytes of it still to come */
+	unsigned int		chunks_left;
+	unsigned int		skip;		/* bytes of header to skip */
+	uint32_t		blk;		/* next block to write */
+	uint32_t		total_blocks;
+	uint32_t		skipped;
+	uint32_t		erased;
+	char			*partial;	/* header or part of a block */
+	unsigned int		partial_len;
+};
+
+/**
+ * sparse_stream_start() - Start storing an image as it arrives
+ *
+ * @ss:			Stream state to set up
+ * @storage:		Where to store the image
+ * @storage_priv:	Passed to the storage callbacks
+ * @session_id:		As for store_sparse_image()
+ * @return 0 if OK, -ENOMEM if out of memory
+ */
+int sparse_stream_start(struct sparse_stream *ss, sparse_storage_t *storage,
+			void *storage_priv, unsigned int session_id);
+
+/**
+ * sparse_stream_feed() - Store the next part of an image
+ *
+ * The data may be split anywhere, chunks and blocks which are not complete
+ * are finished off by later calls. Once an error has been seen, all later
+ * calls return it without doing anything.
+ *
+ * @ss:		Stream state
+ * @data:	The next bytes of the image
+ * @len:	Number of bytes
+ * @return 0 if OK, -ve on error
+ */
+int sparse_stream_feed(struct sparse_stream *ss, void *data,
+		       unsigned int len);
+
+/**
+ * sparse_stream_finish() - Finish storing an image
+ *
+ * This checks that the whole image was seen and frees the stream's buffers.
+ *
+ * @ss:		Stream state
+ * @return 0 if the whole image was stored, -ve on error
+ */
+int sparse_stream_finish(struct sparse_stream *ss);
+
+/**
+ * sparse_stream_abort() - Give up on an image and free the stream's buffers
+ *
+ * @ss:		Stream state
+ */
+void sparse_stream_abort(struct sparse_stream *ss);
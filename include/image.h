@@ -261,6 +261,7 @@ struct lmb;
 #define IH_COMP_LZMA		3	/* lzma  Compression Used	*/
 #define IH_COMP_LZO		4	/* lzo   Compression Used	*/
 #define IH_COMP_LZ4		5	/* lz4   Compression Used	*/
+#define IH_COMP_ZSTD		6	/* zstd  Compression Used	*/
 
 #define IH_MAGIC	0x27051956	/* Image Magic Number		*/
 #define IH_NMLEN		32	/* Image Name Length		*/
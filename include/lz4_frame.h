@@ -0,0 +1,109 @@
+/*
+ * Decoding the blocks of an LZ4 frame out of order
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef __LZ4_FRAME_H
+#define __LZ4_FRAME_H
+
+/**
+ * struct ulz4_block - One block of an LZ4 frame
+ *
+ * @src:	Block data, without its header
+ * @src_len:	Size of the block data
+ * @stored:	true if the data is not compressed
+ * @dst_off:	Offset of the block's output in the decompressed data
+ * @ret:	Number of bytes the block decompressed to, or -ve error; set
+ *		by ulz4_decode_blocks()
+ */
+struct ulz4_block {
+	const void *src;
+	size_t src_len;
+	bool stored;
+	size_t dst_off;
+	int ret;
+};
+
+/**
+ * struct ulz4_index - Where each block of an LZ4 frame is, and goes
+ *
+ * @block:	Array of blocks, in the order they appear in the frame
+ * @count:	Number of blocks
+ * @block_max:	Maximum decompressed size of a block
+ */
+struct ulz4_index {
+	struct ulz4_block *block;
+	int count;
+	size_t block_max;
+};
+
+/**
+ * ulz4_index_frame() - Find the blocks of an LZ4 frame
+ *
+ * The frame must use independent blocks. Each block is assumed to fill
+ * a whole @block_max of output except the last, as the lz4 tool writes
+ * them, so that all blocks can be decoded at once into their final place.
+ * ulz4_index_finish() checks this afterwards.
+ *
+ * @src:	LZ4 frame
+ * @srcn:	Size of the frame
+ * @idx:	Returns the index; free it with ulz4_index_free()
+ * @return 0 if OK, -EPROTONOSUPPORT if this is not an LZ4 frame with
+ *	independent blocks, -EINVAL if it is corrupt, -ENOMEM if out of memory
+ */
+int ulz4_index_frame(const void *src, size_t srcn, struct ulz4_index *idx);
+
+/**
+ * ulz4_decode_blocks() - Decode some of the blocks of an indexed frame
+ *
+ * This decodes blocks @first, @first + @step, @first + 2 * @step, ... of
+ * the frame. It only reads the frame and writes the output of those
+ * blocks, so several CPUs can call it at once with different values of
+ * @first to share the work.
+ *
+ * @idx:	Frame index from ulz4_index_frame()
+ * @dst:	Output buffer for the whole frame
+ * @dstn:	Size of the output buffer
+ * @first:	First block to decode
+ * @step:	Number of blocks to step over each time
+ */
+void ulz4_decode_blocks(struct ulz4_index *idx, void *dst, size_t dstn,
+			int first, int step);
+
+/**
+ * ulz4_index_finish() - Check that all blocks of a frame were decoded
+ *
+ * @idx:	Frame index, after all blocks are decoded
+ * @dstn:	Returns the size of the decompressed data
+ * @return 0 if OK, -EAGAIN if a block other than the last was short, so
+ *	the output is not contiguous and the frame must be decoded in order
+ *	with ulz4fn(), else the error from the first block which failed
+ */
+int ulz4_index_finish(const struct ulz4_index *idx, size_t *dstn);
+
+/**
+ * ulz4_index_free() - Free the memory used by a frame index
+ *
+ * @idx:	Frame index to free
+ */
+void ulz4_index_free(struct ulz4_index *idx);
+
+/**
+ * ulz4_run_workers() - Run a function on several CPUs at once
+ *
+ * ulz4fn() uses this to decode the blocks of a frame in parallel. It
+ * calls @func once for each worker number from 0 to @nr - 1 and returns
+ * when they have all finished. The default does this in turn on the
+ * current CPU. Boards with more than one core may override it to run the
+ * workers on secondary cores, making sure that the output they write is
+ * visible to the calling CPU before returning.
+ *
+ * @func:	Function to run
+ * @arg:	Argument to pass to @func
+ * @nr:		Number of workers
+ * @return 0 if OK, -ve if the workers could not be run
+ */
+int ulz4_run_workers(void (*func)(void *arg, int worker), void *arg, int nr);
+
+#endif
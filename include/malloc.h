@@ -953,6 +953,12 @@ extern ulong mem_malloc_start;
 extern ulong mem_malloc_end;
 extern ulong mem_malloc_brk;
 
+/*
+ * Highest "brk" so far. Set it to mem_malloc_brk, after malloc_trim(0),
+ * to see how far some code makes the heap grow.
+ */
+extern ulong mem_malloc_brk_max;
+
 void mem_malloc_init(ulong start, ulong size);
 
 #ifdef __cplusplus
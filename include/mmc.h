@@ -56,8 +56,28 @@
 #define MMC_MODE_8BIT		(1 << 3)
 #define MMC_MODE_SPI		(1 << 4)
 #define MMC_MODE_DDR_52MHz	(1 << 5)
+#define MMC_MODE_HS200		(1 << 6)
+#define MMC_MODE_HS400		(1 << 7)
+#define MMC_MODE_UHS_SDR50	(1 << 8)
+#define MMC_MODE_UHS_SDR104	(1 << 9)
+/* Host waits for the card to leave the busy state after R1b responses */
+#define MMC_MODE_BUSY_END	(1 << 10)
+
+/* Bus timings, see struct mmc */
+#define MMC_TIMING_LEGACY	0
+#define MMC_TIMING_HS		1
+#define MMC_TIMING_UHS_SDR50	2
+#define MMC_TIMING_UHS_SDR104	3
+#define MMC_TIMING_MMC_HS200	4
+#define MMC_TIMING_MMC_HS400	5
+
+/* I/O signalling voltages */
+#define MMC_SIGNAL_VOLTAGE_330	0
+#define MMC_SIGNAL_VOLTAGE_180	1
+#define MMC_SIGNAL_VOLTAGE_120	2
 
 #define SD_DATA_4BIT	0x00040000
+#define SD_DATA_STAT_AFTER_ERASE	0x00800000	/* erased data is 1s */
 
 #define IS_SD(x)	((x)->version & SD_VERSION_SD)
 #define IS_MMC(x)	((x)->version & MMC_VERSION_MMC)
@@ -70,6 +90,7 @@
 #define COMM_ERR		-18 /* Communications Error */
 #define TIMEOUT			-19
 #define SWITCH_ERR		-20 /* Card reports failure to switch mode */
+#define IN_PROGRESS		-21 /* operation is in progress */
 
 #define MMC_CMD_GO_IDLE_STATE		0
 #define MMC_CMD_SEND_OP_COND		1
@@ -86,6 +107,8 @@
 #define MMC_CMD_SET_BLOCKLEN		16
 #define MMC_CMD_READ_SINGLE_BLOCK	17
 #define MMC_CMD_READ_MULTIPLE_BLOCK	18
+#define MMC_CMD_SEND_TUNING_BLOCK	19
+#define MMC_CMD_SEND_TUNING_BLOCK_HS200	21
 #define MMC_CMD_SET_BLOCK_COUNT         23
 #define MMC_CMD_WRITE_SINGLE_BLOCK	24
 #define MMC_CMD_WRITE_MULTIPLE_BLOCK	25
@@ -115,13 +138,22 @@
 /* SCR definitions in different words */
 #define SD_HIGHSPEED_BUSY	0x00020000
 #define SD_HIGHSPEED_SUPPORTED	0x00020000
+#define SD_UHS_SDR50_SUPPORTED	0x00040000
+#define SD_UHS_SDR104_SUPPORTED	0x00080000
+
+/* Access modes in function group 1 of SWITCH_FUNC */
+#define SD_ACCESS_MODE_SDR50	2
+#define SD_ACCESS_MODE_SDR104	3
 
 #define OCR_BUSY		0x80000000
 #define OCR_HCS			0x40000000
 #define OCR_VOLTAGE_MASK	0x007FFF80
 #define OCR_ACCESS_MODE		0x60000000
+#define OCR_S18R		0x01000000	/* SD: switch to 1.8V signalling */
 
 #define SECURE_ERASE		0x80000000
+#define MMC_ERASE_ARG		0x00000000
+#define MMC_TRIM_ARG		0x00000001
 
 #define MMC_STATUS_MASK		(~0x0206BF7F)
 #define MMC_STATUS_SWITCH_ERROR	(1 << 7)
@@ -164,6 +196,8 @@
 /*
  * EXT_CSD fields
  */
+#define EXT_CSD_FLUSH_CACHE		32	/* W */
+#define EXT_CSD_CACHE_CTRL		33	/* R/W */
 #define EXT_CSD_ENH_START_ADDR		136	/* R/W */
 #define EXT_CSD_ENH_SIZE_MULT		140	/* R/W */
 #define EXT_CSD_GP_SIZE_MULT		143	/* R/W */
@@ -178,6 +212,7 @@
 #define EXT_CSD_ERASE_GROUP_DEF		175	/* R/W */
 #define EXT_CSD_BOOT_BUS_WIDTH		177
 #define EXT_CSD_PART_CONF		179	/* R/W */
+#define EXT_CSD_ERASED_MEM_CONT		181	/* RO */
 #define EXT_CSD_BUS_WIDTH		183	/* R/W */
 #define EXT_CSD_HS_TIMING		185	/* R/W */
 #define EXT_CSD_REV			192	/* RO */
@@ -186,6 +221,8 @@
 #define EXT_CSD_HC_WP_GRP_SIZE		221	/* RO */
 #define EXT_CSD_HC_ERASE_GRP_SIZE	224	/* RO */
 #define EXT_CSD_BOOT_MULT		226	/* RO */
+#define EXT_CSD_SEC_FEATURE_SUPPORT	231	/* RO */
+#define EXT_CSD_CACHE_SIZE		249	/* RO, 4 bytes */
 
 /*
  * EXT_CSD field definitions
@@ -201,6 +238,15 @@
 #define EXT_CSD_CARD_TYPE_DDR_1_2V	(1 << 3)
 #define EXT_CSD_CARD_TYPE_DDR_52	(EXT_CSD_CARD_TYPE_DDR_1_8V \
 					| EXT_CSD_CARD_TYPE_DDR_1_2V)
+#define EXT_CSD_CARD_TYPE_HS200_1_8V	(1 << 4)
+#define EXT_CSD_CARD_TYPE_HS200_1_2V	(1 << 5)
+#define EXT_CSD_CARD_TYPE_HS400_1_8V	(1 << 6)
+#define EXT_CSD_CARD_TYPE_HS400_1_2V	(1 << 7)
+
+#define EXT_CSD_TIMING_LEGACY	0	/* Backwards compatible timing */
+#define EXT_CSD_TIMING_HS	1	/* High speed */
+#define EXT_CSD_TIMING_HS200	2	/* HS200 */
+#define EXT_CSD_TIMING_HS400	3	/* HS400 */
 
 #define EXT_CSD_BUS_WIDTH_1	0	/* Card is in 1 bit mode */
 #define EXT_CSD_BUS_WIDTH_4	1	/* Card is in 4 bit mode */
@@ -228,6 +274,8 @@
 
 #define EXT_CSD_HS_CTRL_REL	(1 << 0)	/* host controlled WR_REL_SET */
 
+#define EXT_CSD_SEC_GB_CL_EN	(1 << 4)	/* TRIM is supported */
+
 #define EXT_CSD_WR_DATA_REL_USR		(1 << 0)	/* user data area WR_REL */
 #define EXT_CSD_WR_DATA_REL_GP(x)	(1 << ((x)+1))	/* GP part (x+1) WR_REL */
 
@@ -324,6 +372,20 @@ struct mmc_ops {
 	int (*init)(struct mmc *mmc);
 	int (*getcd)(struct mmc *mmc);
 	int (*getwp)(struct mmc *mmc);
+	/* Optional: switch I/O signalling to MMC_SIGNAL_VOLTAGE_... */
+	int (*set_signal_voltage)(struct mmc *mmc, uint voltage);
+	/*
+	 * Optional: find the sampling point for the current bus timing,
+	 * using the tuning command @opcode (see mmc_send_tuning())
+	 */
+	int (*execute_tuning)(struct mmc *mmc, uint opcode);
+	/*
+	 * Optional: send a data command and return once the transfer is
+	 * under way, without waiting for the data. wait_data() completes it.
+	 */
+	int (*start_data)(struct mmc *mmc,
+			  struct mmc_cmd *cmd, struct mmc_data *data);
+	int (*wait_data)(struct mmc *mmc, struct mmc_data *data);
 };
 
 struct mmc_config {
@@ -358,6 +420,10 @@ struct mmc {
 	u8 part_support;
 	u8 part_attr;
 	u8 wr_rel_set;
+	uint cache_size;	/* write cache size in KiB, 0 if none */
+	char cache_on;		/* 1 if the write cache is enabled */
+	char trim_support;	/* 1 if single blocks can be erased */
+	char erased_zero;	/* 1 if erased blocks read back as zeros */
 	char part_config;
 	char part_num;
 	uint tran_speed;
@@ -377,6 +443,11 @@ struct mmc {
 	char init_in_progress;	/* 1 if we have done mmc_start_init() */
 	char preinit;		/* start init as early as possible */
 	int ddr_mode;
+	uint timing;		/* bus timing, MMC_TIMING_... */
+	uint signal_voltage;	/* I/O signalling, MMC_SIGNAL_VOLTAGE_... */
+	struct mmc_data async_data;	/* read started by mmc_bread_start() */
+	lbaint_t async_blkcnt;	/* blocks being read, 0 if none */
+	char async_pending;	/* 1 if the host is still transferring them */
 };
 
 struct mmc_hwpart_conf {
@@ -419,6 +490,57 @@ int board_mmc_getcd(struct mmc *mmc);
 int mmc_getwp(struct mmc *mmc);
 int board_mmc_getwp(struct mmc *mmc);
 int mmc_set_dsr(struct mmc *mmc, u16 val);
+/**
+ * mmc_send_tuning() - Send a tuning command and check the block received
+ *
+ * Host drivers which tune by trying each sampling point in turn can use
+ * this from their execute_tuning() method.
+ *
+ * @mmc:	MMC device
+ * @opcode:	MMC_CMD_SEND_TUNING_BLOCK or MMC_CMD_SEND_TUNING_BLOCK_HS200
+ * @return 0 if the tuning block was received intact, -ve on error
+ */
+int mmc_send_tuning(struct mmc *mmc, uint opcode);
+/**
+ * mmc_flush_cache() - Write back the eMMC write cache
+ *
+ * mmc_bwrite() calls this once all blocks have been sent, so that the data
+ * is on the flash before the write returns. Callers of mmc_bwrite_cached()
+ * must call it when they are done.
+ *
+ * @mmc:	MMC device
+ * @return 0 if OK (or there is no cache enabled), -ve on error
+ */
+int mmc_flush_cache(struct mmc *mmc);
+/**
+ * mmc_bwrite_cached() - Write blocks, leaving them in the write cache
+ *
+ * This is mmc_bwrite() without the cache flush at the end. It is meant for
+ * callers which write an image in many pieces (fastboot, DFU) and call
+ * mmc_flush_cache() once at the end, rather than once per piece.
+ *
+ * @dev_num:	MMC device number
+ * @start:	First block to write
+ * @blkcnt:	Number of blocks to write
+ * @src:	Data to write
+ * @return number of blocks written, 0 on error
+ */
+ulong mmc_bwrite_cached(int dev_num, lbaint_t start, lbaint_t blkcnt,
+			const void *src);
+/**
+ * mmc_btrim() - Erase blocks without regard to erase groups
+ *
+ * Unlike the block device's block_erase(), this uses TRIM on eMMC (or a
+ * plain erase on SD cards), which works on single blocks and does not
+ * widen the range. Whether the blocks then read back as zeros is given by
+ * mmc->erased_zero.
+ *
+ * @dev_num:	MMC device number
+ * @start:	First block to erase
+ * @blkcnt:	Number of blocks to erase
+ * @return number of blocks erased, 0 on error or if the device cannot do it
+ */
+ulong mmc_btrim(int dev_num, lbaint_t start, lbaint_t blkcnt);
 /* Function to change the size of boot partition and rpmb partitions */
 int mmc_boot_partition_size_change(struct mmc *mmc, unsigned long bootsize,
 					unsigned long rpmbsize);
@@ -460,6 +582,62 @@ int mmc_start_init(struct mmc *mmc);
  */
 void mmc_set_preinit(struct mmc *mmc, int preinit);
 
+/**
+ * mmc_bread_start() - Start reading blocks and return without waiting
+ *
+ * If the host controller can transfer data in the background, the read
+ * runs while the caller does other work, e.g. hashing or decompressing the
+ * previous buffer. Otherwise the blocks are read before this returns.
+ * Only one read may be outstanding per device and it must be completed
+ * with mmc_bread_wait() before the device is used for anything else.
+ *
+ * @mmc:	MMC device, which must have been initialised
+ * @start:	First block to read
+ * @blkcnt:	Number of blocks to read; no more than mmc->cfg->b_max are read
+ * @dst:	Where to put the data
+ * @return number of blocks being read, 0 on error
+ */
+lbaint_t mmc_bread_start(struct mmc *mmc, lbaint_t start, lbaint_t blkcnt,
+			 void *dst);
+
+/**
+ * mmc_bread_wait() - Wait for the read started by mmc_bread_start()
+ *
+ * @mmc:	MMC device
+ * @return number of blocks read, 0 on error or if no read was started
+ */
+lbaint_t mmc_bread_wait(struct mmc *mmc);
+
+/**
+ * typedef mmc_stream_fn - Consume a chunk read by mmc_bread_stream()
+ *
+ * @priv:	Private data passed to mmc_bread_stream()
+ * @buf:	The blocks which were read
+ * @blkcnt:	Number of blocks in @buf
+ * @return 0 if OK, non-zero to stop reading
+ */
+typedef int (*mmc_stream_fn)(void *priv, void *buf, lbaint_t blkcnt);
+
+/**
+ * mmc_bread_stream() - Read blocks, processing each chunk as it arrives
+ *
+ * The blocks are read in chunks into @dst. Each chunk is passed to @fn
+ * while the next one is being transferred, so that with a host which
+ * supports background transfers the processing costs no extra time.
+ *
+ * @mmc:	MMC device, which must have been initialised
+ * @start:	First block to read
+ * @blkcnt:	Number of blocks to read
+ * @dst:	Where to put the data
+ * @chunk:	Blocks per chunk, 0 for the largest the host allows
+ * @fn:		Called for each chunk, or NULL
+ * @priv:	Private data for @fn
+ * @return number of blocks read, 0 on error
+ */
+lbaint_t mmc_bread_stream(struct mmc *mmc, lbaint_t start, lbaint_t blkcnt,
+			  void *dst, lbaint_t chunk, mmc_stream_fn fn,
+			  void *priv);
+
 #ifdef CONFIG_GENERIC_MMC
 #ifdef CONFIG_MMC_SPI
 #define mmc_host_is_spi(mmc)	((mmc)->cfg->host_caps & MMC_MODE_SPI)
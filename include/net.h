@@ -93,6 +93,26 @@ struct eth_pdata {
 	int phy_interface;
 };
 
+/**
+ * struct eth_rx_stats - receive batching statistics of an Ethernet device
+ *
+ * These are reset each time the device is started.
+ *
+ * @polls: Number of calls to eth_rx()
+ * @bursts: Number of calls to eth_rx() which received at least one packet
+ * @packets: Total number of packets received
+ * @batch_max: Largest number of packets received by a single eth_rx()
+ * @batch_full: Number of calls to eth_rx() which stopped at the
+ *		CONFIG_NET_RX_BATCH limit, with packets possibly still pending
+ */
+struct eth_rx_stats {
+	ulong polls;
+	ulong bursts;
+	ulong packets;
+	uint batch_max;
+	ulong batch_full;
+};
+
 enum eth_recv_flags {
 	/*
 	 * Check hardware device for new packets (otherwise only return those
@@ -150,6 +170,14 @@ struct udevice *eth_get_dev(void); /* get the current device */
 struct udevice *eth_get_dev_by_name(const char *devname);
 unsigned char *eth_get_ethaddr(void); /* get the current device MAC */
 
+/**
+ * eth_get_rx_stats() - Get the receive batching statistics of a device
+ *
+ * @dev:	Ethernet device, which must be probed
+ * @return pointer to the statistics, or NULL if the device is not active
+ */
+const struct eth_rx_stats *eth_get_rx_stats(struct udevice *dev);
+
 /* Used only when NetConsole is enabled */
 int eth_is_active(struct udevice *dev); /* Test device for active state */
 int eth_init_state_only(void); /* Set active state */
@@ -320,7 +348,13 @@ struct vlan_ethernet_hdr {
 #define PROT_RARP	0x8035		/* IP ARP protocol		*/
 #define PROT_VLAN	0x8100		/* IEEE 802.1q protocol		*/
 
+#if defined(CONFIG_IP_DEFRAG) && !defined(CONFIG_NET_MAXDEFRAG)
+/* Largest amount of data in a datagram reassembled from IP fragments */
+#define CONFIG_NET_MAXDEFRAG	16384
+#endif
+
 #define IPPROTO_ICMP	 1	/* Internet Control Message Protocol	*/
+#define IPPROTO_TCP	 6	/* Transmission Control Protocol	*/
 #define IPPROTO_UDP	17	/* User Datagram Protocol		*/
 
 /*
@@ -513,7 +547,7 @@ extern int		net_restart_wrap;	/* Tried all network devices */
 
 enum proto_t {
 	BOOTP, RARP, ARP, TFTPGET, DHCP, PING, DNS, NFS, CDP, NETCONS, SNTP,
-	TFTPSRV, TFTPPUT, LINKLOCAL
+	TFTPSRV, TFTPPUT, LINKLOCAL, WGET
 };
 
 extern char	net_boot_file_name[1024];/* Boot File name */
@@ -648,6 +682,17 @@ static inline void net_send_packet(uchar *pkt, int len)
 int net_send_udp_packet(uchar *ether, struct in_addr dest, int dport,
 			int sport, int payload_len);
 
+/*
+ * Transmit "net_tx_packet" as IP packet, performing ARP request if needed
+ *  (ether will be populated). The IP packet must already be in place after
+ *  the Ethernet header.
+ *
+ * @param ether Raw packet buffer
+ * @param dest IP address to send the packet to
+ * @param ip_len Length of the IP packet, including its header
+ */
+int net_send_ip_packet(uchar *ether, struct in_addr dest, int ip_len);
+
 /* Processes a received packet */
 void net_process_received_packet(uchar *in_packet, int len);
 
@@ -170,6 +170,21 @@ void os_usleep(unsigned long usec);
  */
 uint64_t os_get_nsec(void);
 
+/**
+ * Run a function in several host threads at once
+ *
+ * This calls func(arg, num) for each num from 0 to nr - 1, each in its
+ * own thread, and waits for them all to finish. The function must not
+ * call into U-Boot code which is not thread-safe, such as the console
+ * or malloc().
+ *
+ * \param func		Function to run
+ * \param arg		Argument to pass to the function
+ * \param nr		Number of threads
+ * \return 0 if OK, -ENOMEM if out of memory
+ */
+int os_run_threads(void (*func)(void *arg, int num), void *arg, int nr);
+
 /**
  * Parse arguments and update sandbox state.
  *
@@ -144,7 +144,17 @@
 
 #define SDHCI_ACMD12_ERR	0x3C
 
-/* 3E-3F reserved */
+#define SDHCI_HOST_CONTROL2	0x3E
+#define  SDHCI_CTRL_UHS_MASK	0x0007
+#define   SDHCI_CTRL_UHS_SDR12	0x0000
+#define   SDHCI_CTRL_UHS_SDR25	0x0001
+#define   SDHCI_CTRL_UHS_SDR50	0x0002
+#define   SDHCI_CTRL_UHS_SDR104	0x0003
+#define   SDHCI_CTRL_UHS_DDR50	0x0004
+#define   SDHCI_CTRL_HS400	0x0005
+#define  SDHCI_CTRL_VDD_180	0x0008
+#define  SDHCI_CTRL_EXEC_TUNING	0x0040
+#define  SDHCI_CTRL_TUNED_CLK	0x0080
 
 #define SDHCI_CAPABILITIES	0x40
 #define  SDHCI_TIMEOUT_CLK_MASK	0x0000003F
@@ -166,6 +176,9 @@
 #define  SDHCI_CAN_64BIT	0x10000000
 
 #define SDHCI_CAPABILITIES_1	0x44
+#define  SDHCI_SUPPORT_SDR50	0x00000001
+#define  SDHCI_SUPPORT_SDR104	0x00000002
+#define  SDHCI_SUPPORT_DDR50	0x00000004
 
 #define SDHCI_MAX_CURRENT	0x48
 
@@ -179,6 +192,7 @@
 /* 55-57 reserved */
 
 #define SDHCI_ADMA_ADDRESS	0x58
+#define SDHCI_ADMA_ADDRESS_HI	0x5C
 
 /* 60-FB reserved */
 
@@ -215,6 +229,29 @@
 #define SDHCI_QUIRK_NO_SIMULT_VDD_AND_POWER (1 << 7)
 #define SDHCI_QUIRK_USE_WIDE8		(1 << 8)
 
+/*
+ * ADMA2 descriptors. 32-bit descriptors end after addr_lo.
+ */
+#define SDHCI_ADMA_VALID	0x01
+#define SDHCI_ADMA_END		0x02
+#define SDHCI_ADMA_INT		0x04
+#define SDHCI_ADMA_ACT_NOP	0x00
+#define SDHCI_ADMA_ACT_TRAN	0x20
+#define SDHCI_ADMA_ACT_LINK	0x30
+
+#define SDHCI_ADMA_DESC_SIZE_32	8
+#define SDHCI_ADMA_DESC_SIZE_64	12
+
+/* Largest length one descriptor can hold, kept a multiple of 4 */
+#define SDHCI_ADMA_MAX_LEN	65532
+
+struct sdhci_adma_desc {
+	u16 attr;
+	u16 len;
+	u32 addr_lo;
+	u32 addr_hi;
+} __packed;
+
 /* to make gcc happy */
 struct sdhci_host;
 
@@ -254,6 +291,17 @@ struct sdhci_host {
 	uint	voltages;
 
 	struct mmc_config cfg;
+
+	/* DMA state of the current transfer, kept until it completes */
+	unsigned int start_addr;
+	int trans_bytes;
+	int is_aligned;
+
+#ifdef CONFIG_MMC_SDHCI_ADMA
+	void *adma_desc;	/* ADMA2 descriptor table */
+	uint adma_desc_size;	/* size of one descriptor, 0 to not use ADMA */
+	uint adma_desc_count;	/* number of descriptors in the table */
+#endif
 };
 
 #ifdef CONFIG_MMC_SDHCI_IO_ACCESSORS
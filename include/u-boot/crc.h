@@ -13,6 +13,19 @@
 uint32_t crc32 (uint32_t, const unsigned char *, uint);
 uint32_t crc32_wd (uint32_t, const unsigned char *, uint, uint);
 uint32_t crc32_no_comp (uint32_t, const unsigned char *, uint);
+uint32_t crc32_no_comp_generic(uint32_t, const unsigned char *, uint);
+
+/**
+ * crc32_no_comp_arch - Perform CRC32 without complement using CPU instructions
+ *
+ * This is provided by the architecture when CONFIG_CRC32_ARCH is set.
+ *
+ * @crc:	CRC to update
+ * @buf:	Input buffer
+ * @len:	Input buffer length
+ * @return 0 if OK, -ENOSYS if the CPU lacks the instructions
+ */
+int crc32_no_comp_arch(uint32_t *crc, const unsigned char *buf, uint len);
 
 /**
  * crc32_wd_buf - Perform CRC32 on a buffer and return result in buffer
@@ -62,6 +62,30 @@ void sha1_starts( sha1_context *ctx );
 void sha1_update(sha1_context *ctx, const unsigned char *input,
 		 unsigned int ilen);
 
+/**
+ * \brief	   SHA-1 process whole blocks with the portable C code
+ *
+ * \param ctx	   SHA-1 context
+ * \param data	   buffer holding the blocks
+ * \param blocks   number of 64-byte blocks
+ */
+void sha1_process_generic(sha1_context *ctx, const unsigned char *data,
+			  unsigned int blocks);
+
+/**
+ * \brief	   SHA-1 process whole blocks with CPU instructions
+ *
+ * Provided by the architecture when CONFIG_SHA1_ARCH is set.
+ *
+ * \param ctx	   SHA-1 context
+ * \param data	   buffer holding the blocks
+ * \param blocks   number of 64-byte blocks, 0 to only check the CPU
+ *
+ * \return	   0 if OK, -ENOSYS if the CPU lacks the instructions
+ */
+int sha1_process_arch(sha1_context *ctx, const unsigned char *data,
+		      unsigned int blocks);
+
 /**
  * \brief	   SHA-1 final digest
  *
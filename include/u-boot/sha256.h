@@ -16,6 +16,47 @@ void sha256_starts(sha256_context * ctx);
 void sha256_update(sha256_context *ctx, const uint8_t *input, uint32_t length);
 void sha256_finish(sha256_context * ctx, uint8_t digest[SHA256_SUM_LEN]);
 
+/**
+ * sha256_process_generic() - Hash whole blocks with the portable C code
+ *
+ * @ctx:	Context to update
+ * @data:	Blocks to hash
+ * @blocks:	Number of 64-byte blocks
+ */
+void sha256_process_generic(sha256_context *ctx, const uint8_t *data,
+			    unsigned int blocks);
+
+/**
+ * sha256_process_arch() - Hash whole blocks with CPU instructions
+ *
+ * This is provided by the architecture when CONFIG_SHA256_ARCH is set.
+ *
+ * @ctx:	Context to update
+ * @data:	Blocks to hash
+ * @blocks:	Number of 64-byte blocks, 0 to only check the CPU
+ * @return 0 if OK, -ENOSYS if the CPU lacks the instructions
+ */
+int sha256_process_arch(sha256_context *ctx, const uint8_t *data,
+			unsigned int blocks);
+
+/* Most messages sha256_update_multi() works on at a time */
+#define SHA256_MULTI_MAX	8
+
+/**
+ * sha256_update_multi() - Add data to several independent hashes
+ *
+ * This has the same effect as calling sha256_update() for each context,
+ * but processes blocks of two messages at a time with interleaved rounds,
+ * which is considerably faster on superscalar CPUs.
+ *
+ * @ctx:	Contexts to update
+ * @input:	Data for each context
+ * @length:	Length of the data for each context
+ * @count:	Number of contexts
+ */
+void sha256_update_multi(sha256_context *ctx[], const uint8_t *input[],
+			 const uint32_t length[], int count);
+
 void sha256_csum_wd(const unsigned char *input, unsigned int ilen,
 		unsigned char *output, unsigned int chunk_sz);
 
@@ -0,0 +1,142 @@
+/*
+ * Zstandard decompression
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef __ZSTD_H
+#define __ZSTD_H
+
+#define ZSTD_MAGIC			0xfd2fb528
+#define ZSTD_FRAME_HEADER_MAX		18
+#define ZSTD_CONTENT_SIZE_UNKNOWN	(~0ULL)
+
+/* Most data a block can decompress to */
+#define ZSTD_BLOCK_MAX			(128 << 10)
+
+/* Each block starts with a 3-byte little-endian header */
+#define ZSTD_BLOCK_HEADER_SIZE		3
+#define ZSTD_BLOCK_LAST			1
+#define ZSTD_BLOCK_TYPE(hdr)		(((hdr) >> 1) & 3)
+#define ZSTD_BLOCK_SIZE(hdr)		((hdr) >> 3)
+
+enum {
+	ZSTD_BLOCK_RAW,
+	ZSTD_BLOCK_RLE,
+	ZSTD_BLOCK_COMPRESSED,
+	ZSTD_BLOCK_RESERVED,
+};
+
+/**
+ * struct zstd_frame - Information from a frame header
+ *
+ * @content_size:	Decompressed size, or ZSTD_CONTENT_SIZE_UNKNOWN
+ * @window_size:	Most data a match may refer back to
+ * @checksum:		true if the frame ends with a checksum of its content
+ */
+struct zstd_frame {
+	u64 content_size;
+	u64 window_size;
+	bool checksum;
+};
+
+struct zstd_dctx;
+
+/**
+ * zstd_decompress() - Decompress Zstandard data
+ *
+ * This handles any number of frames, and skips skippable frames.
+ * Dictionaries are not supported. Where a frame does not record its
+ * decompressed size, up to 16 bytes after its output may be overwritten.
+ *
+ * @src:	Compressed data
+ * @srcn:	Size of the compressed data
+ * @dst:	Where to put the output
+ * @dstn:	Space available at @dst; returns the number of bytes
+ *		written, which is valid even on error
+ * @return 0 if OK, -EINVAL if the data is corrupt, -ENOSPC if the output
+ *	does not fit, -EPROTONOSUPPORT if a dictionary is needed, -ENOMEM
+ *	if out of memory
+ */
+int zstd_decompress(const void *src, size_t srcn, void *dst, size_t *dstn);
+
+/**
+ * zstd_frame_header() - Parse a frame header
+ *
+ * @src:	Start of the frame
+ * @srcn:	Number of bytes available at @src
+ * @frame:	Returns information about the frame
+ * @return length of the header, 0 if @srcn bytes are not enough, -EINVAL
+ *	if this is not a valid frame header, -EPROTONOSUPPORT if the frame
+ *	needs a dictionary
+ */
+int zstd_frame_header(const void *src, size_t srcn, struct zstd_frame *frame);
+
+/**
+ * zstd_dctx_alloc() - Allocate a decoder
+ *
+ * This is about 140KiB, mostly for the literals of one block.
+ *
+ * @return the decoder, or NULL if out of memory
+ */
+struct zstd_dctx *zstd_dctx_alloc(void);
+
+/**
+ * zstd_dctx_free() - Free a decoder
+ *
+ * @dc:		Decoder to free
+ */
+void zstd_dctx_free(struct zstd_dctx *dc);
+
+/**
+ * zstd_dctx_start() - Get ready to decode the blocks of a new frame
+ *
+ * The blocks must be decompressed one after the other into a single
+ * buffer, since this also holds the data that matches refer back to.
+ *
+ * @dc:		Decoder to use
+ * @base:	Where the output of the frame starts
+ */
+void zstd_dctx_start(struct zstd_dctx *dc, void *base);
+
+/**
+ * zstd_block_in_size() - Get the size of a block's data
+ *
+ * @hdr:	Block header
+ * @return number of bytes after the header which zstd_decode_block()
+ *	needs
+ */
+static inline size_t zstd_block_in_size(u32 hdr)
+{
+	if (ZSTD_BLOCK_TYPE(hdr) == ZSTD_BLOCK_RLE)
+		return 1;
+
+	return ZSTD_BLOCK_SIZE(hdr);
+}
+
+/**
+ * zstd_decode_block() - Decompress one block of a frame
+ *
+ * @dc:		Decoder, set up with zstd_dctx_start()
+ * @hdr:	Block header
+ * @src:	Block data, zstd_block_in_size() bytes
+ * @out:	Where to put the output, just after that of the last block
+ * @avail:	Space available at @out. Matches are copied 16 bytes at a
+ *		time where there is room, so up to 16 bytes after the
+ *		block's output may be overwritten.
+ * @return number of bytes written, -EINVAL if the block is corrupt,
+ *	-ENOSPC if the output does not fit
+ */
+int zstd_decode_block(struct zstd_dctx *dc, u32 hdr, const void *src,
+		      void *out, size_t avail);
+
+/**
+ * zstd_checksum() - Calculate the checksum of a frame's content
+ *
+ * @buf:	Decompressed content of the frame
+ * @len:	Size of the content
+ * @return the checksum, which is the low 32 bits of its XXH64 hash
+ */
+u32 zstd_checksum(const void *buf, size_t len);
+
+#endif
@@ -0,0 +1,131 @@
+/*
+ * CRC32 using the x86 PCLMULQDQ instruction
+ *
+ * The input is folded 64 bytes at a time by carry-less multiplication
+ * with constants, then reduced to 32 bits with Barrett reduction, as
+ * described in Intel's "Fast CRC Computation for Generic Polynomials
+ * Using PCLMULQDQ Instruction". The constants are those used by
+ * arch/x86/crypto/crc32-pclmul_asm.S in Linux.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <errno.h>
+#include <u-boot/crc.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#ifdef CONFIG_X86
+#include <asm/control_regs.h>
+#include <asm/processor-flags.h>
+#endif
+
+/* Below this there is not enough data for the folding to pay off */
+#define PCLMUL_MIN_LEN	64
+
+typedef long long v2di __attribute__((vector_size(16)));
+typedef long long v2di_u __attribute__((vector_size(16), aligned(1)));
+typedef int v4si __attribute__((vector_size(16)));
+
+#define PCLMUL_TARGET	__attribute__((target("sse4.1,pclmul")))
+
+#define clmul(a, b, imm)	__builtin_ia32_pclmulqdq128(a, b, imm)
+#define load(p)			((v2di)*(const v2di_u *)(p))
+
+/* Multiply both halves of @x by their constant and add them up */
+#define fold(x, k)		(clmul(x, k, 0x00) ^ clmul(x, k, 0x11))
+
+/* @len must be at least PCLMUL_MIN_LEN and a multiple of 16 */
+static PCLMUL_TARGET uint32_t crc32_pclmul(uint32_t crc, const uint8_t *p,
+					   size_t len)
+{
+	const v2di k1k2 = { 0x154442bd4LL, 0x1c6e41596LL };
+	const v2di k3k4 = { 0x1751997d0LL, 0x0ccaa009eLL };
+	const v2di k5 = { 0x163cd6124LL, 0 };
+	const v2di poly = { 0x1db710641LL, 0x1f7011641LL };
+	const v2di mask32 = { 0xffffffffLL, 0 };
+	v2di x0, x1, x2, x3;
+	v4si w;
+
+	x0 = load(p) ^ (v2di){ crc, 0 };
+	x1 = load(p + 16);
+	x2 = load(p + 32);
+	x3 = load(p + 48);
+	p += 64;
+	len -= 64;
+
+	/* Four independent streams of 16 bytes */
+	while (len >= 64) {
+		x0 = fold(x0, k1k2) ^ load(p);
+		x1 = fold(x1, k1k2) ^ load(p + 16);
+		x2 = fold(x2, k1k2) ^ load(p + 32);
+		x3 = fold(x3, k1k2) ^ load(p + 48);
+		p += 64;
+		len -= 64;
+	}
+
+	/* Fold them into one, then the rest of the input */
+	x0 = fold(x0, k3k4) ^ x1;
+	x0 = fold(x0, k3k4) ^ x2;
+	x0 = fold(x0, k3k4) ^ x3;
+	while (len >= 16) {
+		x0 = fold(x0, k3k4) ^ load(p);
+		p += 16;
+		len -= 16;
+	}
+
+	/* 128 to 64 bits, appending the 32 zero bits of the CRC */
+	x0 = clmul(k3k4, x0, 0x01) ^ (v2di){ x0[1], 0 };
+	w = (v4si)x0;
+	x1 = (v2di)(v4si){ w[1], w[2], w[3], 0 };
+	x0 = clmul(x0 & mask32, k5, 0x00) ^ x1;
+
+	/* Barrett reduction to 32 bits */
+	x1 = x0;
+	x0 = clmul(x0 & mask32, poly, 0x10);
+	x0 = clmul(x0 & mask32, poly, 0x00) ^ x1;
+
+	return ((v4si)x0)[1];
+}
+
+static int crc32_have_pclmul(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return 0;
+	if (!(ecx & bit_PCLMUL) || !(ecx & bit_SSE4_1))
+		return 0;
+#ifdef CONFIG_X86
+	/* SSE instructions fault unless the OS (that is us) enabled them */
+	if (!(read_cr4() & X86_CR4_OSFXSR))
+		return 0;
+#endif
+
+	return 1;
+}
+
+int crc32_no_comp_arch(uint32_t *crc, const unsigned char *buf, uint len)
+{
+	uint n = len & ~15;
+
+	if (!crc32_have_pclmul())
+		return -ENOSYS;
+
+	if (n >= PCLMUL_MIN_LEN) {
+		*crc = crc32_pclmul(*crc, buf, n);
+		buf += n;
+		len -= n;
+	}
+	if (len)
+		*crc = crc32_no_comp_generic(*crc, buf, len);
+
+	return 0;
+}
+#else
+int crc32_no_comp_arch(uint32_t *crc, const unsigned char *buf, uint len)
+{
+	return -ENOSYS;
+}
+#endif
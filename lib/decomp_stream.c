@@ -0,0 +1,728 @@
+/*
+ * Streaming decompression of gzip, LZMA, LZO, LZ4 and zstd images
+ *
+ * The compressed data is passed in as it arrives, in pieces of any size.
+ * Each format starts with a header, which is gathered into a small
+ * buffer and parsed once it is complete. After that, gzip and LZMA can
+ * decode any amount of input at a time so each piece goes straight to
+ * the decoder. LZO, LZ4 and zstd are made up of blocks which must be
+ * decompressed whole. A block is decompressed from the piece itself when
+ * it lies within it, and only copied into a staging buffer when it is
+ * split across pieces.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <decomp_stream.h>
+#include <errno.h>
+#include <image.h>
+#include <malloc.h>
+#include <watchdog.h>
+#include <asm/unaligned.h>
+#include <linux/lzo.h>
+#include <lzma/LzmaTypes.h>
+#include <lzma/LzmaDec.h>
+#include <u-boot/zlib.h>
+#include <u-boot/zstd.h>
+
+/* Longest header accepted, including any file name and comment */
+#define DS_HDR_MAX	512
+
+struct decomp_ops;
+
+struct decomp_stream {
+	const struct decomp_ops *ops;
+	u8 *dst;
+	ulong dst_len;
+	ulong out;		/* Bytes written to dst so far */
+	int err;		/* First error seen, returned from then on */
+	bool done;		/* End of the compressed stream reached */
+
+	bool in_hdr;		/* Still gathering the header */
+	uint hdr_len;
+	u8 hdr[DS_HDR_MAX];
+
+	/* For block formats: the next unit to handle and where it is staged */
+	int state;
+	uint need;
+	u8 *stage;
+	uint stage_len;
+	uint stage_size;
+
+	union {
+#ifdef CONFIG_GZIP
+		z_stream zs;
+#endif
+#ifdef CONFIG_LZMA
+		struct {
+			CLzmaDec dec;
+			SizeT limit;
+			bool known_size;
+		} lzma;
+#endif
+#ifdef CONFIG_LZO
+		struct {
+			u32 dlen;
+		} lzo;
+#endif
+#ifdef CONFIG_LZ4
+		struct {
+			u32 block_max;
+			u32 size;
+			bool checksum;
+			bool raw;
+		} lz4;
+#endif
+#ifdef CONFIG_ZSTD
+		struct {
+			struct zstd_dctx *dc;
+			u64 content_size;
+			bool checksum;
+			u32 hdr;
+		} zstd;
+#endif
+	} u;
+};
+
+/**
+ * struct decomp_ops - Handlers for one compression format
+ *
+ * Stream formats provide @data, block formats provide @block.
+ *
+ * @comp:	Compression type (IH_COMP_...)
+ * @parse:	Parse the header and set up the decoder. Returns the length
+ *		of the header, 0 if @len bytes are not enough, or -ve error
+ * @data:	Decode some input. Returns the number of bytes used, or -ve
+ *		error
+ * @block:	Handle the next ds->need bytes and set the next ds->need,
+ *		or ds->done. Returns 0 if OK, or -ve error
+ * @free:	Free the decoder, once @parse has succeeded
+ */
+struct decomp_ops {
+	int comp;
+	int (*parse)(struct decomp_stream *ds, const u8 *hdr, uint len);
+	long (*data)(struct decomp_stream *ds, const u8 *src, ulong len);
+	int (*block)(struct decomp_stream *ds, const u8 *src);
+	void (*free)(struct decomp_stream *ds);
+};
+
+#ifdef CONFIG_GZIP
+#define GZ_HEAD_CRC		2
+#define GZ_EXTRA_FIELD		4
+#define GZ_ORIG_NAME		8
+#define GZ_COMMENT		0x10
+#define GZ_RESERVED		0xe0
+#define GZ_DEFLATED		8
+
+/* Returns the offset after the string at @i, or 0 if it is not all there */
+static uint gzip_skip_string(const u8 *hdr, uint i, uint len)
+{
+	while (i < len && hdr[i])
+		i++;
+
+	return i < len ? i + 1 : 0;
+}
+
+/* The same checks as gunzip() */
+static int gzip_parse(struct decomp_stream *ds, const u8 *hdr, uint len)
+{
+	uint i = 10;
+	int flags;
+
+	if (len < i)
+		return 0;
+	flags = hdr[3];
+	if (hdr[2] != GZ_DEFLATED || (flags & GZ_RESERVED))
+		return -EINVAL;
+	if (flags & GZ_EXTRA_FIELD) {
+		if (len < 12)
+			return 0;
+		i = 12 + hdr[10] + (hdr[11] << 8);
+	}
+	if (flags & GZ_ORIG_NAME) {
+		i = gzip_skip_string(hdr, i, len);
+		if (!i)
+			return 0;
+	}
+	if (flags & GZ_COMMENT) {
+		i = gzip_skip_string(hdr, i, len);
+		if (!i)
+			return 0;
+	}
+	if (flags & GZ_HEAD_CRC)
+		i += 2;
+	if (i > len)
+		return 0;
+
+	ds->u.zs.zalloc = gzalloc;
+	ds->u.zs.zfree = gzfree;
+	if (inflateInit2(&ds->u.zs, -MAX_WBITS) != Z_OK)
+		return -ENOMEM;
+
+	return i;
+}
+
+static long gzip_data(struct decomp_stream *ds, const u8 *src, ulong len)
+{
+	z_stream *zs = &ds->u.zs;
+	int r;
+
+	zs->next_in = (u8 *)src;
+	zs->avail_in = len;
+	zs->next_out = ds->dst + ds->out;
+	zs->avail_out = ds->dst_len - ds->out;
+	r = inflate(zs, Z_NO_FLUSH);
+	ds->out = zs->next_out - ds->dst;
+
+	if (r == Z_STREAM_END)
+		ds->done = true;
+	else if (r != Z_OK && r != Z_BUF_ERROR)
+		return -EINVAL;
+	/* Input is left, or nothing happened, only if the output is full */
+	else if (!zs->avail_out && (zs->avail_in || r == Z_BUF_ERROR))
+		return -ENOSPC;
+
+	return len - zs->avail_in;
+}
+
+static void gzip_free(struct decomp_stream *ds)
+{
+	inflateEnd(&ds->u.zs);
+}
+#endif /* CONFIG_GZIP */
+
+#ifdef CONFIG_LZMA
+/* Properties, then the uncompressed size, all ones if unknown */
+#define LZMA_HDR_SIZE	(LZMA_PROPS_SIZE + sizeof(u64))
+
+static void *lzma_alloc(void *p, size_t size)
+{
+	return malloc(size);
+}
+
+static void lzma_free(void *p, void *address)
+{
+	free(address);
+}
+
+static ISzAlloc lzma_allocator = { lzma_alloc, lzma_free };
+
+static int lzma_parse(struct decomp_stream *ds, const u8 *hdr, uint len)
+{
+	CLzmaDec *dec = &ds->u.lzma.dec;
+	u64 size;
+	SRes res;
+
+	if (len < LZMA_HDR_SIZE)
+		return 0;
+	size = get_unaligned_le64(hdr + LZMA_PROPS_SIZE);
+	ds->u.lzma.known_size = size != ~0ULL;
+	if (ds->u.lzma.known_size && size > ds->dst_len)
+		return -ENOSPC;
+	ds->u.lzma.limit = ds->u.lzma.known_size ? size : ds->dst_len;
+
+	LzmaDec_Construct(dec);
+	res = LzmaDec_AllocateProbs(dec, hdr, LZMA_PROPS_SIZE, &lzma_allocator);
+	if (res != SZ_OK)
+		return res == SZ_ERROR_MEM ? -ENOMEM : -EINVAL;
+	dec->dic = ds->dst;
+	dec->dicBufSize = ds->dst_len;
+	LzmaDec_Init(dec);
+
+	return LZMA_HDR_SIZE;
+}
+
+static long lzma_data(struct decomp_stream *ds, const u8 *src, ulong len)
+{
+	CLzmaDec *dec = &ds->u.lzma.dec;
+	ELzmaStatus status;
+	SizeT in = len;
+	SRes res;
+
+	/* Like lzmaBuffToBuffDecompress(), look for an end mark at the limit */
+	res = LzmaDec_DecodeToDic(dec, ds->u.lzma.limit, src, &in,
+				  LZMA_FINISH_END, &status);
+	ds->out = dec->dicPos;
+	if (res != SZ_OK) {
+		/* Anything but the end mark there means more output */
+		if (!ds->u.lzma.known_size && ds->out == ds->u.lzma.limit)
+			return -ENOSPC;
+		return -EINVAL;
+	}
+
+	if (status == LZMA_STATUS_FINISHED_WITH_MARK ||
+	    status == LZMA_STATUS_MAYBE_FINISHED_WITHOUT_MARK)
+		ds->done = true;
+
+	return in;
+}
+
+static void lzma_free_dec(struct decomp_stream *ds)
+{
+	LzmaDec_FreeProbs(&ds->u.lzma.dec, &lzma_allocator);
+}
+#endif /* CONFIG_LZMA */
+
+#ifdef CONFIG_LZO
+#define LZOP_HAS_FILTER		0x00000800L
+
+enum {
+	LZO_DLEN,		/* Uncompressed size of the next block, or 0 */
+	LZO_SLEN,		/* Compressed size and checksum */
+	LZO_DATA,		/* Block contents */
+};
+
+static const u8 lzop_magic[] = {
+	0x89, 0x4c, 0x5a, 0x4f, 0x00, 0x0d, 0x0a, 0x1a, 0x0a
+};
+
+/* The same as parse_header() in lzo1x_decompress.c, but bounded */
+static int lzo_parse(struct decomp_stream *ds, const u8 *hdr, uint len)
+{
+	uint i = sizeof(lzop_magic);
+	u16 version;
+
+	if (len < i + 12)
+		return 0;
+	if (memcmp(hdr, lzop_magic, i))
+		return -EINVAL;
+
+	/* version, library version, version needed, method, then level */
+	version = get_unaligned_be16(hdr + i);
+	i += 7;
+	if (version >= 0x0940)
+		i++;
+	if (get_unaligned_be32(hdr + i) & LZOP_HAS_FILTER)
+		i += 4;
+	/* flags, mode and mtime */
+	i += 12;
+	if (version >= 0x0940)
+		i += 4;
+	/* file name and header checksum */
+	if (len < i + 1)
+		return 0;
+	i += 1 + hdr[i] + 4;
+	if (len < i)
+		return 0;
+
+	ds->state = LZO_DLEN;
+	ds->need = 4;
+
+	return i;
+}
+
+static int lzo_block(struct decomp_stream *ds, const u8 *src)
+{
+	u32 dlen = ds->u.lzo.dlen;
+	size_t size;
+	int ret;
+
+	switch (ds->state) {
+	case LZO_DLEN:
+		dlen = get_unaligned_be32(src);
+		if (!dlen) {
+			ds->done = true;
+			break;
+		}
+		ds->u.lzo.dlen = dlen;
+		ds->state = LZO_SLEN;
+		ds->need = 8;
+		break;
+	case LZO_SLEN:
+		ds->need = get_unaligned_be32(src);
+		if (!ds->need || ds->need > dlen)
+			return -EINVAL;
+		if (dlen > ds->dst_len - ds->out)
+			return -ENOSPC;
+		ds->state = LZO_DATA;
+		break;
+	case LZO_DATA:
+		/* lzop stores blocks which do not compress as they are */
+		if (ds->need == dlen) {
+			memcpy(ds->dst + ds->out, src, dlen);
+		} else {
+			size = dlen;
+			ret = lzo1x_decompress_safe(src, ds->need,
+						    ds->dst + ds->out, &size);
+			if (ret != LZO_E_OK || size != dlen)
+				return -EINVAL;
+		}
+		ds->out += dlen;
+		ds->state = LZO_DLEN;
+		ds->need = 4;
+		break;
+	}
+
+	return 0;
+}
+#endif /* CONFIG_LZO */
+
+#ifdef CONFIG_LZ4
+#define LZ4F_MAGIC		0x184D2204
+#define LZ4F_FLG_CONTENT_SIZE	BIT(3)
+#define LZ4F_FLG_BLOCK_CHECKSUM	BIT(4)
+#define LZ4F_FLG_INDEPENDENT	BIT(5)
+#define LZ4F_FLG_RESERVED	0x03
+#define LZ4F_BD_RESERVED	0x8f
+#define LZ4F_BLOCK_RAW		BIT(31)
+
+enum {
+	LZ4_BLOCK_HDR,		/* Block size, 0 at the end */
+	LZ4_BLOCK_DATA,		/* Block contents and checksum */
+};
+
+/* The same checks as ulz4fn() */
+static int lz4_parse(struct decomp_stream *ds, const u8 *hdr, uint len)
+{
+	uint flags, bd, max;
+	uint i = 7;
+
+	if (len < i)
+		return 0;
+	flags = hdr[4];
+	bd = hdr[5];
+	if (get_unaligned_le32(hdr) != LZ4F_MAGIC || flags >> 6 != 1)
+		return -EINVAL;
+	if ((flags & LZ4F_FLG_RESERVED) || (bd & LZ4F_BD_RESERVED))
+		return -EINVAL;
+	/* Blocks which refer back to earlier ones are not supported */
+	if (!(flags & LZ4F_FLG_INDEPENDENT))
+		return -EINVAL;
+
+	/* 64KiB to 4MiB; smaller values are reserved */
+	max = bd >> 4;
+	if (max < 4)
+		return -EINVAL;
+	ds->u.lz4.block_max = 1 << (8 + 2 * max);
+	ds->u.lz4.checksum = flags & LZ4F_FLG_BLOCK_CHECKSUM;
+	if (flags & LZ4F_FLG_CONTENT_SIZE)
+		i += sizeof(u64);
+	if (len < i)
+		return 0;
+
+	ds->state = LZ4_BLOCK_HDR;
+	ds->need = 4;
+
+	return i;
+}
+
+static int lz4_block(struct decomp_stream *ds, const u8 *src)
+{
+	ulong avail = ds->dst_len - ds->out;
+	u32 size;
+	int ret;
+
+	switch (ds->state) {
+	case LZ4_BLOCK_HDR:
+		size = get_unaligned_le32(src);
+		ds->u.lz4.raw = size & LZ4F_BLOCK_RAW;
+		size &= ~LZ4F_BLOCK_RAW;
+		if (!size) {
+			ds->done = true;
+			break;
+		}
+		if (size > ds->u.lz4.block_max)
+			return -EINVAL;
+		ds->u.lz4.size = size;
+		ds->state = LZ4_BLOCK_DATA;
+		ds->need = size + (ds->u.lz4.checksum ? sizeof(u32) : 0);
+		break;
+	case LZ4_BLOCK_DATA:
+		size = ds->u.lz4.size;
+		if (ds->u.lz4.raw) {
+			if (size > avail)
+				return -ENOSPC;
+			memcpy(ds->dst + ds->out, src, size);
+			ds->out += size;
+		} else {
+			ret = ulz4_decompress_block(src, size,
+						    ds->dst + ds->out, avail);
+			if (ret < 0)
+				return -EINVAL;
+			ds->out += ret;
+		}
+		ds->state = LZ4_BLOCK_HDR;
+		ds->need = 4;
+		break;
+	}
+
+	return 0;
+}
+#endif /* CONFIG_LZ4 */
+
+#ifdef CONFIG_ZSTD
+enum {
+	ZSTD_HDR,		/* Block header */
+	ZSTD_DATA,		/* Block contents */
+	ZSTD_CHECKSUM,		/* Checksum of the frame's content */
+};
+
+/* Only a single frame is handled, as with LZ4 */
+static int zstd_parse(struct decomp_stream *ds, const u8 *hdr, uint len)
+{
+	struct zstd_frame frame;
+	int ret;
+
+	ret = zstd_frame_header(hdr, len, &frame);
+	if (ret <= 0)
+		return ret;
+	if (frame.content_size != ZSTD_CONTENT_SIZE_UNKNOWN &&
+	    frame.content_size > ds->dst_len)
+		return -ENOSPC;
+	ds->u.zstd.dc = zstd_dctx_alloc();
+	if (!ds->u.zstd.dc)
+		return -ENOMEM;
+	zstd_dctx_start(ds->u.zstd.dc, ds->dst);
+	ds->u.zstd.content_size = frame.content_size;
+	ds->u.zstd.checksum = frame.checksum;
+
+	ds->state = ZSTD_HDR;
+	ds->need = ZSTD_BLOCK_HEADER_SIZE;
+
+	return ret;
+}
+
+/* Decode a block, then move on to the next one or the checksum */
+static int zstd_data(struct decomp_stream *ds, const u8 *src)
+{
+	u32 hdr = ds->u.zstd.hdr;
+	u64 size = ds->u.zstd.content_size;
+	ulong end = ds->dst_len;
+	int ret;
+
+	/* Nothing is written past the end of the frame, if that is known */
+	if (size != ZSTD_CONTENT_SIZE_UNKNOWN)
+		end = size;
+	ret = zstd_decode_block(ds->u.zstd.dc, hdr, src, ds->dst + ds->out,
+				end - ds->out);
+	if (ret == -ENOSPC && end != ds->dst_len)
+		return -EINVAL;
+	if (ret < 0)
+		return ret;
+	ds->out += ret;
+	ds->state = ZSTD_HDR;
+	ds->need = ZSTD_BLOCK_HEADER_SIZE;
+	if (!(hdr & ZSTD_BLOCK_LAST))
+		return 0;
+
+	if (size != ZSTD_CONTENT_SIZE_UNKNOWN && size != ds->out)
+		return -EINVAL;
+	if (ds->u.zstd.checksum) {
+		ds->state = ZSTD_CHECKSUM;
+		ds->need = sizeof(u32);
+	} else {
+		ds->done = true;
+	}
+
+	return 0;
+}
+
+static int zstd_block(struct decomp_stream *ds, const u8 *src)
+{
+	u32 hdr;
+
+	switch (ds->state) {
+	case ZSTD_HDR:
+		hdr = src[0] | src[1] << 8 | src[2] << 16;
+		ds->u.zstd.hdr = hdr;
+		ds->need = zstd_block_in_size(hdr);
+		/* An empty block has nothing more to wait for */
+		if (!ds->need)
+			return zstd_data(ds, NULL);
+		ds->state = ZSTD_DATA;
+		break;
+	case ZSTD_DATA:
+		return zstd_data(ds, src);
+	case ZSTD_CHECKSUM:
+		if (get_unaligned_le32(src) != zstd_checksum(ds->dst, ds->out))
+			return -EINVAL;
+		ds->done = true;
+		break;
+	}
+
+	return 0;
+}
+
+static void zstd_free(struct decomp_stream *ds)
+{
+	zstd_dctx_free(ds->u.zstd.dc);
+}
+#endif /* CONFIG_ZSTD */
+
+static const struct decomp_ops decomp_ops[] = {
+#ifdef CONFIG_GZIP
+	{
+		.comp = IH_COMP_GZIP,
+		.parse = gzip_parse,
+		.data = gzip_data,
+		.free = gzip_free,
+	},
+#endif
+#ifdef CONFIG_LZMA
+	{
+		.comp = IH_COMP_LZMA,
+		.parse = lzma_parse,
+		.data = lzma_data,
+		.free = lzma_free_dec,
+	},
+#endif
+#ifdef CONFIG_LZO
+	{
+		.comp = IH_COMP_LZO,
+		.parse = lzo_parse,
+		.block = lzo_block,
+	},
+#endif
+#ifdef CONFIG_LZ4
+	{
+		.comp = IH_COMP_LZ4,
+		.parse = lz4_parse,
+		.block = lz4_block,
+	},
+#endif
+#ifdef CONFIG_ZSTD
+	{
+		.comp = IH_COMP_ZSTD,
+		.parse = zstd_parse,
+		.block = zstd_block,
+		.free = zstd_free,
+	},
+#endif
+};
+
+/* Gather the header and set up the decoder once it is all there */
+static int ds_header(struct decomp_stream *ds, const u8 **srcp, ulong *lenp)
+{
+	uint have = ds->hdr_len;
+	uint n = min_t(ulong, *lenp, DS_HDR_MAX - have);
+	int ret;
+
+	memcpy(ds->hdr + have, *srcp, n);
+	ds->hdr_len += n;
+	ret = ds->ops->parse(ds, ds->hdr, ds->hdr_len);
+	if (ret < 0)
+		return ret;
+	if (!ret) {
+		if (ds->hdr_len == DS_HDR_MAX)
+			return -EINVAL;
+		*srcp += n;
+		*lenp -= n;
+		return 0;
+	}
+
+	/* Only the end of the header is used from this piece */
+	ds->in_hdr = false;
+	*srcp += ret - have;
+	*lenp -= ret - have;
+
+	return 0;
+}
+
+/* Hand the next ds->need bytes to the block handler */
+static int ds_block(struct decomp_stream *ds, const u8 **srcp, ulong *lenp)
+{
+	uint need = ds->need;
+	uint n;
+
+	if (!ds->stage_len && *lenp >= need) {
+		*srcp += need;
+		*lenp -= need;
+		return ds->ops->block(ds, *srcp - need);
+	}
+
+	if (!ds->stage_len && ds->stage_size < need) {
+		free(ds->stage);
+		ds->stage = malloc(need);
+		if (!ds->stage) {
+			ds->stage_size = 0;
+			return -ENOMEM;
+		}
+		ds->stage_size = need;
+	}
+	n = min_t(ulong, *lenp, need - ds->stage_len);
+	memcpy(ds->stage + ds->stage_len, *srcp, n);
+	ds->stage_len += n;
+	*srcp += n;
+	*lenp -= n;
+	if (ds->stage_len < need)
+		return 0;
+	ds->stage_len = 0;
+
+	return ds->ops->block(ds, ds->stage);
+}
+
+int decomp_stream_init(struct decomp_stream **dsp, int comp, void *dst,
+		       ulong dst_len)
+{
+	const struct decomp_ops *ops = NULL;
+	struct decomp_stream *ds;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(decomp_ops); i++) {
+		if (decomp_ops[i].comp == comp)
+			ops = &decomp_ops[i];
+	}
+	if (!ops)
+		return -EPROTONOSUPPORT;
+
+	ds = calloc(1, sizeof(*ds));
+	if (!ds)
+		return -ENOMEM;
+	ds->ops = ops;
+	ds->dst = dst;
+	ds->dst_len = dst_len;
+	ds->in_hdr = true;
+	*dsp = ds;
+
+	return 0;
+}
+
+int decomp_stream_feed(struct decomp_stream *ds, const void *src, ulong len)
+{
+	const u8 *ptr = src;
+	long ret;
+
+	WATCHDOG_RESET();
+	while (len && !ds->done && !ds->err) {
+		if (ds->in_hdr) {
+			ret = ds_header(ds, &ptr, &len);
+		} else if (ds->ops->data) {
+			ret = ds->ops->data(ds, ptr, len);
+			if (!ret && !ds->done)
+				ret = -EINVAL;	/* no progress */
+			if (ret > 0) {
+				ptr += ret;
+				len -= ret;
+				ret = 0;
+			}
+		} else {
+			ret = ds_block(ds, &ptr, &len);
+		}
+		if (ret)
+			ds->err = ret;
+	}
+
+	return ds->err;
+}
+
+bool decomp_stream_done(struct decomp_stream *ds)
+{
+	return ds->done;
+}
+
+int decomp_stream_finish(struct decomp_stream *ds, ulong *out_len)
+{
+	int ret = ds->err;
+
+	if (!ret && !ds->done)
+		ret = -EINVAL;
+	if (out_len)
+		*out_len = ds->out;
+	if (!ds->in_hdr && ds->ops->free)
+		ds->ops->free(ds);
+	free(ds->stage);
+	free(ds);
+
+	return ret;
+}
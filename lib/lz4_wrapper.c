@@ -6,6 +6,9 @@
 
 #include <common.h>
 #include <compiler.h>
+#include <errno.h>
+#include <lz4_frame.h>
+#include <malloc.h>
 #include <linux/kernel.h>
 #include <linux/types.h>
 
@@ -63,6 +66,182 @@ struct lz4_block_header {
 	/* + u32 block_checksum iff has_block_checksum is set */
 } __packed;
 
+int ulz4_decompress_block(const void *src, size_t srcn, void *dst,
+			  size_t dstn)
+{
+	int ret;
+
+	/* constant folding essential, do not touch params! */
+	ret = LZ4_decompress_generic(src, dst, srcn, dstn, endOnInputSize,
+				     full, 0, noDict, dst, NULL, 0);
+
+	return ret < 0 ? -EPROTO : ret;
+}
+
+#ifdef CONFIG_LZ4_PARALLEL
+int ulz4_index_frame(const void *src, size_t srcn, struct ulz4_index *idx)
+{
+	const struct lz4_frame_header *h = src;
+	const void *end = src + srcn;
+	struct lz4_block_header b;
+	struct ulz4_block *blk;
+	const void *in;
+	int count, pass;
+
+	memset(idx, '\0', sizeof(*idx));
+	if (srcn < sizeof(*h) + sizeof(u64) + sizeof(u8))
+		return -EINVAL;
+	if (le32_to_cpu(h->magic) != LZ4F_MAGIC || h->version != 1 ||
+	    !h->independent_blocks)
+		return -EPROTONOSUPPORT;
+	if (h->reserved0 || h->reserved1 || h->reserved2 ||
+	    h->max_block_size < 4)
+		return -EINVAL;
+	idx->block_max = 1 << (2 * h->max_block_size + 8);
+
+	/* Count the blocks, then go round again to fill in the index */
+	for (pass = 0; pass < 2; pass++) {
+		in = src + sizeof(*h) + sizeof(u8);
+		if (h->has_content_size)
+			in += sizeof(u64);
+		for (count = 0;; count++) {
+			if (in + sizeof(b) > end)
+				return -EINVAL;
+			b.raw = le32_to_cpu(*(u32 *)in);
+			in += sizeof(b);
+			if (!b.size)
+				break;
+			if (b.size > end - in || b.size > idx->block_max)
+				return -EINVAL;
+			if (pass) {
+				blk = &idx->block[count];
+				blk->src = in;
+				blk->src_len = b.size;
+				blk->stored = b.not_compressed;
+				blk->dst_off = count * idx->block_max;
+			}
+			in += b.size;
+			if (h->has_block_checksum)
+				in += sizeof(u32);
+		}
+		if (!pass) {
+			idx->block = calloc(count + 1, sizeof(*blk));
+			if (!idx->block)
+				return -ENOMEM;
+		}
+	}
+	idx->count = count;
+
+	return 0;
+}
+
+void ulz4_decode_blocks(struct ulz4_index *idx, void *dst, size_t dstn,
+			int first, int step)
+{
+	struct ulz4_block *blk;
+	size_t size;
+	int i;
+
+	for (i = first; i < idx->count; i += step) {
+		blk = &idx->block[i];
+		size = 0;
+		if (blk->dst_off < dstn)
+			size = min(idx->block_max, dstn - blk->dst_off);
+		if (!blk->stored) {
+			blk->ret = ulz4_decompress_block(blk->src, blk->src_len,
+							 dst + blk->dst_off,
+							 size);
+		} else if (blk->src_len > size) {
+			blk->ret = -ENOBUFS;
+		} else {
+			memcpy(dst + blk->dst_off, blk->src, blk->src_len);
+			blk->ret = blk->src_len;
+		}
+	}
+}
+
+int ulz4_index_finish(const struct ulz4_index *idx, size_t *dstn)
+{
+	const struct ulz4_block *blk;
+	int i;
+
+	*dstn = 0;
+	for (i = 0; i < idx->count; i++) {
+		blk = &idx->block[i];
+		if (blk->ret < 0)
+			return blk->ret;
+		if (i < idx->count - 1 && blk->ret != idx->block_max)
+			return -EAGAIN;
+		*dstn = blk->dst_off + blk->ret;
+	}
+
+	return 0;
+}
+
+void ulz4_index_free(struct ulz4_index *idx)
+{
+	free(idx->block);
+	idx->block = NULL;
+}
+
+__weak int ulz4_run_workers(void (*func)(void *arg, int worker), void *arg,
+			    int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++)
+		func(arg, i);
+
+	return 0;
+}
+
+struct ulz4_job {
+	struct ulz4_index *idx;
+	void *dst;
+	size_t dstn;
+	int nr;
+};
+
+static void ulz4_worker(void *arg, int worker)
+{
+	struct ulz4_job *job = arg;
+
+	ulz4_decode_blocks(job->idx, job->dst, job->dstn, worker, job->nr);
+}
+
+/* Decode all the blocks of a frame at once, spread over the workers */
+static int ulz4fn_parallel(const void *src, size_t srcn, void *dst,
+			   size_t *dstn)
+{
+	struct ulz4_index idx;
+	struct ulz4_job job;
+	int ret;
+
+	/* Blocks are written out of order, which cannot be done in-place */
+	if (dst < src + srcn && src < dst + *dstn)
+		return -EINVAL;
+	ret = ulz4_index_frame(src, srcn, &idx);
+	if (ret)
+		goto done;
+	if (idx.count < 2) {
+		ret = -EAGAIN;
+		goto done;
+	}
+
+	job.idx = &idx;
+	job.dst = dst;
+	job.dstn = *dstn;
+	job.nr = min(idx.count, CONFIG_LZ4_PARALLEL_WORKERS);
+	ret = ulz4_run_workers(ulz4_worker, &job, job.nr);
+	if (!ret)
+		ret = ulz4_index_finish(&idx, dstn);
+done:
+	ulz4_index_free(&idx);
+
+	return ret;
+}
+#endif
+
 int ulz4fn(const void *src, size_t srcn, void *dst, size_t *dstn)
 {
 	const void *end = dst + *dstn;
@@ -70,6 +249,15 @@ int ulz4fn(const void *src, size_t srcn, void *dst, size_t *dstn)
 	void *out = dst;
 	int has_block_checksum;
 	int ret;
+
+#ifdef CONFIG_LZ4_PARALLEL
+	/*
+	 * If that fails for any reason, decoding in order reports why. The
+	 * blocks which were decoded may have left data anywhere in @dst.
+	 */
+	if (!ulz4fn_parallel(src, srcn, dst, dstn))
+		return 0;
+#endif
 	*dstn = 0;
 
 	{ /* With in-place decompression the header may become invalid later. */
@@ -73,7 +73,7 @@ void sha1_starts (sha1_context * ctx)
 	ctx->state[4] = 0xC3D2E1F0;
 }
 
-static void sha1_process(sha1_context *ctx, const unsigned char data[64])
+static void sha1_process_one(sha1_context *ctx, const unsigned char data[64])
 {
 	unsigned long temp, W[16], A, B, C, D, E;
 
@@ -227,6 +227,25 @@ static void sha1_process(sha1_context *ctx, const unsigned char data[64])
 	ctx->state[4] += E;
 }
 
+void sha1_process_generic(sha1_context *ctx, const unsigned char *data,
+			  unsigned int blocks)
+{
+	while (blocks--) {
+		sha1_process_one(ctx, data);
+		data += 64;
+	}
+}
+
+static void sha1_process(sha1_context *ctx, const unsigned char *data,
+			 unsigned int blocks)
+{
+#if defined(CONFIG_SHA1_ARCH) && !defined(USE_HOSTCC)
+	if (!sha1_process_arch(ctx, data, blocks))
+		return;
+#endif
+	sha1_process_generic(ctx, data, blocks);
+}
+
 /*
  * SHA-1 process buffer
  */
@@ -250,16 +269,16 @@ void sha1_update(sha1_context *ctx, const unsigned char *input,
 
 	if (left && ilen >= fill) {
 		memcpy ((void *) (ctx->buffer + left), (void *) input, fill);
-		sha1_process (ctx, ctx->buffer);
+		sha1_process(ctx, ctx->buffer, 1);
 		input += fill;
 		ilen -= fill;
 		left = 0;
 	}
 
-	while (ilen >= 64) {
-		sha1_process (ctx, input);
-		input += 64;
-		ilen -= 64;
+	if (ilen >= 64) {
+		sha1_process(ctx, input, ilen / 64);
+		input += ilen & ~63;
+		ilen &= 63;
 	}
 
 	if (ilen > 0) {
@@ -50,7 +50,7 @@ void sha256_starts(sha256_context * ctx)
 	ctx->state[7] = 0x5BE0CD19;
 }
 
-static void sha256_process(sha256_context *ctx, const uint8_t data[64])
+static void sha256_process_one(sha256_context *ctx, const uint8_t data[64])
 {
 	uint32_t temp1, temp2;
 	uint32_t W[64];
@@ -181,6 +181,136 @@ static void sha256_process(sha256_context *ctx, const uint8_t data[64])
 	ctx->state[7] += H;
 }
 
+void sha256_process_generic(sha256_context *ctx, const uint8_t *data,
+			    unsigned int blocks)
+{
+	while (blocks--) {
+		sha256_process_one(ctx, data);
+		data += 64;
+	}
+}
+
+static void sha256_process(sha256_context *ctx, const uint8_t *data,
+			   unsigned int blocks)
+{
+#if defined(CONFIG_SHA256_ARCH) && !defined(USE_HOSTCC)
+	if (!sha256_process_arch(ctx, data, blocks))
+		return;
+#endif
+	sha256_process_generic(ctx, data, blocks);
+}
+
+/* Check whether sha256_process() uses dedicated CPU instructions */
+static int sha256_have_arch(void)
+{
+#if defined(CONFIG_SHA256_ARCH) && !defined(USE_HOSTCC)
+	return !sha256_process_arch(NULL, NULL, 0);
+#else
+	return 0;
+#endif
+}
+
+static const uint32_t sha256_k[64] = {
+	0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5,
+	0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+	0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3,
+	0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+	0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC,
+	0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+	0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7,
+	0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+	0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13,
+	0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+	0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3,
+	0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+	0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5,
+	0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+	0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208,
+	0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2,
+};
+
+/*
+ * Process one block of each of two independent messages. The rounds of the
+ * two are interleaved, which gives the CPU two independent dependency chains
+ * to work on and so hides much of the latency of each round.
+ */
+static void sha256_process_x2(sha256_context *ctx0, const uint8_t *data0,
+			      sha256_context *ctx1, const uint8_t *data1)
+{
+	uint32_t temp1, temp2;
+	uint32_t W0[64], W1[64];
+	uint32_t A0, B0, C0, D0, E0, F_0, G0, H0;
+	uint32_t A1, B1, C1, D1, E1, F_1, G1, H1;
+	int t;
+
+	for (t = 0; t < 16; t++) {
+		GET_UINT32_BE(W0[t], data0, t * 4);
+		GET_UINT32_BE(W1[t], data1, t * 4);
+	}
+
+#define R2(W, t)				\
+	(W[t] = S1(W[t - 2]) + W[t - 7] +	\
+		S0(W[t - 15]) + W[t - 16])
+
+	for (t = 16; t < 64; t++) {
+		R2(W0, t);
+		R2(W1, t);
+	}
+
+/* F0 and F1 are taken by the round functions */
+#define P2(a, b, c, d, e, f, g, h, t) {					\
+	P(a##0, b##0, c##0, d##0, e##0, f##0, g##0, h##0, W0[t], sha256_k[t]); \
+	P(a##1, b##1, c##1, d##1, e##1, f##1, g##1, h##1, W1[t], sha256_k[t]); \
+}
+
+	A0 = ctx0->state[0];
+	B0 = ctx0->state[1];
+	C0 = ctx0->state[2];
+	D0 = ctx0->state[3];
+	E0 = ctx0->state[4];
+	F_0 = ctx0->state[5];
+	G0 = ctx0->state[6];
+	H0 = ctx0->state[7];
+
+	A1 = ctx1->state[0];
+	B1 = ctx1->state[1];
+	C1 = ctx1->state[2];
+	D1 = ctx1->state[3];
+	E1 = ctx1->state[4];
+	F_1 = ctx1->state[5];
+	G1 = ctx1->state[6];
+	H1 = ctx1->state[7];
+
+	for (t = 0; t < 64; t += 8) {
+		P2(A, B, C, D, E, F_, G, H, t);
+		P2(H, A, B, C, D, E, F_, G, t + 1);
+		P2(G, H, A, B, C, D, E, F_, t + 2);
+		P2(F_, G, H, A, B, C, D, E, t + 3);
+		P2(E, F_, G, H, A, B, C, D, t + 4);
+		P2(D, E, F_, G, H, A, B, C, t + 5);
+		P2(C, D, E, F_, G, H, A, B, t + 6);
+		P2(B, C, D, E, F_, G, H, A, t + 7);
+	}
+
+	ctx0->state[0] += A0;
+	ctx0->state[1] += B0;
+	ctx0->state[2] += C0;
+	ctx0->state[3] += D0;
+	ctx0->state[4] += E0;
+	ctx0->state[5] += F_0;
+	ctx0->state[6] += G0;
+	ctx0->state[7] += H0;
+
+	ctx1->state[0] += A1;
+	ctx1->state[1] += B1;
+	ctx1->state[2] += C1;
+	ctx1->state[3] += D1;
+	ctx1->state[4] += E1;
+	ctx1->state[5] += F_1;
+	ctx1->state[6] += G1;
+	ctx1->state[7] += H1;
+}
+
 void sha256_update(sha256_context *ctx, const uint8_t *input, uint32_t length)
 {
 	uint32_t left, fill;
@@ -199,22 +329,115 @@ void sha256_update(sha256_context *ctx, const uint8_t *input, uint32_t length)
 
 	if (left && length >= fill) {
 		memcpy((void *) (ctx->buffer + left), (void *) input, fill);
-		sha256_process(ctx, ctx->buffer);
+		sha256_process(ctx, ctx->buffer, 1);
 		length -= fill;
 		input += fill;
 		left = 0;
 	}
 
-	while (length >= 64) {
-		sha256_process(ctx, input);
-		length -= 64;
-		input += 64;
+	if (length >= 64) {
+		sha256_process(ctx, input, length / 64);
+		input += length & ~63;
+		length &= 63;
 	}
 
 	if (length)
 		memcpy((void *) (ctx->buffer + left), (void *) input, length);
 }
 
+/*
+ * Account for the new input and fill up a partial block, leaving only
+ * whole blocks and a tail in *input and *length
+ */
+static void sha256_update_head(sha256_context *ctx, const uint8_t **input,
+			       uint32_t *length)
+{
+	uint32_t left, fill;
+
+	left = ctx->total[0] & 0x3F;
+	fill = 64 - left;
+
+	ctx->total[0] += *length;
+	ctx->total[0] &= 0xFFFFFFFF;
+
+	if (ctx->total[0] < *length)
+		ctx->total[1]++;
+
+	if (!left)
+		return;
+
+	if (*length < fill) {
+		memcpy(ctx->buffer + left, *input, *length);
+		*length = 0;
+		return;
+	}
+
+	memcpy(ctx->buffer + left, *input, fill);
+	sha256_process(ctx, ctx->buffer, 1);
+	*length -= fill;
+	*input += fill;
+}
+
+void sha256_update_multi(sha256_context *ctx[], const uint8_t *input[],
+			 const uint32_t length[], int count)
+{
+	const uint8_t *in[SHA256_MULTI_MAX];
+	uint32_t len[SHA256_MULTI_MAX];
+	uint32_t blocks;
+	int i, a, b, pair;
+
+	for (; count > SHA256_MULTI_MAX; count -= SHA256_MULTI_MAX) {
+		sha256_update_multi(ctx, input, length, SHA256_MULTI_MAX);
+		ctx += SHA256_MULTI_MAX;
+		input += SHA256_MULTI_MAX;
+		length += SHA256_MULTI_MAX;
+	}
+
+	for (i = 0; i < count; i++) {
+		in[i] = input[i];
+		len[i] = length[i];
+		sha256_update_head(ctx[i], &in[i], &len[i]);
+	}
+
+	/*
+	 * Pair up the messages which still have whole blocks, unless the CPU
+	 * has SHA-256 instructions; those beat interleaving in C
+	 */
+	pair = !sha256_have_arch();
+	for (;;) {
+		for (a = -1, b = -1, i = 0; i < count; i++) {
+			if (len[i] < 64)
+				continue;
+			if (a < 0)
+				a = i;
+			else if (b < 0)
+				b = i;
+		}
+		if (a < 0)
+			break;
+
+		if (b < 0 || !pair) {
+			blocks = len[a] / 64;
+			sha256_process(ctx[a], in[a], blocks);
+			in[a] += blocks * 64;
+			len[a] -= blocks * 64;
+			continue;
+		}
+
+		while (len[a] >= 64 && len[b] >= 64) {
+			sha256_process_x2(ctx[a], in[a], ctx[b], in[b]);
+			in[a] += 64;
+			len[a] -= 64;
+			in[b] += 64;
+			len[b] -= 64;
+		}
+	}
+
+	for (i = 0; i < count; i++)
+		if (len[i])
+			memcpy(ctx[i]->buffer, in[i], len[i]);
+}
+
 static uint8_t sha256_padding[64] = {
 	0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
 	   0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
@@ -12,6 +12,298 @@
 
 #ifndef ASMINF
 
+#ifdef CONFIG_ZLIB_INFLATE_WIDE
+
+/*
+   Word-at-a-time version of inflate_fast(). The differences from the
+   byte-at-a-time version below are:
+
+    - The bit buffer is refilled with one unaligned load of a whole
+      unsigned long, counting only the whole bytes which fit. The bits
+      loaded above the count belong to the next input bytes, which the
+      next refill loads again into the same place, so they do no harm.
+      A 64-bit buffer then holds at least 56 bits, enough for a whole
+      length/distance pair, so there is one refill per code.
+
+    - Runs of literals are decoded while enough bits remain, without
+      refilling.
+
+    - Matches are copied 16 or 8 bytes at a time. The last chunk is placed
+      so that it ends exactly at the end of the match, overlapping the one
+      before, so nothing is written past the match. A distance of less
+      than 8 is first widened to a multiple of itself of at least 8.
+
+   Refilling reads up to INFLATE_FAST_MIN_INPUT bytes ahead, so that is
+   how much input inflate() must have available before calling this.
+   Otherwise the entry assumptions and the results are as below.
+ */
+
+#define HOLD_BITS       (8 * sizeof(unsigned long))
+
+/* Load a whole unsigned long, giving at least HOLD_BITS - 8 bits */
+#define REFILL() \
+    do { \
+        unsigned long w_; \
+        __builtin_memcpy(&w_, in, sizeof(w_)); \
+        w_ = sizeof(w_) == 8 ? le64_to_cpu(w_) : le32_to_cpu(w_); \
+        hold |= w_ << bits; \
+        in += (HOLD_BITS - 1 - bits) >> 3; \
+        bits |= HOLD_BITS - 8; \
+    } while (0)
+
+/* Only used where the source is at least n bytes before the destination */
+#define COPY_CHUNK(to, from, n) __builtin_memcpy(to, from, n)
+
+/* Copy a match of len >= 1 bytes from dist back, ending at out + len */
+local inline unsigned char FAR *copy_match(unsigned char FAR *out,
+                                           unsigned dist, unsigned len)
+{
+    unsigned char FAR *end = out + len;
+    unsigned wide;
+
+    /* A short repeated pattern can equally be copied from further back */
+    if (dist < 16 && len >= 32) {
+        wide = (dist + 15) / dist * dist;
+        len = wide - dist;
+        do {
+            *out = *(out - dist);
+            out++;
+        } while (--len);
+        dist = wide;
+    }
+
+    if (dist >= 16 && end - out >= 16) {
+        while (end - out > 16) {
+            COPY_CHUNK(out, out - dist, 16);
+            out += 16;
+        }
+        COPY_CHUNK(end - 16, end - 16 - dist, 16);
+        return end;
+    }
+    if (dist >= 8 && end - out >= 8) {
+        while (end - out > 8) {
+            COPY_CHUNK(out, out - dist, 8);
+            out += 8;
+        }
+        COPY_CHUNK(end - 8, end - 8 - dist, 8);
+        return end;
+    }
+    while (out < end) {
+        *out = *(out - dist);
+        out++;
+    }
+    return end;
+}
+
+void inflate_fast(z_streamp strm, unsigned start)
+/* start: inflate()'s starting value for strm->avail_out */
+{
+    struct inflate_state FAR *state;
+    unsigned char FAR *in;      /* local strm->next_in */
+    unsigned char FAR *last;    /* while in < last, enough input available */
+    unsigned char FAR *out;     /* local strm->next_out */
+    unsigned char FAR *beg;     /* inflate()'s initial strm->next_out */
+    unsigned char FAR *end;     /* while out < end, enough space available */
+#ifdef INFLATE_STRICT
+    unsigned dmax;              /* maximum distance from zlib header */
+#endif
+    unsigned wsize;             /* window size or zero if not using window */
+    unsigned whave;             /* valid bytes in the window */
+    unsigned write;             /* window write index */
+    unsigned char FAR *window;  /* allocated sliding window, if wsize != 0 */
+    unsigned long hold;         /* local strm->hold */
+    unsigned bits;              /* local strm->bits */
+    code const FAR *lcode;      /* local strm->lencode */
+    code const FAR *dcode;      /* local strm->distcode */
+    unsigned lmask;             /* mask for first level of length codes */
+    unsigned dmask;             /* mask for first level of distance codes */
+    code this;                  /* retrieved table entry */
+    unsigned op;                /* code bits, operation, extra bits, or */
+                                /*  window position, window bytes to copy */
+    unsigned len;               /* match length, unused bytes */
+    unsigned dist;              /* match distance */
+    unsigned char FAR *from;    /* where to copy match from */
+
+    /* copy state to local variables */
+    state = (struct inflate_state FAR *)strm->state;
+    in = strm->next_in;
+    last = in + (strm->avail_in - (INFLATE_FAST_MIN_INPUT - 1));
+    if (in > last && strm->avail_in > INFLATE_FAST_MIN_INPUT - 1) {
+        /*
+         * overflow detected, limit strm->avail_in to the
+         * max. possible size and recalculate last
+         */
+        strm->avail_in = 0xffffffff - (uintptr_t)in;
+        last = in + (strm->avail_in - (INFLATE_FAST_MIN_INPUT - 1));
+    }
+    out = strm->next_out;
+    beg = out - (start - strm->avail_out);
+    end = out + (strm->avail_out - (INFLATE_FAST_MIN_OUTPUT - 1));
+#ifdef INFLATE_STRICT
+    dmax = state->dmax;
+#endif
+    wsize = state->wsize;
+    whave = state->whave;
+    write = state->write;
+    window = state->window;
+    hold = state->hold;
+    bits = state->bits;
+    lcode = state->lencode;
+    dcode = state->distcode;
+    lmask = (1U << state->lenbits) - 1;
+    dmask = (1U << state->distbits) - 1;
+
+    /* decode literals and length/distances until end-of-block or not enough
+       input data or output space */
+    do {
+        REFILL();
+        this = lcode[hold & lmask];
+      dolen:
+        op = (unsigned)(this.bits);
+        hold >>= op;
+        bits -= op;
+        op = (unsigned)(this.op);
+        if (op == 0) {                          /* literal */
+            Tracevv((stderr, this.val >= 0x20 && this.val < 0x7f ?
+                    "inflate:         literal '%c'\n" :
+                    "inflate:         literal 0x%02x\n", this.val));
+            *out++ = (unsigned char)(this.val);
+
+            /* take any following literals from the bits already loaded */
+            while (bits >= 15) {
+                this = lcode[hold & lmask];
+                if (this.op)
+                    break;
+                hold >>= this.bits;
+                bits -= this.bits;
+                *out++ = (unsigned char)(this.val);
+            }
+        }
+        else if (op & 16) {                     /* length base */
+            len = (unsigned)(this.val);
+            op &= 15;                           /* number of extra bits */
+            if (op) {
+                len += (unsigned)hold & ((1U << op) - 1);
+                hold >>= op;
+                bits -= op;
+            }
+            Tracevv((stderr, "inflate:         length %u\n", len));
+            if (bits < 15)
+                REFILL();
+            this = dcode[hold & dmask];
+          dodist:
+            op = (unsigned)(this.bits);
+            hold >>= op;
+            bits -= op;
+            op = (unsigned)(this.op);
+            if (op & 16) {                      /* distance base */
+                dist = (unsigned)(this.val);
+                op &= 15;                       /* number of extra bits */
+                if (bits < op)
+                    REFILL();
+                dist += (unsigned)hold & ((1U << op) - 1);
+#ifdef INFLATE_STRICT
+                if (dist > dmax) {
+                    strm->msg = (char *)"invalid distance too far back";
+                    state->mode = BAD;
+                    break;
+                }
+#endif
+                hold >>= op;
+                bits -= op;
+                Tracevv((stderr, "inflate:         distance %u\n", dist));
+                op = (unsigned)(out - beg);     /* max distance in output */
+                if (dist > op) {                /* see if copy from window */
+                    op = dist - op;             /* distance back in window */
+                    if (op > whave) {
+                        strm->msg = (char *)"invalid distance too far back";
+                        state->mode = BAD;
+                        break;
+                    }
+                    from = window;
+                    if (write == 0) {           /* very common case */
+                        from += wsize - op;
+                    }
+                    else if (write < op) {      /* wrap around window */
+                        from += wsize + write - op;
+                        op -= write;
+                        if (op < len) {         /* some from end of window */
+                            len -= op;
+                            do {
+                                *out++ = *from++;
+                            } while (--op);
+                            from = window;      /* then from start */
+                            op = write;
+                        }
+                    }
+                    else {                      /* contiguous in window */
+                        from += write - op;
+                    }
+                    if (op < len) {             /* some from window */
+                        len -= op;
+                        do {
+                            *out++ = *from++;
+                        } while (--op);
+                        out = copy_match(out, dist, len); /* rest from output */
+                    }
+                    else {
+                        do {
+                            *out++ = *from++;
+                        } while (--len);
+                    }
+                }
+                else {
+                    out = copy_match(out, dist, len);
+                }
+            }
+            else if ((op & 64) == 0) {          /* 2nd level distance code */
+                this = dcode[this.val + (hold & ((1U << op) - 1))];
+                goto dodist;
+            }
+            else {
+                strm->msg = (char *)"invalid distance code";
+                state->mode = BAD;
+                break;
+            }
+        }
+        else if ((op & 64) == 0) {              /* 2nd level length code */
+            this = lcode[this.val + (hold & ((1U << op) - 1))];
+            goto dolen;
+        }
+        else if (op & 32) {                     /* end-of-block */
+            Tracevv((stderr, "inflate:         end of block\n"));
+            state->mode = TYPE;
+            break;
+        }
+        else {
+            strm->msg = (char *)"invalid literal/length code";
+            state->mode = BAD;
+            break;
+        }
+    } while (in < last && out < end);
+
+    /* return unused bytes, dropping the extra ones loaded above them */
+    len = bits >> 3;
+    in -= len;
+    bits -= len << 3;
+    hold &= (1UL << bits) - 1;
+
+    /* update state and return */
+    strm->next_in = in;
+    strm->next_out = out;
+    strm->avail_in = (unsigned)(in < last ?
+                                (INFLATE_FAST_MIN_INPUT - 1) + (last - in) :
+                                (INFLATE_FAST_MIN_INPUT - 1) - (in - last));
+    strm->avail_out = (unsigned)(out < end ?
+                                 (INFLATE_FAST_MIN_OUTPUT - 1) + (end - out) :
+                                 (INFLATE_FAST_MIN_OUTPUT - 1) - (out - end));
+    state->hold = hold;
+    state->bits = bits;
+    return;
+}
+
+#else /* !CONFIG_ZLIB_INFLATE_WIDE */
+
 /* Allow machine dependent optimization for post-increment or pre-increment.
    Based on testing to date,
    Pre-increment preferred for:
@@ -353,4 +645,6 @@ void inflate_fast(z_streamp strm, unsigned start)
    - Moving len -= 3 statement into middle of loop
  */
 
+#endif /* CONFIG_ZLIB_INFLATE_WIDE */
+
 #endif /* !ASMINF */
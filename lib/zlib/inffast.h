@@ -9,3 +9,11 @@
  */
 
 void inflate_fast OF((z_streamp strm, unsigned start));
+
+/* inflate() only calls inflate_fast() with at least this much available */
+#ifdef CONFIG_ZLIB_INFLATE_WIDE
+#define INFLATE_FAST_MIN_INPUT	(2 * sizeof(unsigned long) + 8)
+#else
+#define INFLATE_FAST_MIN_INPUT	6
+#endif
+#define INFLATE_FAST_MIN_OUTPUT	258
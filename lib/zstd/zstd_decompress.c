@@ -0,0 +1,1052 @@
+/*
+ * Zstandard decompression
+ *
+ * This decodes the format described in RFC 8878. The output goes into a
+ * single buffer which also holds the history that matches refer back
+ * to, as with the other decompressors in U-Boot, so no window buffer is
+ * needed. Apart from the decoding tables, the only other memory used is
+ * a buffer for the literals of one block.
+ *
+ * Blocks are made up of literals, usually Huffman-coded, followed by a
+ * list of sequences. Each sequence copies some literals then a match
+ * from earlier output. The lengths and offsets are coded with FSE
+ * (finite state entropy, a form of arithmetic coding) and read from a
+ * bitstream which runs backwards from the end of the block.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <errno.h>
+#include <malloc.h>
+#include <asm/unaligned.h>
+#include <linux/bitops.h>
+#include <u-boot/zstd.h>
+
+/* Skippable frames use any of 16 magic numbers */
+#define ZSTD_SKIP_MAGIC		0x184d2a50
+#define ZSTD_SKIP_MASK		0xfffffff0
+
+#define FHD_SINGLE_SEGMENT	0x20
+#define FHD_RESERVED		0x08
+#define FHD_CHECKSUM		0x04
+
+/* Largest symbol and table log for each kind of code */
+#define LL_MAX_SYM		35
+#define ML_MAX_SYM		52
+#define OF_MAX_SYM		31
+#define LL_MAX_LOG		9
+#define ML_MAX_LOG		9
+#define OF_MAX_LOG		8
+#define HUF_MAX_BITS		11
+#define HUF_WEIGHT_MAX_LOG	6
+
+enum {
+	LIT_RAW,
+	LIT_RLE,
+	LIT_COMPRESSED,
+	LIT_TREELESS,
+};
+
+enum {
+	SEQ_PREDEFINED,
+	SEQ_RLE,
+	SEQ_FSE,
+	SEQ_REPEAT,
+};
+
+/* The literals are copied 16 bytes at a time, so may be read beyond */
+#define LIT_SLACK		32
+
+struct fse_entry {
+	u8 sym;
+	u8 nbits;
+	u16 base;
+};
+
+struct huf_entry {
+	u8 sym;
+	u8 nbits;
+};
+
+struct zstd_dctx {
+	struct fse_entry ll[1 << LL_MAX_LOG];
+	struct fse_entry ml[1 << ML_MAX_LOG];
+	struct fse_entry of[1 << OF_MAX_LOG];
+	struct huf_entry huf[1 << HUF_MAX_BITS];
+	int ll_log;		/* -1 if there is no table to repeat */
+	int ml_log;
+	int of_log;
+	int huf_bits;		/* 0 if there is no table to repeat */
+	u32 rep[3];		/* Recent offsets */
+	u8 *base;		/* Start of the frame's output */
+	u8 lit[ZSTD_BLOCK_MAX + LIT_SLACK];
+};
+
+static const s16 ll_default[] = {
+	4, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 3, 2, 1, 1, 1, 1, 1,
+	-1, -1, -1, -1
+};
+
+static const s16 ml_default[] = {
+	1, 4, 3, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, -1, -1,
+	-1, -1, -1, -1, -1
+};
+
+static const s16 of_default[] = {
+	1, 1, 1, 1, 1, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1
+};
+
+static const u32 ll_base[LL_MAX_SYM + 1] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+	16, 18, 20, 22, 24, 28, 32, 40, 48, 64, 0x80, 0x100,
+	0x200, 0x400, 0x800, 0x1000, 0x2000, 0x4000, 0x8000, 0x10000
+};
+
+static const u8 ll_bits[LL_MAX_SYM + 1] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	1, 1, 1, 1, 2, 2, 3, 3, 4, 6, 7, 8, 9, 10, 11, 12,
+	13, 14, 15, 16
+};
+
+static const u32 ml_base[ML_MAX_SYM + 1] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18,
+	19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34,
+	35, 37, 39, 41, 43, 47, 51, 59, 67, 83, 99, 0x83, 0x103, 0x203,
+	0x403, 0x803, 0x1003, 0x2003, 0x4003, 0x8003, 0x10003
+};
+
+static const u8 ml_bits[ML_MAX_SYM + 1] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	1, 1, 1, 1, 2, 2, 3, 3, 4, 4, 5, 7, 8, 9, 10, 11,
+	12, 13, 14, 15, 16
+};
+
+/*
+ * Reading a bitstream backwards. @val holds the 8 bytes at @ptr and bits
+ * are taken from the top down, @used counting those already read. Reads
+ * must be followed by bits_reload() before they total more than 56 bits.
+ */
+struct bits {
+	u64 val;
+	uint used;
+	const u8 *ptr;
+	const u8 *start;
+};
+
+static int bits_init(struct bits *b, const u8 *src, size_t len)
+{
+	size_t i;
+	u8 last;
+
+	if (!len || !src[len - 1])
+		return -EINVAL;
+	last = src[len - 1];
+	b->start = src;
+	if (len >= sizeof(b->val)) {
+		b->ptr = src + len - sizeof(b->val);
+		b->val = get_unaligned_le64(b->ptr);
+		b->used = 0;
+	} else {
+		b->ptr = src;
+		b->val = 0;
+		for (i = 0; i < len; i++)
+			b->val |= (u64)src[i] << (8 * i);
+		b->used = 8 * (sizeof(b->val) - len);
+	}
+	/* The stream starts after the highest set bit of the last byte */
+	b->used += 9 - fls(last);
+
+	return 0;
+}
+
+/* Once the stream is used up, reading more gives meaningless values */
+static inline u32 bits_peek(const struct bits *b, uint n)
+{
+	return (b->val << (b->used & 63)) >> 1 >> (63 - n);
+}
+
+static inline u32 bits_read(struct bits *b, uint n)
+{
+	u32 v = bits_peek(b, n);
+
+	b->used += n;
+
+	return v;
+}
+
+static inline void bits_reload(struct bits *b)
+{
+	size_t n = b->used >> 3;
+
+	if (n > b->ptr - b->start)
+		n = b->ptr - b->start;
+	if (!n)
+		return;
+	b->ptr -= n;
+	b->used -= 8 * n;
+	b->val = get_unaligned_le64(b->ptr);
+}
+
+/* Check whether more bits were read than the stream holds */
+static inline bool bits_overflow(struct bits *b)
+{
+	bits_reload(b);
+
+	return b->used > 64;
+}
+
+/* Check whether exactly all of the stream has been read */
+static inline bool bits_done(struct bits *b)
+{
+	bits_reload(b);
+
+	return b->ptr == b->start && b->used == 64;
+}
+
+/* Read bits forwards from @pos, for the short table descriptions */
+static u32 fwd_peek(const u8 *src, size_t len, size_t pos)
+{
+	size_t i = pos >> 3;
+	u32 v = 0;
+	int k;
+
+	for (k = 0; k < 4 && i + k < len; k++)
+		v |= (u32)src[i + k] << (8 * k);
+
+	return v >> (pos & 7);
+}
+
+/**
+ * fse_read_counts() - Read the normalised counts of an FSE table
+ *
+ * @norm:	Returns the count for each symbol; -1 means a probability
+ *		of less than one in the table size
+ * @nsymp:	Largest number of symbols allowed; returns the number read
+ * @logp:	Largest table log allowed; returns the table log
+ * @src:	Table description
+ * @len:	Bytes available at @src
+ * @return number of bytes used, or -EINVAL if the counts are not valid
+ */
+static int fse_read_counts(s16 *norm, int *nsymp, int *logp, const u8 *src,
+			   size_t len)
+{
+	int remaining, threshold, nbits, max, count, rep, log;
+	bool prev0 = false;
+	size_t pos = 4;
+	int sym = 0;
+	u32 v;
+
+	if (!len)
+		return -EINVAL;
+	log = (src[0] & 15) + 5;
+	if (log > *logp)
+		return -EINVAL;
+	remaining = (1 << log) + 1;
+	threshold = 1 << log;
+	nbits = log + 1;
+
+	while (remaining > 1) {
+		/* A zero count is followed by how many more zeros there are */
+		if (prev0) {
+			do {
+				rep = fwd_peek(src, len, pos) & 3;
+				pos += 2;
+				if (sym + rep > *nsymp)
+					return -EINVAL;
+				for (count = 0; count < rep; count++)
+					norm[sym++] = 0;
+			} while (rep == 3);
+		}
+		if (sym >= *nsymp)
+			return -EINVAL;
+
+		/* Smaller values take one bit less */
+		v = fwd_peek(src, len, pos);
+		max = 2 * threshold - 1 - remaining;
+		if ((v & (threshold - 1)) < max) {
+			count = v & (threshold - 1);
+			pos += nbits - 1;
+		} else {
+			count = v & (2 * threshold - 1);
+			if (count >= threshold)
+				count -= max;
+			pos += nbits;
+		}
+		count--;
+		remaining -= count < 0 ? -count : count;
+		if (remaining < 1)
+			return -EINVAL;
+		norm[sym++] = count;
+		prev0 = !count;
+		while (remaining < threshold) {
+			nbits--;
+			threshold >>= 1;
+		}
+	}
+	if (remaining != 1 || pos > len * 8)
+		return -EINVAL;
+	*nsymp = sym;
+	*logp = log;
+
+	return (pos + 7) >> 3;
+}
+
+/* Spread the symbols over the table according to their counts */
+static int fse_build(struct fse_entry *table, const s16 *norm, int nsym,
+		     int log)
+{
+	int size = 1 << log, high = size - 1, mask = size - 1;
+	int step = (size >> 1) + (size >> 3) + 3;
+	u16 next[ML_MAX_SYM + 1];
+	int pos = 0;
+	int sym, i;
+
+	for (sym = 0; sym < nsym; sym++) {
+		if (norm[sym] == -1) {
+			if (high < 0)
+				return -EINVAL;
+			table[high--].sym = sym;
+			next[sym] = 1;
+		} else {
+			next[sym] = norm[sym];
+		}
+	}
+	for (sym = 0; sym < nsym; sym++) {
+		for (i = 0; i < norm[sym]; i++) {
+			table[pos].sym = sym;
+			do {
+				pos = (pos + step) & mask;
+			} while (pos > high);
+		}
+	}
+	if (pos)
+		return -EINVAL;
+
+	for (i = 0; i < size; i++) {
+		u16 n = next[table[i].sym]++;
+		int nbits = log + 1 - fls(n);
+
+		table[i].nbits = nbits;
+		table[i].base = (n << nbits) - size;
+	}
+
+	return 0;
+}
+
+/* Set up the table for literal lengths, match lengths or offsets */
+static int seq_table(struct fse_entry *table, int *logp, int mode,
+		     const s16 *def, int def_nsym, int def_log, int max_sym,
+		     int max_log, const u8 *src, size_t len)
+{
+	s16 norm[ML_MAX_SYM + 1];
+	int nsym = max_sym + 1;
+	int log = max_log;
+	int ret;
+
+	switch (mode) {
+	case SEQ_PREDEFINED:
+		*logp = def_log;
+		return fse_build(table, def, def_nsym, def_log);
+	case SEQ_RLE:
+		if (!len || src[0] > max_sym)
+			return -EINVAL;
+		table[0].sym = src[0];
+		table[0].nbits = 0;
+		table[0].base = 0;
+		*logp = 0;
+		return 1;
+	case SEQ_FSE:
+		ret = fse_read_counts(norm, &nsym, &log, src, len);
+		if (ret < 0)
+			return ret;
+		*logp = log;
+		if (fse_build(table, norm, nsym, log))
+			return -EINVAL;
+		return ret;
+	default:
+		return *logp < 0 ? -EINVAL : 0;
+	}
+}
+
+/* Read the Huffman code weights, which are FSE-coded when there are many */
+static int huf_read_weights(u8 *weights, int *nump, const u8 *src,
+			    size_t len)
+{
+	struct fse_entry table[1 << HUF_WEIGHT_MAX_LOG];
+	int nsym = HUF_MAX_BITS + 1, log = HUF_WEIGHT_MAX_LOG;
+	uint size, s1, s2, n, i;
+	s16 norm[HUF_MAX_BITS + 1];
+	struct bits b;
+	int ret;
+
+	if (!len)
+		return -EINVAL;
+	size = src[0];
+	if (size >= 128) {
+		n = size - 127;
+		size = (n + 1) / 2;
+		if (size + 1 > len)
+			return -EINVAL;
+		for (i = 0; i < n; i++) {
+			weights[i] = src[1 + i / 2];
+			weights[i] = i & 1 ? weights[i] & 15 : weights[i] >> 4;
+		}
+		*nump = n;
+		return size + 1;
+	}
+
+	if (size + 1 > len)
+		return -EINVAL;
+	ret = fse_read_counts(norm, &nsym, &log, src + 1, size);
+	if (ret < 0 || fse_build(table, norm, nsym, log))
+		return -EINVAL;
+	if (bits_init(&b, src + 1 + ret, size - ret))
+		return -EINVAL;
+
+	/* Two interleaved states, until the stream runs out */
+	s1 = bits_read(&b, log);
+	s2 = bits_read(&b, log);
+	for (n = 0;;) {
+		if (n > 252)
+			return -EINVAL;
+		weights[n++] = table[s1].sym;
+		s1 = table[s1].base + bits_read(&b, table[s1].nbits);
+		if (bits_overflow(&b)) {
+			weights[n++] = table[s2].sym;
+			break;
+		}
+		weights[n++] = table[s2].sym;
+		s2 = table[s2].base + bits_read(&b, table[s2].nbits);
+		if (bits_overflow(&b)) {
+			weights[n++] = table[s1].sym;
+			break;
+		}
+	}
+	*nump = n;
+
+	return size + 1;
+}
+
+static int huf_read_table(struct zstd_dctx *dc, const u8 *src, size_t len)
+{
+	u8 weights[256];
+	u32 total = 0, rest;
+	int num, bits, pos, w, sym, i, ret;
+
+	ret = huf_read_weights(weights, &num, src, len);
+	if (ret < 0)
+		return ret;
+	for (i = 0; i < num; i++) {
+		if (weights[i] > HUF_MAX_BITS)
+			return -EINVAL;
+		if (weights[i])
+			total += 1 << (weights[i] - 1);
+	}
+	if (!total)
+		return -EINVAL;
+
+	/* The last weight makes the total up to a power of two */
+	bits = fls(total);
+	rest = (1 << bits) - total;
+	if (bits > HUF_MAX_BITS || rest & (rest - 1))
+		return -EINVAL;
+	weights[num++] = fls(rest);
+
+	/* Longest codes first, so each code indexes its own table entries */
+	pos = 0;
+	for (w = 1; w <= bits; w++) {
+		for (sym = 0; sym < num; sym++) {
+			if (weights[sym] != w)
+				continue;
+			for (i = 0; i < 1 << (w - 1); i++) {
+				dc->huf[pos].sym = sym;
+				dc->huf[pos].nbits = bits + 1 - w;
+				pos++;
+			}
+		}
+	}
+	dc->huf_bits = bits;
+
+	return ret;
+}
+
+static inline u8 huf_decode_sym(const struct huf_entry *table, uint bits,
+				 struct bits *b)
+{
+	struct huf_entry e = table[bits_peek(b, bits)];
+
+	b->used += e.nbits;
+
+	return e.sym;
+}
+
+/* Four symbols of at most HUF_MAX_BITS each fit between reloads */
+static inline void huf_decode4(const struct huf_entry *table, uint bits,
+			       struct bits *b, u8 *out)
+{
+	bits_reload(b);
+	out[0] = huf_decode_sym(table, bits, b);
+	out[1] = huf_decode_sym(table, bits, b);
+	out[2] = huf_decode_sym(table, bits, b);
+	out[3] = huf_decode_sym(table, bits, b);
+}
+
+/* Decode the rest of a stream, and check that it ends in the right place */
+static int huf_decode_tail(struct zstd_dctx *dc, struct bits *b, u8 *out,
+			   u8 *end)
+{
+	while (end - out >= 4) {
+		huf_decode4(dc->huf, dc->huf_bits, b, out);
+		out += 4;
+	}
+	while (out < end) {
+		bits_reload(b);
+		*out++ = huf_decode_sym(dc->huf, dc->huf_bits, b);
+	}
+
+	return bits_done(b) ? 0 : -EINVAL;
+}
+
+/* Returns the number of bytes used, and sets *nlitp to the literal count */
+static int decode_literals(struct zstd_dctx *dc, const u8 *src, size_t len,
+			   size_t *nlitp)
+{
+	uint type, format, hsize, size_bits, csize, seg, pos, i;
+	u8 *out, *lit_end;
+	size_t nlit, sizes[4];
+	const u8 *p, *end;
+	struct bits b[4];
+	u64 hdr = 0;
+	int ret;
+
+	if (!len)
+		return -EINVAL;
+	type = src[0] & 3;
+	format = (src[0] >> 2) & 3;
+
+	if (type == LIT_RAW || type == LIT_RLE) {
+		hsize = format == 1 ? 2 : format == 3 ? 3 : 1;
+		if (len < hsize)
+			return -EINVAL;
+		if (hsize == 1)
+			nlit = src[0] >> 3;
+		else if (hsize == 2)
+			nlit = (src[0] >> 4) + (src[1] << 4);
+		else
+			nlit = (src[0] >> 4) + (src[1] << 4) + (src[2] << 12);
+		if (nlit > ZSTD_BLOCK_MAX)
+			return -EINVAL;
+		*nlitp = nlit;
+		if (type == LIT_RLE) {
+			if (len < hsize + 1)
+				return -EINVAL;
+			memset(dc->lit, src[hsize], nlit);
+			return hsize + 1;
+		}
+		if (len < hsize + nlit)
+			return -EINVAL;
+		memcpy(dc->lit, src + hsize, nlit);
+		return hsize + nlit;
+	}
+
+	/* Sizes of the output and of the Huffman-coded data */
+	hsize = format < 2 ? 3 : format + 2;
+	size_bits = format < 2 ? 10 : format == 2 ? 14 : 18;
+	if (len < hsize)
+		return -EINVAL;
+	for (i = 0; i < hsize; i++)
+		hdr |= (u64)src[i] << (8 * i);
+	nlit = (hdr >> 4) & ((1 << size_bits) - 1);
+	csize = (hdr >> (4 + size_bits)) & ((1 << size_bits) - 1);
+	if (nlit > ZSTD_BLOCK_MAX || csize > len - hsize)
+		return -EINVAL;
+	*nlitp = nlit;
+	p = src + hsize;
+	end = p + csize;
+
+	if (type == LIT_COMPRESSED) {
+		ret = huf_read_table(dc, p, csize);
+		if (ret < 0)
+			return ret;
+		p += ret;
+	} else if (!dc->huf_bits) {
+		return -EINVAL;
+	}
+
+	if (!format) {
+		if (bits_init(&b[0], p, end - p))
+			return -EINVAL;
+		ret = huf_decode_tail(dc, &b[0], dc->lit, dc->lit + nlit);
+		return ret ? ret : hsize + csize;
+	}
+
+	/* Four streams, each of a quarter of the output */
+	if (end - p < 6)
+		return -EINVAL;
+	sizes[0] = get_unaligned_le16(p);
+	sizes[1] = get_unaligned_le16(p + 2);
+	sizes[2] = get_unaligned_le16(p + 4);
+	p += 6;
+	if (sizes[0] + sizes[1] + sizes[2] > end - p)
+		return -EINVAL;
+	sizes[3] = end - p - sizes[0] - sizes[1] - sizes[2];
+	seg = (nlit + 3) / 4;
+	if (3 * seg > nlit)
+		return -EINVAL;
+	for (i = 0; i < 4; i++) {
+		if (bits_init(&b[i], p, sizes[i]))
+			return -EINVAL;
+		p += sizes[i];
+	}
+
+	/*
+	 * Each symbol depends on the one before it in the same stream, so
+	 * decode the streams side by side while all of them have room. The
+	 * last is the shortest.
+	 */
+	out = dc->lit;
+	lit_end = dc->lit + nlit;
+	for (pos = 0; lit_end - (out + 3 * seg + pos) >= 4; pos += 4) {
+		huf_decode4(dc->huf, dc->huf_bits, &b[0], out + pos);
+		huf_decode4(dc->huf, dc->huf_bits, &b[1], out + seg + pos);
+		huf_decode4(dc->huf, dc->huf_bits, &b[2], out + 2 * seg + pos);
+		huf_decode4(dc->huf, dc->huf_bits, &b[3], out + 3 * seg + pos);
+	}
+	for (i = 0; i < 4; i++) {
+		ret = huf_decode_tail(dc, &b[i], out + i * seg + pos,
+				      i < 3 ? out + (i + 1) * seg : lit_end);
+		if (ret)
+			return ret;
+	}
+
+	return hsize + csize;
+}
+
+/* Copy 16 bytes at a time, writing up to 15 bytes too many */
+static inline void wild_copy16(u8 *op, const u8 *ip, size_t len)
+{
+	u8 *end = op + len;
+
+	do {
+		__builtin_memcpy(op, ip, 16);
+		op += 16;
+		ip += 16;
+	} while (op < end);
+}
+
+/* Copy a match, which may overlap its output if @off is small */
+static inline void copy_match(u8 *op, size_t off, size_t len, bool slack)
+{
+	const u8 *ip = op - off;
+	u8 *end = op + len;
+
+	if (slack && off >= 16) {
+		wild_copy16(op, ip, len);
+	} else if (slack && off >= 8) {
+		do {
+			__builtin_memcpy(op, ip, 8);
+			op += 8;
+			ip += 8;
+		} while (op < end);
+	} else {
+		while (op < end)
+			*op++ = *ip++;
+	}
+}
+
+static int decode_sequences(struct zstd_dctx *dc, const u8 *src, size_t len,
+			    u8 *out, size_t avail, size_t nlit)
+{
+	const u8 *p = src, *end = src + len;
+	const u8 *lit = dc->lit, *lit_end = lit + nlit;
+	u8 *op = out, *oend = out + avail;
+	uint ll_state, ml_state, of_state;
+	uint nseq, modes, llc, mlc, ofc, rep, i;
+	size_t ll, ml, off;
+	struct bits b;
+	int ret;
+
+	if (p == end)
+		return -EINVAL;
+	nseq = *p++;
+	if (nseq == 255) {
+		if (end - p < 2)
+			return -EINVAL;
+		nseq = get_unaligned_le16(p) + 0x7f00;
+		p += 2;
+	} else if (nseq >= 128) {
+		if (p == end)
+			return -EINVAL;
+		nseq = ((nseq - 128) << 8) + *p++;
+	}
+
+	if (nseq) {
+		if (p == end)
+			return -EINVAL;
+		modes = *p++;
+		if (modes & 3)
+			return -EINVAL;
+		ret = seq_table(dc->ll, &dc->ll_log, modes >> 6, ll_default,
+				ARRAY_SIZE(ll_default), 6, LL_MAX_SYM,
+				LL_MAX_LOG, p, end - p);
+		if (ret < 0)
+			return ret;
+		p += ret;
+		ret = seq_table(dc->of, &dc->of_log, (modes >> 4) & 3,
+				of_default, ARRAY_SIZE(of_default), 5,
+				OF_MAX_SYM, OF_MAX_LOG, p, end - p);
+		if (ret < 0)
+			return ret;
+		p += ret;
+		ret = seq_table(dc->ml, &dc->ml_log, (modes >> 2) & 3,
+				ml_default, ARRAY_SIZE(ml_default), 6,
+				ML_MAX_SYM, ML_MAX_LOG, p, end - p);
+		if (ret < 0)
+			return ret;
+		p += ret;
+
+		if (bits_init(&b, p, end - p))
+			return -EINVAL;
+		ll_state = bits_read(&b, dc->ll_log);
+		of_state = bits_read(&b, dc->of_log);
+		ml_state = bits_read(&b, dc->ml_log);
+	} else if (p != end) {
+		return -EINVAL;
+	}
+
+	for (i = nseq; i; i--) {
+		llc = dc->ll[ll_state].sym;
+		mlc = dc->ml[ml_state].sym;
+		ofc = dc->of[of_state].sym;
+
+		bits_reload(&b);
+		off = (1UL << ofc) + bits_read(&b, ofc);
+		bits_reload(&b);
+		ml = ml_base[mlc] + bits_read(&b, ml_bits[mlc]);
+		ll = ll_base[llc] + bits_read(&b, ll_bits[llc]);
+		bits_reload(&b);
+
+		/* Offsets 1-3 pick one of the recent offsets */
+		if (off > 3) {
+			off -= 3;
+			dc->rep[2] = dc->rep[1];
+			dc->rep[1] = dc->rep[0];
+			dc->rep[0] = off;
+		} else {
+			rep = off - 1 + !ll;
+			if (rep) {
+				off = rep == 3 ? dc->rep[0] - 1 : dc->rep[rep];
+				if (rep > 1)
+					dc->rep[2] = dc->rep[1];
+				dc->rep[1] = dc->rep[0];
+				dc->rep[0] = off;
+			} else {
+				off = dc->rep[0];
+			}
+		}
+
+		/* The states are not updated after the last sequence */
+		if (i > 1) {
+			ll_state = dc->ll[ll_state].base +
+				bits_read(&b, dc->ll[ll_state].nbits);
+			ml_state = dc->ml[ml_state].base +
+				bits_read(&b, dc->ml[ml_state].nbits);
+			of_state = dc->of[of_state].base +
+				bits_read(&b, dc->of[of_state].nbits);
+		}
+
+		if (ll > lit_end - lit)
+			return -EINVAL;
+		if (ll + ml > oend - op)
+			return -ENOSPC;
+		if (!off || off > op + ll - dc->base)
+			return -EINVAL;
+		if (oend - op >= ll + ml + 16) {
+			wild_copy16(op, lit, ll);
+			copy_match(op + ll, off, ml, true);
+		} else {
+			memcpy(op, lit, ll);
+			copy_match(op + ll, off, ml, false);
+		}
+		lit += ll;
+		op += ll + ml;
+	}
+	if (nseq && !bits_done(&b))
+		return -EINVAL;
+
+	/* Then any literals left over */
+	ll = lit_end - lit;
+	if (ll > oend - op)
+		return -ENOSPC;
+	memcpy(op, lit, ll);
+
+	return op + ll - out;
+}
+
+int zstd_decode_block(struct zstd_dctx *dc, u32 hdr, const void *src,
+		      void *out, size_t avail)
+{
+	size_t size = ZSTD_BLOCK_SIZE(hdr);
+	size_t nlit;
+	int ret;
+
+	if (size > ZSTD_BLOCK_MAX)
+		return -EINVAL;
+	switch (ZSTD_BLOCK_TYPE(hdr)) {
+	case ZSTD_BLOCK_RAW:
+		if (size > avail)
+			return -ENOSPC;
+		memcpy(out, src, size);
+		return size;
+	case ZSTD_BLOCK_RLE:
+		if (size > avail)
+			return -ENOSPC;
+		memset(out, *(u8 *)src, size);
+		return size;
+	case ZSTD_BLOCK_COMPRESSED:
+		ret = decode_literals(dc, src, size, &nlit);
+		if (ret < 0)
+			return ret;
+		ret = decode_sequences(dc, src + ret, size - ret, out,
+				       min_t(size_t, avail, ZSTD_BLOCK_MAX),
+				       nlit);
+		/* Blocks may not decompress to more than ZSTD_BLOCK_MAX */
+		if (ret == -ENOSPC && avail > ZSTD_BLOCK_MAX)
+			return -EINVAL;
+		return ret;
+	default:
+		return -EINVAL;
+	}
+}
+
+int zstd_frame_header(const void *src, size_t srcn, struct zstd_frame *frame)
+{
+	static const u8 dict_id_size[] = { 0, 1, 2, 4 };
+	const u8 *p = src;
+	uint fhd, wd, fcs_size, did_size, len, i;
+	u64 val;
+
+	if (srcn < 5)
+		return 0;
+	if (get_unaligned_le32(p) != ZSTD_MAGIC)
+		return -EINVAL;
+	fhd = p[4];
+	if (fhd & FHD_RESERVED)
+		return -EINVAL;
+	did_size = dict_id_size[fhd & 3];
+	fcs_size = fhd >> 6 ? 1 << (fhd >> 6) : !!(fhd & FHD_SINGLE_SEGMENT);
+	len = 5 + !(fhd & FHD_SINGLE_SEGMENT) + did_size + fcs_size;
+	if (srcn < len)
+		return 0;
+	p += 5;
+
+	frame->window_size = 0;
+	if (!(fhd & FHD_SINGLE_SEGMENT)) {
+		wd = *p++;
+		frame->window_size = 1ULL << (10 + (wd >> 3));
+		frame->window_size += (frame->window_size >> 3) * (wd & 7);
+	}
+
+	for (val = 0, i = 0; i < did_size; i++)
+		val |= (u64)*p++ << (8 * i);
+	if (val)
+		return -EPROTONOSUPPORT;
+
+	for (val = 0, i = 0; i < fcs_size; i++)
+		val |= (u64)*p++ << (8 * i);
+	if (fcs_size == 2)
+		val += 256;
+	frame->content_size = fcs_size ? val : ZSTD_CONTENT_SIZE_UNKNOWN;
+	if (fhd & FHD_SINGLE_SEGMENT)
+		frame->window_size = frame->content_size;
+	frame->checksum = fhd & FHD_CHECKSUM;
+
+	return len;
+}
+
+struct zstd_dctx *zstd_dctx_alloc(void)
+{
+	return malloc(sizeof(struct zstd_dctx));
+}
+
+void zstd_dctx_free(struct zstd_dctx *dc)
+{
+	free(dc);
+}
+
+void zstd_dctx_start(struct zstd_dctx *dc, void *base)
+{
+	dc->ll_log = -1;
+	dc->ml_log = -1;
+	dc->of_log = -1;
+	dc->huf_bits = 0;
+	dc->rep[0] = 1;
+	dc->rep[1] = 4;
+	dc->rep[2] = 8;
+	dc->base = base;
+}
+
+#define PRIME64_1	0x9e3779b185ebca87ULL
+#define PRIME64_2	0xc2b2ae3d27d4eb4fULL
+#define PRIME64_3	0x165667b19e3779f9ULL
+#define PRIME64_4	0x85ebca77c2b2ae63ULL
+#define PRIME64_5	0x27d4eb2f165667c5ULL
+
+static inline u64 rotl64(u64 x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline u64 xxh64_round(u64 acc, u64 input)
+{
+	acc += input * PRIME64_2;
+
+	return rotl64(acc, 31) * PRIME64_1;
+}
+
+static inline u64 xxh64_merge(u64 acc, u64 val)
+{
+	acc ^= xxh64_round(0, val);
+
+	return acc * PRIME64_1 + PRIME64_4;
+}
+
+u32 zstd_checksum(const void *buf, size_t len)
+{
+	const u8 *p = buf, *end = p + len;
+	u64 v1, v2, v3, v4, h;
+
+	if (len >= 32) {
+		v1 = PRIME64_1 + PRIME64_2;
+		v2 = PRIME64_2;
+		v3 = 0;
+		v4 = -PRIME64_1;
+		do {
+			v1 = xxh64_round(v1, get_unaligned_le64(p));
+			v2 = xxh64_round(v2, get_unaligned_le64(p + 8));
+			v3 = xxh64_round(v3, get_unaligned_le64(p + 16));
+			v4 = xxh64_round(v4, get_unaligned_le64(p + 24));
+			p += 32;
+		} while (end - p >= 32);
+		h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) +
+			rotl64(v4, 18);
+		h = xxh64_merge(h, v1);
+		h = xxh64_merge(h, v2);
+		h = xxh64_merge(h, v3);
+		h = xxh64_merge(h, v4);
+	} else {
+		h = PRIME64_5;
+	}
+	h += len;
+
+	for (; end - p >= 8; p += 8) {
+		h ^= xxh64_round(0, get_unaligned_le64(p));
+		h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+	}
+	if (end - p >= 4) {
+		h ^= get_unaligned_le32(p) * PRIME64_1;
+		h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+		p += 4;
+	}
+	for (; p < end; p++) {
+		h ^= *p * PRIME64_5;
+		h = rotl64(h, 11) * PRIME64_1;
+	}
+
+	h ^= h >> 33;
+	h *= PRIME64_2;
+	h ^= h >> 29;
+	h *= PRIME64_3;
+	h ^= h >> 32;
+
+	return h;
+}
+
+int zstd_decompress(const void *src, size_t srcn, void *dst, size_t *dstn)
+{
+	const u8 *in = src, *end = in + srcn;
+	u8 *out = dst, *oend = out + *dstn;
+	struct zstd_frame frame;
+	struct zstd_dctx *dc;
+	u8 *frame_start, *frame_end;
+	size_t size;
+	int ret = -EINVAL;
+	u32 hdr, magic;
+
+	dc = zstd_dctx_alloc();
+	if (!dc)
+		return -ENOMEM;
+
+	while (in < end) {
+		magic = end - in >= 8 ? get_unaligned_le32(in) : 0;
+		if ((magic & ZSTD_SKIP_MASK) == ZSTD_SKIP_MAGIC) {
+			size = get_unaligned_le32(in + 4);
+			if (size > end - in - 8)
+				goto err;
+			in += 8 + size;
+			continue;
+		}
+
+		ret = zstd_frame_header(in, end - in, &frame);
+		if (ret <= 0) {
+			ret = ret ?: -EINVAL;
+			goto err;
+		}
+		in += ret;
+		frame_start = out;
+		frame_end = oend;
+		if (frame.content_size != ZSTD_CONTENT_SIZE_UNKNOWN) {
+			if (frame.content_size > oend - out) {
+				ret = -ENOSPC;
+				goto err;
+			}
+			/* Stop copies running on past the end of the frame */
+			frame_end = out + frame.content_size;
+		}
+
+		zstd_dctx_start(dc, frame_start);
+		do {
+			ret = -EINVAL;
+			if (end - in < ZSTD_BLOCK_HEADER_SIZE)
+				goto err;
+			hdr = in[0] | in[1] << 8 | in[2] << 16;
+			in += ZSTD_BLOCK_HEADER_SIZE;
+			size = zstd_block_in_size(hdr);
+			if (size > end - in)
+				goto err;
+			ret = zstd_decode_block(dc, hdr, in, out,
+						frame_end - out);
+			/* Running past the frame's own size means corruption */
+			if (ret == -ENOSPC && frame_end != oend)
+				ret = -EINVAL;
+			if (ret < 0)
+				goto err;
+			in += size;
+			out += ret;
+		} while (!(hdr & ZSTD_BLOCK_LAST));
+
+		ret = -EINVAL;
+		if (frame.content_size != ZSTD_CONTENT_SIZE_UNKNOWN &&
+		    frame.content_size != out - frame_start)
+			goto err;
+		if (frame.checksum) {
+			if (end - in < 4 || get_unaligned_le32(in) !=
+			    zstd_checksum(frame_start, out - frame_start))
+				goto err;
+			in += 4;
+		}
+		ret = 0;
+	}
+
+err:
+	*dstn = out - (u8 *)dst;
+	zstd_dctx_free(dc);
+
+	return ret;
+}
@@ -118,9 +118,11 @@ static void eth_common_init(void)
  * struct eth_device_priv - private structure for each Ethernet device
  *
  * @state: The state of the Ethernet MAC driver (defined by enum eth_state_t)
+ * @rx_stats: Receive batching statistics since the device was last started
  */
 struct eth_device_priv {
 	enum eth_state_t state;
+	struct eth_rx_stats rx_stats;
 };
 
 /**
@@ -359,6 +361,8 @@ int eth_init(void)
 						current->uclass_priv;
 
 					priv->state = ETH_STATE_ACTIVE;
+					memset(&priv->rx_stats, 0,
+					       sizeof(priv->rx_stats));
 					return 0;
 				}
 			} else {
@@ -427,13 +431,40 @@ int eth_send(void *packet, int length)
 	return ret;
 }
 
+const struct eth_rx_stats *eth_get_rx_stats(struct udevice *dev)
+{
+	struct eth_device_priv *priv;
+
+	if (!dev || !device_active(dev))
+		return NULL;
+
+	priv = dev_get_uclass_priv(dev);
+	return &priv->rx_stats;
+}
+
+static void eth_update_rx_stats(struct udevice *dev, uint count)
+{
+	struct eth_device_priv *priv = dev_get_uclass_priv(dev);
+	struct eth_rx_stats *stats = &priv->rx_stats;
+
+	stats->polls++;
+	if (!count)
+		return;
+	stats->bursts++;
+	stats->packets += count;
+	if (count > stats->batch_max)
+		stats->batch_max = count;
+	if (count == CONFIG_NET_RX_BATCH)
+		stats->batch_full++;
+}
+
 int eth_rx(void)
 {
 	struct udevice *current;
 	uchar *packet;
+	uint count;
 	int flags;
 	int ret;
-	int i;
 
 	current = eth_get_dev();
 	if (!current)
@@ -442,18 +473,34 @@ int eth_rx(void)
 	if (!device_active(current))
 		return -EINVAL;
 
-	/* Process up to 32 packets at one time */
+	/*
+	 * Drain up to CONFIG_NET_RX_BATCH packets at one time. Once the
+	 * driver has handed out everything it already holds in memory, the
+	 * hardware is checked again, so that a whole burst is taken off the
+	 * device before its receive ring fills up.
+	 */
 	flags = ETH_RECV_CHECK_DEVICE;
-	for (i = 0; i < 32; i++) {
+	count = 0;
+	while (count < CONFIG_NET_RX_BATCH) {
 		ret = eth_get_ops(current)->recv(current, flags, &packet);
-		flags = 0;
-		if (ret > 0)
+		if (ret > 0) {
 			net_process_received_packet(packet, ret);
+			count++;
+		}
 		if (ret >= 0 && eth_get_ops(current)->free_pkt)
 			eth_get_ops(current)->free_pkt(current, packet, ret);
-		if (ret <= 0)
+		if (ret > 0) {
+			flags = 0;
+			continue;
+		}
+		if (ret < 0 && ret != -EAGAIN)
+			break;
+		/* The device itself has nothing more for us */
+		if (flags & ETH_RECV_CHECK_DEVICE)
 			break;
+		flags = ETH_RECV_CHECK_DEVICE;
 	}
+	eth_update_rx_stats(current, count);
 	if (ret == -EAGAIN)
 		ret = 0;
 	if (ret < 0) {
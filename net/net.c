@@ -107,6 +107,12 @@
 #if defined(CONFIG_CMD_SNTP)
 #include "sntp.h"
 #endif
+#if defined(CONFIG_PROT_TCP)
+#include "tcp.h"
+#endif
+#if defined(CONFIG_CMD_WGET)
+#include "wget.h"
+#endif
 
 DECLARE_GLOBAL_DATA_PTR;
 
@@ -353,6 +359,10 @@ static void net_clear_handlers(void)
 	net_set_udp_handler(NULL);
 	net_set_arp_handler(NULL);
 	net_set_timeout_handler(0, NULL);
+#if defined(CONFIG_PROT_TCP)
+	/* Don't let stray segments reach a finished connection's handlers */
+	tcp_reset();
+#endif
 }
 
 static void net_cleanup_loop(void)
@@ -484,6 +494,11 @@ restart:
 			nfs_start();
 			break;
 #endif
+#if defined(CONFIG_CMD_WGET)
+		case WGET:
+			wget_start();
+			break;
+#endif
 #if defined(CONFIG_CMD_CDP)
 		case CDP:
 			cdp_start();
@@ -778,10 +793,6 @@ void net_set_timeout_handler(ulong iv, thand_f *f)
 int net_send_udp_packet(uchar *ether, struct in_addr dest, int dport, int sport,
 		int payload_len)
 {
-	uchar *pkt;
-	int eth_hdr_size;
-	int pkt_hdr_size;
-
 	/* make sure the net_tx_packet is initialized (net_init() was called) */
 	assert(net_tx_packet != NULL);
 	if (net_tx_packet == NULL)
@@ -791,16 +802,26 @@ int net_send_udp_packet(uchar *ether, struct in_addr dest, int dport, int sport,
 	if (dest.s_addr == 0)
 		dest.s_addr = 0xFFFFFFFF;
 
+	net_set_udp_header(net_tx_packet + net_eth_hdr_size(), dest, dport,
+			   sport, payload_len);
+
+	return net_send_ip_packet(ether, dest, IP_UDP_HDR_SIZE + payload_len);
+}
+
+int net_send_ip_packet(uchar *ether, struct in_addr dest, int ip_len)
+{
+	int eth_hdr_size;
+
+	/* make sure the net_tx_packet is initialized (net_init() was called) */
+	assert(net_tx_packet != NULL);
+	if (net_tx_packet == NULL)
+		return -1;
+
 	/* if broadcast, make the ether address a broadcast and don't do ARP */
 	if (dest.s_addr == 0xFFFFFFFF)
 		ether = (uchar *)net_bcast_ethaddr;
 
-	pkt = (uchar *)net_tx_packet;
-
-	eth_hdr_size = net_set_ether(pkt, ether, PROT_IP);
-	pkt += eth_hdr_size;
-	net_set_udp_header(pkt, dest, dport, sport, payload_len);
-	pkt_hdr_size = eth_hdr_size + IP_UDP_HDR_SIZE;
+	eth_hdr_size = net_set_ether(net_tx_packet, ether, PROT_IP);
 
 	/* if MAC address was not discovered yet, do an ARP request */
 	if (memcmp(ether, net_null_ethaddr, 6) == 0) {
@@ -811,7 +832,7 @@ int net_send_udp_packet(uchar *ether, struct in_addr dest, int dport, int sport,
 		arp_wait_packet_ethaddr = ether;
 
 		/* size of the waiting packet */
-		arp_wait_tx_packet_size = pkt_hdr_size + payload_len;
+		arp_wait_tx_packet_size = eth_hdr_size + ip_len;
 
 		/* and do the ARP request */
 		arp_wait_try = 1;
@@ -819,9 +840,9 @@ int net_send_udp_packet(uchar *ether, struct in_addr dest, int dport, int sport,
 		arp_request();
 		return 1;	/* waiting */
 	} else {
-		debug_cond(DEBUG_DEV_PKT, "sending UDP to %pI4/%pM\n",
+		debug_cond(DEBUG_DEV_PKT, "sending IP to %pI4/%pM\n",
 			   &dest, ether);
-		net_send_packet(net_tx_packet, pkt_hdr_size + payload_len);
+		net_send_packet(net_tx_packet, eth_hdr_size + ip_len);
 		return 0;	/* transmitted */
 	}
 }
@@ -832,21 +853,31 @@ int net_send_udp_packet(uchar *ether, struct in_addr dest, int dport, int sport,
  * to the algorithm in RFC815. It returns NULL or the pointer to
  * a complete packet, in static storage
  */
-#ifndef CONFIG_NET_MAXDEFRAG
-#define CONFIG_NET_MAXDEFRAG 16384
-#endif
 /*
- * MAXDEFRAG, above, is chosen in the config file and  is real data
- * so we need to add the NFS overhead, which is more than TFTP.
+ * MAXDEFRAG, in net.h, is chosen in the config file and  is real data
+ * so we need to add the IP, UDP and NFS overhead, which is more than TFTP.
  * To use sizeof in the internal unnamed structures, we need a real
  * instance (can't do "sizeof(struct rpc_t.u.reply))", unfortunately).
  * The compiler doesn't complain nor allocates the actual structure
  */
 static struct rpc_t rpc_specimen;
-#define IP_PKTSIZE (CONFIG_NET_MAXDEFRAG + sizeof(rpc_specimen.u.reply))
+#define IP_PKTSIZE (CONFIG_NET_MAXDEFRAG + sizeof(rpc_specimen.u.reply) + \
+		    IP_UDP_HDR_SIZE)
 
 #define IP_MAXUDP (IP_PKTSIZE - IP_HDR_SIZE)
 
+/*
+ * Several datagrams may be reassembled at once, so that the fragmented
+ * replies to NFS READ requests which are in flight together can arrive
+ * interleaved. Each slot costs IP_PKTSIZE bytes.
+ */
+#if defined(CONFIG_NFS_READ_WINDOW) && CONFIG_NFS_READ_WINDOW > 1
+#define IP_DEFRAG_SLOTS	(CONFIG_NFS_READ_WINDOW < 8 ? \
+			 CONFIG_NFS_READ_WINDOW : 8)
+#else
+#define IP_DEFRAG_SLOTS	1
+#endif
+
 /*
  * this is the packet being assembled, either data or frag control.
  * Fragments go by 8 bytes, so this union must be 8 bytes long
@@ -859,10 +890,46 @@ struct hole {
 	u16 unused;
 };
 
+/* A datagram being reassembled; total_len is 0 if the slot is free */
+struct defrag_slot {
+	uchar pkt_buff[IP_PKTSIZE] __aligned(PKTALIGN);
+	u16 first_hole, total_len;
+	ulong last_use;
+};
+
+/*
+ * Find the slot holding the datagram this fragment belongs to, else a
+ * free one, else the one which has waited longest for its fragments.
+ */
+static struct defrag_slot *defrag_slot(struct ip_udp_hdr *ip)
+{
+	static struct defrag_slot slots[IP_DEFRAG_SLOTS];
+	static ulong defrag_clock;
+	struct defrag_slot *slot, *victim = &slots[0];
+	struct ip_udp_hdr *localip;
+	int i;
+
+	for (i = 0; i < IP_DEFRAG_SLOTS; i++) {
+		slot = &slots[i];
+		localip = (struct ip_udp_hdr *)slot->pkt_buff;
+		if (slot->total_len && localip->ip_id == ip->ip_id &&
+		    localip->ip_src.s_addr == net_read_ip(&ip->ip_src).s_addr) {
+			victim = slot;
+			break;
+		}
+		if (victim->total_len &&
+		    (!slot->total_len || slot->last_use < victim->last_use))
+			victim = slot;
+	}
+	victim->last_use = ++defrag_clock;
+
+	return victim;
+}
+
 static struct ip_udp_hdr *__net_defragment(struct ip_udp_hdr *ip, int *lenp)
 {
-	static uchar pkt_buff[IP_PKTSIZE] __aligned(PKTALIGN);
-	static u16 first_hole, total_len;
+	struct defrag_slot *slot = defrag_slot(ip);
+	uchar *pkt_buff = slot->pkt_buff;
 	struct hole *payload, *thisfrag, *h, *newh;
 	struct ip_udp_hdr *localip = (struct ip_udp_hdr *)pkt_buff;
 	uchar *indata = (uchar *)ip;
@@ -879,13 +946,14 @@ static struct ip_udp_hdr *__net_defragment(struct ip_udp_hdr *ip, int *lenp)
 	if (start + len > IP_MAXUDP) /* fragment extends too far */
 		return NULL;
 
-	if (!total_len || localip->ip_id != ip->ip_id) {
+	if (!slot->total_len || localip->ip_id != ip->ip_id ||
+	    localip->ip_src.s_addr != net_read_ip(&ip->ip_src).s_addr) {
 		/* new (or different) packet, reset structs */
-		total_len = 0xffff;
+		slot->total_len = 0xffff;
 		payload[0].last_byte = ~0;
 		payload[0].next_hole = 0;
 		payload[0].prev_hole = 0;
-		first_hole = 0;
+		slot->first_hole = 0;
 		/* any IP header will work, copy the first we received */
 		memcpy(localip, ip, IP_HDR_SIZE);
 	}
@@ -897,7 +965,7 @@ static struct ip_udp_hdr *__net_defragment(struct ip_udp_hdr *ip, int *lenp)
 	 * so it is represented as byte count, not as 8-byte blocks.
 	 */
 
-	h = payload + first_hole;
+	h = payload + slot->first_hole;
 	while (h->last_byte < start) {
 		if (!h->next_hole) {
 			/* no hole that far away */
@@ -914,7 +982,7 @@ static struct ip_udp_hdr *__net_defragment(struct ip_udp_hdr *ip, int *lenp)
 
 	if (!(ip_off & IP_FLAGS_MFRAG)) {
 		/* no more fragmentss: truncate this (last) hole */
-		total_len = start + len;
+		slot->total_len = start + len;
 		h->last_byte = start + len;
 	}
 
@@ -931,7 +999,7 @@ static struct ip_udp_hdr *__net_defragment(struct ip_udp_hdr *ip, int *lenp)
 			done = 1;
 		} else if (!h->prev_hole) {
 			/* first hole */
-			first_hole = h->next_hole;
+			slot->first_hole = h->next_hole;
 			payload[h->next_hole].prev_hole = 0;
 		} else if (!h->next_hole) {
 			/* last hole */
@@ -956,7 +1024,7 @@ static struct ip_udp_hdr *__net_defragment(struct ip_udp_hdr *ip, int *lenp)
 		if (h->prev_hole)
 			payload[h->prev_hole].next_hole = (h - payload);
 		else
-			first_hole = (h - payload);
+			slot->first_hole = (h - payload);
 
 	} else {
 		/* fragment sits in the middle: split the hole */
@@ -974,8 +1042,10 @@ static struct ip_udp_hdr *__net_defragment(struct ip_udp_hdr *ip, int *lenp)
 	if (!done)
 		return NULL;
 
-	localip->ip_len = htons(total_len);
-	*lenp = total_len + IP_HDR_SIZE;
+	localip->ip_len = htons(slot->total_len);
+	*lenp = slot->total_len + IP_HDR_SIZE;
+	/* the packet is handled before the next one is received */
+	slot->total_len = 0;
 	return localip;
 }
 
@@ -1215,6 +1285,11 @@ void net_process_received_packet(uchar *in_packet, int len)
 		if (ip->ip_p == IPPROTO_ICMP) {
 			receive_icmp(ip, len, src_ip, et);
 			return;
+#if defined(CONFIG_PROT_TCP)
+		} else if (ip->ip_p == IPPROTO_TCP) {
+			tcp_receive((struct ip_tcp_hdr *)ip, len);
+			return;
+#endif
 		} else if (ip->ip_p != IPPROTO_UDP) {	/* Only UDP packets */
 			return;
 		}
@@ -1316,6 +1391,9 @@ static int net_check_prereq(enum proto_t protocol)
 #endif
 #if defined(CONFIG_CMD_NFS)
 	case NFS:
+#endif
+#if defined(CONFIG_CMD_WGET)
+	case WGET:
 #endif
 		/* Fall through */
 	case TFTPGET:
@@ -1492,7 +1570,8 @@ void copy_filename(char *dst, const char *src, int size)
 
 #if	defined(CONFIG_CMD_NFS)		|| \
 	defined(CONFIG_CMD_SNTP)	|| \
-	defined(CONFIG_CMD_DNS)
+	defined(CONFIG_CMD_DNS)		|| \
+	defined(CONFIG_PROT_TCP)
 /*
  * make port a little random (1024-17407)
  * This keeps the math somewhat trivial to compute, and seems to work with
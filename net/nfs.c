@@ -43,12 +43,30 @@
 
 static int fs_mounted;
 static unsigned long rpc_id;
-static int nfs_offset = -1;
-static int nfs_len;
 static ulong nfs_timeout = NFS_TIMEOUT;
 
-static char dirfh[NFS_FHSIZE];	/* file handle of directory */
-static char filefh[NFS_FHSIZE]; /* file handle of kernel image */
+static enum nfs_version nfs_version;
+static char dirfh[NFS3_FHSIZE];	/* file handle of directory */
+static int dirfh_len;
+static char filefh[NFS3_FHSIZE]; /* file handle of kernel image */
+static int filefh_len;
+
+/*
+ * An outstanding READ request. Several are kept in flight and the replies
+ * are stored by offset, in whatever order they arrive.
+ */
+struct nfs_read_slot {
+	unsigned long id;	/* RPC transaction id, reused on retransmit */
+	u64 offset;
+	unsigned len;		/* 0 if the slot is free */
+};
+
+static struct nfs_read_slot nfs_read_slots[NFS_READ_WINDOW];
+static u64 nfs_read_next;	/* offset of the next block to request */
+static int nfs_read_eof;	/* the server reported the end of file */
+static unsigned nfs_read_size;
+static ulong nfs_read_bytes;
+static int nfs_hashes;
 
 static enum net_loop_state nfs_download_state;
 static struct in_addr nfs_server_ip;
@@ -64,13 +82,14 @@ static int nfs_state;
 #define STATE_LOOKUP_REQ		5
 #define STATE_READ_REQ			6
 #define STATE_READLINK_REQ		7
+#define STATE_FSINFO_REQ		8
 
 static char default_filename[64];
 static char *nfs_filename;
 static char *nfs_path;
 static char nfs_path_buff[2048];
 
-static inline int store_block(uchar *src, unsigned offset, unsigned len)
+static inline int store_block(uchar *src, ulong offset, unsigned len)
 {
 	ulong newsize = offset + len;
 #ifdef CONFIG_SYS_DIRECT_FLASH_NFS
@@ -173,22 +192,29 @@ static long *rpc_add_credentials(long *p)
 }
 
 /**************************************************************************
-RPC_LOOKUP - Lookup RPC Port numbers
+RPC_SEND - Send an RPC call with the given transaction id
 **************************************************************************/
-static void rpc_req(int rpc_prog, int rpc_proc, uint32_t *data, int datalen)
+static void rpc_send(unsigned long id, int rpc_prog, int rpc_proc,
+		     uint32_t *data, int datalen)
 {
 	struct rpc_t pkt;
-	unsigned long id;
 	uint32_t *p;
 	int pktlen;
 	int sport;
+	int vers;
+
+	if (rpc_prog == PROG_NFS)
+		vers = nfs_version;
+	else if (rpc_prog == PROG_MOUNT && nfs_version == NFS_V3)
+		vers = 3;
+	else
+		vers = 2;	/* portmapper and mountd are version 2 */
 
-	id = ++rpc_id;
 	pkt.u.call.id = htonl(id);
 	pkt.u.call.type = htonl(MSG_CALL);
 	pkt.u.call.rpcvers = htonl(2);	/* use RPC version 2 */
 	pkt.u.call.prog = htonl(rpc_prog);
-	pkt.u.call.vers = htonl(2);	/* portmapper is version 2 */
+	pkt.u.call.vers = htonl(vers);
 	pkt.u.call.proc = htonl(rpc_proc);
 	p = (uint32_t *)&(pkt.u.call.data);
 
@@ -211,6 +237,40 @@ static void rpc_req(int rpc_prog, int rpc_proc, uint32_t *data, int datalen)
 			    nfs_our_port, pktlen);
 }
 
+/**************************************************************************
+RPC_REQ - Send an RPC call with a new transaction id
+**************************************************************************/
+static void rpc_req(int rpc_prog, int rpc_proc, uint32_t *data, int datalen)
+{
+	rpc_send(++rpc_id, rpc_prog, rpc_proc, data, datalen);
+}
+
+/* Add a file handle to an NFS call */
+static uint32_t *nfs_add_fh(uint32_t *p, const char *fh, int fh_len)
+{
+	if (nfs_version == NFS_V3)
+		*p++ = htonl(fh_len);
+	memcpy(p, fh, fh_len);
+
+	return p + fh_len / 4;
+}
+
+/* Get a file handle from an NFS reply, return -1 if it is not valid */
+static int nfs_get_fh(const uint32_t *p, char *fh, int *fh_len)
+{
+	int len = NFS_FHSIZE;
+
+	if (nfs_version == NFS_V3) {
+		len = ntohl(*p++);
+		if (len > NFS3_FHSIZE || len & 3)
+			return -1;
+	}
+	memcpy(fh, p, len);
+	*fh_len = len;
+
+	return 0;
+}
+
 /**************************************************************************
 RPC_LOOKUP - Lookup RPC Port numbers
 **************************************************************************/
@@ -291,8 +351,7 @@ static void nfs_readlink_req(void)
 	p = &(data[0]);
 	p = (uint32_t *)rpc_add_credentials((long *)p);
 
-	memcpy(p, filefh, NFS_FHSIZE);
-	p += (NFS_FHSIZE / 4);
+	p = nfs_add_fh(p, filefh, filefh_len);
 
 	len = (uint32_t *)p - (uint32_t *)&(data[0]);
 
@@ -314,8 +373,7 @@ static void nfs_lookup_req(char *fname)
 	p = &(data[0]);
 	p = (uint32_t *)rpc_add_credentials((long *)p);
 
-	memcpy(p, dirfh, NFS_FHSIZE);
-	p += (NFS_FHSIZE / 4);
+	p = nfs_add_fh(p, dirfh, dirfh_len);
 	*p++ = htonl(fnamelen);
 	if (fnamelen & 3)
 		*(p + fnamelen / 4) = 0;
@@ -324,13 +382,33 @@ static void nfs_lookup_req(char *fname)
 
 	len = (uint32_t *)p - (uint32_t *)&(data[0]);
 
-	rpc_req(PROG_NFS, NFS_LOOKUP, data, len);
+	rpc_req(PROG_NFS, nfs_version == NFS_V3 ? NFS3PROC_LOOKUP : NFS_LOOKUP,
+		data, len);
+}
+
+/**************************************************************************
+NFS_FSINFO - Ask an NFSv3 server for its transfer sizes
+**************************************************************************/
+static void nfs_fsinfo_req(void)
+{
+	uint32_t data[1024];
+	uint32_t *p;
+	int len;
+
+	p = &(data[0]);
+	p = (uint32_t *)rpc_add_credentials((long *)p);
+
+	p = nfs_add_fh(p, dirfh, dirfh_len);
+
+	len = (uint32_t *)p - (uint32_t *)&(data[0]);
+
+	rpc_req(PROG_NFS, NFS3PROC_FSINFO, data, len);
 }
 
 /**************************************************************************
 NFS_READ - Read File on NFS Server
 **************************************************************************/
-static void nfs_read_req(int offset, int readlen)
+static void nfs_read_req(struct nfs_read_slot *slot)
 {
 	uint32_t data[1024];
 	uint32_t *p;
@@ -339,15 +417,67 @@ static void nfs_read_req(int offset, int readlen)
 	p = &(data[0]);
 	p = (uint32_t *)rpc_add_credentials((long *)p);
 
-	memcpy(p, filefh, NFS_FHSIZE);
-	p += (NFS_FHSIZE / 4);
-	*p++ = htonl(offset);
-	*p++ = htonl(readlen);
-	*p++ = 0;
+	p = nfs_add_fh(p, filefh, filefh_len);
+	if (nfs_version == NFS_V3) {
+		*p++ = htonl(slot->offset >> 32);
+		*p++ = htonl(slot->offset);
+		*p++ = htonl(slot->len);
+	} else {
+		*p++ = htonl(slot->offset);
+		*p++ = htonl(slot->len);
+		*p++ = 0;		/* totalcount, unused */
+	}
 
 	len = (uint32_t *)p - (uint32_t *)&(data[0]);
 
-	rpc_req(PROG_NFS, NFS_READ, data, len);
+	rpc_send(slot->id, PROG_NFS, NFS_READ, data, len);
+}
+
+/* Request the next block of the file into a free slot */
+static void nfs_read_next_block(struct nfs_read_slot *slot)
+{
+	if (nfs_read_eof) {
+		slot->len = 0;
+		return;
+	}
+
+	slot->id = ++rpc_id;
+	slot->offset = nfs_read_next;
+	slot->len = nfs_read_size;
+	nfs_read_next += nfs_read_size;
+	nfs_read_req(slot);
+}
+
+static void nfs_read_start(void)
+{
+	int i;
+
+	nfs_read_next = 0;
+	nfs_read_eof = 0;
+	nfs_read_bytes = 0;
+	nfs_hashes = 0;
+	for (i = 0; i < NFS_READ_WINDOW; i++)
+		nfs_read_next_block(&nfs_read_slots[i]);
+}
+
+static void nfs_read_stop(void)
+{
+	int i;
+
+	for (i = 0; i < NFS_READ_WINDOW; i++)
+		nfs_read_slots[i].len = 0;
+}
+
+static int nfs_read_busy(void)
+{
+	int i;
+
+	for (i = 0; i < NFS_READ_WINDOW; i++) {
+		if (nfs_read_slots[i].len)
+			return 1;
+	}
+
+	return 0;
 }
 
 /**************************************************************************
@@ -355,14 +485,16 @@ RPC request dispatcher
 **************************************************************************/
 static void nfs_send(void)
 {
+	int i;
+
 	debug("%s\n", __func__);
 
 	switch (nfs_state) {
 	case STATE_PRCLOOKUP_PROG_MOUNT_REQ:
-		rpc_lookup_req(PROG_MOUNT, 1);
+		rpc_lookup_req(PROG_MOUNT, nfs_version == NFS_V3 ? 3 : 1);
 		break;
 	case STATE_PRCLOOKUP_PROG_NFS_REQ:
-		rpc_lookup_req(PROG_NFS, 2);
+		rpc_lookup_req(PROG_NFS, nfs_version);
 		break;
 	case STATE_MOUNT_REQ:
 		nfs_mount_req(nfs_path);
@@ -373,8 +505,15 @@ static void nfs_send(void)
 	case STATE_LOOKUP_REQ:
 		nfs_lookup_req(nfs_filename);
 		break;
+	case STATE_FSINFO_REQ:
+		nfs_fsinfo_req();
+		break;
 	case STATE_READ_REQ:
-		nfs_read_req(nfs_offset, nfs_len);
+		/* Send every outstanding request again */
+		for (i = 0; i < NFS_READ_WINDOW; i++) {
+			if (nfs_read_slots[i].len)
+				nfs_read_req(&nfs_read_slots[i]);
+		}
 		break;
 	case STATE_READLINK_REQ:
 		nfs_readlink_req();
@@ -435,8 +574,9 @@ static int nfs_mount_reply(uchar *pkt, unsigned len)
 	    rpc_pkt.u.reply.data[0])
 		return -1;
 
+	if (nfs_get_fh(rpc_pkt.u.reply.data + 1, dirfh, &dirfh_len))
+		return -1;
 	fs_mounted = 1;
-	memcpy(dirfh, rpc_pkt.u.reply.data + 1, NFS_FHSIZE);
 
 	return 0;
 }
@@ -484,7 +624,43 @@ static int nfs_lookup_reply(uchar *pkt, unsigned len)
 	    rpc_pkt.u.reply.data[0])
 		return -1;
 
-	memcpy(filefh, rpc_pkt.u.reply.data + 1, NFS_FHSIZE);
+	if (nfs_get_fh(rpc_pkt.u.reply.data + 1, filefh, &filefh_len))
+		return -1;
+
+	return 0;
+}
+
+static int nfs_fsinfo_reply(uchar *pkt, unsigned len)
+{
+	struct rpc_t rpc_pkt;
+	uint32_t *p;
+	unsigned rtmax;
+
+	debug("%s\n", __func__);
+
+	memcpy((unsigned char *)&rpc_pkt, pkt, len);
+
+	if (ntohl(rpc_pkt.u.reply.id) > rpc_id)
+		return -NFS_RPC_ERR;
+	else if (ntohl(rpc_pkt.u.reply.id) < rpc_id)
+		return -NFS_RPC_DROP;
+
+	if (rpc_pkt.u.reply.rstatus  ||
+	    rpc_pkt.u.reply.verifier ||
+	    rpc_pkt.u.reply.astatus  ||
+	    rpc_pkt.u.reply.data[0])
+		return -1;
+
+	/* Skip the optional attributes */
+	p = rpc_pkt.u.reply.data + 1;
+	if (ntohl(*p++))
+		p += NFS3_FATTR_WORDS;
+	rtmax = ntohl(*p);
+
+	/* Stay within what the server and our packet buffers handle */
+	if (rtmax && rtmax < nfs_read_size)
+		nfs_read_size = rtmax & ~3;
+	debug("rtmax %u, using rsize %u\n", rtmax, nfs_read_size);
 
 	return 0;
 }
@@ -492,6 +668,7 @@ static int nfs_lookup_reply(uchar *pkt, unsigned len)
 static int nfs_readlink_reply(uchar *pkt, unsigned len)
 {
 	struct rpc_t rpc_pkt;
+	uint32_t *p;
 	int rlen;
 
 	debug("%s\n", __func__);
@@ -509,34 +686,64 @@ static int nfs_readlink_reply(uchar *pkt, unsigned len)
 	    rpc_pkt.u.reply.data[0])
 		return -1;
 
-	rlen = ntohl(rpc_pkt.u.reply.data[1]); /* new path length */
+	p = rpc_pkt.u.reply.data + 1;
+	/* Skip the optional attributes */
+	if (nfs_version == NFS_V3 && ntohl(*p++))
+		p += NFS3_FATTR_WORDS;
+	rlen = ntohl(*p++); /* new path length */
 
-	if (*((char *)&(rpc_pkt.u.reply.data[2])) != '/') {
+	if (*((char *)p) != '/') {
 		int pathlen;
 		strcat(nfs_path, "/");
 		pathlen = strlen(nfs_path);
-		memcpy(nfs_path + pathlen, (uchar *)&(rpc_pkt.u.reply.data[2]),
-		       rlen);
+		memcpy(nfs_path + pathlen, (uchar *)p, rlen);
 		nfs_path[pathlen + rlen] = 0;
 	} else {
-		memcpy(nfs_path, (uchar *)&(rpc_pkt.u.reply.data[2]), rlen);
+		memcpy(nfs_path, (uchar *)p, rlen);
 		nfs_path[rlen] = 0;
 	}
 	return 0;
 }
 
+static struct nfs_read_slot *nfs_read_find_slot(unsigned long id)
+{
+	int i;
+
+	for (i = 0; i < NFS_READ_WINDOW; i++) {
+		if (nfs_read_slots[i].len && nfs_read_slots[i].id == id)
+			return &nfs_read_slots[i];
+	}
+
+	return NULL;
+}
+
+static void nfs_read_show_progress(unsigned len)
+{
+	nfs_read_bytes += len;
+	while (nfs_read_bytes / ((NFS_READ_SIZE / 2) * 10) > nfs_hashes) {
+		putc('#');
+		if (++nfs_hashes % HASHES_PER_LINE == 0)
+			puts("\n\t ");
+	}
+}
+
 static int nfs_read_reply(uchar *pkt, unsigned len)
 {
 	struct rpc_t rpc_pkt;
-	int rlen;
+	struct nfs_read_slot *slot;
+	uint32_t *p;
+	unsigned rlen;
+	int eof;
 
 	debug("%s\n", __func__);
 
-	memcpy((uchar *)&rpc_pkt, pkt, sizeof(rpc_pkt.u.reply));
+	if (len < sizeof(rpc_pkt.u.reply.id) + sizeof(rpc_pkt.u.reply.type))
+		return -NFS_RPC_DROP;
+	memcpy((uchar *)&rpc_pkt, pkt,
+	       min_t(unsigned, len, sizeof(rpc_pkt.u.reply)));
 
-	if (ntohl(rpc_pkt.u.reply.id) > rpc_id)
-		return -NFS_RPC_ERR;
-	else if (ntohl(rpc_pkt.u.reply.id) < rpc_id)
+	slot = nfs_read_find_slot(ntohl(rpc_pkt.u.reply.id));
+	if (!slot)
 		return -NFS_RPC_DROP;
 
 	if (rpc_pkt.u.reply.rstatus  ||
@@ -550,18 +757,47 @@ static int nfs_read_reply(uchar *pkt, unsigned len)
 		return -ntohl(rpc_pkt.u.reply.data[0]);
 	}
 
-	if ((nfs_offset != 0) && !((nfs_offset) %
-			(NFS_READ_SIZE / 2 * 10 * HASHES_PER_LINE)))
-		puts("\n\t ");
-	if (!(nfs_offset % ((NFS_READ_SIZE / 2) * 10)))
-		putc('#');
+	p = rpc_pkt.u.reply.data + 1;
+	if (nfs_version == NFS_V3) {
+		/* Skip the optional attributes */
+		if (ntohl(*p++))
+			p += NFS3_FATTR_WORDS;
+		rlen = ntohl(*p++);
+		eof = ntohl(*p++);
+		p++;			/* length of the data, same as rlen */
+	} else {
+		p += 17;		/* attributes */
+		rlen = ntohl(*p++);
+		/* NFSv2 only returns less than asked for at the end */
+		eof = rlen < slot->len;
+	}
+
+	if (rlen > slot->len ||
+	    (uchar *)p - (uchar *)&rpc_pkt + rlen > len)
+		return -9999;
+	/* Asking again after an empty read would loop for ever */
+	if (!rlen && !eof)
+		return -9999;
 
-	rlen = ntohl(rpc_pkt.u.reply.data[18]);
-	if (store_block((uchar *)pkt + sizeof(rpc_pkt.u.reply),
-			nfs_offset, rlen))
+	if (store_block(pkt + ((uchar *)p - (uchar *)&rpc_pkt),
+			slot->offset, rlen))
 		return -9999;
+	nfs_read_show_progress(rlen);
+
+	if (eof) {
+		nfs_read_eof = 1;
+		slot->len = 0;
+	} else if (rlen < slot->len) {
+		/* Short read, ask for the rest of the block */
+		slot->id = ++rpc_id;
+		slot->offset += rlen;
+		slot->len -= rlen;
+		nfs_read_req(slot);
+	} else {
+		nfs_read_next_block(slot);
+	}
 
-	return rlen;
+	return 0;
 }
 
 /**************************************************************************
@@ -581,6 +817,17 @@ static void nfs_timeout_handler(void)
 	}
 }
 
+/* The server has no NFSv3 (or no MOUNT v3): start again with NFSv2 */
+static void nfs_use_v2(void)
+{
+	debug("NFSv3 not available, falling back to NFSv2\n");
+	nfs_version = NFS_V2;
+	if (nfs_read_size > NFS_MAXDATA)
+		nfs_read_size = NFS_MAXDATA;
+	nfs_state = STATE_PRCLOOKUP_PROG_MOUNT_REQ;
+	nfs_send();
+}
+
 static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			unsigned src, unsigned len)
 {
@@ -592,10 +839,18 @@ static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 	if (dest != nfs_our_port)
 		return;
 
+	/* Only READ replies may be larger than our RPC buffer */
+	if (nfs_state != STATE_READ_REQ && len > sizeof(struct rpc_t))
+		return;
+
 	switch (nfs_state) {
 	case STATE_PRCLOOKUP_PROG_MOUNT_REQ:
 		if (rpc_lookup_reply(PROG_MOUNT, pkt, len) == -NFS_RPC_DROP)
 			break;
+		if (!nfs_server_mount_port && nfs_version == NFS_V3) {
+			nfs_use_v2();
+			break;
+		}
 		nfs_state = STATE_PRCLOOKUP_PROG_NFS_REQ;
 		nfs_send();
 		break;
@@ -603,6 +858,10 @@ static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 	case STATE_PRCLOOKUP_PROG_NFS_REQ:
 		if (rpc_lookup_reply(PROG_NFS, pkt, len) == -NFS_RPC_DROP)
 			break;
+		if (!nfs_server_port && nfs_version == NFS_V3) {
+			nfs_use_v2();
+			break;
+		}
 		nfs_state = STATE_MOUNT_REQ;
 		nfs_send();
 		break;
@@ -617,11 +876,22 @@ static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			nfs_state = STATE_UMOUNT_REQ;
 			nfs_send();
 		} else {
-			nfs_state = STATE_LOOKUP_REQ;
+			if (nfs_version == NFS_V3)
+				nfs_state = STATE_FSINFO_REQ;
+			else
+				nfs_state = STATE_LOOKUP_REQ;
 			nfs_send();
 		}
 		break;
 
+	case STATE_FSINFO_REQ:
+		/* Not fatal, we just keep our default read size */
+		if (nfs_fsinfo_reply(pkt, len) == -NFS_RPC_DROP)
+			break;
+		nfs_state = STATE_LOOKUP_REQ;
+		nfs_send();
+		break;
+
 	case STATE_UMOUNT_REQ:
 		reply = nfs_umountall_reply(pkt, len);
 		if (reply == -NFS_RPC_DROP) {
@@ -645,9 +915,8 @@ static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			nfs_send();
 		} else {
 			nfs_state = STATE_READ_REQ;
-			nfs_offset = 0;
-			nfs_len = NFS_READ_SIZE;
-			nfs_send();
+			nfs_timeout_count = 0;
+			nfs_read_start();
 		}
 		break;
 
@@ -671,17 +940,22 @@ static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 
 	case STATE_READ_REQ:
 		rlen = nfs_read_reply(pkt, len);
+		if (rlen == -NFS_RPC_DROP)
+			break;
 		net_set_timeout_handler(nfs_timeout, nfs_timeout_handler);
-		if (rlen > 0) {
-			nfs_offset += rlen;
+		if (!rlen) {
+			if (nfs_read_busy())
+				break;
+			nfs_download_state = NETLOOP_SUCCESS;
+			nfs_state = STATE_UMOUNT_REQ;
 			nfs_send();
 		} else if ((rlen == -NFSERR_ISDIR) || (rlen == -NFSERR_INVAL)) {
 			/* symbolic link */
+			nfs_read_stop();
 			nfs_state = STATE_READLINK_REQ;
 			nfs_send();
 		} else {
-			if (!rlen)
-				nfs_download_state = NETLOOP_SUCCESS;
+			nfs_read_stop();
 			nfs_state = STATE_UMOUNT_REQ;
 			nfs_send();
 		}
@@ -762,6 +1036,9 @@ void nfs_start(void)
 
 	nfs_timeout_count = 0;
 	nfs_state = STATE_PRCLOOKUP_PROG_MOUNT_REQ;
+	nfs_version = NFS_V3;
+	nfs_read_size = NFS_READ_SIZE;
+	nfs_read_stop();
 
 	/*nfs_our_port = 4096 + (get_ticks() % 3072);*/
 	/*FIX ME !!!*/
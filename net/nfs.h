@@ -25,7 +25,16 @@
 #define NFS_READLINK    5
 #define NFS_READ        6
 
+#define NFS3PROC_LOOKUP 3
+#define NFS3PROC_FSINFO 19
+
 #define NFS_FHSIZE      32
+#define NFS3_FHSIZE     64
+
+#define NFS_MAXDATA     8192	/* largest NFSv2 read */
+
+/* Words in an NFSv3 fattr3 structure */
+#define NFS3_FATTR_WORDS 21
 
 #define NFSERR_PERM     1
 #define NFSERR_NOENT    2
@@ -35,15 +44,26 @@
 
 /* Block size used for NFS read accesses.  A RPC reply packet (including  all
  * headers) must fit within a single Ethernet frame to avoid fragmentation.
- * However, if CONFIG_IP_DEFRAG is set, the config file may want to use a
- * bigger value. In any case, most NFS servers are optimized for a power of 2.
+ * However, if CONFIG_IP_DEFRAG is set, the reply may be as large as a
+ * reassembled datagram. In any case, most NFS servers are optimized for a
+ * power of 2. With NFSv3 this is only an upper limit: the server's own
+ * maximum, as reported by FSINFO, is used if it is smaller.
  */
 #ifdef CONFIG_NFS_READ_SIZE
 #define NFS_READ_SIZE CONFIG_NFS_READ_SIZE
+#elif defined(CONFIG_IP_DEFRAG)
+#define NFS_READ_SIZE CONFIG_NET_MAXDEFRAG
 #else
 #define NFS_READ_SIZE 1024 /* biggest power of two that fits Ether frame */
 #endif
 
+/* Number of READ requests kept in flight */
+#ifdef CONFIG_NFS_READ_WINDOW
+#define NFS_READ_WINDOW CONFIG_NFS_READ_WINDOW
+#else
+#define NFS_READ_WINDOW 1
+#endif
+
 #define NFS_MAXLINKDEPTH 16
 
 struct rpc_t {
@@ -65,10 +85,17 @@ struct rpc_t {
 			uint32_t verifier;
 			uint32_t v2;
 			uint32_t astatus;
-			uint32_t data[19];
+			/* enough for the header of an NFSv3 READ reply */
+			uint32_t data[26];
 		} reply;
 	} u;
 };
+
+enum nfs_version {
+	NFS_V2 = 2,
+	NFS_V3 = 3,
+};
+
 void nfs_start(void);	/* Begin NFS */
 
 
@@ -0,0 +1,540 @@
+/*
+ * Minimal TCP client for U-Boot
+ *
+ * This handles a single client connection at a time and is meant for bulk
+ * downloads: we only ever send small requests, one segment at a time, but
+ * receive with a large scaled window (RFC 7323). Out-of-order segments are
+ * handed to the application straight away, so it can store them at their
+ * final place, and are reported back to the server with selective
+ * acknowledgements (RFC 2018) so that only the missing segments are sent
+ * again.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <errno.h>
+#include <net.h>
+#include <asm/unaligned.h>
+#include "tcp.h"
+
+/* Millisecs to wait for the server before retransmitting */
+#define TCP_TIMEOUT		1000UL
+#ifndef CONFIG_NET_RETRY_COUNT
+/* # of timeouts before giving up */
+# define TCP_TIMEOUT_COUNT	10
+#else
+# define TCP_TIMEOUT_COUNT	(CONFIG_NET_RETRY_COUNT * 2)
+#endif
+
+/*
+ * Our receive window. Received data goes straight to memory, so it does not
+ * need to be buffered and the window can be much larger than 64KiB.
+ */
+#define TCP_RCV_WSCALE		3
+#define TCP_RCV_WND		(0xffffU << TCP_RCV_WSCALE)
+
+/* Maximum number of SACK blocks that fit in the TCP options */
+#define TCP_SACK_BLOCKS		4
+
+/* Sequence number comparisons, which work across wraparound */
+#define SEQ_LT(a, b)		((s32)((a) - (b)) < 0)
+#define SEQ_LEQ(a, b)		((s32)((a) - (b)) <= 0)
+#define SEQ_GT(a, b)		((s32)((a) - (b)) > 0)
+#define SEQ_GEQ(a, b)		((s32)((a) - (b)) >= 0)
+
+/* A range of sequence numbers received out of order: [left, right) */
+struct tcp_sack_block {
+	u32 left;
+	u32 right;
+};
+
+static enum tcp_state tcp_state;
+static tcp_rx_f *tcp_rx_handler;
+static tcp_event_f *tcp_event_handler;
+
+static struct in_addr tcp_remote_ip;
+static uchar tcp_remote_ethaddr[6];
+static int tcp_remote_port;
+static int tcp_our_port;
+static int tcp_timeout_count;
+
+/* Our initial sequence number */
+static u32 tcp_iss;
+/* Oldest sequence number the server has not acknowledged */
+static u32 tcp_snd_una;
+/* Next sequence number we will send */
+static u32 tcp_snd_nxt;
+/* Sequence number of our FIN, valid once we have closed our side */
+static u32 tcp_fin_seq;
+/* The unacknowledged data segment, kept for retransmission */
+static uchar tcp_tx_data[TCP_MSS];
+static int tcp_tx_len;
+static u32 tcp_tx_seq;
+
+/* The server's initial sequence number */
+static u32 tcp_irs;
+/* Next sequence number we expect from the server */
+static u32 tcp_rcv_nxt;
+/* Options the server agreed to in its SYN */
+static int tcp_peer_mss;
+static int tcp_wscale_ok;
+static int tcp_sack_ok;
+/* Data received beyond tcp_rcv_nxt, most recent first */
+static struct tcp_sack_block tcp_sack[TCP_SACK_BLOCKS];
+static int tcp_sack_count;
+
+static void tcp_timeout_handler(void);
+
+enum tcp_state tcp_get_state(void)
+{
+	return tcp_state;
+}
+
+void tcp_reset(void)
+{
+	tcp_state = TCP_CLOSED;
+	tcp_sack_count = 0;
+	tcp_tx_len = 0;
+}
+
+static void tcp_event(enum tcp_event event)
+{
+	if (event != TCP_EVENT_CONNECTED && event != TCP_EVENT_PEER_CLOSED)
+		net_set_timeout_handler(0, NULL);
+	if (tcp_event_handler)
+		tcp_event_handler(event);
+}
+
+static u16 tcp_checksum(struct ip_tcp_hdr *ip, int tcp_len)
+{
+	struct {
+		struct in_addr src;
+		struct in_addr dst;
+		u8 zero;
+		u8 proto;
+		u16 len;
+	} ph;
+
+	net_copy_ip(&ph.src, &ip->ip_src);
+	net_copy_ip(&ph.dst, &ip->ip_dst);
+	ph.zero = 0;
+	ph.proto = IPPROTO_TCP;
+	ph.len = htons(tcp_len);
+
+	return add_ip_checksums(sizeof(ph), compute_ip_checksum(&ph, sizeof(ph)),
+				compute_ip_checksum(&ip->tcp_src, tcp_len));
+}
+
+static u16 tcp_window(u8 flags)
+{
+	/* The window in a SYN is never scaled */
+	if ((flags & TCP_SYN) || !tcp_wscale_ok)
+		return 0xffff;
+
+	return TCP_RCV_WND >> TCP_RCV_WSCALE;
+}
+
+/* Add TCP options for an outgoing segment, returning their length */
+static int tcp_set_options(uchar *opt, u8 flags)
+{
+	uchar *start = opt;
+	int i;
+
+	if (flags & TCP_SYN) {
+		*opt++ = TCP_OPT_MSS;
+		*opt++ = 4;
+		put_unaligned_be16(TCP_MSS, opt);
+		opt += 2;
+		*opt++ = TCP_OPT_NOP;
+		*opt++ = TCP_OPT_WSCALE;
+		*opt++ = 3;
+		*opt++ = TCP_RCV_WSCALE;
+		*opt++ = TCP_OPT_SACK_PERM;
+		*opt++ = 2;
+		*opt++ = TCP_OPT_NOP;
+		*opt++ = TCP_OPT_NOP;
+	} else if (tcp_sack_ok && tcp_sack_count) {
+		*opt++ = TCP_OPT_NOP;
+		*opt++ = TCP_OPT_NOP;
+		*opt++ = TCP_OPT_SACK;
+		*opt++ = 2 + tcp_sack_count * 8;
+		for (i = 0; i < tcp_sack_count; i++) {
+			put_unaligned_be32(tcp_sack[i].left, opt);
+			put_unaligned_be32(tcp_sack[i].right, opt + 4);
+			opt += 8;
+		}
+	}
+
+	return opt - start;
+}
+
+static void tcp_send_segment(u8 flags, u32 seq, const void *data, int len)
+{
+	uchar *pkt = net_tx_packet + net_eth_hdr_size();
+	struct ip_tcp_hdr *ip = (struct ip_tcp_hdr *)pkt;
+	int opt_len;
+	int tcp_len;
+
+	opt_len = tcp_set_options(pkt + IP_TCP_HDR_SIZE, flags);
+	tcp_len = TCP_HDR_SIZE + opt_len + len;
+	if (len)
+		memcpy(pkt + IP_TCP_HDR_SIZE + opt_len, data, len);
+	/* zero the byte after odd-sized data so that the checksum works */
+	if (tcp_len & 1)
+		pkt[IP_HDR_SIZE + tcp_len] = 0;
+
+	net_set_ip_header(pkt, tcp_remote_ip, net_ip);
+	ip->ip_len   = htons(IP_HDR_SIZE + tcp_len);
+	ip->ip_p     = IPPROTO_TCP;
+	ip->ip_sum   = compute_ip_checksum(ip, IP_HDR_SIZE);
+
+	ip->tcp_src  = htons(tcp_our_port);
+	ip->tcp_dst  = htons(tcp_remote_port);
+	put_unaligned_be32(seq, &ip->tcp_seq);
+	put_unaligned_be32(flags & TCP_ACK ? tcp_rcv_nxt : 0, &ip->tcp_ack);
+	ip->tcp_hlen = ((TCP_HDR_SIZE + opt_len) / 4) << 4;
+	ip->tcp_flags = flags;
+	ip->tcp_win  = htons(tcp_window(flags));
+	ip->tcp_xsum = 0;
+	ip->tcp_urg  = 0;
+	ip->tcp_xsum = tcp_checksum(ip, tcp_len);
+
+	debug_cond(DEBUG_DEV_PKT, "TCP send: flags=%02x seq=%u ack=%u len=%d\n",
+		   flags, seq - tcp_iss, tcp_rcv_nxt - tcp_irs, len);
+	net_send_ip_packet(tcp_remote_ethaddr, tcp_remote_ip,
+			   IP_HDR_SIZE + tcp_len);
+}
+
+static void tcp_send_ack(void)
+{
+	tcp_send_segment(TCP_ACK, tcp_snd_nxt, NULL, 0);
+}
+
+static void tcp_restart_timer(void)
+{
+	tcp_timeout_count = 0;
+	net_set_timeout_handler(TCP_TIMEOUT, tcp_timeout_handler);
+}
+
+void tcp_connect(struct in_addr dest, int dport, tcp_rx_f *rx_handler,
+		 tcp_event_f *event_handler)
+{
+	tcp_reset();
+	tcp_rx_handler = rx_handler;
+	tcp_event_handler = event_handler;
+
+	tcp_remote_ip = dest;
+	tcp_remote_port = dport;
+	tcp_our_port = random_port();
+	/* zero out the server ether in case the server ip has changed */
+	memset(tcp_remote_ethaddr, 0, 6);
+
+	tcp_iss = (u32)get_ticks();
+	tcp_snd_una = tcp_iss;
+	tcp_snd_nxt = tcp_iss + 1;
+	tcp_wscale_ok = 0;
+	tcp_sack_ok = 0;
+
+	tcp_state = TCP_SYN_SENT;
+	tcp_restart_timer();
+	tcp_send_segment(TCP_SYN, tcp_iss, NULL, 0);
+}
+
+int tcp_send(const void *data, int len)
+{
+	if (tcp_state != TCP_ESTABLISHED && tcp_state != TCP_CLOSE_WAIT)
+		return -ENOTCONN;
+	if (tcp_tx_len)
+		return -EBUSY;
+	if (len > TCP_MSS || len > tcp_peer_mss)
+		return -EMSGSIZE;
+
+	memcpy(tcp_tx_data, data, len);
+	tcp_tx_len = len;
+	tcp_tx_seq = tcp_snd_nxt;
+	tcp_snd_nxt += len;
+
+	tcp_restart_timer();
+	tcp_send_segment(TCP_ACK | TCP_PSH, tcp_tx_seq, tcp_tx_data, len);
+
+	return 0;
+}
+
+void tcp_close(void)
+{
+	switch (tcp_state) {
+	case TCP_SYN_SENT:
+		tcp_reset();
+		return;
+	case TCP_ESTABLISHED:
+		tcp_state = TCP_FIN_WAIT_1;
+		break;
+	case TCP_CLOSE_WAIT:
+		tcp_state = TCP_LAST_ACK;
+		break;
+	default:
+		return;
+	}
+
+	tcp_fin_seq = tcp_snd_nxt++;
+	tcp_restart_timer();
+	tcp_send_segment(TCP_FIN | TCP_ACK, tcp_fin_seq, NULL, 0);
+}
+
+static void tcp_timeout_handler(void)
+{
+	if (++tcp_timeout_count > TCP_TIMEOUT_COUNT) {
+		tcp_reset();
+		tcp_event(TCP_EVENT_TIMEOUT);
+		return;
+	}
+
+	puts("T ");
+	net_set_timeout_handler(TCP_TIMEOUT, tcp_timeout_handler);
+	if (tcp_state == TCP_SYN_SENT)
+		tcp_send_segment(TCP_SYN, tcp_iss, NULL, 0);
+	else if (tcp_tx_len)
+		tcp_send_segment(TCP_ACK | TCP_PSH, tcp_tx_seq, tcp_tx_data,
+				 tcp_tx_len);
+	else if (tcp_state == TCP_FIN_WAIT_1 || tcp_state == TCP_LAST_ACK)
+		tcp_send_segment(TCP_FIN | TCP_ACK, tcp_fin_seq, NULL, 0);
+	else
+		tcp_send_ack();	/* repeat what we are missing */
+}
+
+static void tcp_parse_options(const uchar *opt, int len)
+{
+	tcp_peer_mss = 536;	/* RFC 1122 default */
+	tcp_wscale_ok = 0;
+	tcp_sack_ok = 0;
+
+	while (len > 0) {
+		if (opt[0] == TCP_OPT_EOL)
+			break;
+		if (opt[0] == TCP_OPT_NOP) {
+			opt++;
+			len--;
+			continue;
+		}
+		if (len < 2 || opt[1] < 2 || opt[1] > len)
+			break;
+		switch (opt[0]) {
+		case TCP_OPT_MSS:
+			if (opt[1] == 4)
+				tcp_peer_mss = get_unaligned_be16(opt + 2);
+			break;
+		case TCP_OPT_WSCALE:
+			/*
+			 * We never send more than one segment, so the
+			 * server's own scale factor does not matter; only
+			 * that it scales ours.
+			 */
+			if (opt[1] == 3)
+				tcp_wscale_ok = 1;
+			break;
+		case TCP_OPT_SACK_PERM:
+			tcp_sack_ok = 1;
+			break;
+		}
+		len -= opt[1];
+		opt += opt[1];
+	}
+	debug("TCP: mss=%d wscale=%d sack=%d\n", tcp_peer_mss, tcp_wscale_ok,
+	      tcp_sack_ok);
+}
+
+/* Move tcp_rcv_nxt over any out-of-order data which is now in sequence */
+static void tcp_sack_advance(void)
+{
+	int i = 0;
+
+	while (i < tcp_sack_count) {
+		struct tcp_sack_block *blk = &tcp_sack[i];
+
+		if (SEQ_GT(blk->left, tcp_rcv_nxt)) {
+			i++;
+			continue;
+		}
+		if (SEQ_GT(blk->right, tcp_rcv_nxt))
+			tcp_rcv_nxt = blk->right;
+		memmove(blk, blk + 1, (--tcp_sack_count - i) * sizeof(*blk));
+		i = 0;
+	}
+}
+
+/* Record out-of-order data, merging it with what we already have */
+static void tcp_sack_add(u32 left, u32 right)
+{
+	int i = 0;
+
+	while (i < tcp_sack_count) {
+		struct tcp_sack_block *blk = &tcp_sack[i];
+
+		if (SEQ_GT(blk->left, right) || SEQ_LT(blk->right, left)) {
+			i++;
+			continue;
+		}
+		if (SEQ_LT(blk->left, left))
+			left = blk->left;
+		if (SEQ_GT(blk->right, right))
+			right = blk->right;
+		memmove(blk, blk + 1, (--tcp_sack_count - i) * sizeof(*blk));
+	}
+
+	/*
+	 * The block holding the latest segment goes first (RFC 2018). If
+	 * there is no room, forget the oldest; that data will be sent again.
+	 */
+	if (tcp_sack_count == TCP_SACK_BLOCKS)
+		tcp_sack_count--;
+	memmove(&tcp_sack[1], &tcp_sack[0], tcp_sack_count * sizeof(*tcp_sack));
+	tcp_sack[0].left = left;
+	tcp_sack[0].right = right;
+	tcp_sack_count++;
+}
+
+static void tcp_receive_data(u32 seq, const uchar *data, unsigned len)
+{
+	u32 end = seq + len;
+	u32 wnd = tcp_wscale_ok ? TCP_RCV_WND : 0xffff;
+
+	/* Drop what we already have */
+	if (SEQ_LT(seq, tcp_rcv_nxt)) {
+		if (SEQ_LEQ(end, tcp_rcv_nxt))
+			return;
+		data += tcp_rcv_nxt - seq;
+		seq = tcp_rcv_nxt;
+		len = end - seq;
+	}
+	if (SEQ_GT(end, tcp_rcv_nxt + wnd)) {
+		debug("TCP: segment beyond the window\n");
+		return;
+	}
+
+	if (tcp_rx_handler(seq - tcp_irs - 1, data, len))
+		return;
+
+	if (seq == tcp_rcv_nxt) {
+		tcp_rcv_nxt = end;
+		tcp_sack_advance();
+	} else {
+		debug("TCP: out of order, got %u, expected %u\n",
+		      seq - tcp_irs, tcp_rcv_nxt - tcp_irs);
+		tcp_sack_add(seq, end);
+	}
+}
+
+static void tcp_receive_ack(u32 ack)
+{
+	if (SEQ_LEQ(ack, tcp_snd_una) || SEQ_GT(ack, tcp_snd_nxt))
+		return;
+
+	tcp_snd_una = ack;
+	if (tcp_tx_len && SEQ_GEQ(ack, tcp_tx_seq + tcp_tx_len))
+		tcp_tx_len = 0;
+
+	if (ack != tcp_snd_nxt)
+		return;
+	/* Everything we sent, including any FIN, has arrived */
+	if (tcp_state == TCP_FIN_WAIT_1) {
+		tcp_state = TCP_FIN_WAIT_2;
+	} else if (tcp_state == TCP_LAST_ACK) {
+		tcp_reset();
+		tcp_event(TCP_EVENT_CLOSED);
+	}
+}
+
+void tcp_receive(struct ip_tcp_hdr *ip, int len)
+{
+	const uchar *data;
+	int hdr_len;
+	int peer_fin;
+	u32 seq;
+	u8 flags;
+
+	if (tcp_state == TCP_CLOSED || len < IP_TCP_HDR_SIZE)
+		return;
+	hdr_len = (ip->tcp_hlen >> 4) * 4;
+	if (hdr_len < TCP_HDR_SIZE || IP_HDR_SIZE + hdr_len > len)
+		return;
+	if (ntohs(ip->tcp_dst) != tcp_our_port ||
+	    ntohs(ip->tcp_src) != tcp_remote_port ||
+	    net_read_ip(&ip->ip_src).s_addr != tcp_remote_ip.s_addr)
+		return;
+	if (tcp_checksum(ip, len - IP_HDR_SIZE)) {
+		debug("TCP: bad checksum\n");
+		return;
+	}
+
+	flags = ip->tcp_flags;
+	seq = get_unaligned_be32(&ip->tcp_seq);
+	data = (uchar *)&ip->tcp_src + hdr_len;
+	len -= IP_HDR_SIZE + hdr_len;
+	debug_cond(DEBUG_DEV_PKT, "TCP recv: flags=%02x seq=%u len=%d\n",
+		   flags, seq - tcp_irs, len);
+
+	if (flags & TCP_RST) {
+		tcp_reset();
+		tcp_event(TCP_EVENT_RESET);
+		return;
+	}
+	if (!(flags & TCP_ACK))
+		return;
+
+	if (tcp_state == TCP_SYN_SENT) {
+		if (!(flags & TCP_SYN) ||
+		    get_unaligned_be32(&ip->tcp_ack) != tcp_iss + 1)
+			return;
+		tcp_irs = seq;
+		tcp_rcv_nxt = seq + 1;
+		tcp_snd_una = tcp_snd_nxt;
+		tcp_parse_options((uchar *)ip + IP_TCP_HDR_SIZE,
+				  hdr_len - TCP_HDR_SIZE);
+		tcp_state = TCP_ESTABLISHED;
+		tcp_restart_timer();
+		tcp_send_ack();
+		tcp_event(TCP_EVENT_CONNECTED);
+		return;
+	}
+
+	/* A repeated SYN means that our ACK of it got lost */
+	if (flags & TCP_SYN) {
+		tcp_send_ack();
+		return;
+	}
+
+	tcp_restart_timer();
+	tcp_receive_ack(get_unaligned_be32(&ip->tcp_ack));
+	if (tcp_state == TCP_CLOSED)
+		return;
+
+	/* No more data is expected once the server has sent its FIN */
+	if (len && (tcp_state == TCP_ESTABLISHED ||
+		    tcp_state == TCP_FIN_WAIT_1 || tcp_state == TCP_FIN_WAIT_2))
+		tcp_receive_data(seq, data, len);
+	/* The application may have dropped the connection */
+	if (tcp_state == TCP_CLOSED)
+		return;
+
+	/* Only act on a FIN once everything before it has arrived */
+	peer_fin = (flags & TCP_FIN) && seq + len == tcp_rcv_nxt &&
+		   tcp_state != TCP_CLOSE_WAIT && tcp_state != TCP_LAST_ACK;
+	if (peer_fin)
+		tcp_rcv_nxt++;
+
+	/* Acknowledge every segment, which also repeats any SACK blocks */
+	if (len || (flags & TCP_FIN))
+		tcp_send_ack();
+
+	if (!peer_fin)
+		return;
+	if (tcp_state == TCP_ESTABLISHED) {
+		tcp_state = TCP_CLOSE_WAIT;
+		tcp_event(TCP_EVENT_PEER_CLOSED);
+	} else {
+		/* We closed first; skip TIME_WAIT as nobody reuses the port */
+		tcp_reset();
+		tcp_event(TCP_EVENT_CLOSED);
+	}
+}
@@ -0,0 +1,153 @@
+/*
+ * Minimal TCP client for U-Boot
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef __TCP_H__
+#define __TCP_H__
+
+#include <common.h>
+#include <net.h>
+
+/*
+ *	Internet Protocol (IP) + TCP header, without TCP options.
+ */
+struct ip_tcp_hdr {
+	u8		ip_hl_v;	/* header length and version	*/
+	u8		ip_tos;		/* type of service		*/
+	u16		ip_len;		/* total length			*/
+	u16		ip_id;		/* identification		*/
+	u16		ip_off;		/* fragment offset field	*/
+	u8		ip_ttl;		/* time to live			*/
+	u8		ip_p;		/* protocol			*/
+	u16		ip_sum;		/* checksum			*/
+	struct in_addr	ip_src;		/* Source IP address		*/
+	struct in_addr	ip_dst;		/* Destination IP address	*/
+	u16		tcp_src;	/* TCP source port		*/
+	u16		tcp_dst;	/* TCP destination port		*/
+	u32		tcp_seq;	/* sequence number		*/
+	u32		tcp_ack;	/* acknowledgement number	*/
+	u8		tcp_hlen;	/* header length (upper 4 bits)	*/
+	u8		tcp_flags;	/* control flags		*/
+	u16		tcp_win;	/* receive window		*/
+	u16		tcp_xsum;	/* checksum			*/
+	u16		tcp_urg;	/* urgent pointer		*/
+};
+
+#define IP_TCP_HDR_SIZE		(sizeof(struct ip_tcp_hdr))
+#define TCP_HDR_SIZE		(IP_TCP_HDR_SIZE - IP_HDR_SIZE)
+
+/* TCP control flags */
+#define TCP_FIN		0x01
+#define TCP_SYN		0x02
+#define TCP_RST		0x04
+#define TCP_PSH		0x08
+#define TCP_ACK		0x10
+
+/* TCP options */
+#define TCP_OPT_EOL		0
+#define TCP_OPT_NOP		1
+#define TCP_OPT_MSS		2	/* maximum segment size, RFC 793 */
+#define TCP_OPT_WSCALE		3	/* window scale, RFC 7323 */
+#define TCP_OPT_SACK_PERM	4	/* SACK permitted, RFC 2018 */
+#define TCP_OPT_SACK		5	/* SACK blocks, RFC 2018 */
+
+/* Largest segment we accept: an Ethernet MTU minus the IP and TCP headers */
+#define TCP_MSS		1460
+
+enum tcp_state {
+	TCP_CLOSED,
+	TCP_SYN_SENT,
+	TCP_ESTABLISHED,
+	TCP_FIN_WAIT_1,
+	TCP_FIN_WAIT_2,
+	TCP_CLOSE_WAIT,
+	TCP_LAST_ACK,
+};
+
+enum tcp_event {
+	TCP_EVENT_CONNECTED,	/* the handshake completed */
+	TCP_EVENT_PEER_CLOSED,	/* all data received, peer sent FIN */
+	TCP_EVENT_CLOSED,	/* the connection is fully closed */
+	TCP_EVENT_RESET,	/* the peer reset the connection */
+	TCP_EVENT_TIMEOUT,	/* the peer stopped responding */
+};
+
+/**
+ * tcp_rx_f - receive data handler
+ *
+ * Data may arrive out of order; it is passed on as soon as it is received
+ * so that it can be stored at its final place. Overlapping or repeated
+ * ranges are possible after retransmissions.
+ *
+ * @offset:	Offset of the data in the received byte stream
+ * @data:	Received data
+ * @len:	Number of bytes at @data
+ * @return 0 if the data was consumed, or a negative value to drop it, in
+ * which case the peer will send it again later
+ */
+typedef int tcp_rx_f(u32 offset, const uchar *data, unsigned len);
+
+/**
+ * tcp_event_f - connection state change handler
+ *
+ * @event:	What happened
+ */
+typedef void tcp_event_f(enum tcp_event event);
+
+/**
+ * tcp_connect() - Open a connection
+ *
+ * Any previous connection is dropped. The handshake runs from the network
+ * loop; @event_handler is told once it has completed.
+ *
+ * @dest:		IP address of the server
+ * @dport:		TCP port of the server
+ * @rx_handler:		Handler for received data
+ * @event_handler:	Handler for connection state changes
+ */
+void tcp_connect(struct in_addr dest, int dport, tcp_rx_f *rx_handler,
+		 tcp_event_f *event_handler);
+
+/**
+ * tcp_send() - Send data over the open connection
+ *
+ * The data is copied and retransmitted until the peer acknowledges it. Only
+ * one segment may be outstanding at a time.
+ *
+ * @data:	Data to send
+ * @len:	Number of bytes to send, at most TCP_MSS
+ * @return 0 if OK, -ENOTCONN if not connected, -EBUSY if earlier data is
+ * not acknowledged yet, -EMSGSIZE if @len is too large
+ */
+int tcp_send(const void *data, int len);
+
+/**
+ * tcp_close() - Start an orderly close of the connection
+ *
+ * TCP_EVENT_CLOSED is reported once the peer has acknowledged it.
+ */
+void tcp_close(void);
+
+/**
+ * tcp_reset() - Forget about the current connection without telling the peer
+ */
+void tcp_reset(void);
+
+/**
+ * tcp_get_state() - Get the state of the connection
+ *
+ * @return the current state
+ */
+enum tcp_state tcp_get_state(void);
+
+/**
+ * tcp_receive() - Process a received TCP segment
+ *
+ * @ip:		IP packet holding the segment, with a valid IP header
+ * @len:	Length of the IP packet
+ */
+void tcp_receive(struct ip_tcp_hdr *ip, int len);
+
+#endif /* __TCP_H__ */
@@ -133,6 +133,17 @@ static char tftp_filename[MAX_LEN];
 static unsigned short tftp_block_size = TFTP_BLOCK_SIZE;
 static unsigned short tftp_block_size_option = TFTP_MTU_BLOCKSIZE;
 
+/*
+ * RFC 7440 window size: the number of DATA blocks the server may send
+ * before it waits for an ACK. A window of 1 is plain lock-step RFC 1350.
+ */
+static unsigned short tftp_window_size = 1;
+static unsigned short tftp_window_size_option = CONFIG_TFTP_WINDOWSIZE;
+/* block number whose arrival completes the current window */
+static ulong	tftp_next_ack;
+/* last in-sequence block we re-acknowledged after a gap */
+static ulong	tftp_last_nack;
+
 #ifdef CONFIG_MCAST_TFTP
 #include <malloc.h>
 #define MTFTP_BITMAPSIZE	0x1000
@@ -210,6 +221,8 @@ static void new_transfer(void)
 	tftp_prev_block = 0;
 	tftp_block_wrap = 0;
 	tftp_block_wrap_offset = 0;
+	tftp_next_ack = tftp_window_size;
+	tftp_last_nack = TFTP_SEQUENCE_SIZE;	/* matches no block number */
 #ifdef CONFIG_CMD_TFTPPUT
 	tftp_put_final_block_sent = 0;
 #endif
@@ -371,6 +384,10 @@ static void tftp_send(void)
 		/* try for more effic. blk size */
 		pkt += sprintf((char *)pkt, "blksize%c%d%c",
 				0, tftp_block_size_option, 0);
+		/* only the receive side of a windowed transfer is supported */
+		if (tftp_state == STATE_SEND_RRQ && tftp_window_size_option > 1)
+			pkt += sprintf((char *)pkt, "windowsize%c%d%c",
+					0, tftp_window_size_option, 0);
 #ifdef CONFIG_MCAST_TFTP
 		/* Check all preconditions before even trying the option */
 		if (!tftp_mcast_disabled) {
@@ -461,6 +478,7 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 {
 	__be16 proto;
 	__be16 *s;
+	ulong rx_block;
 	int i;
 
 	if (dest != tftp_our_port) {
@@ -539,6 +557,16 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 				debug("Blocksize ack: %s, %d\n",
 				      (char *)pkt + i + 8, tftp_block_size);
 			}
+			if (strcmp((char *)pkt + i, "windowsize") == 0) {
+				ulong win = simple_strtoul((char *)pkt + i + 11,
+							   NULL, 10);
+
+				/* the server may lower it, not raise it */
+				tftp_window_size = clamp_t(ulong, win, 1,
+						tftp_window_size_option);
+				debug("Windowsize ack: %s, %d\n",
+				      (char *)pkt + i + 11, tftp_window_size);
+			}
 #ifdef CONFIG_TFTP_TSIZE
 			if (strcmp((char *)pkt+i, "tsize") == 0) {
 				tftp_tsize = simple_strtoul((char *)pkt + i + 6,
@@ -550,6 +578,9 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 		}
 #ifdef CONFIG_MCAST_TFTP
 		parse_multicast_oack((char *)pkt, len - 1);
+		/* multicast tracks missing blocks itself, in a bitmap */
+		if (tftp_mcast_active)
+			tftp_window_size = 1;
 		if ((tftp_mcast_active) && (!tftp_mcast_master_client))
 			tftp_state = STATE_DATA;	/* passive.. */
 		else
@@ -567,9 +598,11 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 		if (len < 2)
 			return;
 		len -= 2;
-		tftp_cur_block = ntohs(*(__be16 *)pkt);
-
-		update_block_number();
+		/*
+		 * tftp_cur_block is what a timeout re-acknowledges, so only
+		 * move it on once the block has been accepted.
+		 */
+		rx_block = ntohs(*(__be16 *)pkt);
 
 		if (tftp_state == STATE_SEND_RRQ)
 			debug("Server did not acknowledge timeout option!\n");
@@ -583,24 +616,53 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 
 #ifdef CONFIG_MCAST_TFTP
 			if (tftp_mcast_active) { /* start!=1 common if mcast */
-				tftp_prev_block = tftp_cur_block - 1;
+				tftp_prev_block = rx_block - 1;
 			} else
 #endif
-			if (tftp_cur_block != 1) {	/* Assertion */
+			/* Assertion; with a window it is just another gap */
+			if (rx_block != 1 && tftp_window_size == 1) {
 				puts("\nTFTP error: ");
 				printf("First block is not block 1 (%ld)\n",
-				       tftp_cur_block);
+				       rx_block);
 				puts("Starting again\n\n");
 				net_start_again();
 				break;
 			}
 		}
 
-		if (tftp_cur_block == tftp_prev_block) {
+		if (rx_block == tftp_prev_block) {
 			/* Same block again; ignore it. */
 			break;
 		}
 
+		if (tftp_window_size > 1 &&
+		    rx_block != (ushort)(tftp_prev_block + 1)) {
+			/* Late duplicate from an earlier window; ignore it. */
+			if ((ushort)(tftp_prev_block - rx_block) <
+			    TFTP_SEQUENCE_SIZE / 2)
+				break;
+			/*
+			 * A block went missing. Drop everything until it shows
+			 * up and re-ACK the last block received in sequence,
+			 * which makes the server restart its window from there
+			 * (RFC 7440 section 4). Only do that once per gap: the
+			 * rest of the broken window is still on the wire.
+			 */
+			debug("Got block %ld, expected %ld\n", rx_block,
+			      (ulong)(ushort)(tftp_prev_block + 1));
+			if (tftp_last_nack != tftp_prev_block) {
+				tftp_last_nack = tftp_prev_block;
+				tftp_cur_block = tftp_prev_block;
+				tftp_next_ack = (ushort)(tftp_cur_block +
+							 tftp_window_size);
+				tftp_send();
+			}
+			break;
+		}
+
+		tftp_cur_block = rx_block;
+		update_block_number();
+
 		tftp_prev_block = tftp_cur_block;
 		timeout_count_max = tftp_timeout_count_max;
 		net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
@@ -637,7 +699,16 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			}
 		}
 #endif
-		tftp_send();
+		/*
+		 * Inside a window only the last block (or the short final
+		 * block) is acknowledged.
+		 */
+		if (tftp_window_size == 1 || len < tftp_block_size ||
+		    tftp_cur_block == tftp_next_ack) {
+			tftp_next_ack = (ushort)(tftp_cur_block +
+						 tftp_window_size);
+			tftp_send();
+		}
 
 #ifdef CONFIG_MCAST_TFTP
 		if (tftp_mcast_active) {
@@ -689,8 +760,16 @@ static void tftp_timeout_handler(void)
 	} else {
 		puts("T ");
 		net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
-		if (tftp_state != STATE_RECV_WRQ)
+		if (tftp_state != STATE_RECV_WRQ) {
+			/*
+			 * The server restarts its window after our ACK. A gap
+			 * in that window must be re-acknowledged again.
+			 */
+			tftp_next_ack = (ushort)(tftp_cur_block +
+						 tftp_window_size);
+			tftp_last_nack = TFTP_SEQUENCE_SIZE;
 			tftp_send();
+		}
 	}
 }
 
@@ -699,6 +778,7 @@ void tftp_start(enum proto_t protocol)
 {
 #if CONFIG_NET_TFTP_VARS
 	char *ep;             /* Environment pointer */
+	long win;
 
 	/*
 	 * Allow the user to choose TFTP blocksize and timeout.
@@ -709,6 +789,20 @@ void tftp_start(enum proto_t protocol)
 	if (ep != NULL)
 		tftp_block_size_option = simple_strtol(ep, NULL, 10);
 
+	/*
+	 * Late duplicates are told from gaps by sequence number, so the
+	 * window must stay below half the sequence space.
+	 */
+	ep = getenv("tftpwindowsize");
+	if (ep != NULL) {
+		win = simple_strtol(ep, NULL, 10);
+		if (win >= 1 && win < TFTP_SEQUENCE_SIZE / 2)
+			tftp_window_size_option = win;
+		else
+			printf("TFTP windowsize (%ld) out of range, ignored\n",
+			       win);
+	}
+
 	ep = getenv("tftptimeout");
 	if (ep != NULL)
 		timeout_ms = simple_strtol(ep, NULL, 10);
@@ -730,8 +824,8 @@ void tftp_start(enum proto_t protocol)
 	}
 #endif
 
-	debug("TFTP blocksize = %i, timeout = %ld ms\n",
-	      tftp_block_size_option, timeout_ms);
+	debug("TFTP blocksize = %i, windowsize = %i, timeout = %ld ms\n",
+	      tftp_block_size_option, tftp_window_size_option, timeout_ms);
 
 	tftp_remote_ip = net_server_ip;
 	if (net_boot_file_name[0] == '\0') {
@@ -831,8 +925,9 @@ void tftp_start(enum proto_t protocol)
 
 	/* zero out server ether in case the server ip has changed */
 	memset(net_server_ethaddr, 0, 6);
-	/* Revert tftp_block_size to dflt */
+	/* Revert tftp_block_size and tftp_window_size to dflt */
 	tftp_block_size = TFTP_BLOCK_SIZE;
+	tftp_window_size = 1;
 #ifdef CONFIG_MCAST_TFTP
 	mcast_cleanup();
 #endif
@@ -860,8 +955,9 @@ void tftp_start_server(void)
 	timeout_ms = TIMEOUT;
 	net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
 
-	/* Revert tftp_block_size to dflt */
+	/* Revert tftp_block_size and tftp_window_size to dflt */
 	tftp_block_size = TFTP_BLOCK_SIZE;
+	tftp_window_size = 1;
 	tftp_cur_block = 0;
 	tftp_our_port = WELL_KNOWN_PORT;
 
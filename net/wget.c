@@ -0,0 +1,279 @@
+/*
+ * HTTP download over the minimal TCP client
+ *
+ * Fetches a single file with an HTTP/1.1 GET request and stores it at the
+ * load address. Data which arrives out of order is written to its place
+ * straight away, so a lost segment does not stall the transfer.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <net.h>
+#include <mapmem.h>
+#include <linux/linux_string.h>
+#include "tcp.h"
+#include "wget.h"
+
+/* Room for the status line and headers of the response */
+#define WGET_HDR_SIZE		2048
+/* Print a hash mark every this many bytes */
+#define WGET_HASH_BYTES		(64 << 10)
+#define WGET_HASHES_PER_LINE	65
+
+static struct in_addr wget_server_ip;
+static int wget_server_port;
+static char *wget_path;
+
+static char wget_hdr[WGET_HDR_SIZE + 1];
+static unsigned wget_hdr_len;
+/* Offset of the body in the TCP stream, valid once the header is parsed */
+static u32 wget_body_start;
+static int wget_hdr_done;
+static ulong wget_content_len;
+static int wget_content_len_known;	/* 0 if not given by the server */
+
+static ulong wget_received;
+static int wget_hashes;
+static ulong time_start;
+
+static void wget_fail(const char *msg)
+{
+	printf("\n%s\n", msg);
+	tcp_reset();
+	net_set_state(NETLOOP_FAIL);
+}
+
+static void wget_send_request(void)
+{
+	char req[TCP_MSS];
+	int len;
+
+	len = snprintf(req, sizeof(req),
+		       "GET %s HTTP/1.1\r\n"
+		       "Host: %pI4\r\n"
+		       "User-Agent: U-Boot\r\n"
+		       "Connection: close\r\n\r\n",
+		       wget_path, &wget_server_ip);
+	if (len >= sizeof(req) || tcp_send(req, len))
+		wget_fail("HTTP request too long");
+}
+
+/* Check the response header; return 0 to go on with the body */
+static int wget_parse_header(void)
+{
+	char *line = wget_hdr;
+	char *end;
+
+	if (strncmp(line, "HTTP/1.", 7) || !line[7] || line[8] != ' ') {
+		puts("\nNot an HTTP response\n");
+		return -1;
+	}
+	if (simple_strtoul(line + 9, NULL, 10) != 200) {
+		end = strstr(line, "\r\n");
+		*end = '\0';
+		printf("\nServer error: %s\n", line + 9);
+		return -1;
+	}
+
+	wget_content_len_known = 0;
+	while ((end = strstr(line, "\r\n")) != NULL && end != line) {
+		*end = '\0';
+		if (!strncasecmp(line, "Content-Length:", 15)) {
+			/* simple_strtoul() does not skip the space */
+			line = skip_spaces(line + 15);
+			wget_content_len = simple_strtoul(line, NULL, 10);
+			wget_content_len_known = 1;
+		} else if (!strncasecmp(line, "Transfer-Encoding:", 18) &&
+			   strstr(line + 18, "chunked")) {
+			puts("\nChunked transfer encoding is not supported\n");
+			return -1;
+		}
+		line = end + 2;
+	}
+
+	if (wget_content_len_known) {
+		puts(" Size is ");
+		print_size(wget_content_len, "");
+	}
+	puts("\nLoading: ");
+
+	return 0;
+}
+
+/* Collect the response header, which is always received in sequence */
+static int wget_store_header(u32 offset, const uchar *data, unsigned len)
+{
+	unsigned skip;
+	char *end;
+
+	if (offset > wget_hdr_len)
+		return -1;	/* keep it until the gap before it is filled */
+	skip = wget_hdr_len - offset;
+	if (skip >= len)
+		return 0;
+	len = min(len - skip, (unsigned)(WGET_HDR_SIZE - wget_hdr_len));
+	memcpy(wget_hdr + wget_hdr_len, data + skip, len);
+	wget_hdr_len += len;
+	wget_hdr[wget_hdr_len] = '\0';
+
+	end = strstr(wget_hdr, "\r\n\r\n");
+	if (!end) {
+		if (wget_hdr_len == WGET_HDR_SIZE)
+			wget_fail("HTTP response header too long");
+		return 0;
+	}
+
+	wget_body_start = end + 4 - wget_hdr;
+	wget_hdr_done = 1;
+	if (wget_parse_header()) {
+		tcp_reset();
+		net_set_state(NETLOOP_FAIL);
+	}
+
+	return 0;
+}
+
+static void wget_store_body(u32 offset, const uchar *data, unsigned len)
+{
+	ulong end = offset + len;
+	void *ptr;
+
+	if (wget_content_len_known && end > wget_content_len) {
+		if (offset >= wget_content_len)
+			return;
+		len = wget_content_len - offset;
+		end = wget_content_len;
+	}
+
+	ptr = map_sysmem(load_addr + offset, len);
+	memcpy(ptr, data, len);
+	unmap_sysmem(ptr);
+
+	if (net_boot_file_size < end)
+		net_boot_file_size = end;
+
+	wget_received += len;
+	while (wget_received / WGET_HASH_BYTES > wget_hashes) {
+		putc('#');
+		if (++wget_hashes % WGET_HASHES_PER_LINE == 0)
+			puts("\n\t ");
+	}
+}
+
+static int wget_rx_handler(u32 offset, const uchar *data, unsigned len)
+{
+	unsigned skip;
+
+	if (!wget_hdr_done) {
+		if (wget_store_header(offset, data, len))
+			return -1;
+		if (!wget_hdr_done || net_state != NETLOOP_CONTINUE)
+			return 0;
+	}
+
+	/* The part of this segment which belongs to the body, if any */
+	if (offset + len <= wget_body_start)
+		return 0;
+	skip = offset < wget_body_start ? wget_body_start - offset : 0;
+	wget_store_body(offset + skip - wget_body_start, data + skip,
+			len - skip);
+
+	return 0;
+}
+
+static void wget_complete(void)
+{
+	time_start = get_timer(time_start);
+	if (time_start > 0) {
+		puts("\n\t ");	/* Line up with "Loading: " */
+		print_size(net_boot_file_size / time_start * 1000, "/s");
+	}
+	puts("\ndone\n");
+	net_set_state(NETLOOP_SUCCESS);
+}
+
+static void wget_event_handler(enum tcp_event event)
+{
+	switch (event) {
+	case TCP_EVENT_CONNECTED:
+		wget_send_request();
+		break;
+	case TCP_EVENT_PEER_CLOSED:
+		if (!wget_hdr_done) {
+			wget_fail("Connection closed before the response");
+			break;
+		}
+		if (wget_content_len_known &&
+		    net_boot_file_size != wget_content_len) {
+			printf("\nShort file: got %lu of %lu bytes\n",
+			       (ulong)net_boot_file_size, wget_content_len);
+			tcp_reset();
+			net_set_state(NETLOOP_FAIL);
+			break;
+		}
+		tcp_close();
+		break;
+	case TCP_EVENT_CLOSED:
+		wget_complete();
+		break;
+	case TCP_EVENT_RESET:
+		puts("\nConnection reset by server\n");
+		net_set_state(NETLOOP_FAIL);
+		break;
+	case TCP_EVENT_TIMEOUT:
+		puts("\nRetry count exceeded; starting again\n");
+		net_start_again();
+		break;
+	}
+}
+
+void wget_start(void)
+{
+	char *p;
+
+	wget_server_ip = net_server_ip;
+	wget_server_port = getenv_ulong("httpdstp", 10, WGET_HTTP_PORT);
+
+	p = strchr(net_boot_file_name, ':');
+	if (p) {
+		wget_server_ip = string_to_ip(net_boot_file_name);
+		wget_path = p + 1;
+	} else {
+		wget_path = net_boot_file_name;
+	}
+	if (*wget_path != '/') {
+		printf("*** ERROR: '%s' is not an absolute path\n", wget_path);
+		net_set_state(NETLOOP_FAIL);
+		return;
+	}
+
+	printf("Using %s device\n", eth_get_name());
+	printf("HTTP from server %pI4:%d; our IP address is %pI4",
+	       &wget_server_ip, wget_server_port, &net_ip);
+
+	/* Check if we need to send across this subnet */
+	if (net_gateway.s_addr && net_netmask.s_addr) {
+		struct in_addr our_net;
+		struct in_addr server_net;
+
+		our_net.s_addr = net_ip.s_addr & net_netmask.s_addr;
+		server_net.s_addr = wget_server_ip.s_addr & net_netmask.s_addr;
+		if (our_net.s_addr != server_net.s_addr)
+			printf("; sending through gateway %pI4",
+			       &net_gateway);
+	}
+	printf("\nFilename '%s'.\nLoad address: 0x%lx", wget_path, load_addr);
+
+	wget_hdr_len = 0;
+	wget_hdr_done = 0;
+	wget_body_start = 0;
+	wget_content_len_known = 0;
+	wget_received = 0;
+	wget_hashes = 0;
+	net_boot_file_size = 0;
+	time_start = get_timer(0);
+
+	tcp_connect(wget_server_ip, wget_server_port, wget_rx_handler,
+		    wget_event_handler);
+}
@@ -0,0 +1,15 @@
+/*
+ * HTTP download over the minimal TCP client
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef __WGET_H__
+#define __WGET_H__
+
+/* Default HTTP port, can be overridden by the "httpdstp" variable */
+#define WGET_HTTP_PORT	80
+
+void wget_start(void);	/* Begin HTTP download */
+
+#endif /* __WGET_H__ */
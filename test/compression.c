@@ -9,9 +9,16 @@
 #include <common.h>
 #include <bootm.h>
 #include <command.h>
+#include <decomp_stream.h>
+#include <div64.h>
+#include <errno.h>
+#include <lz4_frame.h>
 #include <malloc.h>
 #include <mapmem.h>
+#include <os.h>
 #include <asm/io.h>
+#include <asm/state.h>
+#include <asm/unaligned.h>
 
 #include <u-boot/zlib.h>
 #include <bzlib.h>
@@ -22,6 +29,8 @@
 
 #include <linux/lzo.h>
 
+#include <u-boot/zstd.h>
+
 static const char plain[] =
 	"I am a highly compressable bit of text.\n"
 	"I am a highly compressable bit of text.\n"
@@ -117,6 +126,23 @@ static const char lz4_compressed[] =
 	"\x9d\x12\x8c\x9d";
 static const unsigned long lz4_compressed_size = 276;
 
+/* zstd -19 -c /tmp/plain.txt > /tmp/plain.zst */
+static const char zstd_compressed[] =
+	"\x28\xb5\x2f\xfd\x64\x5e\x00\xad\x05\x00\x42\x4e\x26\x17\x90\x3b"
+	"\x07\x04\x5a\x13\x8b\xa7\x65\x34\x12\x21\x6d\xb0\x39\xbb\xae\xe8"
+	"\xba\xc9\xcd\x5e\x02\x49\xd0\x2b\xa9\xfa\x96\x92\xe7\x1f\x19\x19"
+	"\x7c\x8f\xf1\x9d\x54\x37\xfc\xd6\x0a\xf3\x0c\x93\x56\xc7\x52\x4f"
+	"\x0a\x62\x3e\xd1\xa5\x83\x17\x31\xab\x5d\x8f\x57\xf3\xcc\x3b\x58"
+	"\xf8\x91\x8c\xf1\x2a\x5c\x89\xdd\xf2\x9b\x15\xb7\x92\x5b\xbe\xba"
+	"\xab\xd5\xd1\x34\xdf\xf0\x02\x0e\x61\xcd\x7b\xd6\x01\xfc\xc2\xa7"
+	"\xd4\xd1\x3d\x26\x9c\x10\x49\xb8\x5b\xcd\xba\x7c\xf7\xac\x4b\xad"
+	"\xb7\x31\x1c\xbc\xf9\xcb\x62\x8e\x2e\x9b\x0f\xd3\x87\x57\x45\x12"
+	"\x16\xfa\x3a\x79\xde\x65\xf8\xcc\x48\xd5\x43\xa6\xbd\xc3\x91\x29"
+	"\x65\x29\xa7\x5b\x9a\x08\x08\x00\x60\x13\x00\x63\xa3\x8e\x28\x94"
+	"\x79\x41\x2a\x78\xc2\x91\x70\x9f\xaa\x6a\x21\x7a\xa1\xaa\x0c\xe4"
+	"\xf4\x6e\xfa";
+static const unsigned long zstd_compressed_size = 195;
+
 
 #define TEST_BUFFER_SIZE	512
 
@@ -282,6 +308,38 @@ static int uncompress_using_lz4(void *in, unsigned long in_size,
 	return (ret != 0);
 }
 
+static int compress_using_zstd(void *in, unsigned long in_size,
+			       void *out, unsigned long out_max,
+			       unsigned long *out_size)
+{
+	/* There is no zstd compression in u-boot, so fake it. */
+	assert(in_size == strlen(plain));
+	assert(memcmp(plain, in, in_size) == 0);
+
+	if (zstd_compressed_size > out_max)
+		return -1;
+
+	memcpy(out, zstd_compressed, zstd_compressed_size);
+	if (out_size)
+		*out_size = zstd_compressed_size;
+
+	return 0;
+}
+
+static int uncompress_using_zstd(void *in, unsigned long in_size,
+				 void *out, unsigned long out_max,
+				 unsigned long *out_size)
+{
+	int ret;
+	size_t output_size = out_max;
+
+	ret = zstd_decompress(in, in_size, out, &output_size);
+	if (out_size)
+		*out_size = output_size;
+
+	return (ret != 0);
+}
+
 #define errcheck(statement) if (!(statement)) { \
 	fprintf(stderr, "\tFailed: %s\n", #statement); \
 	ret = 1; \
@@ -371,16 +429,225 @@ out:
 	return ret;
 }
 
+/*
+ * Benchmark mode: ut_compression bench <file>...
+ *
+ * Each file is compressed and decompressed with every codec, reporting
+ * the compression ratio, the speed in MiB/s of uncompressed data and how
+ * much heap each step needs. Only gzip can compress in U-Boot, so for the
+ * other codecs the compressed data is read from the file with the
+ * codec's extension added, if there is one. A suitable set of corpora
+ * can be made with:
+ *
+ *   dd if=/dev/zero of=zeros bs=1M count=4
+ *   dd if=/dev/urandom of=random bs=1M count=4
+ *   dd if=rootfs.ext4 of=rootfs.chunk bs=1M count=4
+ *   for f in vmlinux u-boot.dtb rootfs.chunk zeros random; do
+ *       bzip2 -k $f; lzma -k $f; lzop $f; lz4 $f; zstd $f
+ *   done
+ *
+ * The heap figure is how far the top of the malloc() area rose during
+ * one run, after trimming it. Free space lower down in the heap may be
+ * reused without being counted, so it is a lower bound.
+ *
+ * Building with CONFIG_ZLIB_INFLATE_WIDE on and off shows what the
+ * word-at-a-time inflate_fast() gains on a given CPU.
+ */
+#define BENCH_MIN_MS	200
+
+static const struct {
+	const char *name;
+	const char *ext;
+	mutate_func compress;
+	mutate_func uncompress;
+} bench_codecs[] = {
+	{ "gzip", ".gz", compress_using_gzip, uncompress_using_gzip },
+	{ "bzip2", ".bz2", NULL, uncompress_using_bzip2 },
+	{ "lzma", ".lzma", NULL, uncompress_using_lzma },
+	{ "lzo", ".lzo", NULL, uncompress_using_lzo },
+	{ "lz4", ".lz4", NULL, uncompress_using_lz4 },
+	{ "zstd", ".zst", NULL, uncompress_using_zstd },
+};
+
+/* Read a whole host file into memory from os_malloc() */
+static void *read_host_file(const char *fname, ulong *sizep)
+{
+	loff_t size;
+	void *buf;
+	int fd;
+
+	if (os_get_filesize(fname, &size) < 0)
+		return NULL;
+	buf = os_malloc(size);
+	if (!buf)
+		return NULL;
+	fd = os_open(fname, OS_O_RDONLY);
+	if (fd < 0 || os_read(fd, buf, size) != size) {
+		if (fd >= 0)
+			os_close(fd);
+		os_free(buf);
+		return NULL;
+	}
+	os_close(fd);
+	*sizep = size;
+
+	return buf;
+}
+
+/**
+ * bench_run() - Measure the speed and heap use of a codec
+ *
+ * @func:	Compressor or decompressor to run
+ * @in:		Input data
+ * @in_size:	Size of the input
+ * @out:	Output buffer
+ * @out_max:	Size of the output buffer
+ * @out_size:	Returns the size of the output
+ * @size:	Uncompressed size, which the speed is based on
+ * @rate:	Returns the speed in MiB/s
+ * @heap:	Returns the heap used, in bytes
+ * @return 0 if OK, -EIO if @func failed
+ */
+static int bench_run(mutate_func func, void *in, ulong in_size, void *out,
+		     ulong out_max, ulong *out_size, ulong size, ulong *rate,
+		     ulong *heap)
+{
+	ulong brk, start, ms, loops;
+	u64 bytes;
+	int ret;
+
+	malloc_trim(0);
+	brk = mem_malloc_brk;
+	mem_malloc_brk_max = brk;
+	ret = func(in, in_size, out, out_max, out_size);
+	*heap = mem_malloc_brk_max - brk;
+	if (ret)
+		return -EIO;
+
+	/* Small files go round many times, to get a useful time */
+	start = get_timer(0);
+	loops = 0;
+	do {
+		func(in, in_size, out, out_max, NULL);
+		loops++;
+		ms = get_timer(start);
+	} while (ms < BENCH_MIN_MS);
+
+	bytes = (u64)size * loops * 1000;
+	do_div(bytes, ms);
+	*rate = bytes >> 20;
+
+	return 0;
+}
+
+/**
+ * bench_codec() - Benchmark one codec on one file
+ *
+ * @fname:	Name of the file, to find any compressed version
+ * @i:		Index into bench_codecs[]
+ * @orig:	Contents of the file
+ * @orig_size:	Size of the file
+ * @return 0 if OK (including if there is nothing to test), -ve on error
+ */
+static int bench_codec(const char *fname, int i, void *orig, ulong orig_size)
+{
+	ulong comp_size, comp_max, out_size, ratio, rate, heap;
+	void *comp = NULL, *out = NULL;
+	char name[256];
+	int ret = -ENOMEM;
+
+	printf("  %-6s", bench_codecs[i].name);
+	comp_max = orig_size + orig_size / 8 + 1024;
+	out = os_malloc(orig_size + 1);
+	if (!out)
+		goto out;
+
+	if (bench_codecs[i].compress) {
+		comp = os_malloc(comp_max);
+		if (!comp)
+			goto out;
+		ret = bench_run(bench_codecs[i].compress, orig, orig_size,
+				comp, comp_max, &comp_size, orig_size, &rate,
+				&heap);
+		if (ret)
+			goto out;
+		ratio = orig_size * 100 / (comp_size ? comp_size : 1);
+		printf(" %10lu %4lu.%02lux %10lu %9lu", comp_size, ratio / 100,
+		       ratio % 100, rate, heap >> 10);
+	} else {
+		snprintf(name, sizeof(name), "%s%s", fname,
+			 bench_codecs[i].ext);
+		comp = read_host_file(name, &comp_size);
+		if (!comp) {
+			printf(" (no %s)\n", name);
+			ret = 0;
+			goto out;
+		}
+		ratio = orig_size * 100 / (comp_size ? comp_size : 1);
+		printf(" %10lu %4lu.%02lux %10s %9s", comp_size, ratio / 100,
+		       ratio % 100, "-", "-");
+	}
+
+	ret = bench_run(bench_codecs[i].uncompress, comp, comp_size, out,
+			orig_size, &out_size, orig_size, &rate, &heap);
+	if (!ret && (out_size != orig_size || memcmp(orig, out, orig_size)))
+		ret = -EINVAL;
+	if (ret)
+		goto out;
+	printf(" %10lu %9lu\n", rate, heap >> 10);
+out:
+	if (ret)
+		printf(" FAILED (%d)\n", ret);
+	os_free(comp);
+	os_free(out);
+
+	return ret;
+}
+
+static int compression_bench(int argc, char *const argv[])
+{
+	ulong orig_size;
+	void *orig;
+	int i, j, err = 0;
+
+	for (i = 0; i < argc; i++) {
+		orig = read_host_file(argv[i], &orig_size);
+		if (!orig || !orig_size) {
+			printf("%s: cannot read file\n", argv[i]);
+			err = 1;
+			continue;
+		}
+		printf("%s: %lu bytes\n", argv[i], orig_size);
+		printf("  %-6s %10s %8s %10s %9s %10s %9s\n", "codec", "size",
+		       "ratio", "comp MiB/s", "heap KiB", "dec MiB/s",
+		       "heap KiB");
+		for (j = 0; j < ARRAY_SIZE(bench_codecs); j++)
+			err |= bench_codec(argv[i], j, orig, orig_size) != 0;
+		os_free(orig);
+	}
+
+	printf("ut_compression bench %s\n", err == 0 ? "ok" : "FAILED");
+
+	return err;
+}
+
 static int do_ut_compression(cmd_tbl_t *cmdtp, int flag, int argc,
 			     char *const argv[])
 {
 	int err = 0;
 
+	if (argc > 1) {
+		if (strcmp(argv[1], "bench") || argc < 3)
+			return CMD_RET_USAGE;
+		return compression_bench(argc - 2, argv + 2);
+	}
+
 	err += run_test("gzip", compress_using_gzip, uncompress_using_gzip);
 	err += run_test("bzip2", compress_using_bzip2, uncompress_using_bzip2);
 	err += run_test("lzma", compress_using_lzma, uncompress_using_lzma);
 	err += run_test("lzo", compress_using_lzo, uncompress_using_lzo);
 	err += run_test("lz4", compress_using_lz4, uncompress_using_lz4);
+	err += run_test("zstd", compress_using_zstd, uncompress_using_zstd);
 
 	printf("ut_compression %s\n", err == 0 ? "ok" : "FAILED");
 
@@ -458,6 +725,7 @@ static int do_ut_image_decomp(cmd_tbl_t *cmdtp, int flag, int argc,
 	err |= run_bootm_test(IH_COMP_LZMA, compress_using_lzma);
 	err |= run_bootm_test(IH_COMP_LZO, compress_using_lzo);
 	err |= run_bootm_test(IH_COMP_LZ4, compress_using_lz4);
+	err |= run_bootm_test(IH_COMP_ZSTD, compress_using_zstd);
 	err |= run_bootm_test(IH_COMP_NONE, compress_using_none);
 
 	printf("ut_image_decomp %s\n", err == 0 ? "ok" : "FAILED");
@@ -465,12 +733,314 @@ static int do_ut_image_decomp(cmd_tbl_t *cmdtp, int flag, int argc,
 	return 0;
 }
 
+#ifdef CONFIG_DECOMP_STREAM
+/**
+ * stream_decomp() - Decompress by feeding the data in pieces
+ *
+ * @comp_type:	Compression type
+ * @in:		Compressed data
+ * @in_size:	Size of the compressed data
+ * @piece:	Size of each piece
+ * @out:	Where to put the output
+ * @out_max:	Space available at @out
+ * @out_size:	Returns the number of bytes decompressed
+ * @return 0 if OK, -ve on error
+ */
+static int stream_decomp(int comp_type, void *in, ulong in_size, ulong piece,
+			 void *out, ulong out_max, ulong *out_size)
+{
+	struct decomp_stream *ds;
+	ulong done, size;
+	int ret;
+
+	ret = decomp_stream_init(&ds, comp_type, out, out_max);
+	if (ret)
+		return ret;
+	for (done = 0; done < in_size; done += size) {
+		size = min(piece, in_size - done);
+		if (decomp_stream_feed(ds, in + done, size))
+			break;
+	}
+
+	return decomp_stream_finish(ds, out_size);
+}
+
+/**
+ * run_stream_test() - Run tests on the streaming decompressor
+ *
+ * @comp_type:	Compression type to test
+ * @compress:	Our function to compress data
+ * @return 0 if OK, non-zero on failure
+ */
+static int run_stream_test(int comp_type, mutate_func compress)
+{
+	static const ulong pieces[] = { 1, 7, 100, TEST_BUFFER_SIZE };
+	ulong compressed_size = TEST_BUFFER_SIZE;
+	ulong orig_size = strlen(plain);
+	ulong out_size;
+	char *compressed_buf, *out_buf;
+	int i, ret;
+
+	printf(" testing stream %s ...\n", genimg_get_comp_name(comp_type));
+	compressed_buf = malloc(TEST_BUFFER_SIZE);
+	out_buf = malloc(TEST_BUFFER_SIZE);
+	errcheck(compressed_buf != NULL && out_buf != NULL);
+	errcheck(compress((void *)plain, orig_size, compressed_buf,
+			  compressed_size, &compressed_size) == 0);
+
+	/* Any split of the input gives the same output */
+	for (i = 0; i < ARRAY_SIZE(pieces); i++) {
+		memset(out_buf, 'A', TEST_BUFFER_SIZE);
+		errcheck(stream_decomp(comp_type, compressed_buf,
+				       compressed_size, pieces[i], out_buf,
+				       TEST_BUFFER_SIZE, &out_size) == 0);
+		errcheck(out_size == orig_size);
+		errcheck(memcmp(plain, out_buf, orig_size) == 0);
+		errcheck(out_buf[orig_size] == 'A');
+	}
+
+	/* Exactly the right size output buffer */
+	errcheck(stream_decomp(comp_type, compressed_buf, compressed_size, 7,
+			       out_buf, orig_size, &out_size) == 0);
+	errcheck(out_size == orig_size);
+
+	/* Too small an output buffer, without over-running it */
+	memset(out_buf, 'A', TEST_BUFFER_SIZE);
+	errcheck(stream_decomp(comp_type, compressed_buf, compressed_size, 7,
+			       out_buf, orig_size - 1, &out_size) != 0);
+	errcheck(out_buf[orig_size - 1] == 'A');
+
+	/* Truncated input */
+	errcheck(stream_decomp(comp_type, compressed_buf,
+			       compressed_size / 2, 7, out_buf,
+			       TEST_BUFFER_SIZE, &out_size) != 0);
+
+	/* Corrupt input */
+	memset(compressed_buf + compressed_size / 2, '\x49',
+	       compressed_size - compressed_size / 2);
+	errcheck(stream_decomp(comp_type, compressed_buf, compressed_size, 7,
+			       out_buf, TEST_BUFFER_SIZE, &out_size) != 0);
+
+	ret = 0;
+out:
+	printf(" stream %s: %s\n", genimg_get_comp_name(comp_type),
+	       ret == 0 ? "ok" : "FAILED");
+	free(out_buf);
+	free(compressed_buf);
+
+	return ret;
+}
+
+static int do_ut_decomp_stream(cmd_tbl_t *cmdtp, int flag, int argc,
+			       char *const argv[])
+{
+	int err = 0;
+
+	err |= run_stream_test(IH_COMP_GZIP, compress_using_gzip);
+	err |= run_stream_test(IH_COMP_LZMA, compress_using_lzma);
+	err |= run_stream_test(IH_COMP_LZO, compress_using_lzo);
+	err |= run_stream_test(IH_COMP_LZ4, compress_using_lz4);
+	err |= run_stream_test(IH_COMP_ZSTD, compress_using_zstd);
+
+	printf("ut_decomp_stream %s\n", err == 0 ? "ok" : "FAILED");
+
+	return err;
+}
+#endif
+
+#ifdef CONFIG_LZ4_PARALLEL
+#define LZ4_TEST_BLOCK		(64 << 10)
+#define LZ4_TEST_BLOCKS		4
+
+/**
+ * make_lz4_frame() - Make an LZ4 frame with several blocks
+ *
+ * All blocks are stored 64KiB blocks, except for the one compressed block
+ * from lz4_compressed.
+ *
+ * @frame:	Where to put the frame
+ * @expect:	Where to put the data it decompresses to
+ * @pos:	Which block is the compressed one
+ * @expect_size: Returns the size of the decompressed data
+ * @return size of the frame
+ */
+static ulong make_lz4_frame(char *frame, char *expect, int pos,
+			    ulong *expect_size)
+{
+	/* Skip the 7-byte frame header, and the end mark and checksum */
+	const ulong lz4_block_size = lz4_compressed_size - 7 - 8;
+	char *in = frame, *out = expect;
+	int i;
+
+	/* Independent 64KiB blocks, without the header checksum */
+	memcpy(in, "\x04\x22\x4d\x18\x60\x40\x00", 7);
+	in += 7;
+	for (i = 0; i < LZ4_TEST_BLOCKS; i++) {
+		if (i == pos) {
+			memcpy(in, lz4_compressed + 7, lz4_block_size);
+			in += lz4_block_size;
+			memcpy(out, plain, strlen(plain));
+			out += strlen(plain);
+			continue;
+		}
+		put_unaligned_le32(0x80000000 | LZ4_TEST_BLOCK, in);
+		in += 4;
+		memset(in, 'a' + i, LZ4_TEST_BLOCK);
+		memset(out, 'a' + i, LZ4_TEST_BLOCK);
+		in += LZ4_TEST_BLOCK;
+		out += LZ4_TEST_BLOCK;
+	}
+	put_unaligned_le32(0, in);
+	in += 4;
+	*expect_size = out - expect;
+
+	return in - frame;
+}
+
+/**
+ * run_lz4_parallel_test() - Test decoding LZ4 blocks out of order
+ *
+ * @pos:	Which block of the frame is the short, compressed one
+ * @return 0 if OK, non-zero on failure
+ */
+static int run_lz4_parallel_test(int pos)
+{
+	const ulong size = (LZ4_TEST_BLOCKS + 1) * LZ4_TEST_BLOCK;
+	ulong frame_size, expect_size;
+	char *frame, *expect, *out;
+	struct ulz4_index idx;
+	size_t out_size;
+	int i, ret;
+
+	printf(" testing lz4 with compressed block %d ...\n", pos);
+	memset(&idx, '\0', sizeof(idx));
+	frame = malloc(size);
+	expect = malloc(size);
+	out = malloc(size);
+	errcheck(frame != NULL && expect != NULL && out != NULL);
+	frame_size = make_lz4_frame(frame, expect, pos, &expect_size);
+
+	/* Decode the blocks backwards, one at a time */
+	errcheck(ulz4_index_frame(frame, frame_size, &idx) == 0);
+	errcheck(idx.count == LZ4_TEST_BLOCKS);
+	memset(out, 'A', size);
+	for (i = idx.count - 1; i >= 0; i--)
+		ulz4_decode_blocks(&idx, out, size, i, idx.count);
+	ret = ulz4_index_finish(&idx, &out_size);
+	if (pos == LZ4_TEST_BLOCKS - 1) {
+		errcheck(ret == 0);
+		errcheck(out_size == expect_size);
+		errcheck(memcmp(expect, out, expect_size) == 0);
+		errcheck(out[expect_size] == 'A');
+	} else {
+		/* A short block other than the last leaves a gap */
+		errcheck(ret == -EAGAIN);
+	}
+
+	/* ulz4fn() gets it right either way */
+	out_size = size;
+	errcheck(ulz4fn(frame, frame_size, out, &out_size) == 0);
+	errcheck(out_size == expect_size);
+	errcheck(memcmp(expect, out, expect_size) == 0);
+
+	/* Too small an output buffer */
+	out_size = expect_size - 1;
+	errcheck(ulz4fn(frame, frame_size, out, &out_size) != 0);
+
+	ret = 0;
+out:
+	printf(" lz4 with compressed block %d: %s\n", pos,
+	       ret == 0 ? "ok" : "FAILED");
+	ulz4_index_free(&idx);
+	free(out);
+	free(expect);
+	free(frame);
+
+	return ret;
+}
+
+/**
+ * run_lz4_bootm_test() - Check that bootm decodes an LZ4 frame in parallel
+ *
+ * @return 0 if OK, non-zero on failure
+ */
+static int run_lz4_bootm_test(void)
+{
+	const ulong size = (LZ4_TEST_BLOCKS + 1) * LZ4_TEST_BLOCK;
+	const ulong image_start = 0;
+	const ulong load_addr = 0x100000;
+	struct sandbox_state *state = state_get_current();
+	ulong frame_size, expect_size, load_end;
+	char *expect, *out;
+	int runs, ret;
+
+	printf(" testing lz4 through bootm ...\n");
+	expect = malloc(size);
+	errcheck(expect != NULL);
+	out = map_sysmem(load_addr, size);
+	frame_size = make_lz4_frame(map_sysmem(image_start, size), expect,
+				    LZ4_TEST_BLOCKS - 1, &expect_size);
+
+	runs = state->lz4_worker_runs;
+	errcheck(bootm_decomp_image(IH_COMP_LZ4, load_addr, image_start,
+				    IH_TYPE_KERNEL, out,
+				    map_sysmem(image_start, 0), frame_size,
+				    size, &load_end) == 0);
+	errcheck(state->lz4_worker_runs == runs + 1);
+	errcheck(load_end == load_addr + expect_size);
+	errcheck(memcmp(expect, out, expect_size) == 0);
+
+	/* Too small an output buffer */
+	errcheck(bootm_decomp_image(IH_COMP_LZ4, load_addr, image_start,
+				    IH_TYPE_KERNEL, out,
+				    map_sysmem(image_start, 0), frame_size,
+				    expect_size - 1, &load_end) != 0);
+
+	ret = 0;
+out:
+	printf(" lz4 through bootm: %s\n", ret == 0 ? "ok" : "FAILED");
+	free(expect);
+
+	return ret;
+}
+
+static int do_ut_lz4_parallel(cmd_tbl_t *cmdtp, int flag, int argc,
+			      char *const argv[])
+{
+	int err = 0;
+
+	err |= run_lz4_parallel_test(LZ4_TEST_BLOCKS - 1);
+	err |= run_lz4_parallel_test(0);
+	err |= run_lz4_bootm_test();
+
+	printf("ut_lz4_parallel %s\n", err == 0 ? "ok" : "FAILED");
+
+	return err;
+}
+#endif
+
 U_BOOT_CMD(
-	ut_compression,	5,	1,	do_ut_compression,
-	"Basic test of compressors: gzip bzip2 lzma lzo", ""
+	ut_compression,	CONFIG_SYS_MAXARGS,	1,	do_ut_compression,
+	"Basic test of compressors: gzip bzip2 lzma lzo lz4 zstd",
+	"\n"
+	"ut_compression bench <file>... - measure each codec on host files"
 );
 
 U_BOOT_CMD(
 	ut_image_decomp,	5,	1, do_ut_image_decomp,
 	"Basic test of bootm decompression", ""
 );
+
+#ifdef CONFIG_DECOMP_STREAM
+U_BOOT_CMD(
+	ut_decomp_stream,	5,	1, do_ut_decomp_stream,
+	"Basic test of streaming decompression", ""
+);
+#endif
+
+#ifdef CONFIG_LZ4_PARALLEL
+U_BOOT_CMD(
+	ut_lz4_parallel,	5,	1, do_ut_lz4_parallel,
+	"Basic test of decoding LZ4 blocks out of order", ""
+);
+#endif
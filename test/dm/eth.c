@@ -11,6 +11,7 @@
 #include <dm.h>
 #include <fdtdec.h>
 #include <malloc.h>
+#include <mapmem.h>
 #include <net.h>
 #include <dm/test.h>
 #include <dm/device-internal.h>
@@ -86,6 +87,51 @@ static int dm_test_eth_prime(struct unit_test_state *uts)
 }
 DM_TEST(dm_test_eth_prime, DM_TESTF_SCAN_FDT);
 
+static int dm_test_eth_rx_stats(struct unit_test_state *uts)
+{
+	const struct eth_rx_stats *stats;
+	struct udevice *dev;
+
+	net_ping_ip = string_to_ip("1.1.2.2");
+
+	setenv("ethact", "eth@10002000");
+	ut_assertok(net_loop(PING));
+	ut_assertok(uclass_get_device_by_name(UCLASS_ETH, "eth@10002000",
+					      &dev));
+	stats = eth_get_rx_stats(dev);
+	ut_assertnonnull(stats);
+
+	/*
+	 * Handling the ARP reply sends the ping, whose reply is then picked
+	 * up within the same poll
+	 */
+	ut_asserteq(2, stats->packets);
+	ut_asserteq(1, stats->bursts);
+	ut_asserteq(2, stats->batch_max);
+	ut_asserteq(0, stats->batch_full);
+	ut_assert(stats->polls >= stats->bursts);
+
+	return 0;
+}
+DM_TEST(dm_test_eth_rx_stats, DM_TESTF_SCAN_FDT);
+
+#ifdef CONFIG_CMD_WGET
+/* The fake host answers TCP as a one-shot HTTP server */
+static int dm_test_eth_wget(struct unit_test_state *uts)
+{
+	net_server_ip = string_to_ip("1.1.2.2");
+	copy_filename(net_boot_file_name, "/hello",
+		      sizeof(net_boot_file_name));
+
+	setenv("ethact", "eth@10002000");
+	ut_asserteq(11, net_loop(WGET));
+	ut_assertok(memcmp(map_sysmem(load_addr, 11), "hello world", 11));
+
+	return 0;
+}
+DM_TEST(dm_test_eth_wget, DM_TESTF_SCAN_FDT);
+#endif
+
 /**
  * This test case is trying to test the following scenario:
  *	- All ethernet devices are not probed
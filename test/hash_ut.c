@@ -0,0 +1,331 @@
+/*
+ * Tests for the SHA-1, SHA-256 and CRC32 implementations
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <command.h>
+#include <div64.h>
+#include <errno.h>
+#include <hash.h>
+#include <malloc.h>
+#include <u-boot/crc.h>
+#include <u-boot/sha1.h>
+#include <u-boot/sha256.h>
+
+/* Enough blocks for the unrolled loops, plus room to misalign the data */
+#define TEST_BLOCKS	67
+#define TEST_SIZE	(TEST_BLOCKS * 64 + 8)
+
+static const char str_abc[] = "abc";
+static const char str_448[] =
+	"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+static const char str_check[] = "123456789";
+
+/* Digests from FIPS 180-2 and the usual CRC32 check value */
+static const struct {
+	const char *algo;
+	const char *input;
+	uint8_t digest[HASH_MAX_DIGEST_SIZE];
+} known_answers[] = {
+	{ "sha1", str_abc,
+	  { 0xa9, 0x99, 0x3e, 0x36, 0x47, 0x06, 0x81, 0x6a, 0xba, 0x3e,
+	    0x25, 0x71, 0x78, 0x50, 0xc2, 0x6c, 0x9c, 0xd0, 0xd8, 0x9d } },
+	{ "sha1", str_448,
+	  { 0x84, 0x98, 0x3e, 0x44, 0x1c, 0x3b, 0xd2, 0x6e, 0xba, 0xae,
+	    0x4a, 0xa1, 0xf9, 0x51, 0x29, 0xe5, 0xe5, 0x46, 0x70, 0xf1 } },
+	{ "sha256", str_abc,
+	  { 0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea,
+	    0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+	    0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c,
+	    0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad } },
+	{ "sha256", str_448,
+	  { 0x24, 0x8d, 0x6a, 0x61, 0xd2, 0x06, 0x38, 0xb8,
+	    0xe5, 0xc0, 0x26, 0x93, 0x0c, 0x3e, 0x60, 0x39,
+	    0xa3, 0x3c, 0xe4, 0x59, 0x64, 0xff, 0x21, 0x67,
+	    0xf6, 0xec, 0xed, 0xd4, 0x19, 0xdb, 0x06, 0xc1 } },
+	{ "crc32", str_check, { 0xcb, 0xf4, 0x39, 0x26 } },
+};
+
+static const char *const algo_names[] = { "sha1", "sha256", "crc32" };
+
+static void fill_buf(uint8_t *buf, int size)
+{
+	uint32_t seed = 0x12345678;
+	int i;
+
+	for (i = 0; i < size; i++) {
+		seed = seed * 1103515245 + 12345;
+		buf[i] = seed >> 16;
+	}
+}
+
+/* Check the algorithms the hash command uses against known digests */
+static int test_known_answers(void)
+{
+	uint8_t digest[HASH_MAX_DIGEST_SIZE];
+	struct hash_algo *algo;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(known_answers); i++) {
+		if (hash_lookup_algo(known_answers[i].algo, &algo))
+			continue;
+		algo->hash_func_ws((const uint8_t *)known_answers[i].input,
+				   strlen(known_answers[i].input), digest,
+				   algo->chunk_size);
+		if (memcmp(digest, known_answers[i].digest,
+			   algo->digest_size)) {
+			printf("%s: %s of \"%s\" is wrong\n", __func__,
+			       algo->name, known_answers[i].input);
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+/* Hashing in uneven pieces must give the same digest as in one go */
+static int test_progressive(const uint8_t *buf)
+{
+	static const unsigned int pieces[] = { 1, 63, 65, 200, 64, 3, 2048 };
+	uint8_t digest[HASH_MAX_DIGEST_SIZE], expect[HASH_MAX_DIGEST_SIZE];
+	struct hash_algo *algo;
+	unsigned int done, size;
+	void *ctx;
+	int i, j;
+
+	for (i = 0; i < ARRAY_SIZE(algo_names); i++) {
+		if (hash_progressive_lookup_algo(algo_names[i], &algo))
+			continue;
+		algo->hash_func_ws(buf, TEST_SIZE, expect, algo->chunk_size);
+
+		if (algo->hash_init(algo, &ctx))
+			return -ENOMEM;
+		for (done = 0, j = 0; done < TEST_SIZE; done += size, j++) {
+			size = j < ARRAY_SIZE(pieces) ? pieces[j] : 64;
+			if (size > TEST_SIZE - done)
+				size = TEST_SIZE - done;
+			if (algo->hash_update(algo, ctx, buf + done, size,
+					      done + size == TEST_SIZE))
+				return -EIO;
+		}
+		if (algo->hash_finish(algo, ctx, digest, algo->digest_size))
+			return -EIO;
+
+		if (memcmp(digest, expect, algo->digest_size)) {
+			printf("%s: %s differs when hashed in pieces\n",
+			       __func__, algo->name);
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+/* CRC32 one bit at a time, straight from the definition */
+static uint32_t crc32_bitwise(uint32_t crc, const uint8_t *buf, int len)
+{
+	int i;
+
+	while (len--) {
+		crc ^= *buf++;
+		for (i = 0; i < 8; i++)
+			crc = crc & 1 ? (crc >> 1) ^ 0xedb88320 : crc >> 1;
+	}
+
+	return crc;
+}
+
+/* Check the table-driven code, which may work on eight bytes at a time */
+static int test_crc32_generic(const uint8_t *buf)
+{
+	uint32_t expect, crc;
+	int offset, len;
+
+	for (offset = 0; offset < 8; offset++) {
+		for (len = 0; len <= 100; len++) {
+			expect = crc32_bitwise(~0, buf + offset, len);
+			crc = crc32_no_comp_generic(~0, buf + offset, len);
+			if (crc != expect) {
+				printf("%s: %d bytes at offset %d differ\n",
+				       __func__, len, offset);
+				return -EINVAL;
+			}
+		}
+	}
+
+	return 0;
+}
+
+#ifdef CONFIG_SHA1_ARCH
+/* The CPU instructions must give the same results as the C code */
+static int test_sha1_arch(const uint8_t *buf)
+{
+	static const unsigned int blocks[] = { 1, 2, 3, TEST_BLOCKS };
+	sha1_context arch, generic;
+	int i, offset;
+
+	if (sha1_process_arch(&arch, buf, 0)) {
+		printf("%s: no SHA-1 instructions, skipped\n", __func__);
+		return 0;
+	}
+
+	for (offset = 0; offset < 8; offset++) {
+		for (i = 0; i < ARRAY_SIZE(blocks); i++) {
+			sha1_starts(&arch);
+			sha1_starts(&generic);
+			sha1_process_arch(&arch, buf + offset, blocks[i]);
+			sha1_process_generic(&generic, buf + offset,
+					     blocks[i]);
+			if (memcmp(arch.state, generic.state,
+				   sizeof(arch.state))) {
+				printf("%s: %u blocks at offset %d differ\n",
+				       __func__, blocks[i], offset);
+				return -EINVAL;
+			}
+		}
+	}
+
+	return 0;
+}
+#endif
+
+#ifdef CONFIG_SHA256_ARCH
+static int test_sha256_arch(const uint8_t *buf)
+{
+	static const unsigned int blocks[] = { 1, 2, 3, TEST_BLOCKS };
+	sha256_context arch, generic;
+	int i, offset;
+
+	if (sha256_process_arch(&arch, buf, 0)) {
+		printf("%s: no SHA-256 instructions, skipped\n", __func__);
+		return 0;
+	}
+
+	for (offset = 0; offset < 8; offset++) {
+		for (i = 0; i < ARRAY_SIZE(blocks); i++) {
+			sha256_starts(&arch);
+			sha256_starts(&generic);
+			sha256_process_arch(&arch, buf + offset, blocks[i]);
+			sha256_process_generic(&generic, buf + offset,
+					       blocks[i]);
+			if (memcmp(arch.state, generic.state,
+				   sizeof(arch.state))) {
+				printf("%s: %u blocks at offset %d differ\n",
+				       __func__, blocks[i], offset);
+				return -EINVAL;
+			}
+		}
+	}
+
+	return 0;
+}
+#endif
+
+#ifdef CONFIG_CRC32_ARCH
+static int test_crc32_arch(const uint8_t *buf)
+{
+	uint32_t arch, generic;
+	int offset, len;
+
+	arch = 0;
+	if (crc32_no_comp_arch(&arch, buf, 0)) {
+		printf("%s: no CRC32 instructions, skipped\n", __func__);
+		return 0;
+	}
+
+	/* Every alignment and every length around the unrolled loops */
+	for (offset = 0; offset < 8; offset++) {
+		for (len = 0; len <= 300; len++) {
+			arch = ~0;
+			crc32_no_comp_arch(&arch, buf + offset, len);
+			generic = crc32_no_comp_generic(~0, buf + offset, len);
+			if (arch != generic) {
+				printf("%s: %d bytes at offset %d differ\n",
+				       __func__, len, offset);
+				return -EINVAL;
+			}
+		}
+		arch = 0;
+		len = TEST_SIZE - offset;
+		crc32_no_comp_arch(&arch, buf + offset, len);
+		generic = crc32_no_comp_generic(0, buf + offset, len);
+		if (arch != generic) {
+			printf("%s: %d bytes at offset %d differ\n",
+			       __func__, len, offset);
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+#endif
+
+#define BENCH_SIZE	(1 << 20)
+#define BENCH_LOOPS	16
+
+static void show_rate(const char *name, ulong ms)
+{
+	u64 rate = (u64)BENCH_SIZE * BENCH_LOOPS * 1000;
+
+	do_div(rate, ms ? ms : 1);
+	printf("bench_crc32: %s %lu MiB/s\n", name, (ulong)(rate >> 20));
+}
+
+/* Show how fast CRC32 is, since it runs over whole images at boot */
+static int bench_crc32(void)
+{
+	uint32_t crc = 0;
+	uint8_t *buf;
+	ulong start;
+	int i;
+
+	buf = calloc(1, BENCH_SIZE);
+	if (!buf)
+		return -ENOMEM;
+
+	start = get_timer(0);
+	for (i = 0; i < BENCH_LOOPS; i++)
+		crc = crc32_no_comp_generic(crc, buf, BENCH_SIZE);
+	show_rate("crc32_no_comp_generic()", get_timer(start));
+
+	start = get_timer(0);
+	for (i = 0; i < BENCH_LOOPS; i++)
+		crc = crc32_no_comp(crc, buf, BENCH_SIZE);
+	show_rate("crc32_no_comp()", get_timer(start));
+
+	free(buf);
+
+	return 0;
+}
+
+int do_ut_hash(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
+{
+	uint8_t *buf;
+	int ret = 0;
+
+	buf = malloc(TEST_SIZE);
+	if (!buf)
+		return CMD_RET_FAILURE;
+	fill_buf(buf, TEST_SIZE);
+
+	ret |= test_known_answers();
+	ret |= test_progressive(buf);
+	ret |= test_crc32_generic(buf);
+#ifdef CONFIG_SHA1_ARCH
+	ret |= test_sha1_arch(buf);
+#endif
+#ifdef CONFIG_SHA256_ARCH
+	ret |= test_sha256_arch(buf);
+#endif
+#ifdef CONFIG_CRC32_ARCH
+	ret |= test_crc32_arch(buf);
+#endif
+	free(buf);
+	ret |= bench_crc32();
+
+	printf("Test %s\n", ret ? "failed" : "passed");
+
+	return ret ? CMD_RET_FAILURE : CMD_RET_SUCCESS;
+}